@@ -0,0 +1,1139 @@
+"""
+Generates the benchmark suite in code/bench/input.
+
+Each kernel is written with a small assembler for RV32IM (plus ecall).
+Every program leaves a checksum in a1 (x11), prints it
+with ecall 1 (visible under -m) and exits with ecall 10. A python model of
+each kernel gives the expected checksum, recorded in manifest.csv.
+
+Instructions are packed densely, the way a compiler would lay them out:
+the pipeline pairs them itself, holds back a second instruction that
+cannot issue with the first and stalls a consumer right behind a load.
+
+With --rvc (or rvc=1 in a spec) every instruction that has a 16-bit form of
+the C extension is compressed. Branches and jumps stay 32-bit so their
+offsets are known when they are emitted. Compressed instructions are
+written as 4-digit lines.
+
+usage: python3 bench_gen.py [--rvc] [--out DIR] [name[:key=value,...] ...]
+"""
+import argparse
+import os
+import sys
+
+BASE_PC = 0x1000
+DATA = 0x10000          # first data array, well above the code
+MASK = 0xFFFFFFFF
+LCG_A = 1103515245
+LCG_C = 12345
+
+# register names used by the kernels
+zero, ra, sp = 0, 1, 2
+t0, t1, t2 = 5, 6, 7
+s0, s1 = 8, 9
+a0, a1, a2, a3, a4, a5, a6, a7 = 10, 11, 12, 13, 14, 15, 16, 17
+s2, s3, s4, s5, s6, s7, s8, s9, s10, s11 = 18, 19, 20, 21, 22, 23, 24, 25, 26, 27
+t3, t4, t5, t6 = 28, 29, 30, 31
+
+
+def u32(value):
+    return value & MASK
+
+
+def s32(value):
+    value &= MASK
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def lcg(x):
+    return u32(x * LCG_A + LCG_C)
+
+
+###############################################################################
+# Assembler
+###############################################################################
+
+class Asm:
+    def __init__(self, rvc=False):
+        self.rvc = rvc
+        self.words = []        # ints, or (encoder, label) fixups
+        self.sizes = []        # bytes of each entry of words, 2 when compressed
+        self.labels = {}
+        self.label_count = 0
+        self.size = 0
+
+    def pc(self):
+        return BASE_PC + self.size
+
+    def new_label(self, stem):
+        self.label_count += 1
+        return "%s_%d" % (stem, self.label_count)
+
+    def label(self, name):
+        if name in self.labels:
+            raise ValueError("duplicate label " + name)
+        self.labels[name] = self.pc()
+
+    def _place(self, word):
+        size = 4
+        if self.rvc and not isinstance(word, tuple):
+            parcel = compress(word)
+            if parcel is not None:
+                word, size = parcel, 2
+        self.words.append(word)
+        self.sizes.append(size)
+        self.size += size
+
+    def emit(self, word):
+        self._place(word)
+
+    def assemble(self):
+        """[(encoding, size in bytes)]"""
+        out = []
+        pc = BASE_PC
+        for word, size in zip(self.words, self.sizes):
+            if isinstance(word, tuple):
+                encoder, label = word
+                if label not in self.labels:
+                    raise ValueError("undefined label " + label)
+                word = encoder(self.labels[label] - pc)
+            out.append((word & MASK, size))
+            pc += size
+        return out
+
+    # encodings
+    @staticmethod
+    def r_type(funct7, rs2, rs1, funct3, rd, opcode):
+        return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode
+
+    @staticmethod
+    def i_type(imm, rs1, funct3, rd, opcode):
+        if not -2048 <= imm < 2048:
+            raise ValueError("immediate out of range: %d" % imm)
+        return ((imm & 0xFFF) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode
+
+    @staticmethod
+    def s_type(imm, rs2, rs1, funct3):
+        if not -2048 <= imm < 2048:
+            raise ValueError("offset out of range: %d" % imm)
+        imm &= 0xFFF
+        return ((imm >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((imm & 0x1F) << 7) | 0x23
+
+    @staticmethod
+    def b_type(offset, rs2, rs1, funct3):
+        if not -4096 <= offset < 4096:
+            raise ValueError("branch out of range: %d" % offset)
+        imm = offset & 0x1FFF
+        return (((imm >> 12) & 1) << 31) | (((imm >> 5) & 0x3F) << 25) | (rs2 << 20) | (rs1 << 15) | \
+               (funct3 << 12) | (((imm >> 1) & 0xF) << 8) | (((imm >> 11) & 1) << 7) | 0x63
+
+    @staticmethod
+    def u_type(imm20, rd, opcode):
+        return ((imm20 & 0xFFFFF) << 12) | (rd << 7) | opcode
+
+    @staticmethod
+    def j_type(offset, rd):
+        imm = offset & 0x1FFFFF
+        return (((imm >> 20) & 1) << 31) | (((imm >> 1) & 0x3FF) << 21) | (((imm >> 11) & 1) << 20) | \
+               (((imm >> 12) & 0xFF) << 12) | (rd << 7) | 0x6F
+
+    # R-type
+    def _r(self, funct7, funct3, rd, rs1, rs2):
+        self.emit(self.r_type(funct7, rs2, rs1, funct3, rd, 0x33))
+
+    def add(self, rd, rs1, rs2): self._r(0x00, 0x0, rd, rs1, rs2)
+    def sub(self, rd, rs1, rs2): self._r(0x20, 0x0, rd, rs1, rs2)
+    def sll(self, rd, rs1, rs2): self._r(0x00, 0x1, rd, rs1, rs2)
+    def slt(self, rd, rs1, rs2): self._r(0x00, 0x2, rd, rs1, rs2)
+    def xor(self, rd, rs1, rs2): self._r(0x00, 0x4, rd, rs1, rs2)
+    def srl(self, rd, rs1, rs2): self._r(0x00, 0x5, rd, rs1, rs2)
+    def sra(self, rd, rs1, rs2): self._r(0x20, 0x5, rd, rs1, rs2)
+    def or_(self, rd, rs1, rs2): self._r(0x00, 0x6, rd, rs1, rs2)
+    def and_(self, rd, rs1, rs2): self._r(0x00, 0x7, rd, rs1, rs2)
+    def mul(self, rd, rs1, rs2): self._r(0x01, 0x0, rd, rs1, rs2)
+    def mulh(self, rd, rs1, rs2): self._r(0x01, 0x1, rd, rs1, rs2)
+    def sltu(self, rd, rs1, rs2): self._r(0x00, 0x3, rd, rs1, rs2)
+    def mulhsu(self, rd, rs1, rs2): self._r(0x01, 0x2, rd, rs1, rs2)
+    def mulhu(self, rd, rs1, rs2): self._r(0x01, 0x3, rd, rs1, rs2)
+    def div(self, rd, rs1, rs2): self._r(0x01, 0x4, rd, rs1, rs2)
+    def divu(self, rd, rs1, rs2): self._r(0x01, 0x5, rd, rs1, rs2)
+    def rem(self, rd, rs1, rs2): self._r(0x01, 0x6, rd, rs1, rs2)
+    def remu(self, rd, rs1, rs2): self._r(0x01, 0x7, rd, rs1, rs2)
+
+    # I-type
+    def _i(self, funct3, rd, rs1, imm):
+        self.emit(self.i_type(imm, rs1, funct3, rd, 0x13))
+
+    def addi(self, rd, rs1, imm): self._i(0x0, rd, rs1, imm)
+    def slti(self, rd, rs1, imm): self._i(0x2, rd, rs1, imm)
+    def sltiu(self, rd, rs1, imm): self._i(0x3, rd, rs1, imm)
+    def xori(self, rd, rs1, imm): self._i(0x4, rd, rs1, imm)
+    def ori(self, rd, rs1, imm): self._i(0x6, rd, rs1, imm)
+    def andi(self, rd, rs1, imm): self._i(0x7, rd, rs1, imm)
+    def slli(self, rd, rs1, shamt): self._i(0x1, rd, rs1, shamt)
+    def srli(self, rd, rs1, shamt): self._i(0x5, rd, rs1, shamt)
+    def srai(self, rd, rs1, shamt): self._i(0x5, rd, rs1, 0x400 | shamt)
+
+    # memory
+    def _load(self, funct3, rd, offset, rs1):
+        self.emit(self.i_type(offset, rs1, funct3, rd, 0x03))
+
+    def lb(self, rd, offset, rs1): self._load(0x0, rd, offset, rs1)
+    def lh(self, rd, offset, rs1): self._load(0x1, rd, offset, rs1)
+    def lw(self, rd, offset, rs1): self._load(0x2, rd, offset, rs1)
+    def lbu(self, rd, offset, rs1): self._load(0x4, rd, offset, rs1)
+    def lhu(self, rd, offset, rs1): self._load(0x5, rd, offset, rs1)
+
+    def _store(self, funct3, rs2, offset, rs1):
+        self.emit(self.s_type(offset, rs2, rs1, funct3))
+
+    def sb(self, rs2, offset, rs1): self._store(0x0, rs2, offset, rs1)
+    def sh(self, rs2, offset, rs1): self._store(0x1, rs2, offset, rs1)
+    def sw(self, rs2, offset, rs1): self._store(0x2, rs2, offset, rs1)
+
+    # control
+    def _branch(self, funct3, rs1, rs2, label):
+        self.emit((lambda off: self.b_type(off, rs2, rs1, funct3), label))
+
+    def beq(self, rs1, rs2, label): self._branch(0x0, rs1, rs2, label)
+    def bne(self, rs1, rs2, label): self._branch(0x1, rs1, rs2, label)
+    def blt(self, rs1, rs2, label): self._branch(0x4, rs1, rs2, label)
+    def bge(self, rs1, rs2, label): self._branch(0x5, rs1, rs2, label)
+    def bltu(self, rs1, rs2, label): self._branch(0x6, rs1, rs2, label)
+    def bgeu(self, rs1, rs2, label): self._branch(0x7, rs1, rs2, label)
+
+    def jal(self, rd, label):
+        self.emit((lambda off: self.j_type(off, rd), label))
+
+    def jalr(self, rd, offset, rs1):
+        self.emit(self.i_type(offset, rs1, 0x0, rd, 0x67))
+
+    def lui(self, rd, imm20):
+        self.emit(self.u_type(imm20, rd, 0x37))
+
+    def auipc(self, rd, imm20):
+        self.emit(self.u_type(imm20, rd, 0x17))
+
+    def ecall(self):
+        self.emit(0x00000073)
+
+    # pseudo instructions
+    def nop(self): self.addi(zero, zero, 0)
+    def mv(self, rd, rs): self.addi(rd, rs, 0)
+    def j(self, label): self.jal(zero, label)
+    def ret(self): self.jalr(zero, 0, ra)
+
+    def la(self, rd, label):
+        """rd = address of label, pc-relative through auipc + addi"""
+        start = self.pc()
+        self.emit((lambda off: self.u_type((off + 0x800) >> 12, rd, 0x17), label))
+        gap = self.pc() - start   # the addi's offset is taken from its own pc
+        self.emit((lambda off: self.i_type(s32(off + gap) - s32(((off + gap + 0x800) >> 12) << 12),
+                                           rd, 0x0, rd, 0x13), label))
+
+    def li(self, rd, value):
+        value = s32(value)
+        if -2048 <= value < 2048:
+            self.addi(rd, zero, value)
+            return
+        hi = ((value + 0x800) >> 12) & 0xFFFFF
+        lo = value - s32(hi << 12)
+        self.lui(rd, hi)
+        if lo != 0:
+            self.addi(rd, rd, lo)
+
+    # helpers shared by the kernels
+    def lcg_step(self, x, a_reg, c_reg):
+        """x = x * LCG_A + LCG_C, with the constants held in a_reg / c_reg"""
+        self.mul(x, x, a_reg)
+        self.add(x, x, c_reg)
+
+    def sum_words(self, base, count, ptr=t0, end=t1, value=t2):
+        """a1 += the `count` words starting at `base`"""
+        loop = self.new_label("sum")
+        self.li(ptr, base)
+        self.li(end, base + 4 * count)
+        self.label(loop)
+        self.lw(value, 0, ptr)
+        self.addi(ptr, ptr, 4)
+        self.add(a1, a1, value)
+        self.bne(ptr, end, loop)
+
+    def exit(self):
+        self.addi(a0, zero, 1)     # print a1 (emulator)
+        self.ecall()
+        self.addi(a0, zero, 10)    # exit
+        self.ecall()
+        for _ in range(8):         # keep the pipeline fed while the ecall drains
+            self.nop()
+
+
+def compress(word):
+    """16-bit C extension form of a 32-bit instruction, or None"""
+    opcode, rd, funct3 = word & 0x7F, (word >> 7) & 0x1F, (word >> 12) & 0x7
+    rs1, rs2, funct7 = (word >> 15) & 0x1F, (word >> 20) & 0x1F, word >> 25
+    imm = s32(word) >> 20
+
+    def bits(value, hi, lo):
+        return (value >> lo) & ((1 << (hi - lo + 1)) - 1)
+
+    def ci(funct3, rd, imm6, op):
+        return (funct3 << 13) | (bits(imm6, 5, 5) << 12) | (rd << 7) | (bits(imm6, 4, 0) << 2) | op
+
+    def small(reg):
+        return 8 <= reg < 16
+
+    def mem_offset(off):   # c.lw / c.sw offset fields
+        return (bits(off, 5, 3) << 10) | (bits(off, 2, 2) << 6) | (bits(off, 6, 6) << 5)
+
+    if opcode == 0x13 and funct3 == 0x0:
+        if rd == rs1 == 0 and imm == 0:
+            return 0x0001                                        # c.nop
+        if rd == rs1 != 0 and imm != 0 and -32 <= imm < 32:
+            return ci(0x0, rd, imm, 0x1)                         # c.addi
+        if rd != 0 and rs1 == 0 and -32 <= imm < 32:
+            return ci(0x2, rd, imm, 0x1)                         # c.li
+        if rd != 0 and rs1 != 0 and imm == 0:
+            return (0x4 << 13) | (rd << 7) | (rs1 << 2) | 0x2    # c.mv
+        if rd == rs1 == sp and imm != 0 and imm % 16 == 0 and -512 <= imm < 512:
+            return (0x3 << 13) | (bits(imm, 9, 9) << 12) | (sp << 7) | (bits(imm, 4, 4) << 6) | \
+                   (bits(imm, 6, 6) << 5) | (bits(imm, 8, 7) << 3) | (bits(imm, 5, 5) << 2) | 0x1  # c.addi16sp
+        if small(rd) and rs1 == sp and imm > 0 and imm % 4 == 0 and imm < 1024:
+            return (bits(imm, 5, 4) << 11) | (bits(imm, 9, 6) << 7) | (bits(imm, 2, 2) << 6) | \
+                   (bits(imm, 3, 3) << 5) | ((rd - 8) << 2)      # c.addi4spn
+    if opcode == 0x13 and funct3 == 0x1 and rd == rs1 != 0 and 0 < imm < 32:
+        return ci(0x0, rd, imm, 0x2)                             # c.slli
+    if opcode == 0x13 and funct3 == 0x5 and rd == rs1 and small(rd) and (imm & 0x1F) != 0:
+        kind = 0x1 if imm & 0x400 else 0x0                       # c.srai / c.srli
+        return (0x4 << 13) | (kind << 10) | ((rd - 8) << 7) | (bits(imm, 4, 0) << 2) | 0x1
+    if opcode == 0x13 and funct3 == 0x7 and rd == rs1 and small(rd) and -32 <= imm < 32:
+        return (0x4 << 13) | (bits(imm, 5, 5) << 12) | (0x2 << 10) | ((rd - 8) << 7) | \
+               (bits(imm, 4, 0) << 2) | 0x1                      # c.andi
+    if opcode == 0x33 and funct3 == 0x0 and funct7 == 0x00 and rd != 0 and rs2 != 0:
+        if rs1 == 0:
+            return (0x4 << 13) | (rd << 7) | (rs2 << 2) | 0x2    # c.mv
+        if rd == rs1:
+            return (0x4 << 13) | (1 << 12) | (rd << 7) | (rs2 << 2) | 0x2  # c.add
+    if opcode == 0x33 and rd == rs1 and small(rd) and small(rs2):
+        ops = {(0x20, 0x0): 0x0, (0x00, 0x4): 0x1, (0x00, 0x6): 0x2, (0x00, 0x7): 0x3}
+        if (funct7, funct3) in ops:                              # c.sub / c.xor / c.or / c.and
+            return (0x4 << 13) | (0x3 << 10) | ((rd - 8) << 7) | (ops[(funct7, funct3)] << 5) | \
+                   ((rs2 - 8) << 2) | 0x1
+    if opcode == 0x37 and rd not in (0, sp):
+        value = s32(word & 0xFFFFF000) >> 12
+        if value != 0 and -32 <= value < 32:
+            return ci(0x3, rd, value, 0x1)                       # c.lui
+    if opcode == 0x03 and funct3 == 0x2:
+        if rs1 == sp and rd != 0 and 0 <= imm < 256 and imm % 4 == 0:
+            return (0x2 << 13) | (bits(imm, 5, 5) << 12) | (rd << 7) | (bits(imm, 4, 2) << 4) | \
+                   (bits(imm, 7, 6) << 2) | 0x2                  # c.lwsp
+        if small(rd) and small(rs1) and 0 <= imm < 128 and imm % 4 == 0:
+            return (0x2 << 13) | mem_offset(imm) | ((rs1 - 8) << 7) | ((rd - 8) << 2)  # c.lw
+    if opcode == 0x23 and funct3 == 0x2:
+        off = s32(((word >> 25) << 5) | ((word >> 7) & 0x1F) | (0xFFFFF000 if word >> 31 else 0))
+        if rs1 == sp and 0 <= off < 256 and off % 4 == 0:
+            return (0x6 << 13) | (bits(off, 5, 2) << 9) | (bits(off, 7, 6) << 7) | (rs2 << 2) | 0x2  # c.swsp
+        if small(rs2) and small(rs1) and 0 <= off < 128 and off % 4 == 0:
+            return (0x6 << 13) | mem_offset(off) | ((rs1 - 8) << 7) | ((rs2 - 8) << 2)  # c.sw
+    if opcode == 0x67 and imm == 0 and rs1 != 0 and rd in (0, ra):
+        return (0x4 << 13) | ((1 if rd == ra else 0) << 12) | (rs1 << 7) | 0x2  # c.jr / c.jalr
+    return None
+
+
+###############################################################################
+# Kernels: each emits its program and returns the expected checksum
+###############################################################################
+
+def k_memcpy(asm, n=1024):
+    src, dst = DATA, DATA + 4 * n
+    asm.li(a1, 0)
+    # src[i] = 7 * i + 3
+    asm.li(t0, src)
+    asm.li(t1, src + 4 * n)
+    asm.li(t2, 3)
+    asm.label("init")
+    asm.sw(t2, 0, t0)
+    asm.addi(t2, t2, 7)
+    asm.addi(t0, t0, 4)
+    asm.bne(t0, t1, "init")
+    # copy, two words per iteration
+    asm.li(t0, src)
+    asm.li(t3, dst)
+    asm.label("copy")
+    asm.lw(t4, 0, t0)
+    asm.lw(t5, 4, t0)
+    asm.addi(t0, t0, 8)
+    asm.sw(t4, 0, t3)
+    asm.sw(t5, 4, t3)
+    asm.addi(t3, t3, 8)
+    asm.bne(t0, t1, "copy")
+    asm.sum_words(dst, n)
+    asm.exit()
+    return u32(sum(7 * i + 3 for i in range(n)))
+
+
+def k_memset(asm, n=1024, value=0x5A5A):
+    dst = DATA
+    asm.li(a1, 0)
+    asm.li(t3, dst)
+    asm.li(t4, dst + 4 * n)
+    asm.li(t5, value)
+    asm.label("set")
+    asm.sw(t5, 0, t3)
+    asm.sw(t5, 4, t3)
+    asm.sw(t5, 8, t3)
+    asm.sw(t5, 12, t3)
+    asm.addi(t3, t3, 16)
+    asm.bne(t3, t4, "set")
+    asm.sum_words(dst, n)
+    asm.exit()
+    return u32(value * n)
+
+
+def _matmul_init(asm, n, A, B):
+    # A[k] = k & 15, B[k] = (5 * k) & 15 over the flattened matrices
+    asm.li(t0, A)
+    asm.li(t1, B)
+    asm.li(t2, 0)
+    asm.li(t3, n * n)
+    asm.label("init")
+    asm.andi(t4, t2, 15)
+    asm.sw(t4, 0, t0)
+    asm.slli(t5, t2, 2)
+    asm.add(t5, t5, t2)
+    asm.andi(t5, t5, 15)
+    asm.sw(t5, 0, t1)
+    asm.addi(t0, t0, 4)
+    asm.addi(t1, t1, 4)
+    asm.addi(t2, t2, 1)
+    asm.bne(t2, t3, "init")
+
+
+def _matmul_model(n):
+    A = [k & 15 for k in range(n * n)]
+    B = [(5 * k) & 15 for k in range(n * n)]
+    total = 0
+    for i in range(n):
+        for j in range(n):
+            total += sum(A[i * n + k] * B[k * n + j] for k in range(n))
+    return u32(total)
+
+
+def k_matmul(asm, n=16, order="ijk", tile=4):
+    A, B, C = DATA, DATA + 4 * n * n, DATA + 8 * n * n
+    row = 4 * n
+    asm.li(a1, 0)
+    _matmul_init(asm, n, A, B)
+    asm.li(s7, row)
+    if order == "ijk":
+        # C[i][j] = sum_k A[i][k] * B[k][j], dot product in a register
+        asm.li(s0, A)                  # A row
+        asm.li(s2, C)                  # C element
+        asm.li(s6, A + 4 * n * n)      # A end
+        asm.label("i")
+        asm.li(s4, B)                  # B column
+        asm.addi(s5, s0, row)          # A row end
+        asm.label("j")
+        asm.mv(t0, s0)
+        asm.mv(t1, s4)
+        asm.li(t2, 0)
+        asm.label("k")
+        asm.lw(t3, 0, t0)
+        asm.lw(t4, 0, t1)
+        asm.addi(t0, t0, 4)
+        asm.add(t1, t1, s7)
+        asm.mul(t5, t3, t4)
+        asm.add(t2, t2, t5)
+        asm.bne(t0, s5, "k")
+        asm.sw(t2, 0, s2)
+        asm.addi(s2, s2, 4)
+        asm.addi(s4, s4, 4)
+        asm.li(t6, B + row)
+        asm.bne(s4, t6, "j")
+        asm.mv(s0, s5)
+        asm.bne(s0, s6, "i")
+    elif order == "ikj":
+        # C[i][:] += A[i][k] * B[k][:], streaming through rows
+        asm.li(s0, A)                  # A element
+        asm.li(s2, C)                  # C row
+        asm.li(s6, A + 4 * n * n)
+        asm.label("i")
+        asm.addi(s5, s0, row)          # A row end
+        asm.li(s4, B)                  # B row
+        asm.label("k")
+        asm.lw(s3, 0, s0)
+        asm.mv(t0, s4)
+        asm.mv(t1, s2)
+        asm.add(t6, s2, s7)            # C row end
+        asm.label("j")
+        asm.lw(t3, 0, t0)
+        asm.lw(t4, 0, t1)
+        asm.addi(t0, t0, 4)
+        asm.mul(t5, t3, s3)
+        asm.add(t4, t4, t5)
+        asm.sw(t4, 0, t1)
+        asm.addi(t1, t1, 4)
+        asm.bne(t1, t6, "j")
+        asm.addi(s0, s0, 4)
+        asm.add(s4, s4, s7)
+        asm.bne(s0, s5, "k")
+        asm.add(s2, s2, s7)
+        asm.bne(s0, s6, "i")
+    elif order == "tiled":
+        # ikj over tile x tile blocks of k and j
+        if n % tile:
+            raise ValueError("matmul: n must be a multiple of the tile")
+        asm.li(s8, 0)                  # kk * 4
+        asm.label("kk")
+        asm.li(s9, 0)                  # jj * 4
+        asm.label("jj")
+        asm.li(s0, A)                  # A row
+        asm.li(s2, C)                  # C row
+        asm.label("i")
+        asm.add(s10, s0, s8)           # &A[i][kk]
+        asm.addi(s5, s10, 4 * tile)    # &A[i][kk + tile]
+        asm.li(t6, B)                  # &B[kk][0]
+        asm.li(t2, 0)
+        asm.label("kb")                # t6 += kk * row
+        asm.beq(t2, s8, "kb_done")
+        asm.add(t6, t6, s7)
+        asm.addi(t2, t2, 4)
+        asm.j("kb")
+        asm.label("kb_done")
+        asm.add(s4, t6, s9)            # &B[kk][jj]
+        asm.label("k")
+        asm.lw(s3, 0, s10)
+        asm.mv(t0, s4)
+        asm.add(t1, s2, s9)            # &C[i][jj]
+        asm.addi(a2, t1, 4 * tile)
+        asm.label("j")
+        asm.lw(t3, 0, t0)
+        asm.lw(t4, 0, t1)
+        asm.addi(t0, t0, 4)
+        asm.mul(t5, t3, s3)
+        asm.add(t4, t4, t5)
+        asm.sw(t4, 0, t1)
+        asm.addi(t1, t1, 4)
+        asm.bne(t1, a2, "j")
+        asm.addi(s10, s10, 4)
+        asm.add(s4, s4, s7)
+        asm.bne(s10, s5, "k")
+        asm.add(s0, s0, s7)
+        asm.add(s2, s2, s7)
+        asm.li(t6, A + 4 * n * n)
+        asm.bne(s0, t6, "i")
+        asm.addi(s9, s9, 4 * tile)
+        asm.bne(s9, s7, "jj")
+        asm.addi(s8, s8, 4 * tile)
+        asm.bne(s8, s7, "kk")
+    else:
+        raise ValueError("matmul: unknown order " + order)
+    asm.sum_words(C, n * n)
+    asm.exit()
+    return _matmul_model(n)
+
+
+def _emit_lcg_fill(asm, base, n, seed, shift, mask):
+    """base[i] = (x >> shift) & mask for successive LCG states x"""
+    asm.li(a2, LCG_A)
+    asm.li(a3, LCG_C)
+    asm.li(a4, seed)
+    asm.li(t0, base)
+    asm.li(t1, base + 4 * n)
+    asm.label("fill")
+    asm.lcg_step(a4, a2, a3)
+    asm.srli(t2, a4, shift)
+    asm.li(t3, mask)
+    asm.and_(t2, t2, t3)
+    asm.sw(t2, 0, t0)
+    asm.addi(t0, t0, 4)
+    asm.bne(t0, t1, "fill")
+
+
+def _lcg_values(n, seed, shift, mask):
+    x, out = seed, []
+    for _ in range(n):
+        x = lcg(x)
+        out.append((x >> shift) & mask)
+    return out
+
+
+def k_sort(asm, n=256, seed=1):
+    base = DATA
+    asm.li(a1, 0)
+    _emit_lcg_fill(asm, base, n, seed, 16, 0x7FFF)
+    # insertion sort
+    asm.li(s0, base)
+    asm.addi(s1, s0, -4)                 # one before the first element
+    asm.addi(t0, s0, 4)                  # &a[i]
+    asm.li(t6, base + 4 * n)
+    asm.label("outer")
+    asm.lw(t2, 0, t0)                    # key
+    asm.addi(t1, t0, -4)                 # &a[j]
+    asm.label("inner")
+    asm.lw(t3, 0, t1)
+    asm.slt(t4, t2, t3)                  # key < a[j]
+    asm.beq(t4, zero, "place")
+    asm.sw(t3, 4, t1)
+    asm.addi(t1, t1, -4)
+    asm.bne(t1, s1, "inner")
+    asm.label("place")
+    asm.sw(t2, 4, t1)
+    asm.addi(t0, t0, 4)
+    asm.bne(t0, t6, "outer")
+    # order-sensitive checksum: a1 = a1 * 31 + a[i]
+    asm.li(t0, base)
+    asm.label("check")
+    asm.lw(t2, 0, t0)
+    asm.slli(t3, a1, 5)
+    asm.sub(a1, t3, a1)
+    asm.add(a1, a1, t2)
+    asm.addi(t0, t0, 4)
+    asm.bne(t0, t6, "check")
+    asm.exit()
+    total = 0
+    for v in sorted(_lcg_values(n, seed, 16, 0x7FFF)):
+        total = u32(total * 31 + v)
+    return total
+
+
+def k_list(asm, n=256, stride=97, node=64, laps=4):
+    """pointer chasing: node i links to node (i + stride) mod n"""
+    if node & (node - 1) or node < 8:
+        raise ValueError("list: node size must be a power of two >= 8")
+    shift = node.bit_length() - 1
+    base = DATA
+    asm.li(a1, 0)
+    asm.li(s0, base)
+    asm.li(s1, n)
+    asm.li(t0, 0)                        # i
+    asm.label("build")
+    asm.addi(t1, t0, stride % n)         # j = i + stride, wrapped
+    asm.slt(t2, t1, s1)
+    asm.bne(t2, zero, "nowrap")
+    asm.sub(t1, t1, s1)
+    asm.label("nowrap")
+    asm.slli(t1, t1, shift)
+    asm.add(t1, t1, s0)                  # &node[j]
+    asm.slli(t3, t0, shift)
+    asm.add(t3, t3, s0)                  # &node[i]
+    asm.sw(t1, 0, t3)
+    asm.sw(t0, 4, t3)
+    asm.addi(t0, t0, 1)
+    asm.bne(t0, s1, "build")
+    # chase
+    asm.mv(t0, s0)
+    asm.li(t4, n * laps)
+    asm.label("chase")
+    asm.lw(t5, 4, t0)
+    asm.lw(t0, 0, t0)
+    asm.addi(t4, t4, -1)
+    asm.add(a1, a1, t5)
+    asm.bne(t4, zero, "chase")
+    asm.exit()
+    total, i = 0, 0
+    for _ in range(n * laps):
+        total += i
+        i = (i + stride) % n
+    return u32(total)
+
+
+def k_loaduse(asm, n=1024):
+    """array sum where each load feeds the instruction right behind it, the
+    load-use stall that other threads fill under SMT (-X)"""
+    asm.li(a1, 0)
+    # a[i] = 3 * i + 1
+    asm.li(t0, DATA)
+    asm.li(t1, DATA + 4 * n)
+    asm.li(t2, 1)
+    asm.label("init")
+    asm.sw(t2, 0, t0)
+    asm.addi(t2, t2, 3)
+    asm.addi(t0, t0, 4)
+    asm.bne(t0, t1, "init")
+    asm.li(t0, DATA)
+    asm.label("sum")
+    asm.lw(t3, 0, t0)
+    asm.add(a1, a1, t3)
+    asm.lw(t4, 4, t0)
+    asm.add(a1, a1, t4)
+    asm.addi(t0, t0, 8)
+    asm.bne(t0, t1, "sum")
+    asm.exit()
+    return u32(sum(3 * i + 1 for i in range(n)))
+
+
+def k_bsearch(asm, n=1024, queries=256, seed=7):
+    base = DATA
+    mask = 1
+    while mask < 3 * n + 2:
+        mask <<= 1
+    mask -= 1
+    asm.li(a1, 0)
+    # a[i] = 3 * i + 1
+    asm.li(t0, base)
+    asm.li(t1, base + 4 * n)
+    asm.li(t2, 1)
+    asm.label("init")
+    asm.sw(t2, 0, t0)
+    asm.addi(t2, t2, 3)
+    asm.addi(t0, t0, 4)
+    asm.bne(t0, t1, "init")
+    asm.li(a2, LCG_A)
+    asm.li(a3, LCG_C)
+    asm.li(a4, seed)
+    asm.li(a5, mask)
+    asm.li(s0, base)
+    asm.li(s1, queries)
+    asm.label("query")
+    asm.lcg_step(a4, a2, a3)
+    asm.srli(t2, a4, 8)
+    asm.and_(t2, t2, a5)                 # key
+    asm.li(t0, 0)                        # lo
+    asm.li(t1, n)                        # hi
+    asm.label("search")
+    asm.beq(t0, t1, "next")              # lo == hi: not found
+    asm.add(t3, t0, t1)
+    asm.srli(t3, t3, 1)                  # mid
+    asm.slli(t4, t3, 2)
+    asm.add(t4, t4, s0)
+    asm.lw(t5, 0, t4)
+    asm.beq(t5, t2, "found")
+    asm.slt(t6, t5, t2)
+    asm.beq(t6, zero, "upper")
+    asm.addi(t0, t3, 1)                  # a[mid] < key: lo = mid + 1
+    asm.j("search")
+    asm.label("upper")
+    asm.mv(t1, t3)                       # hi = mid
+    asm.j("search")
+    asm.label("found")
+    asm.add(a1, a1, t3)
+    asm.addi(a1, a1, 1)
+    asm.label("next")
+    asm.addi(s1, s1, -1)
+    asm.bne(s1, zero, "query")
+    asm.exit()
+    total, x = 0, seed
+    for _ in range(queries):
+        x = lcg(x)
+        key = (x >> 8) & mask
+        if key % 3 == 1 and key // 3 < n:
+            total += key // 3 + 1
+    return u32(total)
+
+
+def k_histogram(asm, n=4096, bins=64, seed=3):
+    if bins & (bins - 1):
+        raise ValueError("histogram: bins must be a power of two")
+    hist = DATA
+    asm.li(a1, 0)
+    asm.li(a2, LCG_A)
+    asm.li(a3, LCG_C)
+    asm.li(a4, seed)
+    asm.li(s0, hist)
+    asm.li(s1, n)
+    asm.label("count")
+    asm.lcg_step(a4, a2, a3)
+    asm.srli(t0, a4, 16)
+    asm.andi(t0, t0, bins - 1)
+    asm.slli(t0, t0, 2)
+    asm.add(t0, t0, s0)
+    asm.lw(t1, 0, t0)
+    asm.addi(t1, t1, 1)
+    asm.sw(t1, 0, t0)
+    asm.addi(s1, s1, -1)
+    asm.bne(s1, zero, "count")
+    # a1 = sum count[b] * (b + 1)
+    asm.li(t0, hist)
+    asm.li(t3, hist + 4 * bins)
+    asm.li(t4, 1)
+    asm.label("check")
+    asm.lw(t1, 0, t0)
+    asm.addi(t0, t0, 4)
+    asm.mul(t2, t1, t4)
+    asm.add(a1, a1, t2)
+    asm.addi(t4, t4, 1)
+    asm.bne(t0, t3, "check")
+    asm.exit()
+    counts = [0] * bins
+    for v in _lcg_values(n, seed, 16, bins - 1):
+        counts[v] += 1
+    return u32(sum(c * (b + 1) for b, c in enumerate(counts)))
+
+
+def k_stencil(asm, n=32, iters=4):
+    """5-point stencil on an n x n grid, ping-ponging between two arrays"""
+    A, B = DATA, DATA + 4 * n * n
+    row = 4 * n
+    asm.li(a1, 0)
+    asm.li(t0, A)
+    asm.li(t1, 0)
+    asm.li(t2, n * n)
+    asm.label("init")
+    asm.andi(t3, t1, 31)
+    asm.sw(t3, 0, t0)
+    asm.addi(t0, t0, 4)
+    asm.addi(t1, t1, 1)
+    asm.bne(t1, t2, "init")
+    asm.li(s0, A)                        # source
+    asm.li(s1, B)                        # destination
+    asm.li(s2, iters)
+    asm.label("sweep")
+    asm.addi(s3, s0, row + 4)            # &src[1][1]
+    asm.addi(s4, s1, row + 4)            # &dst[1][1]
+    asm.li(s5, n - 2)                    # rows left
+    asm.label("row")
+    asm.li(s6, n - 2)                    # columns left
+    asm.label("col")
+    asm.lw(t0, 0, s3)
+    asm.lw(t1, -4, s3)
+    asm.lw(t2, 4, s3)
+    asm.lw(t3, -row, s3)
+    asm.lw(t4, row, s3)
+    asm.add(t0, t0, t1)
+    asm.add(t2, t2, t3)
+    asm.add(t0, t0, t4)
+    asm.add(t0, t0, t2)
+    asm.sw(t0, 0, s4)
+    asm.addi(s3, s3, 4)
+    asm.addi(s4, s4, 4)
+    asm.addi(s6, s6, -1)
+    asm.bne(s6, zero, "col")
+    asm.addi(s3, s3, 8)
+    asm.addi(s4, s4, 8)
+    asm.addi(s5, s5, -1)
+    asm.bne(s5, zero, "row")
+    asm.mv(t0, s0)                       # swap source and destination
+    asm.mv(s0, s1)
+    asm.mv(s1, t0)
+    asm.addi(s2, s2, -1)
+    asm.bne(s2, zero, "sweep")
+    asm.mv(t6, s0)
+    # sum the last result
+    asm.li(t0, n * n)
+    asm.label("check")
+    asm.lw(t1, 0, t6)
+    asm.addi(t6, t6, 4)
+    asm.add(a1, a1, t1)
+    asm.addi(t0, t0, -1)
+    asm.bne(t0, zero, "check")
+    asm.exit()
+    src = [k & 31 for k in range(n * n)]
+    dst = [0] * (n * n)
+    for _ in range(iters):
+        for i in range(1, n - 1):
+            for j in range(1, n - 1):
+                k = i * n + j
+                dst[k] = u32(src[k] + src[k - 1] + src[k + 1] + src[k - n] + src[k + n])
+        src, dst = dst, src
+    return u32(sum(src))
+
+
+def k_vec_xprod(asm, n=64, jblk=16):
+    """Biot-Savart style cross products, as code/ms2/input/vec_xprod.c"""
+    if n % jblk:
+        raise ValueError("vec_xprod: n must be a multiple of jblk")
+    uvw, xyz, res = DATA, DATA + 12 * n, DATA + 24 * n
+    asm.li(a1, 0)
+    # input word k holds (k * k) & 255
+    asm.li(t0, uvw)
+    asm.li(t1, res)
+    asm.li(t2, 0)
+    asm.label("init")
+    asm.mul(t3, t2, t2)
+    asm.andi(t3, t3, 255)
+    asm.sw(t3, 0, t0)
+    asm.addi(t2, t2, 1)
+    asm.addi(t0, t0, 4)
+    asm.bne(t0, t1, "init")
+    asm.li(s0, 0)                        # jj
+    asm.li(s1, n)
+    asm.label("jj")
+    asm.li(s2, 0)                        # i
+    asm.label("i")
+    asm.li(a5, 0)                        # temp_result
+    asm.li(a6, 0)
+    asm.li(a7, 0)
+    asm.slli(t0, s2, 2)                  # i * 12
+    asm.slli(t1, s2, 3)
+    asm.add(s3, t0, t1)
+    asm.li(t0, uvw)
+    asm.add(s4, s3, t0)                  # &uvw[i]
+    asm.li(t0, xyz)
+    asm.add(s5, s3, t0)                  # &xyz[i]
+    asm.mv(s6, s0)                       # j
+    asm.addi(s7, s0, jblk)
+    asm.label("j")
+    asm.beq(s6, s2, "skip")
+    asm.slli(t0, s6, 2)
+    asm.slli(t1, s6, 3)
+    asm.add(t0, t0, t1)
+    asm.li(t1, xyz)
+    asm.add(t0, t0, t1)                  # &xyz[j]
+    asm.lw(t1, 0, t0)
+    asm.lw(t2, 4, t0)
+    asm.lw(t3, 8, t0)
+    asm.lw(t4, 0, s5)
+    asm.lw(t5, 4, s5)
+    asm.lw(t6, 8, s5)
+    asm.sub(t1, t1, t4)                  # r = xyz[j] - xyz[i]
+    asm.sub(t2, t2, t5)
+    asm.sub(t3, t3, t6)
+    asm.lw(t4, 0, s4)                    # a = uvw[i]
+    asm.lw(t5, 4, s4)
+    asm.lw(t6, 8, s4)
+    asm.mul(a2, t5, t3)                  # a1 * r2 - a2 * r1
+    asm.mul(a3, t6, t2)
+    asm.sub(a2, a2, a3)
+    asm.add(a5, a5, a2)
+    asm.mul(a2, t6, t1)                  # a2 * r0 - a0 * r2
+    asm.mul(a3, t4, t3)
+    asm.sub(a2, a2, a3)
+    asm.add(a6, a6, a2)
+    asm.mul(a2, t4, t2)                  # a0 * r1 - a1 * r0
+    asm.mul(a3, t5, t1)
+    asm.sub(a2, a2, a3)
+    asm.add(a7, a7, a2)
+    asm.label("skip")
+    asm.addi(s6, s6, 1)
+    asm.bne(s6, s7, "j")
+    asm.li(t0, res)
+    asm.add(t0, t0, s3)                  # &result[i]
+    asm.lw(t1, 0, t0)
+    asm.lw(t2, 4, t0)
+    asm.lw(t3, 8, t0)
+    asm.add(t1, t1, a5)
+    asm.add(t2, t2, a6)
+    asm.add(t3, t3, a7)
+    asm.sw(t1, 0, t0)
+    asm.sw(t2, 4, t0)
+    asm.sw(t3, 8, t0)
+    asm.addi(s2, s2, 1)
+    asm.bne(s2, s1, "i")
+    asm.addi(s0, s0, jblk)
+    asm.bne(s0, s1, "jj")
+    asm.sum_words(res, 3 * n)
+    asm.exit()
+    u = [(k * k) & 255 for k in range(3 * n)]
+    x = [(k * k) & 255 for k in range(3 * n, 6 * n)]
+    out = [0] * (3 * n)
+    for jj in range(0, n, jblk):
+        for i in range(n):
+            tr = [0, 0, 0]
+            for j in range(jj, jj + jblk):
+                if i == j:
+                    continue
+                r = [x[3 * j + c] - x[3 * i + c] for c in range(3)]
+                a = u[3 * i:3 * i + 3]
+                tr[0] += a[1] * r[2] - a[2] * r[1]
+                tr[1] += a[2] * r[0] - a[0] * r[2]
+                tr[2] += a[0] * r[1] - a[1] * r[0]
+            for c in range(3):
+                out[3 * i + c] = u32(out[3 * i + c] + tr[c])
+    return u32(sum(out))
+
+
+def _div(x, y, signed, remainder):
+    """RV32M division, including division by zero and overflow"""
+    x, y = u32(x), u32(y)
+    if y == 0:
+        return x if remainder else MASK
+    if not signed:
+        return x % y if remainder else x // y
+    x, y = s32(x), s32(y)
+    if x == -(1 << 31) and y == -1:
+        return 0 if remainder else u32(x)
+    q = abs(x) // abs(y) * (1 if (x < 0) == (y < 0) else -1)   # rounds toward zero
+    return u32(x - q * y) if remainder else u32(q)
+
+
+def k_rv32im(asm, n=256, seed=11):
+    """division, the high multiplies, unsigned compares and loads, every branch
+    condition and calls through a function pointer (auipc, jalr)"""
+    table = DATA
+    asm.li(a1, 0)
+    asm.li(a2, LCG_A)
+    asm.li(a3, LCG_C)
+    asm.li(a4, seed)
+    asm.li(s0, n)
+    asm.li(s3, table)
+    asm.la(s2, "mix")
+    asm.j("loop")
+    # t0 = mix(a5, a6), clobbers t1-t4
+    asm.label("mix")
+    asm.div(t1, a5, a6)
+    asm.rem(t2, a5, a6)
+    asm.divu(t3, a5, a6)
+    asm.remu(t4, a5, a6)
+    asm.add(t0, t1, t2)
+    asm.xor(t0, t0, t3)
+    asm.add(t0, t0, t4)
+    asm.mulh(t1, a5, a6)
+    asm.mulhsu(t2, a5, a6)
+    asm.mulhu(t3, a5, a6)
+    asm.add(t0, t0, t1)
+    asm.sub(t0, t0, t2)
+    asm.xor(t0, t0, t3)
+    asm.sltu(t1, a5, a6)
+    asm.sltiu(t2, a6, 16)
+    asm.slli(t1, t1, 1)
+    asm.add(t1, t1, t2)
+    asm.add(t0, t0, t1)
+    asm.ret()
+    asm.label("loop")
+    asm.lcg_step(a4, a2, a3)
+    asm.mv(a5, a4)
+    asm.srai(a6, a4, 20)
+    asm.andi(t1, s0, 31)                 # every 32nd call divides by zero
+    asm.bne(t1, zero, "nonzero")
+    asm.li(a6, 0)
+    asm.label("nonzero")
+    asm.andi(t1, s0, 63)                 # and every 64th overflows
+    asm.addi(t2, zero, 1)
+    asm.bne(t1, t2, "call")
+    asm.lui(a5, 0x80000)
+    asm.addi(a6, zero, -1)
+    asm.label("call")
+    asm.jalr(ra, 0, s2)
+    asm.add(a1, a1, t0)
+    asm.blt(a5, a6, "ge")
+    asm.addi(a1, a1, 1)
+    asm.label("ge")
+    asm.bge(a5, zero, "ltu")
+    asm.addi(a1, a1, 2)
+    asm.label("ltu")
+    asm.bltu(a5, a6, "geu")
+    asm.addi(a1, a1, 4)
+    asm.label("geu")
+    asm.bgeu(a6, a5, "store")
+    asm.addi(a1, a1, 8)
+    asm.label("store")
+    asm.addi(s3, s3, 2)
+    asm.sh(a4, -2, s3)                   # negative store offset
+    asm.addi(s0, s0, -1)
+    asm.bne(s0, zero, "loop")
+    # a1 += the halfwords unsigned, their high bytes unsigned and signed
+    asm.li(t0, table)
+    asm.label("check")
+    asm.lhu(t1, 0, t0)
+    asm.lbu(t2, 1, t0)
+    asm.lb(t3, 1, t0)
+    asm.add(a1, a1, t1)
+    asm.add(a1, a1, t2)
+    asm.add(a1, a1, t3)
+    asm.addi(t0, t0, 2)
+    asm.bne(t0, s3, "check")
+    asm.exit()
+    total, x, halves = 0, seed, []
+    for i in range(n, 0, -1):
+        x = lcg(x)
+        y, d = x, u32(s32(x) >> 20)
+        if i % 32 == 0:
+            d = 0
+        if i % 64 == 1:
+            y, d = 0x80000000, MASK
+        r = u32(_div(y, d, True, False) + _div(y, d, True, True))
+        r = u32((r ^ _div(y, d, False, False)) + _div(y, d, False, True))
+        r = u32(r + ((s32(y) * s32(d)) >> 32))
+        r = u32(r - ((s32(y) * d) >> 32))
+        r ^= (y * d) >> 32
+        r = u32(r + 2 * (y < d) + (d < 16))
+        total = u32(total + r)
+        total += (s32(y) >= s32(d)) + 2 * (s32(y) < 0) + 4 * (y >= d) + 8 * (d < y)
+        halves.append(x & 0xFFFF)
+    for h in halves:
+        hi = h >> 8
+        total += h + hi + (hi - 256 if hi & 0x80 else hi)
+    return u32(total)
+
+
+KERNELS = {
+    "memcpy": k_memcpy,
+    "memset": k_memset,
+    "matmul": k_matmul,
+    "sort": k_sort,
+    "list": k_list,
+    "loaduse": k_loaduse,
+    "bsearch": k_bsearch,
+    "histogram": k_histogram,
+    "stencil": k_stencil,
+    "vec_xprod": k_vec_xprod,
+    "rv32im": k_rv32im,
+}
+
+# the default suite: benchmark name -> (kernel, parameters)
+SUITE = [
+    ("memcpy_1k", "memcpy", {"n": 1024}),
+    ("memset_1k", "memset", {"n": 1024}),
+    ("matmul_ijk_16", "matmul", {"n": 16, "order": "ijk"}),
+    ("matmul_ikj_16", "matmul", {"n": 16, "order": "ikj"}),
+    ("matmul_tiled_16x4", "matmul", {"n": 16, "order": "tiled", "tile": 4}),
+    ("sort_256", "sort", {"n": 256}),
+    ("list_seq_256", "list", {"n": 256, "stride": 1, "node": 16}),
+    ("list_rand_256", "list", {"n": 256, "stride": 97, "node": 64}),
+    ("loaduse_1k", "loaduse", {"n": 1024}),
+    ("bsearch_1k", "bsearch", {"n": 1024, "queries": 256}),
+    ("histogram_4k", "histogram", {"n": 4096, "bins": 64}),
+    ("stencil_32", "stencil", {"n": 32, "iters": 4}),
+    ("vec_xprod_64", "vec_xprod", {"n": 64, "jblk": 16}),
+    ("rv32im_256", "rv32im", {"n": 256}),
+    ("vec_xprod_64_rvc", "vec_xprod", {"n": 64, "jblk": 16, "rvc": 1}),
+    ("rv32im_256_rvc", "rv32im", {"n": 256, "rvc": 1}),
+]
+
+
+def parse_spec(spec):
+    """kernel[:key=value,...] -> (name, kernel, params)"""
+    kernel, _, args = spec.partition(":")
+    if kernel not in KERNELS:
+        raise SystemExit("unknown kernel %s (have: %s)" % (kernel, ", ".join(KERNELS)))
+    params = {}
+    for item in filter(None, args.split(",")):
+        key, _, value = item.partition("=")
+        params[key] = int(value, 0) if value.lstrip("-").isdigit() or value.startswith("0x") else value
+    name = kernel + "".join("_%s%s" % (k, v) for k, v in sorted(params.items()))
+    return name, kernel, params
+
+
+def generate(name, kernel, params, out_dir, rvc):
+    params = dict(params)
+    asm = Asm(rvc or bool(params.pop("rvc", 0)))
+    expected = KERNELS[kernel](asm, **params)
+    words = asm.assemble()
+    if BASE_PC + asm.size > DATA:
+        raise SystemExit("%s: program overlaps the data at 0x%x" % (name, DATA))
+    with open(os.path.join(out_dir, name + ".input"), "w") as f:
+        for word, size in words:
+            f.write("0x%04X\n" % word if size == 2 else "0x%08X\n" % word)
+    return expected, len(words), asm.size
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate the benchmark suite")
+    parser.add_argument("specs", nargs="*", help="kernel[:key=value,...], default: the whole suite")
+    parser.add_argument("--out", default="code/bench/input", help="output directory")
+    parser.add_argument("--rvc", action="store_true",
+                        help="compress every instruction with a C extension form")
+    args = parser.parse_args()
+
+    suite = SUITE if not args.specs else [parse_spec(spec) for spec in args.specs]
+    os.makedirs(args.out, exist_ok=True)
+    manifest = os.path.join(args.out, "manifest.csv")
+    rows = {}
+    if os.path.exists(manifest):
+        with open(manifest) as f:
+            for line in f.read().splitlines()[1:]:
+                rows[line.split(",")[0]] = line
+    for name, kernel, params in suite:
+        expected, size, code_bytes = generate(name, kernel, params, args.out, args.rvc)
+        desc = " ".join("%s=%s" % kv for kv in sorted(params.items()))
+        rows[name] = "%s,%s,%s,%d,0x%08x" % (name, kernel, desc, size, expected)
+        print("%-20s %5d words %6d bytes  checksum 0x%08x" % (name, size, code_bytes, expected))
+    with open(manifest, "w") as f:
+        f.write("name,kernel,params,words,checksum\n")
+        for name in sorted(rows):
+            f.write(rows[name] + "\n")
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,121 @@
+"""
+Measures how fast the simulator runs on this host.
+
+Every benchmark of the suite (see bench_gen.py) runs with -H under the
+emulator (-m, reported as host MIPS) and under the pipeline in each
+configuration of bench_run.py (-s, reported as simulated Mcycles/s). Each
+run is repeated and the fastest kept. Results go to
+code/bench/out/host.csv. Host speed depends on the machine, so the baseline
+stays local in code/bench/out/host_baseline.csv (--save-baseline). Single
+runs last milliseconds and are noisy, so regressions are judged per
+configuration on the geometric mean over all benchmarks: a configuration
+regresses when its mean is more than the tolerance slower than the
+baseline's.
+
+Microbenchmarks of single functions are in simbench.c (make simbench).
+
+usage: python3 bench_host.py [--config NAME ...] [--repeat N] [--tolerance PCT]
+                             [--save-baseline] [benchmark ...]
+"""
+import argparse
+import csv
+import math
+import os
+import subprocess
+import sys
+
+from bench_run import BENCH_DIR, CONFIGS, SIMULATOR, load_manifest, parse_stats, run
+
+OUT_DIR = os.path.join(BENCH_DIR, "out")
+FIELDS = ["benchmark", "config", "host_seconds", "host_mips", "host_mcycles_s",
+          "host_ipc", "host_llc_misses", "host_mispredicts"]
+
+
+def measure(args, repeat):
+    """stats of the fastest of `repeat` runs"""
+    best = None
+    for _ in range(repeat):
+        stats, _ = parse_stats(run(args))
+        if "host_seconds" in stats and (best is None or stats["host_seconds"] < best["host_seconds"]):
+            best = stats
+    return best or {}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure simulator throughput on the host")
+    parser.add_argument("benchmarks", nargs="*", help="benchmarks to run, default: all in the manifest")
+    parser.add_argument("--config", action="append", choices=sorted(CONFIGS),
+                        help="pipeline configuration to run (repeatable), default: all")
+    parser.add_argument("--repeat", type=int, default=5, help="runs per measurement, the fastest counts")
+    parser.add_argument("--tolerance", type=float, default=10.0,
+                        help="allowed slowdown against the baseline in percent (default 10)")
+    parser.add_argument("--save-baseline", action="store_true",
+                        help="store this run as the local baseline")
+    args = parser.parse_args()
+
+    if subprocess.call(["make", "-s", "riscv-bench"]) != 0:
+        return 1
+
+    manifest = load_manifest()
+    benchmarks = args.benchmarks or sorted(manifest)
+    configs = args.config or list(CONFIGS)
+    baseline_path = os.path.join(OUT_DIR, "host_baseline.csv")
+    baseline = {}
+    if os.path.exists(baseline_path) and not args.save_baseline:
+        with open(baseline_path) as f:
+            baseline = {(row["benchmark"], row["config"]): row for row in csv.DictReader(f)}
+
+    rows, failures = [], 0
+    ratios = {}   # config -> speed relative to the baseline, per benchmark
+    for name in benchmarks:
+        path = os.path.join(BENCH_DIR, "input", name + ".input")
+        runs = [("emulator", [SIMULATOR, "-m", "-e", "-H", path])]
+        runs += [(config, [SIMULATOR, "-s", "-f", "-c", "-e", "-H"] + CONFIGS[config] + [path])
+                 for config in configs]
+        for config, command in runs:
+            stats = measure(command, args.repeat)
+            row = {"benchmark": name, "config": config}
+            row.update({field: stats.get(field, "") for field in FIELDS[2:]})
+            rows.append(row)
+
+            # the emulator is judged by MIPS, the pipeline by simulated cycles/s
+            metric = "host_mips" if config == "emulator" else "host_mcycles_s"
+            status = ""
+            if not stats:
+                status = "FAIL no -H stats"
+                failures += 1
+            elif (name, config) in baseline and baseline[(name, config)][metric]:
+                ratio = stats[metric] / float(baseline[(name, config)][metric])
+                ratios.setdefault(config, []).append(ratio)
+                status = "%+.1f%%" % (100.0 * (ratio - 1))
+            print("%-20s %-8s %8.3f s  %9.3f %-9s %s" % (
+                name, config, stats.get("host_seconds", 0), stats.get(metric, 0),
+                "MIPS" if config == "emulator" else "Mcycles/s", status))
+
+    os.makedirs(OUT_DIR, exist_ok=True)
+    targets = [os.path.join(OUT_DIR, "host.csv")]
+    if args.save_baseline:
+        targets.append(baseline_path)
+    for target in targets:
+        with open(target, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=FIELDS, lineterminator="\n")
+            writer.writeheader()
+            for row in rows:
+                writer.writerow({k: "%.4f" % v if isinstance(v, float) else v
+                                 for k, v in row.items() if k in FIELDS})
+
+    regressions = 0
+    for config in sorted(ratios):
+        mean = math.exp(sum(math.log(r) for r in ratios[config]) / len(ratios[config]))
+        change = 100.0 * (mean - 1)
+        regressed = change < -args.tolerance
+        regressions += regressed
+        print("%-8s geometric mean %+.1f%% against the baseline%s" % (
+            config, change, "  REGRESSION" if regressed else ""))
+
+    print("%d run(s), %d failed, %d configuration(s) regressed" % (len(rows), failures, regressions))
+    return 1 if failures or regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,210 @@
+"""
+Runs the benchmark suite (see bench_gen.py) on the pipeline and compares the
+results with the stored baseline.
+
+Every benchmark runs under every configuration with `riscv-bench -s -f -c -e
+-r -T <flags>`. The #-statistics it prints (cycles, CPI stack, stalls, cache
+hits and misses, ...) go to code/bench/out/results.csv, one row per
+benchmark and configuration. A run fails when its checksum (a1 at exit)
+differs from the python model, or from the emulator with -m. A run regresses
+when a metric moves more than the tolerance away from
+code/bench/ref/baseline.csv.
+
+usage: python3 bench_run.py [--config NAME ...] [--tolerance PCT]
+                            [--update-baseline] [benchmark ...]
+"""
+import argparse
+import csv
+import os
+import re
+import subprocess
+import sys
+
+BENCH_DIR = "code/bench"
+SIMULATOR = "./riscv-bench"
+TIMEOUT = 600
+
+# configuration name -> extra simulator flags
+CONFIGS = {
+    "base": [],
+    "nb4": ["-M", "4"],
+    "icache": ["-I", "-F"],
+    "dram": ["-D"],
+    "fu": ["-U"],
+    "fetchq": ["-I", "-F", "-B"],
+    "storebuf": ["-O"],
+    "smt": ["-X", "2"],
+}
+
+# benchmarks that update their data in place: every SMT thread runs the
+# whole program on the same memory, so their checksum would depend on how
+# the threads interleave, and they skip the smt configuration
+SHARED_DATA = {
+    "histogram_4k", "matmul_ikj_16", "matmul_tiled_16x4", "sort_256",
+    "vec_xprod_64", "vec_xprod_64_rvc",
+}
+
+# metrics compared against the baseline, in results.csv column order
+METRICS = [
+    "cycles", "instructions", "cpi", "ipc",
+    "retire_dual", "retire_single", "dual_structural", "dual_data",
+    "load_use_stall", "branch_flush", "cache_miss", "functional_unit", "frontend",
+    "stalls", "branches_taken", "mem_stalls",
+    "cache_accesses", "cache_misses", "miss_rate",
+    "icache_misses", "fetch_stalls", "code_bytes", "fetch_bytes",
+]
+
+STAT_LINE = re.compile(r"^#\s*([A-Za-z][A-Za-z \-()/]*?)\s*=\s*(-?[0-9.]+)")
+REG_LINE = re.compile(r"r(\s?\d+)=([0-9a-f]{8})")
+
+
+def stat_key(name):
+    """'MEM   stalls' -> 'mem_stalls', 'Forwards (EX-EX)' -> 'forwards_ex_ex'"""
+    return re.sub(r"[^a-z0-9]+", "_", name.lower()).strip("_")
+
+
+def run(args):
+    result = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True, timeout=TIMEOUT)
+    return result.stdout
+
+
+def parse_stats(output):
+    stats, regs = {}, {}
+    for line in output.splitlines():
+        match = STAT_LINE.match(line)
+        if match:
+            stats[stat_key(match.group(1))] = float(match.group(2))
+        for reg, value in REG_LINE.findall(line):
+            regs[int(reg)] = int(value, 16)
+    if stats.get("instructions") and stats.get("cycles"):
+        stats["cpi"] = stats["cycles"] / stats["instructions"]
+        stats["ipc"] = stats["instructions"] / stats["cycles"]
+    if stats.get("cache_accesses"):
+        stats["miss_rate"] = stats.get("cache_misses", 0) / stats["cache_accesses"]
+    return stats, regs.get(11)
+
+
+def emulator_checksum(path):
+    output = run([SIMULATOR, "-m", "-e", path])
+    match = re.search(r"(-?\d+)exiting the simulator", output)
+    return int(match.group(1)) & 0xFFFFFFFF if match else None
+
+
+def load_manifest():
+    with open(os.path.join(BENCH_DIR, "input", "manifest.csv")) as f:
+        return {row["name"]: row for row in csv.DictReader(f)}
+
+
+def load_baseline(path):
+    if not os.path.exists(path):
+        return {}
+    with open(path) as f:
+        return {(row["benchmark"], row["config"]): row for row in csv.DictReader(f)}
+
+
+def format_value(value):
+    if isinstance(value, float) and not value.is_integer():
+        return "%.4f" % value
+    return "%d" % value
+
+
+def compare(row, base, tolerance):
+    """metrics of `row` more than `tolerance` percent away from `base`"""
+    moved = []
+    for metric in METRICS:
+        if metric not in base or base[metric] == "":
+            continue
+        # compare at the precision the baseline is stored with
+        old, new = float(base[metric]), float(format_value(row.get(metric, 0)))
+        if old == new:
+            continue
+        change = 100.0 * (new - old) / old if old else float("inf")
+        if abs(change) > tolerance:
+            moved.append("%s %s -> %s (%+.1f%%)" % (metric, base[metric], format_value(new), change))
+    return moved
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the benchmark suite and check for regressions")
+    parser.add_argument("benchmarks", nargs="*", help="benchmarks to run, default: all in the manifest")
+    parser.add_argument("--config", action="append", choices=sorted(CONFIGS),
+                        help="configuration to run (repeatable), default: all")
+    parser.add_argument("--tolerance", type=float, default=0.0,
+                        help="allowed change against the baseline in percent (default 0, the simulator is deterministic)")
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="store this run as the new baseline")
+    args = parser.parse_args()
+
+    if subprocess.call(["make", "-s", "riscv-bench"]) != 0:
+        return 1
+
+    manifest = load_manifest()
+    benchmarks = args.benchmarks or sorted(manifest)
+    configs = args.config or list(CONFIGS)
+    baseline_path = os.path.join(BENCH_DIR, "ref", "baseline.csv")
+    baseline = load_baseline(baseline_path)
+
+    rows, failures, regressions = [], 0, 0
+    for name in benchmarks:
+        if name not in manifest:
+            print("unknown benchmark %s, run bench_gen.py first" % name)
+            return 1
+        path = os.path.join(BENCH_DIR, "input", name + ".input")
+        expected = int(manifest[name]["checksum"], 16)
+        emulated = emulator_checksum(path)
+        for config in configs:
+            if config == "smt" and name in SHARED_DATA:
+                continue
+            try:
+                output = run([SIMULATOR, "-s", "-f", "-c", "-e", "-r", "-T"] + CONFIGS[config] + [path])
+            except subprocess.TimeoutExpired:
+                output = ""
+            stats, checksum = parse_stats(output)
+            row = {"benchmark": name, "config": config}
+            row.update({metric: stats.get(metric, 0) for metric in METRICS})
+            row["checksum"] = "0x%08x" % checksum if checksum is not None else "none"
+            rows.append(row)
+
+            status = "ok"
+            if checksum != expected or emulated != expected:
+                status = "FAIL checksum pipeline %s emulator %s expected 0x%08x" % (
+                    row["checksum"], "0x%08x" % emulated if emulated is not None else "none", expected)
+                failures += 1
+            elif (name, config) in baseline and not args.update_baseline:
+                moved = compare(row, baseline[(name, config)], args.tolerance)
+                if moved:
+                    status = "REGRESSION " + ", ".join(moved)
+                    regressions += 1
+            elif not args.update_baseline:
+                status = "new"
+            print("%-20s %-7s cycles %9d  CPI %6.3f  %s" % (
+                name, config, row["cycles"], stats.get("cpi", 0), status))
+
+    fields = ["benchmark", "config"] + METRICS + ["checksum"]
+    out_dir = os.path.join(BENCH_DIR, "out")
+    os.makedirs(out_dir, exist_ok=True)
+    outputs = [(os.path.join(out_dir, "results.csv"), rows)]
+    if args.update_baseline:
+        if failures:
+            print("not updating the baseline, %d run(s) failed" % failures)
+        else:
+            os.makedirs(os.path.dirname(baseline_path), exist_ok=True)
+            # keep baseline rows of benchmarks and configurations not run now
+            for row in rows:
+                baseline[(row["benchmark"], row["config"])] = row
+            outputs.append((baseline_path, [baseline[key] for key in sorted(baseline)]))
+    for target, target_rows in outputs:
+        with open(target, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=fields, lineterminator="\n")
+            writer.writeheader()
+            for row in target_rows:
+                writer.writerow({k: format_value(v) if isinstance(v, (int, float)) else v
+                                 for k, v in row.items() if k in fields})
+
+    print("%d run(s), %d failed, %d regressed" % (len(rows), failures, regressions))
+    return 1 if failures or regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,53 @@
+#include "bufwriter.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+bool bw_open(bufwriter_t *bw, const char *filename) {
+  bw->file = fopen(filename, "w");
+  if (bw->file == NULL) {
+    return false;
+  }
+  bw->buf = malloc(BW_BUFFER_SIZE);
+  bw->len = 0;
+  return true;
+}
+
+void bw_printf(bufwriter_t *bw, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(bw->buf + bw->len, BW_BUFFER_SIZE - bw->len, format, args);
+  va_end(args);
+  if (n < 0) {
+    return;
+  }
+  if ((size_t)n < BW_BUFFER_SIZE - bw->len) {
+    bw->len += n;
+    return;
+  }
+
+  // did not fit: flush and try again, longer records bypass the buffer
+  bw_flush(bw);
+  va_start(args, format);
+  if ((size_t)n < BW_BUFFER_SIZE) {
+    bw->len = vsnprintf(bw->buf, BW_BUFFER_SIZE, format, args);
+  } else {
+    vfprintf(bw->file, format, args);
+  }
+  va_end(args);
+}
+
+void bw_flush(bufwriter_t *bw) {
+  fwrite(bw->buf, 1, bw->len, bw->file);
+  bw->len = 0;
+}
+
+void bw_close(bufwriter_t *bw) {
+  if (bw->file == NULL) {
+    return;
+  }
+  bw_flush(bw);
+  fclose(bw->file);
+  free(bw->buf);
+  bw->file = NULL;
+  bw->buf = NULL;
+}
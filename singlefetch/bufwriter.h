@@ -0,0 +1,24 @@
+#ifndef BUFWRITER_H
+#define BUFWRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Buffered text output for the trace writers, so a record per cycle costs a
+// memcpy instead of a stdio call.
+
+#define BW_BUFFER_SIZE (1 << 16)
+
+typedef struct {
+    FILE *file;
+    char *buf;
+    size_t len;
+} bufwriter_t;
+
+// Function declarations
+bool bw_open(bufwriter_t *bw, const char *filename);
+void bw_printf(bufwriter_t *bw, const char *format, ...);
+void bw_flush(bufwriter_t *bw);
+void bw_close(bufwriter_t *bw);
+#endif // BUFWRITER_H
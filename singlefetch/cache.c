@@ -1,5 +1,7 @@
 #include "dogfault.h"
 #include "cache.h"
+#include "replacement.h"
+#include "stackdist.h"
 #include <assert.h>
 #include <ctype.h>
 #include <getopt.h>
@@ -40,16 +42,21 @@ void hit_cacheline(const unsigned long long address, Cache *cache) {
 	for (int i = 0; i < cache->linesPerSet; i++) {
 		Line *line = &set->lines[i];
 		if(line->valid && (line->tag == cache_tag(address, cache))) {
-			if (cache->lfu == 0) {
-				cache->sets[cache_set(address, cache)].lines[i].lru_clock = 
-					++(cache->sets[cache_set(address, cache)].lru_clock);
-			} else if (cache->lfu == 1) {
-				cache->sets[cache_set(address, cache)].lines[i].access_counter++;
-			}
+			repl_on_hit(cache, cache_set(address, cache), i);
 		}
 	}
 }
 
+void dirty_cacheline(const unsigned long long address, Cache *cache) {
+  Set *set = &cache->sets[cache_set(address, cache)];
+  for (int i = 0; i < cache->linesPerSet; i++) {
+    Line *line = &set->lines[i];
+    if (line->valid && (line->tag == cache_tag(address, cache))) {
+      line->dirty = true;
+    }
+  }
+}
+
 bool insert_cacheline(const unsigned long long address, Cache *cache) {
   for (int i = 0; i < cache->linesPerSet; i++) {
     Line *line = &cache->sets[cache_set(address, cache)].lines[i];
@@ -59,34 +66,18 @@ bool insert_cacheline(const unsigned long long address, Cache *cache) {
       line->block_addr = address_to_block(address, cache);
       line->tag = cache_tag(address, cache);
       line->valid = true;
-      line->lru_clock = cache->sets[cache_set(address, cache)].lru_clock;
-      line->access_counter = 1;
+      line->dirty = false;
+      repl_on_fill(cache, cache_set(address, cache), i);
       return true;
     }
   }
   return false;  
 }
 
-unsigned long long victim_cacheline(const unsigned long long address, const Cache *cache) {
+unsigned long long victim_cacheline(const unsigned long long address, Cache *cache) {
   Set *set = &cache->sets[cache_set(address, cache)];
-  Line *victim_line = &set->lines[0];
-  // Create variable to hold the smallest access_counter
-  int smallest = victim_line->access_counter; 
-  for (int i = 1; i < cache->linesPerSet; i++) {
-    Line *line = &set->lines[i];
-    if (cache->lfu == 0) {
-      // Find the cacheline that has been used the least recently
-      if (line->lru_clock < victim_line->lru_clock) {
-        victim_line = line;
-      }
-    } else if (cache->lfu == 1) {
-      // Find the cache line that has been used the least frequently, with a tie-breaker based on the least recently used
-      if ((line->access_counter < smallest) || ((line->access_counter ==  smallest) && line->lru_clock < victim_line->lru_clock)) {
-        smallest = line->access_counter;
-        victim_line = line;
-      }
-    }
-  }
+  // Ask the cache's replacement policy which way to give up
+  Line *victim_line = &set->lines[repl_victim(cache, cache_set(address, cache))];
   return victim_line->block_addr;
 }
 
@@ -98,24 +89,32 @@ void replace_cacheline(const unsigned long long victim_block_addr, const unsigne
       // Replace the victim cache line with the new address
       line->block_addr = address_to_block(insert_addr, cache);
       line->tag = cache_tag(insert_addr, cache);
-      line->lru_clock = set->lru_clock; // Update the lru_clock based on the global lru_clock
-      line->access_counter = 1; // Initialize the access_counter
       line->valid = true; // Mark the cache line as valid
+      line->dirty = false;
+      repl_on_fill(cache, cache_set(insert_addr, cache), i); // Initialize the replacement state
       break;
     }
   }
 }
 
 void cacheSetUp(Cache *cache, char *name) {
-    cache->hit_count = 0;
-    cache->hit_count = 0;
-    /*YOUR CODE HERE*/
-  cache->hit_count = 0;
-    /*YOUR CODE HERE*/
-  cache->setBits = CACHE_SET_BITS;
-  cache->linesPerSet = CACHE_LINES_PER_SET;
-  cache->blockBits = CACHE_BLOCK_BITS;
-  cache->lfu = CACHE_LFU;
+  cacheSetUpGeometry(cache, name, CACHE_SET_BITS, CACHE_LINES_PER_SET, CACHE_BLOCK_BITS);
+}
+
+bool cacheGeometryValid(int setBits, int linesPerSet, int blockBits) {
+  return setBits >= 0 && setBits <= CACHE_MAX_SET_BITS && linesPerSet >= 1 &&
+         blockBits >= CACHE_MIN_BLOCK_BITS && blockBits <= CACHE_MAX_BLOCK_BITS;
+}
+
+// Returns false, allocating nothing, if the geometry is out of range
+bool cacheSetUpGeometry(Cache *cache, char *name, int setBits, int linesPerSet, int blockBits) {
+  if (!cacheGeometryValid(setBits, linesPerSet, blockBits)) {
+    return false;
+  }
+  cache->setBits = setBits;
+  cache->linesPerSet = linesPerSet;
+  cache->blockBits = blockBits;
+  cache->policy = CACHE_REPL_POLICY;
   cache->displayTrace = CACHE_DISPLAY_TRACE;
   // Allocate memory for the sets array
   cache->sets = (Set *)malloc((1 << cache->setBits) * sizeof(Set));
@@ -125,6 +124,8 @@ void cacheSetUp(Cache *cache, char *name) {
     // Initialize each line in the set
     for (int j = 0; j < cache->linesPerSet; j++) {
       cache->sets[i].lines[j].valid = false;
+      cache->sets[i].lines[j].dirty = false;
+      cache->sets[i].lines[j].mesi = 0;
       cache->sets[i].lines[j].lru_clock = 0;
       cache->sets[i].lines[j].access_counter = 0;
       cache->sets[i].lines[j].block_addr = 0;
@@ -132,15 +133,27 @@ void cacheSetUp(Cache *cache, char *name) {
     // Initialize the global lru_clock for the set
     cache->sets[i].lru_clock = 0;
   }
+  // Allocate the per-set replacement state
+  repl_init(cache);
   // Set the cache name
   cache->name = strdup(name);
+  cache->addr_trace = NULL;
+  cache->dram = NULL;
+  cache->clock = NULL;
+  cache->classify = NULL;
+  cache->access_pc = 0;
+  // Blocking until MSHRs are configured
+  mshr_init(&cache->mshrs, 0);
   // Initialize cache statistics
   cache->hit_count = 0;
   cache->miss_count = 0;
   cache->eviction_count = 0;
+  return true;
 }
 
 void deallocate(Cache *cache) {
+  repl_free(cache);
+  mshr_free(&cache->mshrs);
   for (int i = 0; i < (1 << cache->setBits); i++) {
     free(cache->sets[i].lines);
   }
@@ -168,6 +181,14 @@ result operateCache(const unsigned long long address, Cache *cache) {
     else {
       // No empty line found
       unsigned long long victim_block_addr = victim_cacheline(address, cache);
+      r.victim_dirty = false;
+      Set *set = &cache->sets[cache_set(address, cache)];
+      for (int i = 0; i < cache->linesPerSet; i++) {
+        if (set->lines[i].block_addr == victim_block_addr) {
+          r.victim_dirty = set->lines[i].dirty;
+          break;
+        }
+      }
       replace_cacheline(victim_block_addr, address, cache);
       r.status = CACHE_EVICT;
       r.victim_block_addr = victim_block_addr;
@@ -176,6 +197,9 @@ result operateCache(const unsigned long long address, Cache *cache) {
       cache->eviction_count += 1;
     }
   }
+  if (cache->classify != NULL) {
+    mc_record(cache->classify, address, r.status, cache->access_pc);
+  }
   #ifdef PRINT_CACHE_TRACES 
   if (r.status == CACHE_HIT) {
   printf(CACHE_HIT_FORMAT, address); 
@@ -188,12 +212,24 @@ result operateCache(const unsigned long long address, Cache *cache) {
   return r;
 }
 
-int processCacheOperation(unsigned long address, Cache *cache) {
+// Latency of one access starting at cycle `now`
+static int cache_access(unsigned long address, Cache *cache, uint64_t now) {
   result r;
+  if (cache->addr_trace != NULL) {
+    sd_trace_record(cache->addr_trace, address);
+  }
   r = operateCache(address, cache);
 
   if (r.status == CACHE_HIT) {
     return CACHE_HIT_LATENCY;
+  } else if (cache->dram != NULL) {
+    // The fill request leaves after the tag check, a dirty victim is posted
+    // to the DRAM write queue and does not hold up the fill
+    if (r.status == CACHE_EVICT && r.victim_dirty) {
+      dram_write(cache->dram, r.victim_block_addr, cache->blockBits, now);
+    }
+    uint64_t issue = now + CACHE_HIT_LATENCY;
+    return CACHE_HIT_LATENCY + (int)(dram_read(cache->dram, address, cache->blockBits, issue) - issue);
   } else if (r.status == CACHE_MISS)
   {
     return CACHE_MISS_LATENCY;
@@ -203,3 +239,44 @@ int processCacheOperation(unsigned long address, Cache *cache) {
     return CACHE_OTHER_LATENCY;
   }
 }
+
+int processCacheOperation(unsigned long address, Cache *cache) {
+  return cache_access(address, cache, cache->clock != NULL ? *cache->clock : 0);
+}
+
+/*
+Non-blocking access through the cache's MSHRs. Hits are served under any
+outstanding misses, a miss to a block that is already being filled merges
+into its MSHR, and only a primary miss with every MSHR busy waits (the
+wait is returned through `stall`). Returns the cycle the data is ready.
+*/
+uint64_t processCacheOperationNonBlocking(unsigned long address, Cache *cache, uint64_t now, uint64_t *stall) {
+  unsigned long long block_addr = address_to_block(address, cache);
+  *stall = 0;
+  mshr_retire(&cache->mshrs, now);
+  mshr_entry_t *pending = mshr_lookup(&cache->mshrs, block_addr);
+  int latency = cache_access(address, cache, now);
+
+  if (pending != NULL) {
+    // Secondary miss: the line is already allocated, wait for its fill
+    cache->mshrs.secondary_misses++;
+    pending->targets++;
+    return pending->ready_cycle;
+  }
+  if (latency == CACHE_HIT_LATENCY) {
+    return now + CACHE_HIT_LATENCY - 1;
+  }
+
+  // Primary miss
+  cache->mshrs.primary_misses++;
+  if (mshr_allocate(&cache->mshrs, block_addr, now + latency - 1) == NULL) {
+    uint64_t earliest = mshr_earliest_ready(&cache->mshrs);
+    cache->mshrs.full_stalls++;
+    cache->mshrs.full_stall_cycles += earliest - now;
+    *stall = earliest - now;
+    now = earliest;
+    mshr_retire(&cache->mshrs, now);
+    mshr_allocate(&cache->mshrs, block_addr, now + latency - 1);
+  }
+  return now + latency - 1;
+}
@@ -12,12 +12,28 @@
 #include <stdio.h>
 #include "utils.h"
 #include "config.h"
+#include "mshr.h"
+#include "dram.h"
+#include "missclass.h"
 enum status_enum {
   CACHE_MISS = 0,
   CACHE_HIT = 1,
   CACHE_EVICT = 2
 };
 
+// Replacement policies, selectable per cache (see replacement.c)
+typedef enum {
+  REPL_LRU = 0,
+  REPL_LFU,
+  REPL_FIFO,
+  REPL_RANDOM,
+  REPL_PLRU,   // tree pseudo-LRU
+  REPL_SRRIP,  // static re-reference interval prediction
+  REPL_BRRIP,  // bimodal RRIP
+  REPL_DRRIP,  // dynamic RRIP (set dueling between SRRIP and BRRIP)
+  REPL_POLICY_COUNT
+} repl_policy_t;
+
 #define CACHE_HIT_LATENCY 2    // hit latency
 #define CACHE_MISS_LATENCY MEM_LATENCY+CACHE_HIT_LATENCY  // miss latency
 #define CACHE_OTHER_LATENCY MEM_LATENCY+CACHE_HIT_LATENCY // eviction latency
@@ -27,13 +43,25 @@ enum status_enum {
 #define CACHE_LINES_PER_SET 4 // Number of lines per set (associativity)
 #define CACHE_BLOCK_BITS 6 // number of blocks (2^CACHE_BLOCK_BITS)
 #define CACHE_DISPLAY_TRACE false
-#define CACHE_LFU 1 // LRU
+#define CACHE_LFU 1 // LFU (0 = LRU)
+#define CACHE_REPL_POLICY (CACHE_LFU ? REPL_LFU : REPL_LRU) // default policy, override with -R
+#define CACHE_REPL_SEED 0x2545F491 // seed for random replacement
+#define CACHE_MAX_SET_BITS 20
+#define CACHE_MIN_BLOCK_BITS 2     // a block holds at least one instruction
+#define CACHE_MAX_BLOCK_BITS 12
+
+//instruction cache size (default 4, 2, 6 respectively = 2048 bytes), override with -I<sets>:<ways>:<block>
+#define ICACHE_SET_BITS 4
+#define ICACHE_LINES_PER_SET 2
+#define ICACHE_BLOCK_BITS 6
 
 // Struct definitions
 typedef struct {
     bool valid;
     unsigned long long tag;
     unsigned long long block_addr;
+    bool dirty;          // written since the fill, needs a writeback on eviction
+    uint8_t mesi;        // coherence state of a hart's L1 line (-N), see coherence.h
     int lru_clock;
     int access_counter;
 } Line;
@@ -41,6 +69,9 @@ typedef struct {
 typedef struct {
     Line *lines;
     int lru_clock;
+    uint64_t plru_bits;  // tree-PLRU node bits (PLRU only)
+    uint8_t *rrpv;       // per-way re-reference prediction values (RRIP only)
+    uint16_t fifo_next;  // next way to replace (FIFO only)
 } Set;
 
 typedef struct {
@@ -48,31 +79,45 @@ typedef struct {
     int hit_count;
     int miss_count;
     int eviction_count;
-    int lfu;
+    repl_policy_t policy;
+    uint32_t rng_state;  // random replacement state
+    int psel;            // DRRIP policy selector
+    uint32_t fill_count; // BRRIP long-insertion throttle
     bool displayTrace;
     int setBits;
     int linesPerSet;
     int blockBits;
     char *name;
+    FILE *addr_trace;    // records accessed addresses for stack distance analysis (-W)
+    mshr_file_t mshrs;   // outstanding misses (non-blocking mode only, -M)
+    dram_t *dram;        // miss latency from the DRAM model (-D), MEM_LATENCY if NULL
+    const uint64_t *clock; // current cycle, needed by the DRAM model
+    missclass_t *classify; // three-C miss classification (-C), NULL if off
+    uint32_t access_pc;    // PC of the instruction making the access, for per-PC attribution
 } Cache;
 
 typedef struct {
     int status;
     unsigned long long insert_block_addr;
     unsigned long long victim_block_addr;
+    bool victim_dirty;
 } result;
 
 // Function declarations
 void cacheSetUp(Cache *cache, char *name);
+bool cacheGeometryValid(int setBits, int linesPerSet, int blockBits);
+bool cacheSetUpGeometry(Cache *cache, char *name, int setBits, int linesPerSet, int blockBits);
 void deallocate(Cache *cache);
 result operateCache(const unsigned long long address, Cache *cache);
 int processCacheOperation(unsigned long address, Cache *cache);
+uint64_t processCacheOperationNonBlocking(unsigned long address, Cache *cache, uint64_t now, uint64_t *stall);
 unsigned long long address_to_block(const unsigned long long address, const Cache *cache);
 unsigned long long cache_tag(const unsigned long long address, const Cache *cache);
 unsigned long long cache_set(const unsigned long long address, const Cache *cache);
 bool probe_cache(const unsigned long long address, const Cache *cache);
 void hit_cacheline(const unsigned long long address, Cache *cache);
 bool insert_cacheline(const unsigned long long address, Cache *cache);
-unsigned long long victim_cacheline(const unsigned long long address, const Cache *cache);
+unsigned long long victim_cacheline(const unsigned long long address, Cache *cache);
+void dirty_cacheline(const unsigned long long address, Cache *cache);
 void replace_cacheline(const unsigned long long victim_block_addr, const unsigned long long insert_addr, Cache *cache);
 #endif // CACHE_H
@@ -0,0 +1,146 @@
+#include "coherence.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void mesi_init(mesi_t *mesi, int harts) {
+  memset(mesi, 0, sizeof(*mesi));
+  mesi->harts = harts;
+  for (int h = 0; h < harts; h++) {
+    char name[16];
+    snprintf(name, sizeof(name), "L1D%d", h);
+    cacheSetUpGeometry(&mesi->l1[h], name, MESI_L1_SET_BITS, MESI_L1_WAYS, CACHE_BLOCK_BITS);
+  }
+  cacheSetUpGeometry(&mesi->l2, "L2", MESI_L2_SET_BITS, MESI_L2_WAYS, CACHE_BLOCK_BITS);
+}
+
+void mesi_free(mesi_t *mesi) {
+  for (int h = 0; h < mesi->harts; h++) {
+    deallocate(&mesi->l1[h]);
+    free(mesi->l1[h].name);
+  }
+  deallocate(&mesi->l2);
+  free(mesi->l2.name);
+}
+
+unsigned long long mesi_block(const mesi_t *mesi, uint32_t addr) {
+  return address_to_block(addr, &mesi->l1[0]);
+}
+
+// The valid line holding `addr`, NULL if the cache does not have it
+static Line *find_line(Cache *cache, uint32_t addr) {
+  Set *set = &cache->sets[cache_set(addr, cache)];
+  for (int i = 0; i < cache->linesPerSet; i++) {
+    if (set->lines[i].valid && set->lines[i].tag == cache_tag(addr, cache)) {
+      return &set->lines[i];
+    }
+  }
+  return NULL;
+}
+
+// A dirty line goes back to the L2
+static void write_back(mesi_t *mesi, unsigned long long block_addr) {
+  operateCache(block_addr, &mesi->l2);
+  dirty_cacheline(block_addr, &mesi->l2);
+  mesi->writebacks++;
+}
+
+/*
+Snoop every other L1 for `addr`. A write invalidates all copies, a read
+demotes a Modified or Exclusive copy to Shared. Returns true if another L1
+supplied the line (it had it Modified or Exclusive), sets *shared if a copy
+is left in another L1.
+*/
+static bool snoop(mesi_t *mesi, int hart, uint32_t addr, bool write, bool *shared) {
+  bool supplied = false;
+  *shared = false;
+  for (int h = 0; h < mesi->harts; h++) {
+    Line *line = h == hart ? NULL : find_line(&mesi->l1[h], addr);
+    if (line == NULL) {
+      continue;
+    }
+    if (line->mesi == MESI_MODIFIED || line->mesi == MESI_EXCLUSIVE) {
+      supplied = true;
+      mesi->stats[h].supplied++;
+    }
+    if (line->mesi == MESI_MODIFIED) {
+      write_back(mesi, line->block_addr);
+      line->dirty = false;
+    }
+    if (write) {
+      line->valid = false;
+      line->mesi = MESI_INVALID;
+      mesi->stats[h].invalidated++;
+    } else {
+      line->mesi = MESI_SHARED;
+      *shared = true;
+    }
+  }
+  return supplied;
+}
+
+// One load (or store/AMO when `write`) by `hart`, returns its stall cycles
+uint64_t mesi_access(mesi_t *mesi, int hart, uint32_t addr, bool write) {
+  Cache *l1 = &mesi->l1[hart];
+  mesi_hart_stats_t *stats = &mesi->stats[hart];
+  Line *line = find_line(l1, addr);
+  uint64_t latency = 0;
+
+  if (line != NULL && (!write || line->mesi != MESI_SHARED)) {
+    stats->hits++;
+    operateCache(addr, l1);
+  } else if (line != NULL) {
+    // write to a Shared line: invalidate the other copies, no data needed
+    bool shared;
+    snoop(mesi, hart, addr, true, &shared);
+    mesi->bus_upgrades++;
+    stats->upgrades++;
+    operateCache(addr, l1);
+    latency = MESI_BUS_LATENCY;
+  } else {
+    stats->misses++;
+    bool shared;
+    if (write) {
+      mesi->bus_read_excl++;
+    } else {
+      mesi->bus_reads++;
+    }
+    if (snoop(mesi, hart, addr, write, &shared)) {
+      mesi->transfers++;
+      latency = MESI_C2C_LATENCY;
+    } else {
+      result r = operateCache(addr, &mesi->l2);
+      latency = MESI_L2_LATENCY + (r.status == CACHE_HIT ? 0 : MESI_MEM_LATENCY);
+    }
+    result r = operateCache(addr, l1);
+    if (r.status == CACHE_EVICT && r.victim_dirty) {
+      write_back(mesi, r.victim_block_addr);
+    }
+    line = find_line(l1, addr);
+    line->mesi = shared ? MESI_SHARED : MESI_EXCLUSIVE;
+  }
+
+  if (write) {
+    line->mesi = MESI_MODIFIED;
+    line->dirty = true;
+  }
+  stats->stall_cycles += latency;
+  return latency;
+}
+
+void mesi_print_stats(mesi_t *mesi) {
+  printf("#MESI bus reads    = %5lu\n", (unsigned long)mesi->bus_reads);
+  printf("#MESI bus readx    = %5lu\n", (unsigned long)mesi->bus_read_excl);
+  printf("#MESI upgrades     = %5lu\n", (unsigned long)mesi->bus_upgrades);
+  printf("#MESI transfers    = %5lu (cache to cache)\n", (unsigned long)mesi->transfers);
+  printf("#MESI writebacks   = %5lu\n", (unsigned long)mesi->writebacks);
+  printf("#L2 accesses       = %5d\n", mesi->l2.hit_count + mesi->l2.miss_count);
+  printf("#L2 misses         = %5d\n", mesi->l2.miss_count);
+  for (int h = 0; h < mesi->harts; h++) {
+    mesi_hart_stats_t *stats = &mesi->stats[h];
+    printf("#L1D%-2d hits %lu, misses %lu, upgrades %lu, invalidated %lu, supplied %lu, stalls %lu\n", h,
+           (unsigned long)stats->hits, (unsigned long)stats->misses, (unsigned long)stats->upgrades,
+           (unsigned long)stats->invalidated, (unsigned long)stats->supplied,
+           (unsigned long)stats->stall_cycles);
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cache.h"
+
+// MESI snooping coherence between the harts' private L1 data caches (-N).
+// Every L1 miss, and every write to a line held Shared, goes on a bus that
+// all other L1s snoop: a read finds the line Modified or Exclusive in
+// another L1, which supplies it and keeps it Shared (writing it back if
+// Modified), or reads it from the shared L2 (or memory behind it) and gets
+// it Exclusive if nobody else has it. A write invalidates every other copy.
+// Dirty victims are written back to the L2.
+
+#define MESI_MAX_HARTS 16
+#define MESI_L1_SET_BITS 4       // 16 sets x 4 ways x 64 bytes = 4K per hart
+#define MESI_L1_WAYS 4
+#define MESI_L2_SET_BITS 8       // 256 sets x 8 ways x 64 bytes = 128K shared
+#define MESI_L2_WAYS 8
+#define MESI_BUS_LATENCY 4       // a snoop round: upgrade or invalidation
+#define MESI_C2C_LATENCY 16      // line supplied by another L1
+#define MESI_L2_LATENCY 12       // line supplied by the L2
+#define MESI_MEM_LATENCY 100     // L2 miss
+
+enum mesi_state_enum {
+  MESI_INVALID = 0,
+  MESI_SHARED,
+  MESI_EXCLUSIVE,
+  MESI_MODIFIED
+};
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t upgrades;         // writes to a Shared line
+    uint64_t invalidated;      // lines this L1 lost to another hart's write
+    uint64_t supplied;         // lines this L1 sent to another hart
+    uint64_t stall_cycles;
+} mesi_hart_stats_t;
+
+typedef struct {
+    int harts;
+    Cache l1[MESI_MAX_HARTS];
+    Cache l2;
+    mesi_hart_stats_t stats[MESI_MAX_HARTS];
+    uint64_t bus_reads;        // BusRd
+    uint64_t bus_read_excl;    // BusRdX
+    uint64_t bus_upgrades;     // BusUpgr
+    uint64_t transfers;        // cache-to-cache
+    uint64_t writebacks;       // dirty lines written to the L2
+} mesi_t;
+
+// Function declarations
+void mesi_init(mesi_t *mesi, int harts);
+uint64_t mesi_access(mesi_t *mesi, int hart, uint32_t addr, bool write);
+unsigned long long mesi_block(const mesi_t *mesi, uint32_t addr);
+void mesi_print_stats(mesi_t *mesi);
+void mesi_free(mesi_t *mesi);
+#endif // COHERENCE_H
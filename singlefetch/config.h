@@ -1,6 +1,38 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
+#ifdef BENCH_CONFIG
+// benchmark build (make riscv-bench, used by bench_run.py): stats, no traces
+#define PRINT_STATS
+#define MEM_LATENCY 100
+#define CACHE_ENABLE
+#define PRINT_CACHE_STATS
+#elif defined(MS1_CONFIG)
+// regression builds (make regress, used by simregress): one per milestone
+// test script, with the macros its test below asks for
+#define DEBUG_REG_TRACE
+#define DEBUG_CYCLE
+#define MEM_LATENCY 0
+#elif defined(MS2_CONFIG)
+#define DEBUG_REG_TRACE
+#define DEBUG_CYCLE
+#define PRINT_STATS
+#define MEM_LATENCY 0
+#elif defined(MS3_CONFIG)
+#define DEBUG_REG_TRACE
+#define DEBUG_CYCLE
+#define PRINT_STATS
+#define MEM_LATENCY 100
+#define CACHE_ENABLE
+#define PRINT_CACHE_TRACES
+#define PRINT_CACHE_STATS
+#elif defined(FUZZ_CONFIG)
+// differential fuzzer (make simfuzz): forwarding and hazard detection, no
+// cache, so the pipeline runs without a D-cache and nothing is printed
+#define PRINT_STATS
+#define MEM_LATENCY 0
+#else
+
 // For each test, uncomment all its macros, and disable all other macros.
 
 // required for MS1 (test_simulator_ms1.sh)
@@ -28,4 +60,6 @@
 //#define PRINT_CACHE_TRACES      // prints cache trace for each memory access 
 //#define PRINT_CACHE_STATS	// prints the cache stats at the end of program
 
+#endif // BENCH_CONFIG
+
 #endif // __CONFIG_H__
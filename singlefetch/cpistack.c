@@ -0,0 +1,38 @@
+#include "cpistack.h"
+#include <stdio.h>
+
+cpi_stack_t cpi_stack = {0};
+
+static const char *cpi_bucket_names[CPI_BUCKETS] = {
+  "Retire dual", "Retire single", "Dual structural", "Dual data",
+  "Load-use stall", "Branch flush", "Cache miss", "Functional unit", "Frontend"
+};
+
+void cpi_charge(int bucket, uint64_t cycles) {
+  cpi_stack.cycles[bucket] += cycles;
+  cpi_stack.attributed += cycles;
+}
+
+void cpi_begin_cycle(uint64_t now) {
+  cpi_stack.cycle_start = now;
+  cpi_stack.attributed = 0;
+}
+
+// Charge the cycles no stall claimed to `bucket`
+void cpi_end_cycle(int bucket, uint64_t now) {
+  uint64_t elapsed = now - cpi_stack.cycle_start;
+  if (elapsed > cpi_stack.attributed) {
+    cpi_stack.cycles[bucket] += elapsed - cpi_stack.attributed;
+  }
+}
+
+void cpi_print_stats(uint64_t total_cycles, uint64_t instructions) {
+  printf("#Instructions      = %5lu\n", (unsigned long)instructions);
+  printf("#CPI               = %8.3f\n", instructions ? (double)total_cycles / instructions : 0.0);
+  for (int b = 0; b < CPI_BUCKETS; b++) {
+    double share = total_cycles ? (double)cpi_stack.cycles[b] / total_cycles : 0.0;
+    double cpi = instructions ? (double)cpi_stack.cycles[b] / instructions : 0.0;
+    printf("#  %-16s= %5lu (%5.1f%%, CPI %.3f)\n", cpi_bucket_names[b],
+           (unsigned long)cpi_stack.cycles[b], 100.0 * share, cpi);
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef CPISTACK_H
+#define CPISTACK_H
+
+#include <stdint.h>
+
+// CPI stack: every cycle of the pipeline lands in exactly one bucket, so the
+// buckets add up to the total cycle count. Cycles a stall adds on top of the
+// pipeline clock (cache misses, load waits, I-cache fills) are charged where
+// they happen; the pipeline cycle itself is classified by what writeback
+// saw: one or two retiring instructions, or the reason for the bubble.
+
+enum cpi_bucket_enum {
+  CPI_RETIRE_DUAL = 0,    // two instructions retired
+  CPI_RETIRE_SINGLE,      // one retired, nothing to pair it with
+  CPI_DUAL_STRUCTURAL,    // one retired, pair needed the same unit
+  CPI_DUAL_DATA,          // one retired, second depended on the first
+  CPI_LOAD_USE,           // bubble from a detect_hazard stall
+  CPI_BRANCH_FLUSH,       // bubble or lost slot from a taken branch
+  CPI_CACHE_MISS,         // D-cache miss and pending load wait cycles
+  CPI_FUNCTIONAL_UNIT,    // waits for a multi-cycle unit or its result (-U)
+  CPI_FRONTEND,           // empty pipeline and I-cache fill cycles
+  CPI_BUCKETS
+};
+
+typedef struct {
+    uint64_t cycles[CPI_BUCKETS];
+    uint64_t cycle_start;
+    uint64_t attributed;  // stall cycles already charged in this cycle
+} cpi_stack_t;
+
+extern cpi_stack_t cpi_stack;
+
+// Function declarations
+void cpi_charge(int bucket, uint64_t cycles);
+void cpi_begin_cycle(uint64_t now);
+void cpi_end_cycle(int bucket, uint64_t now);
+void cpi_print_stats(uint64_t total_cycles, uint64_t instructions);
+#endif // CPISTACK_H
@@ -0,0 +1,83 @@
+#include "csr.h"
+#include <stddef.h>
+
+csr_file_t csr_file = {0};
+
+void csr_bind(int counter, const uint64_t *source) {
+  csr_file.source[counter] = source;
+  csr_file.offset[counter] = 0;
+}
+
+static uint64_t counter_value(int counter) {
+  const uint64_t *source = csr_file.source[counter];
+  return (source != NULL ? *source : 0) + csr_file.offset[counter];
+}
+
+bool csr_read(uint32_t csr, uint32_t *value) {
+  if (csr >= CSR_CYCLE && csr < CSR_CYCLE + CSR_COUNTERS) {
+    *value = (uint32_t)counter_value(csr - CSR_CYCLE);
+  } else if (csr >= CSR_CYCLEH && csr < CSR_CYCLEH + CSR_COUNTERS) {
+    *value = (uint32_t)(counter_value(csr - CSR_CYCLEH) >> 32);
+  } else if (csr >= CSR_MCYCLE && csr < CSR_MCYCLE + CSR_COUNTERS && csr != CSR_MCYCLE + CSR_COUNTER_TIME) {
+    *value = (uint32_t)counter_value(csr - CSR_MCYCLE);
+  } else if (csr >= CSR_MCYCLEH && csr < CSR_MCYCLEH + CSR_COUNTERS && csr != CSR_MCYCLEH + CSR_COUNTER_TIME) {
+    *value = (uint32_t)(counter_value(csr - CSR_MCYCLEH) >> 32);
+  } else if (csr == CSR_MSCRATCH) {
+    *value = csr_file.mscratch;
+  } else if (csr == CSR_MHARTID) {
+    *value = csr_file.mhartid;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool csr_write(uint32_t csr, uint32_t value) {
+  // csr[11:10] == 3 marks the read-only CSRs
+  if ((csr >> 10) == 0x3) {
+    return false;
+  }
+  if (csr >= CSR_MCYCLE && csr < CSR_MCYCLE + CSR_COUNTERS && csr != CSR_MCYCLE + CSR_COUNTER_TIME) {
+    int counter = csr - CSR_MCYCLE;
+    uint64_t current = counter_value(counter);
+    csr_file.offset[counter] += ((current & ~0xFFFFFFFFULL) | value) - current;
+  } else if (csr >= CSR_MCYCLEH && csr < CSR_MCYCLEH + CSR_COUNTERS && csr != CSR_MCYCLEH + CSR_COUNTER_TIME) {
+    int counter = csr - CSR_MCYCLEH;
+    uint64_t current = counter_value(counter);
+    csr_file.offset[counter] += (((uint64_t)value << 32) | (current & 0xFFFFFFFFULL)) - current;
+  } else if (csr == CSR_MSCRATCH) {
+    csr_file.mscratch = value;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+Executes csrrw/csrrs/csrrc and their immediate forms. `rs1_val` is the
+value of rs1 for the register forms (the immediate forms use the rs1 field
+itself). The previous CSR value goes to `old_value`; returns false for an
+illegal access.
+*/
+bool csr_execute(Instruction instruction, uint32_t rs1_val, uint32_t *old_value) {
+  uint32_t csr = instruction.itype.imm;
+  uint32_t funct3 = instruction.itype.funct3;
+  uint32_t operand = (funct3 & 0x4) ? instruction.itype.rs1 : rs1_val;
+  uint32_t value = 0;
+
+  if (!csr_read(csr, &value)) {
+    return false;
+  }
+  *old_value = value;
+
+  switch (funct3 & 0x3) {
+    case 0x1: // csrrw(i)
+      return csr_write(csr, operand);
+    case 0x2: // csrrs(i), no write when the source is x0 / zero
+      return instruction.itype.rs1 == 0 || csr_write(csr, value | operand);
+    case 0x3: // csrrc(i)
+      return instruction.itype.rs1 == 0 || csr_write(csr, value & ~operand);
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+
+// Zicsr control and status registers. The counter CSRs are views of the
+// simulator's own statistics, so a program can time itself with rdcycle /
+// rdinstret or read cache behaviour from the hpm counters.
+
+// counter CSRs, counter n lives at base + n (n = 0..31)
+#define CSR_CYCLE 0xC00         // user read-only shadows
+#define CSR_CYCLEH 0xC80
+#define CSR_MCYCLE 0xB00        // machine counters, writable
+#define CSR_MCYCLEH 0xB80
+#define CSR_MSCRATCH 0x340
+#define CSR_MHARTID 0xF14
+
+#define CSR_COUNTERS 32
+#define CSR_COUNTER_CYCLE 0
+#define CSR_COUNTER_TIME 1      // no real-time clock, counts cycles
+#define CSR_COUNTER_INSTRET 2
+
+// events behind mhpmcounter3.. (hpmcounter3..)
+#define CSR_HPM_DCACHE_HITS 3
+#define CSR_HPM_DCACHE_MISSES 4
+#define CSR_HPM_HAZARD_STALLS 5
+#define CSR_HPM_MEM_STALLS 6
+#define CSR_HPM_BRANCHES_TAKEN 7
+#define CSR_HPM_FETCH_STALLS 8
+#define CSR_HPM_LOAD_WAIT_STALLS 9
+#define CSR_HPM_FU_STALLS 10
+
+typedef struct {
+    const uint64_t *source[CSR_COUNTERS]; // live value behind each counter, NULL reads as zero
+    uint64_t offset[CSR_COUNTERS];        // applied by writes to the machine counters
+    uint32_t mscratch;
+    uint32_t mhartid;
+} csr_file_t;
+
+extern csr_file_t csr_file;
+
+// Function declarations
+void csr_bind(int counter, const uint64_t *source);
+bool csr_read(uint32_t csr, uint32_t *value);
+bool csr_write(uint32_t csr, uint32_t value);
+bool csr_execute(Instruction instruction, uint32_t rs1_val, uint32_t *old_value);
+#endif // CSR_H
@@ -1,7 +1,10 @@
+#include <stdarg.h>
 #include <stdio.h> // for stderr
 #include <stdlib.h> // for exit()
+#include <string.h>
 #include "types.h"
 #include "utils.h"
+#include "riscv.h"
 
 void print_rtype(char *, Instruction);
 void print_itype_except_load(char *, Instruction, int);
@@ -10,13 +13,55 @@ void print_store(char *, Instruction);
 void print_branch(char *, Instruction);
 void print_lui(Instruction);
 void print_jal(Instruction);
+void print_jalr(Instruction);
+void print_auipc(Instruction);
 void print_ecall(Instruction);
+void print_csr(Instruction);
+void print_amo(Instruction);
 void write_rtype(Instruction);
 void write_itype_except_load(Instruction); 
 void write_load(Instruction);
 void write_store(Instruction);
 void write_branch(Instruction);
 
+// decode_instruction prints to stdout, or into this buffer for disassemble()
+static char *disasm_buf = NULL;
+static size_t disasm_size = 0;
+static const char *disasm_prefix = ""; // "c." while printing a compressed instruction
+
+static void disasm_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (disasm_buf != NULL) {
+        int len = snprintf(disasm_buf, disasm_size, "%s", disasm_prefix);
+        vsnprintf(disasm_buf + len, disasm_size - len, format, args);
+    } else {
+        fputs(disasm_prefix, stdout);
+        vprintf(format, args);
+    }
+    va_end(args);
+}
+
+static void invalid_instruction(Instruction instruction) {
+    if (disasm_buf != NULL) {
+        disasm_printf("unknown\t0x%08x\n", instruction.bits);
+    } else {
+        handle_invalid_instruction(instruction);
+    }
+}
+
+// Disassemble into `buf` (without the trailing newline) instead of stdout
+void disassemble(uint32_t instruction_bits, char *buf, size_t size) {
+    buf[0] = '\0';
+    disasm_buf = buf;
+    disasm_size = size;
+    decode_instruction(instruction_bits);
+    disasm_buf = NULL;
+    size_t len = strlen(buf);
+    if (len > 0 && buf[len - 1] == '\n') {
+        buf[len - 1] = '\0';
+    }
+}
 
 void decode_instruction(uint32_t instruction_bits) {
     // silently return here, the reason to do this is because the pipeline
@@ -24,7 +69,19 @@ void decode_instruction(uint32_t instruction_bits) {
     // `parse_instruction` will fail.
     if(instruction_bits == 0)
     {
-        printf("\n");
+        disasm_printf("\n");
+        return;
+    }
+    // a compressed instruction prints as its expansion, marked with "c."
+    if (instruction_size(instruction_bits) == 2) {
+        uint32_t expanded = expand_compressed(instruction_bits & 0xFFFF);
+        if (expanded == 0) {
+            invalid_instruction(parse_instruction(instruction_bits & 0xFFFF));
+            return;
+        }
+        disasm_prefix = "c.";
+        decode_instruction(expanded);
+        disasm_prefix = "";
         return;
     }
     Instruction instruction = parse_instruction(instruction_bits);
@@ -50,11 +107,24 @@ void decode_instruction(uint32_t instruction_bits) {
         case 0x6F:
             print_jal(instruction);
             break;
+        case 0x67:
+            print_jalr(instruction);
+            break;
+        case 0x17:
+            print_auipc(instruction);
+            break;
         case 0x73:
-            print_ecall(instruction);
+            if (instruction.itype.funct3 == 0x0) {
+                print_ecall(instruction);
+            } else {
+                print_csr(instruction);
+            }
+            break;
+        case 0x2F:
+            print_amo(instruction);
             break;
         default: // undefined opcode
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;
     }
 }
@@ -73,7 +143,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("sub", instruction);
                     break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break;      
             }
             break;
@@ -86,7 +156,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("mulh", instruction);
                     break;  
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                     break;    
             }
             break; 
@@ -94,9 +164,24 @@ void write_rtype(Instruction instruction) {
 	    switch (instruction.rtype.funct7){
 		    case 0x00:
             print_rtype("slt", instruction);
+            break;
+		    case 0x01:
+            print_rtype("mulhsu", instruction);
+            break;
+		    default:
+	    invalid_instruction(instruction);
+	    break;
+	    } break;
+        case 0x3:
+	    switch (instruction.rtype.funct7){
+		    case 0x00:
+            print_rtype("sltu", instruction);
+            break;
+		    case 0x01:
+            print_rtype("mulhu", instruction);
             break;
 		    default:
-	    handle_invalid_instruction(instruction);
+	    invalid_instruction(instruction);
 	    break;
 	    } break;
         case 0x4:
@@ -108,7 +193,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("div", instruction);
                     break;  
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                     break;    
             }
             break;
@@ -116,12 +201,15 @@ void write_rtype(Instruction instruction) {
            switch (instruction.rtype.funct7) {
                 case 0x00:
 		            print_rtype("srl", instruction);
+                    break;
+		        case 0x01:
+                    print_rtype("divu", instruction);
                     break;
 		        case 0x20:
                     print_rtype("sra", instruction);
                     break;  
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break;    
             }
             break; 
@@ -134,7 +222,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("rem", instruction);
                     break;  
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break;    
             }
             break;
@@ -142,13 +230,16 @@ void write_rtype(Instruction instruction) {
 	    switch (instruction.rtype.funct7) {
 		    case 0x00:
             print_rtype("and", instruction);
+            break;
+		    case 0x01:
+            print_rtype("remu", instruction);
             break;
 		    default:
-	    handle_invalid_instruction(instruction);
+	    invalid_instruction(instruction);
 	   break;
 	    } break;
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
         break;
     }
 }
@@ -164,12 +255,15 @@ void write_itype_except_load(Instruction instruction) {
             print_itype_except_load("slli", instruction, instruction.itype.imm);
             break; 
 		    default:
-	    handle_invalid_instruction(instruction);
+	    invalid_instruction(instruction);
 	    break;
 	    } break;   
         case 0x2:
             print_itype_except_load("slti", instruction, instruction.itype.imm);
             break; 
+        case 0x3:
+            print_itype_except_load("sltiu", instruction, instruction.itype.imm);
+            break;
         case 0x4:
             print_itype_except_load("xori", instruction, instruction.itype.imm);
             break;
@@ -182,7 +276,7 @@ void write_itype_except_load(Instruction instruction) {
                     print_itype_except_load("srai", instruction, instruction.itype.imm);
                     break;  
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break;    
             }
             break;
@@ -193,7 +287,7 @@ void write_itype_except_load(Instruction instruction) {
             print_itype_except_load("andi", instruction, instruction.itype.imm);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;  
     }
 }
@@ -209,8 +303,14 @@ void write_load(Instruction instruction) {
         case 0x2:
             print_load("lw", instruction);
             break;
+        case 0x4:
+            print_load("lbu", instruction);
+            break;
+        case 0x5:
+            print_load("lhu", instruction);
+            break;
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;
     }
 }
@@ -227,7 +327,7 @@ void write_store(Instruction instruction) {
             print_store("sw", instruction);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;
     }
 }
@@ -240,46 +340,94 @@ void write_branch(Instruction instruction) {
         case 0x1:
             print_branch("bne", instruction);
             break;
+        case 0x4:
+            print_branch("blt", instruction);
+            break;
+        case 0x5:
+            print_branch("bge", instruction);
+            break;
+        case 0x6:
+            print_branch("bltu", instruction);
+            break;
+        case 0x7:
+            print_branch("bgeu", instruction);
+            break;
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;
     }
 }
 
 void print_rtype(char *name, Instruction instruction) {
-  printf(RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1, instruction.rtype.rs2);
+  disasm_printf(RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1, instruction.rtype.rs2);
 }
 
 void print_itype_except_load(char *name, Instruction instruction, int imm) {
 	if (instruction.itype.funct3 == 0x1 || instruction.itype.funct3 == 0x5) { // check for "slli", "srli", and "srai" and output imm[4:0]
-        printf(ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, (sign_extend_number(instruction.itype.imm, 12) & ((1U << 5) - 1)));
+        disasm_printf(ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, (sign_extend_number(instruction.itype.imm, 12) & ((1U << 5) - 1)));
         return;
 	} else { // other itype except load
-	    printf(ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, sign_extend_number(instruction.itype.imm, 12));
+	    disasm_printf(ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, sign_extend_number(instruction.itype.imm, 12));
 	    return;
 	}
 }
 
 void print_load(char *name, Instruction instruction) {
-  printf(MEM_FORMAT, name, instruction.itype.rd, sign_extend_number(instruction.itype.imm, 12), instruction.itype.rs1);
+  disasm_printf(MEM_FORMAT, name, instruction.itype.rd, sign_extend_number(instruction.itype.imm, 12), instruction.itype.rs1);
 }
 
 void print_store(char *name, Instruction instruction) {
-  printf(MEM_FORMAT, name, instruction.stype.rs2, get_store_offset(instruction), instruction.stype.rs1);
+  disasm_printf(MEM_FORMAT, name, instruction.stype.rs2, sign_extend_number(get_store_offset(instruction), 12), instruction.stype.rs1);
 }
 
 void print_branch(char *name, Instruction instruction) {
-  printf(BRANCH_FORMAT, name, instruction.sbtype.rs1, instruction.sbtype.rs2, sign_extend_number(get_branch_offset(instruction), 13));
+  disasm_printf(BRANCH_FORMAT, name, instruction.sbtype.rs1, instruction.sbtype.rs2, sign_extend_number(get_branch_offset(instruction), 13));
 }
 
 void print_lui(Instruction instruction) {
-  printf(LUI_FORMAT, instruction.utype.rd, instruction.utype.imm);
+  disasm_printf(LUI_FORMAT, instruction.utype.rd, instruction.utype.imm);
 }
 
 void print_jal(Instruction instruction) {
-  printf(JAL_FORMAT, instruction.ujtype.rd, sign_extend_number(get_jump_offset(instruction), 21));
+  disasm_printf(JAL_FORMAT, instruction.ujtype.rd, sign_extend_number(get_jump_offset(instruction), 21));
+}
+
+void print_jalr(Instruction instruction) {
+  disasm_printf(MEM_FORMAT, "jalr", instruction.itype.rd, sign_extend_number(instruction.itype.imm, 12), instruction.itype.rs1);
+}
+
+void print_auipc(Instruction instruction) {
+  disasm_printf(AUIPC_FORMAT, instruction.utype.rd, instruction.utype.imm);
 }
 
 void print_ecall(Instruction instruction) {
-  printf(ECALL_FORMAT);
+  disasm_printf(ECALL_FORMAT);
+}
+
+void print_csr(Instruction instruction) {
+  static const char *names[8] = {NULL, "csrrw", "csrrs", "csrrc", NULL, "csrrwi", "csrrsi", "csrrci"};
+  const char *name = names[instruction.itype.funct3];
+  if (name == NULL) {
+    invalid_instruction(instruction);
+  } else if (instruction.itype.funct3 & 0x4) {
+    disasm_printf(CSRI_FORMAT, name, instruction.itype.rd, instruction.itype.imm, instruction.itype.rs1);
+  } else {
+    disasm_printf(CSR_FORMAT, name, instruction.itype.rd, instruction.itype.imm, instruction.itype.rs1);
+  }
+}
+
+void print_amo(Instruction instruction) {
+  static const char *names[32] = {
+    [0x00] = "amoadd.w", [0x01] = "amoswap.w", [0x02] = "lr.w", [0x03] = "sc.w",
+    [0x04] = "amoxor.w", [0x08] = "amoor.w", [0x0C] = "amoand.w", [0x10] = "amomin.w",
+    [0x14] = "amomax.w", [0x18] = "amominu.w", [0x1C] = "amomaxu.w"
+  };
+  const char *name = names[instruction.rtype.funct7 >> 2];
+  if (name == NULL || instruction.rtype.funct3 != 0x2) {
+    invalid_instruction(instruction);
+  } else if ((instruction.rtype.funct7 >> 2) == 0x02) {
+    disasm_printf(LR_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1);
+  } else {
+    disasm_printf(AMO_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs2, instruction.rtype.rs1);
+  }
 }
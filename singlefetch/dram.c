@@ -0,0 +1,207 @@
+#include "dram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  int channel;
+  dram_bank_t *bank;
+  uint32_t row;
+} dram_loc_t;
+
+static uint64_t max_cycle(uint64_t a, uint64_t b) {
+  return a > b ? a : b;
+}
+
+// Parse "-D [open|closed][:channels:ranks:banks]"
+bool dram_configure(dram_t *dram, const char *spec) {
+  dram_page_policy_t page_policy = DRAM_OPEN_PAGE;
+  int channels = DRAM_CHANNELS, ranks = DRAM_RANKS, banks = DRAM_BANKS;
+  if (spec != NULL) {
+    const char *geometry = strchr(spec, ':');
+    size_t len = geometry ? (size_t)(geometry - spec) : strlen(spec);
+    if (len == 6 && strncmp(spec, "closed", len) == 0) {
+      page_policy = DRAM_CLOSED_PAGE;
+    } else if (len != 0 && !(len == 4 && strncmp(spec, "open", len) == 0)) {
+      return false;
+    }
+    if (geometry && (sscanf(geometry, ":%d:%d:%d", &channels, &ranks, &banks) != 3 ||
+                     channels < 1 || ranks < 1 || banks < 1)) {
+      return false;
+    }
+  }
+  dram_init(dram, page_policy, channels, ranks, banks);
+  return true;
+}
+
+void dram_init(dram_t *dram, dram_page_policy_t page_policy, int channels, int ranks, int banks) {
+  memset(dram, 0, sizeof(*dram));
+  dram->channels = channels;
+  dram->ranks = ranks;
+  dram->banks = banks;
+  dram->page_policy = page_policy;
+  dram->bank_state = calloc(channels * ranks * banks, sizeof(dram_bank_t));
+  dram->bus_free_cycle = calloc(channels, sizeof(uint64_t));
+}
+
+void dram_free(dram_t *dram) {
+  free(dram->bank_state);
+  free(dram->bus_free_cycle);
+  dram->bank_state = NULL;
+  dram->bus_free_cycle = NULL;
+}
+
+// Address mapping row:rank:bank:channel:column, so consecutive blocks stay
+// in the same open row and neighbouring rows spread over channels and banks
+static dram_loc_t dram_map(dram_t *dram, unsigned long long address) {
+  dram_loc_t loc;
+  unsigned long long idx = address >> DRAM_COLUMN_BITS;
+  loc.channel = idx % dram->channels;
+  idx /= dram->channels;
+  int bank = idx % dram->banks;
+  idx /= dram->banks;
+  int rank = idx % dram->ranks;
+  idx /= dram->ranks;
+  loc.row = (uint32_t)idx;
+  loc.bank = &dram->bank_state[(loc.channel * dram->ranks + rank) * dram->banks + bank];
+  return loc;
+}
+
+static bool dram_row_hit(dram_t *dram, unsigned long long address) {
+  dram_loc_t loc = dram_map(dram, address);
+  return loc.bank->row_open && loc.bank->open_row == loc.row;
+}
+
+/*
+Issue one block transfer no earlier than `start`. Returns the cycle the
+last beat leaves the bus and sets `first_beat` to the cycle the first one
+arrives. Bank and bus state is only updated when `commit` is set, which
+lets the scheduler ask whether a write would fit into idle time.
+*/
+static uint64_t dram_issue(dram_t *dram, unsigned long long address, int blockBits,
+                           uint64_t start, bool commit, uint64_t *first_beat) {
+  dram_loc_t loc = dram_map(dram, address);
+  dram_bank_t bank = *loc.bank;
+  uint64_t t = max_cycle(start, bank.ready_cycle);
+
+  if (bank.row_open && bank.open_row == loc.row) {
+    if (commit) dram->row_hits++;
+  } else {
+    if (bank.row_open) {
+      // close the other row first, but not before it has been open for tRAS
+      t = max_cycle(t, bank.activate_cycle + DRAM_T_RAS) + DRAM_T_RP;
+      if (commit) dram->row_conflicts++;
+    } else if (commit) {
+      dram->row_misses++;
+    }
+    bank.activate_cycle = t;
+    bank.row_open = true;
+    bank.open_row = loc.row;
+    t += DRAM_T_RCD;
+  }
+  t += DRAM_T_CAS;
+
+  int bursts = ((1 << blockBits) + DRAM_BURST_BYTES - 1) / DRAM_BURST_BYTES;
+  uint64_t data_start = max_cycle(t, dram->bus_free_cycle[loc.channel]);
+  uint64_t data_end = data_start + bursts * 8 * DRAM_BEAT_CYCLES;
+  bank.ready_cycle = data_start;
+  if (dram->page_policy == DRAM_CLOSED_PAGE) {
+    // auto-precharge once the burst is out
+    bank.row_open = false;
+    bank.ready_cycle = max_cycle(data_end, bank.activate_cycle + DRAM_T_RAS) + DRAM_T_RP;
+  }
+
+  if (commit) {
+    *loc.bank = bank;
+    dram->bus_free_cycle[loc.channel] = data_end;
+  }
+  *first_beat = data_start + DRAM_BEAT_CYCLES;
+  return data_end;
+}
+
+// FR-FCFS pick among the queued writes: row hits first, then the oldest
+static int dram_pick_write(dram_t *dram) {
+  int pick = -1;
+  for (int i = 0; i < dram->write_count; i++) {
+    if (dram_row_hit(dram, dram->write_queue[i].block_addr)) {
+      return i;
+    }
+    if (pick < 0 || dram->write_queue[i].arrival < dram->write_queue[pick].arrival) {
+      pick = i;
+    }
+  }
+  return pick;
+}
+
+static uint64_t dram_service_write(dram_t *dram, int idx, uint64_t start) {
+  dram_write_t w = dram->write_queue[idx];
+  dram->write_queue[idx] = dram->write_queue[--dram->write_count];
+  uint64_t first_beat;
+  dram->writes++;
+  return dram_issue(dram, w.block_addr, w.blockBits, max_cycle(start, w.arrival), true, &first_beat);
+}
+
+/*
+Demand read of the block holding `address`. Reads go ahead of posted
+writes; queued writes are only sent in idle time before `now`, or in a
+batch once the queue reaches DRAM_WQ_HIGH. Returns the cycle the
+requested word is available.
+*/
+uint64_t dram_read(dram_t *dram, unsigned long address, int blockBits, uint64_t now) {
+  unsigned long long block_addr = (address >> blockBits) << blockBits;
+  dram->reads++;
+
+  for (int i = 0; i < dram->write_count; i++) {
+    if (dram->write_queue[i].block_addr == block_addr) {
+      dram->write_forwards++;
+      dram->read_latency_total += DRAM_BEAT_CYCLES;
+      return now + DRAM_BEAT_CYCLES;
+    }
+  }
+
+  // use idle bus time for writes that finish before this read arrives
+  while (dram->write_count > 0) {
+    int idx = dram_pick_write(dram);
+    uint64_t first_beat;
+    dram_write_t *w = &dram->write_queue[idx];
+    if (dram_issue(dram, w->block_addr, w->blockBits, w->arrival, false, &first_beat) > now) {
+      break;
+    }
+    dram_service_write(dram, idx, w->arrival);
+  }
+
+  if (dram->write_count >= DRAM_WQ_HIGH) {
+    dram->write_drains++;
+    while (dram->write_count > DRAM_WQ_LOW) {
+      dram_service_write(dram, dram_pick_write(dram), now);
+    }
+  }
+
+  uint64_t first_beat;
+  uint64_t data_end = dram_issue(dram, address, blockBits, now, true, &first_beat);
+  uint64_t ready = DRAM_CRITICAL_WORD_FIRST ? first_beat : data_end;
+  dram->read_latency_total += ready - now;
+  return ready;
+}
+
+// Post a dirty block writeback; only stalls the caller if the queue is full
+void dram_write(dram_t *dram, unsigned long long block_addr, int blockBits, uint64_t now) {
+  if (dram->write_count == DRAM_WRITE_QUEUE) {
+    dram_service_write(dram, dram_pick_write(dram), now);
+  }
+  dram_write_t *w = &dram->write_queue[dram->write_count++];
+  w->block_addr = block_addr;
+  w->blockBits = blockBits;
+  w->arrival = now;
+}
+
+void dram_print_stats(const dram_t *dram) {
+  printf("#DRAM reads        = %5lu\n", (unsigned long)dram->reads);
+  printf("#DRAM writes       = %5lu\n", (unsigned long)(dram->writes + dram->write_count));
+  printf("#Row hits          = %5lu\n", (unsigned long)dram->row_hits);
+  printf("#Row misses        = %5lu\n", (unsigned long)dram->row_misses);
+  printf("#Row conflicts     = %5lu\n", (unsigned long)dram->row_conflicts);
+  printf("#Write forwards    = %5lu\n", (unsigned long)dram->write_forwards);
+  printf("#Write drains      = %5lu\n", (unsigned long)dram->write_drains);
+  printf("Avg read latency   = %8.2f\n", dram->reads ? (double)dram->read_latency_total / dram->reads : 0.0);
+}
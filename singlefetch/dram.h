@@ -0,0 +1,70 @@
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Main memory timing model behind the caches (-D). Without it every miss
+// costs a flat MEM_LATENCY; with it a miss pays for the row buffer state of
+// its bank and for bus contention. All timings are in CPU cycles.
+
+#define DRAM_CHANNELS 1
+#define DRAM_RANKS 1
+#define DRAM_BANKS 8
+#define DRAM_COLUMN_BITS 11      // 2KB row per bank
+#define DRAM_T_RCD 40            // activate to read/write
+#define DRAM_T_CAS 40            // read/write to first data beat
+#define DRAM_T_RP 40             // precharge
+#define DRAM_T_RAS 100           // activate to precharge
+#define DRAM_BURST_BYTES 64      // 64-bit bus, burst length 8
+#define DRAM_BEAT_CYCLES 2       // cycles per data beat
+#define DRAM_CRITICAL_WORD_FIRST 1 // the missing word is sent in the first beat
+#define DRAM_WRITE_QUEUE 16      // posted writebacks
+#define DRAM_WQ_HIGH 12          // start draining writes at this occupancy
+#define DRAM_WQ_LOW 4            // ... and stop once it falls to this
+
+typedef enum {
+  DRAM_OPEN_PAGE = 0,   // leave the row open after an access
+  DRAM_CLOSED_PAGE      // precharge right after each access
+} dram_page_policy_t;
+
+typedef struct {
+    bool row_open;
+    uint32_t open_row;
+    uint64_t ready_cycle;    // earliest cycle the bank takes a new command
+    uint64_t activate_cycle; // when the open row was activated (for tRAS)
+} dram_bank_t;
+
+typedef struct {
+    unsigned long long block_addr;
+    int blockBits;
+    uint64_t arrival;
+} dram_write_t;
+
+typedef struct {
+    int channels;
+    int ranks;
+    int banks;
+    dram_page_policy_t page_policy;
+    dram_bank_t *bank_state;      // channels * ranks * banks
+    uint64_t *bus_free_cycle;     // per channel data bus
+    dram_write_t write_queue[DRAM_WRITE_QUEUE];
+    int write_count;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t row_hits;
+    uint64_t row_misses;          // bank was precharged
+    uint64_t row_conflicts;       // another row was open
+    uint64_t write_forwards;      // reads served from the write queue
+    uint64_t write_drains;        // times the write queue hit the high watermark
+    uint64_t read_latency_total;
+} dram_t;
+
+// Function declarations
+bool dram_configure(dram_t *dram, const char *spec);
+void dram_init(dram_t *dram, dram_page_policy_t page_policy, int channels, int ranks, int banks);
+void dram_free(dram_t *dram);
+uint64_t dram_read(dram_t *dram, unsigned long address, int blockBits, uint64_t now);
+void dram_write(dram_t *dram, unsigned long long block_addr, int blockBits, uint64_t now);
+void dram_print_stats(const dram_t *dram);
+#endif // DRAM_H
@@ -1,19 +1,38 @@
+#include <stdbool.h>
 #include <stdio.h> // for stderr
 #include <stdlib.h> // for exit()
 #include "types.h"
 #include "utils.h"
 #include "riscv.h"
+#include "csr.h"
 
 void execute_rtype(Instruction, Processor *);
 void execute_itype_except_load(Instruction, Processor *);
 void execute_branch(Instruction, Processor *);
 void execute_jal(Instruction, Processor *);
+void execute_jalr(Instruction, Processor *);
+void execute_auipc(Instruction, Processor *);
 void execute_load(Instruction, Processor *, Byte *);
 void execute_store(Instruction, Processor *, Byte *);
 void execute_ecall(Processor *, Byte *);
 void execute_lui(Instruction, Processor *);
+void execute_csr(Instruction, Processor *);
+void execute_amo(Instruction, Processor *, Byte *);
+
+// 2 for a compressed instruction, which runs as its 32-bit expansion.
+// One per host thread, since harts (-N) may run on several.
+static _Thread_local int instruction_length = 4;
 
 void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *memory) {    
+    instruction_length = instruction_size(instruction_bits);
+    if (instruction_length == 2) {
+        uint32_t expanded = expand_compressed(instruction_bits & 0xFFFF);
+        if (expanded == 0) {
+            handle_invalid_instruction(parse_instruction(instruction_bits & 0xFFFF));
+            exit(-1);
+        }
+        instruction_bits = expanded;
+    }
     Instruction instruction = parse_instruction(instruction_bits);
     switch(instruction.opcode) {
         case 0x33:
@@ -23,7 +42,11 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
             execute_itype_except_load(instruction, processor);
             break;
         case 0x73:
-            execute_ecall(processor, memory);
+            if (instruction.itype.funct3 == 0x0) {
+                execute_ecall(processor, memory);
+            } else {
+                execute_csr(instruction, processor);
+            }
             break;
         case 0x63:
             execute_branch(instruction, processor);
@@ -31,6 +54,12 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
         case 0x6F:
             execute_jal(instruction, processor);
             break;
+        case 0x67:
+            execute_jalr(instruction, processor);
+            break;
+        case 0x17:
+            execute_auipc(instruction, processor);
+            break;
         case 0x23:
             execute_store(instruction, processor, memory);
             break;
@@ -40,6 +69,9 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
         case 0x37:
             execute_lui(instruction, processor);
             break;
+        case 0x2F:
+            execute_amo(instruction, processor, memory);
+            break;
         default: // undefined opcode
             handle_invalid_instruction(instruction);
             exit(-1);
@@ -48,26 +80,22 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
 }
 
 void execute_rtype(Instruction instruction, Processor *processor) {
+    Word rs1 = processor->R[instruction.rtype.rs1];
+    Word rs2 = processor->R[instruction.rtype.rs2];
     switch (instruction.rtype.funct3){
         case 0x0:
             switch (instruction.rtype.funct7) {
                 case 0x0:
                     // Add
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) +
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    processor->R[instruction.rtype.rd] = rs1 + rs2;
                     break;
                 case 0x1:
                     // Mul
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) *
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    processor->R[instruction.rtype.rd] = rs1 * rs2;
                     break;
                 case 0x20:
                     // Sub
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) -
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    processor->R[instruction.rtype.rd] = rs1 - rs2;
                     break;
                 default:
                     handle_invalid_instruction(instruction);
@@ -75,20 +103,16 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                     break;
             }
             break;
-	    // deal with other cases
 	    case 0x1:
             switch (instruction.rtype.funct7) {
                 case 0x00:
                     // sll
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) <<
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    processor->R[instruction.rtype.rd] = rs1 << (rs2 & 0x1F);
                     break;
                 case 0x01:
-                    // mulh                    
+                    // mulh
                     processor->R[instruction.rtype.rd] =
-                        (((sWord)processor->R[instruction.rtype.rs1]) *
-                        ((sWord)processor->R[instruction.rtype.rs2])) >> 31;
+                        ((sDouble)(sWord)rs1 * (sDouble)(sWord)rs2) >> 32;
                     break;
                 default:
                     handle_invalid_instruction(instruction);
@@ -97,27 +121,47 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             }
             break;
         case 0x2:
-            // slt
-            if(((sWord)processor->R[instruction.rtype.rs1]) < ((sWord)processor->R[instruction.rtype.rs2])) {
-                processor->R[instruction.rtype.rd] = 1;
+            switch (instruction.rtype.funct7) {
+                case 0x00:
+                    // slt
+                    processor->R[instruction.rtype.rd] = (sWord)rs1 < (sWord)rs2 ? 1 : 0;
+                    break;
+                case 0x01:
+                    // mulhsu
+                    processor->R[instruction.rtype.rd] =
+                        ((sDouble)(sWord)rs1 * (sDouble)rs2) >> 32;
+                    break;
+                default:
+                    handle_invalid_instruction(instruction);
+                    exit(-1);
+                    break;
+            }
+            break;
+        case 0x3:
+            switch (instruction.rtype.funct7) {
+                case 0x00:
+                    // sltu
+                    processor->R[instruction.rtype.rd] = rs1 < rs2 ? 1 : 0;
+                    break;
+                case 0x01:
+                    // mulhu
+                    processor->R[instruction.rtype.rd] = ((Double)rs1 * (Double)rs2) >> 32;
+                    break;
+                default:
+                    handle_invalid_instruction(instruction);
+                    exit(-1);
+                    break;
             }
-            else {
-                processor->R[instruction.rtype.rd] = 0;
-            }                   
             break;
         case 0x4:
             switch (instruction.rtype.funct7) {
                 case 0x00:
                     // xor
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) ^
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    processor->R[instruction.rtype.rd] = rs1 ^ rs2;
                     break;
                 case 0x01:
-                    // div                    
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) /
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    // div
+                    processor->R[instruction.rtype.rd] = divide(rs1, rs2, 1, 0);
                     break;
                 default:
                     handle_invalid_instruction(instruction);
@@ -129,15 +173,15 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             switch (instruction.rtype.funct7) {
                 case 0x00:
                     // srl
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) >>
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    processor->R[instruction.rtype.rd] = rs1 >> (rs2 & 0x1F);
+                    break;
+                case 0x01:
+                    // divu
+                    processor->R[instruction.rtype.rd] = divide(rs1, rs2, 0, 0);
                     break;
                 case 0x20:
-                    // sra                    
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) >>
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    // sra
+                    processor->R[instruction.rtype.rd] = (sWord)rs1 >> (rs2 & 0x1F);
                     break;
                 default:
                     handle_invalid_instruction(instruction);
@@ -148,16 +192,12 @@ void execute_rtype(Instruction instruction, Processor *processor) {
         case 0x6:
             switch (instruction.rtype.funct7) {
                 case 0x00:
-                    // or 
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) |
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    // or
+                    processor->R[instruction.rtype.rd] = rs1 | rs2;
                     break;
                 case 0x01:
-                    // rem                    
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) %
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    // rem
+                    processor->R[instruction.rtype.rd] = divide(rs1, rs2, 1, 1);
                     break;
                 default:
                     handle_invalid_instruction(instruction);
@@ -166,10 +206,20 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             }
             break;
         case 0x7:
-            // and                   
-            processor->R[instruction.rtype.rd] =
-                ((sWord)processor->R[instruction.rtype.rs1]) &
-                ((sWord)processor->R[instruction.rtype.rs2]);
+            switch (instruction.rtype.funct7) {
+                case 0x00:
+                    // and
+                    processor->R[instruction.rtype.rd] = rs1 & rs2;
+                    break;
+                case 0x01:
+                    // remu
+                    processor->R[instruction.rtype.rd] = divide(rs1, rs2, 0, 1);
+                    break;
+                default:
+                    handle_invalid_instruction(instruction);
+                    exit(-1);
+                    break;
+            }
             break;
         default:
             handle_invalid_instruction(instruction);
@@ -177,7 +227,7 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             break;
     }
     // update PC
-    processor->PC += 4;
+    processor->PC += instruction_length;
 }
 
 void execute_itype_except_load(Instruction instruction, Processor *processor) {
@@ -211,6 +261,11 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
                 processor->R[instruction.itype.rd] = 0;
             }                   
             break;
+        case 0x3:
+            // sltiu (the immediate is sign extended, then compared unsigned)
+            processor->R[instruction.itype.rd] =
+                processor->R[instruction.itype.rs1] < (Word)sign_extend_number(instruction.itype.imm, 12) ? 1 : 0;
+            break;
         case 0x4:
             // xori                   
             processor->R[instruction.itype.rd] =
@@ -222,7 +277,7 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
                 case 0x00:
                     // srli
                     processor->R[instruction.itype.rd] =
-                        ((sWord)processor->R[instruction.itype.rs1]) >>
+                        processor->R[instruction.itype.rs1] >>
                         ((sWord)(sign_extend_number(instruction.itype.imm, 12) & ((1U << 5) - 1)));
                     break;
                 case 0x20:
@@ -253,7 +308,7 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
             handle_invalid_instruction(instruction);
             break;
     }
-    processor->PC += 4;
+    processor->PC += instruction_length;
 }
 
 void execute_ecall(Processor *p, Byte *memory) {
@@ -264,13 +319,13 @@ void execute_ecall(Processor *p, Byte *memory) {
     switch(p->R[10]) {
         case 1: // print an integer
             printf("%d",p->R[11]);
-            p->PC += 4;
+            p->PC += instruction_length;
             break;
         case 4: // print a string
             for(i=p->R[11];i<MEMORY_SPACE && load(memory,i,LENGTH_BYTE);i++) {
                 printf("%c",load(memory,i,LENGTH_BYTE));
             }
-            p->PC += 4;
+            p->PC += instruction_length;
             break;
         case 10: // exit
             printf("exiting the simulator\n");
@@ -278,7 +333,7 @@ void execute_ecall(Processor *p, Byte *memory) {
             break;
         case 11: // print a character
             printf("%c",p->R[11]);
-            p->PC += 4;
+            p->PC += instruction_length;
             break;
         default: // undefined ecall
             printf("Illegal ecall number %d\n", p->R[10]);
@@ -287,31 +342,118 @@ void execute_ecall(Processor *p, Byte *memory) {
     }
 }
 
+void execute_csr(Instruction instruction, Processor *processor) {
+    uint32_t old_value;
+    if (!csr_execute(instruction, processor->R[instruction.itype.rs1], &old_value)) {
+        handle_invalid_instruction(instruction);
+        exit(-1);
+    }
+    processor->R[instruction.itype.rd] = old_value;
+    processor->PC += instruction_length;
+}
+
+// A extension, word forms only. aq/rl need nothing: a hart's memory
+// accesses happen in program order and one at a time (see smp.c).
+void execute_amo(Instruction instruction, Processor *processor, Byte *memory) {
+    Address address = processor->R[instruction.rtype.rs1];
+    Word rs2 = processor->R[instruction.rtype.rs2];
+    Word old, value;
+    if (instruction.rtype.funct3 != 0x2) {
+        handle_invalid_instruction(instruction);
+        exit(-1);
+    }
+    switch (instruction.rtype.funct7 >> 2) {
+        case 0x02: // lr.w
+            processor->R[instruction.rtype.rd] = load(memory, address, LENGTH_WORD);
+            processor->reservation = address;
+            processor->reserved = true;
+            processor->PC += instruction_length;
+            return;
+        case 0x03: // sc.w
+            if (processor->reserved && processor->reservation == address) {
+                store(memory, address, LENGTH_WORD, rs2);
+                processor->R[instruction.rtype.rd] = 0;
+            } else {
+                processor->R[instruction.rtype.rd] = 1;
+            }
+            processor->reserved = false;
+            processor->PC += instruction_length;
+            return;
+        default:
+            break;
+    }
+    old = load(memory, address, LENGTH_WORD);
+    switch (instruction.rtype.funct7 >> 2) {
+        case 0x01: // amoswap.w
+            value = rs2;
+            break;
+        case 0x00: // amoadd.w
+            value = old + rs2;
+            break;
+        case 0x04: // amoxor.w
+            value = old ^ rs2;
+            break;
+        case 0x0C: // amoand.w
+            value = old & rs2;
+            break;
+        case 0x08: // amoor.w
+            value = old | rs2;
+            break;
+        case 0x10: // amomin.w
+            value = (sWord)old < (sWord)rs2 ? old : rs2;
+            break;
+        case 0x14: // amomax.w
+            value = (sWord)old > (sWord)rs2 ? old : rs2;
+            break;
+        case 0x18: // amominu.w
+            value = old < rs2 ? old : rs2;
+            break;
+        case 0x1C: // amomaxu.w
+            value = old > rs2 ? old : rs2;
+            break;
+        default:
+            handle_invalid_instruction(instruction);
+            exit(-1);
+    }
+    store(memory, address, LENGTH_WORD, value);
+    processor->R[instruction.rtype.rd] = old;
+    processor->PC += instruction_length;
+}
+
 void execute_branch(Instruction instruction, Processor *processor) {
+    Word rs1 = processor->R[instruction.sbtype.rs1];
+    Word rs2 = processor->R[instruction.sbtype.rs2];
+    bool taken = false;
     switch (instruction.sbtype.funct3) {
-	case 0x0:
- 	// beq
- 	if(((sWord)processor->R[instruction.sbtype.rs1]) == ((sWord)processor->R[instruction.sbtype.rs2])) {
- 		processor->PC += sign_extend_number(get_branch_offset(instruction), 13);
- 	} else {
-		processor->PC += 4;
-	}
- 	break;
- 	case 0x1:
- 	// bne
- 	if(((sWord)processor->R[instruction.sbtype.rs1]) != ((sWord)instruction.sbtype.rs2)) {
- 	processor->PC = processor->PC +
-	sign_extend_number(get_branch_offset(instruction), 13);
- 	} else {
-		processor->PC += 4;
-	}
-	 break;
+        case 0x0: // beq
+            taken = rs1 == rs2;
+            break;
+        case 0x1: // bne
+            taken = rs1 != rs2;
+            break;
+        case 0x4: // blt
+            taken = (sWord)rs1 < (sWord)rs2;
+            break;
+        case 0x5: // bge
+            taken = (sWord)rs1 >= (sWord)rs2;
+            break;
+        case 0x6: // bltu
+            taken = rs1 < rs2;
+            break;
+        case 0x7: // bgeu
+            taken = rs1 >= rs2;
+            break;
         default:
             handle_invalid_instruction(instruction);
             exit(-1);
             break;
     }
- }
+    if (taken) {
+        processor->PC += sign_extend_number(get_branch_offset(instruction), 13);
+    } else {
+        processor->PC += instruction_length;
+    }
+}
 
 void execute_load(Instruction instruction, Processor *processor, Byte *memory) {
     switch (instruction.itype.funct3) {
@@ -324,40 +466,58 @@ void execute_load(Instruction instruction, Processor *processor, Byte *memory) {
 	case 0x2: // lw
 		processor->R[instruction.rtype.rd] = load(memory, ((sWord)processor->R[instruction.rtype.rs1]) + sign_extend_number(instruction.itype.imm, 12), LENGTH_WORD);
 	break;
+	case 0x4: // lbu
+		processor->R[instruction.rtype.rd] = load(memory, ((sWord)processor->R[instruction.rtype.rs1]) + sign_extend_number(instruction.itype.imm, 12), LENGTH_BYTE);
+	break;
+	case 0x5: // lhu
+		processor->R[instruction.rtype.rd] = load(memory, ((sWord)processor->R[instruction.rtype.rs1]) + sign_extend_number(instruction.itype.imm, 12), LENGTH_HALF_WORD);
+	break;
         default:
             handle_invalid_instruction(instruction);
             break;
     }
-    processor->PC += 4;
+    processor->PC += instruction_length;
 }
 
 void execute_store(Instruction instruction, Processor *processor, Byte *memory) {
     switch (instruction.stype.funct3) {
 	case 0x0: //sb
-	store(memory, ((sWord)processor->R[instruction.rtype.rs1]) + get_store_offset(instruction), LENGTH_BYTE, ((sWord)processor->R[instruction.rtype.rs2]));
+	store(memory, ((sWord)processor->R[instruction.rtype.rs1]) + sign_extend_number(get_store_offset(instruction), 12), LENGTH_BYTE, ((sWord)processor->R[instruction.rtype.rs2]));
 	break;
 	case 0x1: // sh
-	store(memory, ((sWord)processor->R[instruction.rtype.rs1]) + get_store_offset(instruction), LENGTH_HALF_WORD, ((sWord)processor->R[instruction.rtype.rs2]));
+	store(memory, ((sWord)processor->R[instruction.rtype.rs1]) + sign_extend_number(get_store_offset(instruction), 12), LENGTH_HALF_WORD, ((sWord)processor->R[instruction.rtype.rs2]));
 	break;
 	case 0x2: //sw
-	store(memory, ((sWord)processor->R[instruction.rtype.rs1]) + get_store_offset(instruction), LENGTH_WORD, ((sWord)processor->R[instruction.rtype.rs2]));
+	store(memory, ((sWord)processor->R[instruction.rtype.rs1]) + sign_extend_number(get_store_offset(instruction), 12), LENGTH_WORD, ((sWord)processor->R[instruction.rtype.rs2]));
 	break;
         default:
             handle_invalid_instruction(instruction);
             exit(-1);
             break;
     }
-	processor->PC += 4;
+	processor->PC += instruction_length;
 }
 
 void execute_jal(Instruction instruction, Processor *processor) {
-	processor->R[instruction.ujtype.rd] = processor->PC + 4;
-    processor->PC = processor->PC + sign_extend_number(get_jump_offset(instruction), 13);
+	processor->R[instruction.ujtype.rd] = processor->PC + instruction_length;
+    processor->PC = processor->PC + sign_extend_number(get_jump_offset(instruction), 21);
+}
+
+void execute_jalr(Instruction instruction, Processor *processor) {
+    // target taken before rd is written, rd may be rs1
+    Word target = (processor->R[instruction.itype.rs1] + sign_extend_number(instruction.itype.imm, 12)) & ~1U;
+    processor->R[instruction.itype.rd] = processor->PC + instruction_length;
+    processor->PC = target;
+}
+
+void execute_auipc(Instruction instruction, Processor *processor) {
+    processor->R[instruction.utype.rd] = processor->PC + (instruction.utype.imm << 12);
+    processor->PC += instruction_length;
 }
 
 void execute_lui(Instruction instruction, Processor *processor) {
 	processor->R[instruction.ujtype.rd] = ((sWord)instruction.utype.imm) << 12;
-	processor->PC += 4;
+	processor->PC += instruction_length;
 }
 
 void store(Byte *memory, Address address, Alignment alignment, Word value) {
@@ -0,0 +1,96 @@
+#include "fetchq.h"
+#include <stdio.h>
+#include <string.h>
+
+fetch_queue_t fetch_queue = {0};
+
+bool fq_init(fetch_queue_t *fq, int depth) {
+  if (depth < 1 || depth > FETCH_QUEUE_MAX) {
+    return false;
+  }
+  memset(fq, 0, sizeof(*fq));
+  fq->enabled = true;
+  fq->depth = depth;
+  return true;
+}
+
+// The oldest pair in the ring is done with, count the occupancy it saw
+static void retire_oldest(fetch_queue_t *fq) {
+  fq->histogram[fq->entries[fq->head].occupancy]++;
+  fq->head = (fq->head + 1) % fq->depth;
+  fq->count--;
+}
+
+/*
+Fetch the next pair, whose I-cache fill takes `penalty` cycles beyond a hit,
+for decode to take at cycle `now`. Fetch starts it once the previous pair is
+fetched and the pair `depth` places ahead has left the queue. Returns the
+cycles decode waits for it, 0 when fetch was far enough ahead.
+*/
+uint64_t fq_deliver(fetch_queue_t *fq, uint64_t penalty, uint64_t now) {
+  if (fq->redirect) {
+    fq->clock = now;
+    fq->redirect = false;
+  }
+
+  uint64_t start = fq->clock;
+  if (fq->count == fq->depth) {
+    uint64_t room = fq->entries[fq->head].consumed;
+    if (room > start) {
+      fq->full_stalls += room - start;
+      start = room;
+    }
+    retire_oldest(fq);
+  }
+  uint64_t ready = start + penalty;
+  uint64_t consumed = ready > now ? ready : now;
+  fq->clock = ready + 1;
+
+  // older pairs that decode took after this one arrived had it queued behind them
+  for (int i = 0; i < fq->count; i++) {
+    fq_entry_t *entry = &fq->entries[(fq->head + i) % fq->depth];
+    if (entry->occupancy > 0 && entry->consumed >= ready) {
+      entry->occupancy++;
+    }
+  }
+  fq_entry_t *entry = &fq->entries[(fq->head + fq->count) % fq->depth];
+  entry->consumed = consumed;
+  entry->occupancy = ready <= now ? 1 : 0;
+  fq->count++;
+
+  uint64_t wait = consumed - now;
+  fq->pairs++;
+  fq->empty_stalls += wait;
+  fq->hidden += penalty > wait ? penalty - wait : 0;
+  fq->queued += consumed - ready;
+  return wait;
+}
+
+// A taken branch squashes everything fetched past it
+void fq_redirect(fetch_queue_t *fq) {
+  while (fq->count > 0) {
+    retire_oldest(fq);
+  }
+  fq->head = 0;
+  fq->redirect = true;
+  fq->redirects++;
+}
+
+void fq_print_stats(fetch_queue_t *fq, uint64_t total_cycles) {
+  while (fq->count > 0) {
+    retire_oldest(fq);
+  }
+  printf("#FQ depth          = %5d\n", fq->depth);
+  printf("#FQ pairs          = %5lu\n", (unsigned long)fq->pairs);
+  printf("#FQ empty stalls   = %5lu\n", (unsigned long)fq->empty_stalls);
+  printf("#FQ full stalls    = %5lu\n", (unsigned long)fq->full_stalls);
+  printf("#FQ hidden fills   = %5lu\n", (unsigned long)fq->hidden);
+  printf("#FQ redirects      = %5lu\n", (unsigned long)fq->redirects);
+  printf("#FQ occupancy      = %8.3f (mean pairs queued per cycle)\n",
+         total_cycles ? (double)fq->queued / total_cycles : 0.0);
+  // what decode found when it asked for a pair, 0 = it had to wait
+  for (int n = 0; n <= fq->depth; n++) {
+    printf("#FQ occupancy %-4d = %5lu (%5.1f%%)\n", n, (unsigned long)fq->histogram[n],
+           fq->pairs ? 100.0 * fq->histogram[n] / fq->pairs : 0.0);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef FETCHQ_H
+#define FETCHQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decoupled front end (-B[n]): a queue of up to n fetched pairs between
+// fetch and decode. Fetch keeps its own clock, one pair per cycle plus any
+// I-cache fill, and only waits for decode when the queue is full. While the
+// back end stalls fetch runs ahead, so a later miss is hidden by the pairs
+// already queued and decode only waits for what is left of it. A taken
+// branch empties the queue and fetch restarts at the target.
+
+#define FETCH_QUEUE_DEPTH 4    // pairs queued by default
+#define FETCH_QUEUE_MAX 64
+
+typedef struct {
+    uint64_t consumed;     // cycle decode took the pair
+    int occupancy;         // younger pairs already queued at that point
+} fq_entry_t;
+
+typedef struct {
+    bool enabled;
+    int depth;
+    uint64_t clock;        // cycle fetch is free to start the next pair
+    bool redirect;         // a taken branch emptied the queue
+    fq_entry_t entries[FETCH_QUEUE_MAX];  // the last `depth` pairs taken, ring
+    int count;
+    int head;
+
+    uint64_t pairs;
+    uint64_t empty_stalls; // decode waited for fetch
+    uint64_t full_stalls;  // fetch waited for room in the queue
+    uint64_t hidden;       // I-cache fill cycles fetch ran ahead of
+    uint64_t queued;       // cycles pairs spent queued, for the mean occupancy
+    uint64_t redirects;
+    uint64_t histogram[FETCH_QUEUE_MAX + 1];  // occupancy seen by decode
+} fetch_queue_t;
+
+extern fetch_queue_t fetch_queue;
+
+// Function declarations
+bool fq_init(fetch_queue_t *fq, int depth);
+uint64_t fq_deliver(fetch_queue_t *fq, uint64_t penalty, uint64_t now);
+void fq_redirect(fetch_queue_t *fq);
+void fq_print_stats(fetch_queue_t *fq, uint64_t total_cycles);
+#endif // FETCHQ_H
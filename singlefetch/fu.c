@@ -0,0 +1,107 @@
+#include "fu.h"
+#include <stdio.h>
+#include <string.h>
+
+fu_pool_t fu_pool = {0};
+
+static const char *fu_names[FU_KINDS] = {"alu", "mul", "div", "agu"};
+
+// Parse "-U [<unit>=<latency>:<interval>][,...]", units alu, mul, div, agu
+bool fu_configure(fu_pool_t *pool, const char *spec) {
+  static const int defaults[FU_KINDS][2] = {
+    {FU_ALU_LATENCY, FU_ALU_INTERVAL}, {FU_MUL_LATENCY, FU_MUL_INTERVAL},
+    {FU_DIV_LATENCY, FU_DIV_INTERVAL}, {FU_AGU_LATENCY, FU_AGU_INTERVAL}
+  };
+  memset(pool, 0, sizeof(*pool));
+  for (int k = 0; k < FU_KINDS; k++) {
+    pool->units[k].latency = defaults[k][0];
+    pool->units[k].interval = defaults[k][1];
+  }
+  while (spec != NULL && *spec != '\0') {
+    const char *equals = strchr(spec, '=');
+    if (equals == NULL) {
+      return false;
+    }
+    int kind = -1;
+    for (int k = 0; k < FU_KINDS; k++) {
+      if ((size_t)(equals - spec) == strlen(fu_names[k]) && strncmp(spec, fu_names[k], equals - spec) == 0) {
+        kind = k;
+      }
+    }
+    int latency, interval, used;
+    if (kind < 0 || sscanf(equals, "=%d:%d%n", &latency, &interval, &used) != 2 ||
+        latency < 1 || interval < 1) {
+      return false;
+    }
+    pool->units[kind].latency = latency;
+    pool->units[kind].interval = interval;
+    spec = equals + used;
+    if (*spec == ',') {
+      spec++;
+    } else if (*spec != '\0') {
+      return false;
+    }
+  }
+  pool->enabled = true;
+  return true;
+}
+
+int fu_kind(Instruction instruction) {
+  switch (instruction.opcode) {
+    case 0x33:
+      if (instruction.rtype.funct7 == 0x01) {
+        return instruction.rtype.funct3 < 4 ? FU_MUL : FU_DIV;
+      }
+      return FU_ALU;
+    case 0x03: case 0x23:
+      return FU_AGU;
+    default:
+      return FU_ALU;
+  }
+}
+
+/*
+Issue one instruction to a unit of `kind` no earlier than `now`. `uses` has a
+bit for every register the instruction reads or writes, `rd` is the register
+it writes (0 for none), both in the register file of thread `tid`. The
+instruction waits until those registers have no result in flight and the
+unit accepts a new instruction, then occupies the unit. Returns the cycles
+it waited.
+*/
+uint64_t fu_issue(fu_pool_t *pool, int kind, int tid, uint32_t uses, int rd, uint64_t now) {
+  fu_t *unit = &pool->units[kind];
+  uint64_t *ready = pool->ready[tid];
+
+  uint64_t operands = now;
+  for (int r = 1; r < 32; r++) {
+    if ((uses >> r & 1) && ready[r] > operands) {
+      operands = ready[r];
+    }
+  }
+  uint64_t issue = operands > unit->next_issue ? operands : unit->next_issue;
+
+  // a wait for the unit only counts as structural beyond the operand wait
+  pool->result_stalls += operands - now;
+  if (issue > operands) {
+    pool->busy_stalls += issue - operands;
+    unit->busy_stalls += issue - operands;
+  }
+
+  unit->next_issue = issue + unit->interval;
+  unit->issued++;
+  if (rd != 0) {
+    // loads have their value one stage later, after MEM
+    ready[rd] = issue + unit->latency + (kind == FU_AGU ? 1 : 0);
+  }
+  return issue - now;
+}
+
+void fu_print_stats(fu_pool_t *pool) {
+  printf("#FU result stalls  = %5lu\n", (unsigned long)pool->result_stalls);
+  printf("#FU busy stalls    = %5lu\n", (unsigned long)pool->busy_stalls);
+  for (int k = 0; k < FU_KINDS; k++) {
+    fu_t *unit = &pool->units[k];
+    printf("#FU %s issued     = %5lu (latency %d, interval %d, %lu busy)\n", fu_names[k],
+           (unsigned long)unit->issued, unit->latency, unit->interval, (unsigned long)unit->busy_stalls);
+  }
+}
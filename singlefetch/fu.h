@@ -0,0 +1,57 @@
+#ifndef FU_H
+#define FU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+#include "riscv.h"
+#include "pipeline.h"
+
+// Functional units behind the execute stage (-U). Every instruction needs
+// one unit: the integer ALU, the multiplier, the divider or the load/store
+// address generator. A unit takes `latency` cycles to produce a result and
+// accepts a new instruction every `interval` cycles (1 = fully pipelined,
+// interval == latency = not pipelined). Without -U every unit behaves as a
+// single-cycle ALU, which is the pipeline's original timing.
+
+#define FU_ALU_LATENCY 1
+#define FU_ALU_INTERVAL 1
+#define FU_MUL_LATENCY 3
+#define FU_MUL_INTERVAL 1
+#define FU_DIV_LATENCY 20
+#define FU_DIV_INTERVAL 20       // iterative divider, not pipelined
+#define FU_AGU_LATENCY 1         // address only, the cache access follows in MEM
+#define FU_AGU_INTERVAL 1
+
+enum fu_kind_enum {
+  FU_ALU = 0,
+  FU_MUL,
+  FU_DIV,
+  FU_AGU,
+  FU_KINDS
+};
+
+typedef struct {
+    int latency;
+    int interval;
+    uint64_t next_issue;     // earliest cycle the unit accepts an instruction
+    uint64_t issued;
+    uint64_t busy_stalls;    // cycles an instruction waited for this unit
+} fu_t;
+
+typedef struct {
+    bool enabled;
+    fu_t units[FU_KINDS];
+    uint64_t ready[MAX_HW_THREADS][32];  // cycle each thread's register result is ready
+    uint64_t busy_stalls;    // structural: the unit was still occupied
+    uint64_t result_stalls;  // data: an operand was still being computed
+} fu_pool_t;
+
+extern fu_pool_t fu_pool;
+
+// Function declarations
+bool fu_configure(fu_pool_t *pool, const char *spec);
+int fu_kind(Instruction instruction);
+uint64_t fu_issue(fu_pool_t *pool, int kind, int tid, uint32_t uses, int rd, uint64_t now);
+void fu_print_stats(fu_pool_t *pool);
+#endif // FU_H
@@ -0,0 +1,878 @@
+#include "gdbstub.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "storebuf.h"
+#include "watch.h"
+#include "timetravel.h"
+
+gdbstub_t gdb = {0};
+
+static const char *abi_names[32] = {
+  "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+  "fp", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+  "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+  "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+// The register layout GDB asks for with qXfer:features:read
+static char target_xml[2048];
+
+static void build_target_xml(void) {
+  int n = snprintf(target_xml, sizeof(target_xml),
+                   "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+                   "<target version=\"1.0\"><architecture>riscv:rv32</architecture>"
+                   "<feature name=\"org.gnu.gdb.riscv.cpu\">");
+  for (int r = 0; r < 32; r++) {
+    const char *type = r == 1 ? "code_ptr" : r == 2 ? "data_ptr" : "int";
+    n += snprintf(target_xml + n, sizeof(target_xml) - n,
+                  "<reg name=\"%s\" bitsize=\"32\" type=\"%s\" regnum=\"%d\"/>", abi_names[r], type, r);
+  }
+  snprintf(target_xml + n, sizeof(target_xml) - n,
+           "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\" regnum=\"32\"/></feature></target>");
+}
+
+static void gdb_exit(void) {
+  gdb_close(&gdb, 0);
+}
+
+// The next step gdb_trap has to see whatever happens: a Ctrl-C poll, a
+// snapshot or the end of a replay
+static void schedule(gdbstub_t *gdb) {
+  uint64_t wake = gdb->poll_at;
+  if (timetravel.enabled && timetravel.next < wake) {
+    wake = timetravel.next;
+  }
+  if (gdb->mode == GDB_GOTO_CYCLE) {
+    wake = gdb->step + 1;
+  } else if (gdb->mode != GDB_RUN && gdb->target < wake) {
+    wake = gdb->target;
+  }
+  gdb->wake = wake;
+}
+
+// Listen on `spec`, a port on the loopback interface or a Unix socket path,
+// and wait for GDB to connect
+bool gdb_open(gdbstub_t *gdb, const char *spec, Byte *memory, bool pipeline, const uint64_t *cycles) {
+  memset(gdb, 0, sizeof(*gdb));
+  bool tcp = spec[0] != '\0' && spec[strspn(spec, "0123456789")] == '\0';
+  int listener = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    fprintf(stderr, "GDB stub: %s\n", strerror(errno));
+    return false;
+  }
+
+  int status;
+  if (tcp) {
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(atoi(spec));
+    status = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+  } else {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(spec) >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "GDB stub: socket path %s is too long\n", spec);
+      close(listener);
+      return false;
+    }
+    strcpy(addr.sun_path, spec);
+    unlink(spec);
+    status = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+  }
+  if (status != 0 || listen(listener, 1) != 0) {
+    fprintf(stderr, "GDB stub: cannot listen on %s: %s\n", spec, strerror(errno));
+    close(listener);
+    return false;
+  }
+
+  fprintf(stderr, "Waiting for GDB on %s%s\n", tcp ? "localhost:" : "", spec);
+  gdb->fd = accept(listener, NULL, NULL);
+  close(listener);
+  if (!tcp) {
+    unlink(spec);
+  }
+  if (gdb->fd < 0) {
+    fprintf(stderr, "GDB stub: %s\n", strerror(errno));
+    return false;
+  }
+  if (tcp) {
+    int one = 1;
+    setsockopt(gdb->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  build_target_xml();
+  gdb->enabled = true;
+  gdb->pipeline = pipeline;
+  gdb->memory = memory;
+  gdb->cycles = cycles;
+  gdb->poll_at = GDB_POLL_INTERVAL;
+  schedule(gdb);
+  gdb->stepping = true;    // stop before the first instruction
+  gdb->signal = 5;         // SIGTRAP
+  atexit(gdb_exit);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Breakpoint set
+///////////////////////////////////////////////////////////////////////////////
+
+static bool insert_breakpoint(gdbstub_t *gdb, uint32_t pc) {
+  if (gdb_has_breakpoint(gdb, pc)) {
+    return true;
+  }
+  if (gdb->breakpoints >= GDB_BREAKPOINT_SLOTS / 2) {
+    return false;
+  }
+  int i = gdb_hash(pc);
+  while (gdb->bp_used[i]) {
+    i = (i + 1) & (GDB_BREAKPOINT_SLOTS - 1);
+  }
+  gdb->bp_addr[i] = pc;
+  gdb->bp_used[i] = true;
+  gdb->breakpoints++;
+  return true;
+}
+
+// Rehash what is left, so probing never runs into a hole
+static void remove_breakpoint(gdbstub_t *gdb, uint32_t pc) {
+  uint32_t left[GDB_BREAKPOINT_SLOTS];
+  int count = 0;
+  for (int i = 0; i < GDB_BREAKPOINT_SLOTS; i++) {
+    if (gdb->bp_used[i] && gdb->bp_addr[i] != pc) {
+      left[count++] = gdb->bp_addr[i];
+    }
+  }
+  memset(gdb->bp_used, 0, sizeof(gdb->bp_used));
+  gdb->breakpoints = 0;
+  for (int i = 0; i < count; i++) {
+    insert_breakpoint(gdb, left[i]);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Packets
+///////////////////////////////////////////////////////////////////////////////
+
+// The next byte from GDB, -1 when it went away
+static int get_byte(gdbstub_t *gdb) {
+  if (gdb->rx_pos == gdb->rx_len) {
+    ssize_t n = recv(gdb->fd, gdb->rx, sizeof(gdb->rx), 0);
+    if (n <= 0) {
+      return -1;
+    }
+    gdb->rx_len = n;
+    gdb->rx_pos = 0;
+  }
+  return (unsigned char)gdb->rx[gdb->rx_pos++];
+}
+
+static int hex_value(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Send "$data#checksum" until GDB acknowledges it
+static void put_packet(gdbstub_t *gdb, const char *data) {
+  char frame[GDB_PACKET_MAX + 4];
+  uint8_t sum = 0;
+  int n = 0;
+  frame[n++] = '$';
+  for (const char *p = data; *p; p++) {
+    frame[n++] = *p;
+    sum += (uint8_t)*p;
+  }
+  frame[n++] = '#';
+  frame[n++] = hex_digits[sum >> 4];
+  frame[n++] = hex_digits[sum & 0xF];
+  int ack;
+  do {
+    if (send(gdb->fd, frame, n, MSG_NOSIGNAL) != n) {
+      return;
+    }
+    ack = get_byte(gdb);
+  } while (ack == '-');
+}
+
+// Read one packet into gdb->packet, false when GDB went away
+static bool get_packet(gdbstub_t *gdb) {
+  while (1) {
+    int c;
+    do {
+      c = get_byte(gdb);
+      if (c < 0) {
+        return false;
+      }
+    } while (c != '$');
+
+    int n = 0;
+    uint8_t sum = 0;
+    while ((c = get_byte(gdb)) != '#') {
+      if (c < 0) {
+        return false;
+      }
+      if (n < GDB_PACKET_MAX - 1) {
+        gdb->packet[n++] = c;
+      }
+      sum += c;
+    }
+    gdb->packet[n] = '\0';
+    int high = hex_value(get_byte(gdb));
+    int low = hex_value(get_byte(gdb));
+    bool good = high >= 0 && low >= 0 && (high << 4 | low) == sum;
+    send(gdb->fd, good ? "+" : "-", 1, MSG_NOSIGNAL);
+    if (good) {
+      return true;
+    }
+  }
+}
+
+static uint32_t parse_hex(const char **p) {
+  uint32_t value = 0;
+  int digit;
+  while ((digit = hex_value(**p)) >= 0) {
+    value = value << 4 | digit;
+    (*p)++;
+  }
+  return value;
+}
+
+// Registers go over the wire in target (little endian) byte order
+static char *put_word(char *out, uint32_t value) {
+  for (int b = 0; b < 4; b++) {
+    uint8_t byte = value >> (8 * b);
+    *out++ = hex_digits[byte >> 4];
+    *out++ = hex_digits[byte & 0xF];
+  }
+  *out = '\0';
+  return out;
+}
+
+static bool get_word(const char **p, uint32_t *value) {
+  *value = 0;
+  for (int b = 0; b < 4; b++) {
+    int high = hex_value((*p)[0]);
+    int low = hex_value(high < 0 ? 0 : (*p)[1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    *value |= (uint32_t)(high << 4 | low) << (8 * b);
+    *p += 2;
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Target state
+///////////////////////////////////////////////////////////////////////////////
+
+static uint32_t read_register(gdbstub_t *gdb, regfile_t *regfile, int r) {
+  return r == 32 ? gdb->pc : regfile->R[r];
+}
+
+// The pipeline cannot move the PC of an instruction already in flight
+static bool write_register(gdbstub_t *gdb, regfile_t *regfile, int r, uint32_t value) {
+  if (r == 0) {
+    return true;
+  }
+  if (r < 32) {
+    regfile->R[r] = value;
+    return true;
+  }
+  if (gdb->pipeline) {
+    return value == gdb->pc;
+  }
+  gdb->pc = regfile->PC = value;
+  return true;
+}
+
+// What a load would see: memory under the stores still in the buffer
+static Byte read_byte(gdbstub_t *gdb, uint32_t addr) {
+  Byte byte = gdb->memory[addr];
+  for (int i = 0; store_buffer.enabled && i < store_buffer.count; i++) {
+    sb_entry_t *entry = &store_buffer.entries[(store_buffer.head + i) % store_buffer.size];
+    if (entry->addr <= addr && addr < entry->addr + entry->size) {
+      byte = entry->value >> (8 * (addr - entry->addr));
+    }
+  }
+  return byte;
+}
+
+static bool in_memory(uint32_t addr, uint32_t len) {
+  return (uint64_t)addr + len <= MEMORY_SPACE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Commands
+///////////////////////////////////////////////////////////////////////////////
+
+static void read_memory(gdbstub_t *gdb, const char *args) {
+  uint32_t addr = parse_hex(&args);
+  args += *args == ',';
+  uint32_t len = parse_hex(&args);
+  if (!in_memory(addr, len) || len > GDB_PACKET_MAX / 2 - 1) {
+    strcpy(gdb->reply, "E01");
+    return;
+  }
+  char *out = gdb->reply;
+  for (uint32_t i = 0; i < len; i++) {
+    Byte byte = read_byte(gdb, addr + i);
+    *out++ = hex_digits[byte >> 4];
+    *out++ = hex_digits[byte & 0xF];
+  }
+  *out = '\0';
+}
+
+static void write_memory(gdbstub_t *gdb, const char *args) {
+  uint32_t addr = parse_hex(&args);
+  args += *args == ',';
+  uint32_t len = parse_hex(&args);
+  if (*args++ != ':' || !in_memory(addr, len) || strlen(args) < 2 * len) {
+    strcpy(gdb->reply, "E01");
+    return;
+  }
+  for (uint32_t i = 0; i < len; i++) {
+    gdb->memory[addr + i] = hex_value(args[2 * i]) << 4 | hex_value(args[2 * i + 1]);
+  }
+  strcpy(gdb->reply, "OK");
+}
+
+static void read_registers(gdbstub_t *gdb, regfile_t *regfile) {
+  char *out = gdb->reply;
+  for (int r = 0; r < GDB_REGS; r++) {
+    out = put_word(out, read_register(gdb, regfile, r));
+  }
+}
+
+static void write_registers(gdbstub_t *gdb, regfile_t *regfile, const char *args) {
+  uint32_t value;
+  for (int r = 0; r < GDB_REGS && get_word(&args, &value); r++) {
+    if (!write_register(gdb, regfile, r, value)) {
+      strcpy(gdb->reply, "E01");
+      return;
+    }
+  }
+  strcpy(gdb->reply, "OK");
+}
+
+// Z0/Z1 (software or hardware, both are the same set here) and z0/z1,
+// Z2/Z3/Z4 (write, read and access watchpoints) and z2/z3/z4
+static void breakpoint(gdbstub_t *gdb, const char *args, bool insert) {
+  int type = args[0] - '0';
+  if (type < 0 || type > 4 || args[1] != ',') {
+    gdb->reply[0] = '\0';
+    return;
+  }
+  args += 2;
+  uint32_t addr = parse_hex(&args);
+  args += *args == ',';
+  uint32_t kind = parse_hex(&args);
+  if (type >= 2) {
+    int watch_kind = type == 2 ? WATCH_WRITE : type == 3 ? WATCH_READ : WATCH_ACCESS;
+    if (!insert) {
+      watch_remove(&watch, addr, kind, watch_kind);
+    } else if (!watch.enabled || !watch_insert(&watch, addr, kind, watch_kind, true)) {
+      strcpy(gdb->reply, "E02");
+      return;
+    }
+  } else if (insert && !insert_breakpoint(gdb, addr)) {
+    strcpy(gdb->reply, "E02");
+    return;
+  } else if (!insert) {
+    remove_breakpoint(gdb, addr);
+  }
+  strcpy(gdb->reply, "OK");
+}
+
+// qXfer:features:read:target.xml:offset,length
+static void read_features(gdbstub_t *gdb, const char *args) {
+  const char *annex = "target.xml:";
+  if (strncmp(args, annex, strlen(annex)) != 0) {
+    strcpy(gdb->reply, "E00");
+    return;
+  }
+  args += strlen(annex);
+  uint32_t offset = parse_hex(&args);
+  args += *args == ',';
+  uint32_t length = parse_hex(&args);
+  uint32_t size = strlen(target_xml);
+  if (length > GDB_PACKET_MAX - 2) {
+    length = GDB_PACKET_MAX - 2;
+  }
+  if (offset >= size) {
+    strcpy(gdb->reply, "l");
+    return;
+  }
+  uint32_t chunk = size - offset < length ? size - offset : length;
+  gdb->reply[0] = offset + chunk < size ? 'm' : 'l';
+  memcpy(gdb->reply + 1, target_xml + offset, chunk);
+  gdb->reply[chunk + 1] = '\0';
+}
+
+static void query(gdbstub_t *gdb, const char *packet) {
+  const char *xfer = "qXfer:features:read:";
+  if (strncmp(packet, "qSupported", 10) == 0) {
+    snprintf(gdb->reply, GDB_PACKET_MAX, "PacketSize=%x;qXfer:features:read+%s", GDB_PACKET_MAX - 4,
+             timetravel.enabled ? ";ReverseStep+;ReverseContinue+" : "");
+  } else if (strncmp(packet, xfer, strlen(xfer)) == 0) {
+    read_features(gdb, packet + strlen(xfer));
+  } else if (strcmp(packet, "qAttached") == 0) {
+    strcpy(gdb->reply, "1");
+  } else if (strcmp(packet, "qC") == 0) {
+    strcpy(gdb->reply, "QC1");
+  } else if (strcmp(packet, "qfThreadInfo") == 0) {
+    strcpy(gdb->reply, "m1");
+  } else if (strcmp(packet, "qsThreadInfo") == 0) {
+    strcpy(gdb->reply, "l");
+  } else {
+    gdb->reply[0] = '\0';
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Time travel
+///////////////////////////////////////////////////////////////////////////////
+
+// What wakes a snapshot: where the runner goes, and the breakpoints and
+// watchpoints GDB has set by now (the snapshot has the ones of its time)
+typedef struct {
+  int mode;
+  uint64_t target;
+  bool monitor;
+  char arrival[64];
+  uint64_t oldest;             // step of the oldest snapshot left
+  int breakpoints;
+  uint32_t bp_addr[GDB_BREAKPOINT_SLOTS / 2];
+  int watches;
+  struct {
+    Address addr;
+    uint32_t len;
+    int kind;
+  } watch[WATCH_MAX];
+} gdb_request_t;
+
+_Static_assert(sizeof(gdb_request_t) <= TT_REQUEST_MAX, "a request has to fit one pipe write");
+
+// Wake snapshot `index` to replay to `target`. Returns only if it is gone.
+static void travel(gdbstub_t *gdb, int index, int mode, uint64_t target, const char *arrival, bool monitor) {
+  gdb_request_t request;
+  memset(&request, 0, sizeof(request));
+  request.mode = mode;
+  request.target = target;
+  request.monitor = monitor;
+  snprintf(request.arrival, sizeof(request.arrival), "%s", arrival);
+  request.oldest = timetravel.ring[0].step;
+  for (int i = 0; i < GDB_BREAKPOINT_SLOTS; i++) {
+    if (gdb->bp_used[i]) {
+      request.bp_addr[request.breakpoints++] = gdb->bp_addr[i];
+    }
+  }
+  for (int i = 0; i < watch.count; i++) {
+    if (watch.points[i].gdb) {
+      request.watch[request.watches].addr = watch.points[i].addr;
+      request.watch[request.watches].len = watch.points[i].len;
+      request.watch[request.watches++].kind = watch.points[i].kind;
+    }
+  }
+  tt_travel(&timetravel, index, &request, sizeof(request));
+}
+
+// A runner just forked from a snapshot: take over GDB and head for the target
+static void install(gdbstub_t *gdb, const gdb_request_t *request) {
+  tt_trim(&timetravel, request->oldest);
+  gdb->rx_len = gdb->rx_pos = 0;    // what the snapshot had read is long answered
+  memset(gdb->bp_used, 0, sizeof(gdb->bp_used));
+  gdb->breakpoints = 0;
+  for (int i = 0; i < request->breakpoints; i++) {
+    insert_breakpoint(gdb, request->bp_addr[i]);
+  }
+  for (int i = watch.count - 1; i >= 0; i--) {
+    if (watch.points[i].gdb) {
+      watch_remove(&watch, watch.points[i].addr, watch.points[i].len, watch.points[i].kind);
+    }
+  }
+  for (int i = 0; i < request->watches; i++) {
+    watch_insert(&watch, request->watch[i].addr, request->watch[i].len, request->watch[i].kind, true);
+  }
+  watch_arm(&watch);    // the snapshot may have had nothing to watch
+  gdb->mode = request->mode;
+  gdb->target = request->target;
+  gdb->monitor = request->monitor;
+  memcpy(gdb->arrival, request->arrival, sizeof(gdb->arrival));
+  gdb->base = gdb->step;
+  gdb->event = 0;
+  gdb->stepping = false;
+  gdb->running = true;
+}
+
+static void snapshot(gdbstub_t *gdb) {
+  gdb_request_t request;
+  if (tt_snapshot(&timetravel, gdb->step, *gdb->cycles, &request, sizeof(request))) {
+    install(gdb, &request);
+  }
+}
+
+// bs: back to the step before, bc: back to the last breakpoint or watchpoint
+// hit, scanning the snapshots newest first
+static void reverse(gdbstub_t *gdb, bool to_hit) {
+  int index = gdb->at > 1 ? tt_find(&timetravel, gdb->at - 1, false) : -1;
+  if (index < 0) {
+    strcpy(gdb->reply, "T05replaylog:begin;");    // nothing recorded before
+    return;
+  }
+  if (to_hit) {
+    travel(gdb, index, GDB_SCAN, gdb->at, "", false);
+  } else {
+    travel(gdb, index, GDB_GOTO, gdb->at - 1, "S05", false);
+  }
+  strcpy(gdb->reply, "E01");
+}
+
+// Text for GDB's console, as an O packet
+static void console(gdbstub_t *gdb, const char *format, ...) {
+  char text[GDB_PACKET_MAX / 2 - 1];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  char *out = gdb->reply;
+  *out++ = 'O';
+  for (const char *p = text; *p; p++) {
+    *out++ = hex_digits[(uint8_t)*p >> 4];
+    *out++ = hex_digits[*p & 0xF];
+  }
+  *out = '\0';
+  put_packet(gdb, gdb->reply);
+  strcpy(gdb->reply, "OK");
+}
+
+/*
+qRcmd: "monitor goto <cycle>" and "monitor snapshots". A goto forward runs
+on from here, one back replays from the newest snapshot before the cycle.
+Returns true when the target has to run; the answer comes at the arrival.
+*/
+static bool monitor(gdbstub_t *gdb, const char *hex) {
+  char command[128];
+  int n = 0;
+  while (hex_value(hex[0]) >= 0 && hex_value(hex[1]) >= 0 && n < (int)sizeof(command) - 1) {
+    command[n++] = hex_value(hex[0]) << 4 | hex_value(hex[1]);
+    hex += 2;
+  }
+  command[n] = '\0';
+
+  if (!timetravel.enabled) {
+    console(gdb, "Time travel needs the simulator started with -J\n");
+  } else if (strncmp(command, "goto ", 5) == 0) {
+    char *end;
+    uint64_t cycle = strtoull(command + 5, &end, 0);
+    if (end == command + 5 || *end != '\0') {
+      console(gdb, "Usage: monitor goto <cycle>\n");
+    } else if (cycle > *gdb->cycles) {
+      gdb->mode = GDB_GOTO_CYCLE;
+      gdb->target = cycle;
+      gdb->monitor = true;
+      gdb->stepping = false;
+      gdb->running = true;
+      schedule(gdb);
+      return true;
+    } else if (cycle == *gdb->cycles) {
+      console(gdb, "At cycle %lu, pc 0x%08x\n", (unsigned long)cycle, gdb->pc);
+    } else {
+      int index = tt_find(&timetravel, cycle, true);
+      if (index >= 0) {
+        travel(gdb, index, GDB_GOTO_CYCLE, cycle, "", true);
+      }
+      console(gdb, "Cycle %lu is before the oldest snapshot\n", (unsigned long)cycle);
+    }
+  } else if (strcmp(command, "snapshots") == 0) {
+    for (int i = 0; i < timetravel.count; i++) {
+      tt_snapshot_t *snapshot = &timetravel.ring[i];
+      console(gdb, "Snapshot %d: step %lu, cycle %lu\n", i, (unsigned long)snapshot->step,
+              (unsigned long)snapshot->cycle);
+    }
+    console(gdb, "Now at step %lu, cycle %lu\n", (unsigned long)gdb->at, (unsigned long)*gdb->cycles);
+  } else {
+    console(gdb, "Commands: goto <cycle>, snapshots\n");
+  }
+  return false;
+}
+
+/*
+Serve GDB while the target is stopped. Returns once GDB continues or steps
+it (with stepping set for a step), or after a detach.
+*/
+static void serve_packets(gdbstub_t *gdb, regfile_t *regfile) {
+  while (get_packet(gdb)) {
+    const char *packet = gdb->packet;
+    const char *args = packet + 1;
+    uint32_t value;
+    gdb->reply[0] = '\0';
+    switch (packet[0]) {
+    case '?':
+      snprintf(gdb->reply, GDB_PACKET_MAX, "S%02x", gdb->signal);
+      break;
+    case 'g':
+      read_registers(gdb, regfile);
+      break;
+    case 'G':
+      write_registers(gdb, regfile, args);
+      break;
+    case 'p':
+      value = parse_hex(&args);
+      if (value < GDB_REGS) {
+        put_word(gdb->reply, read_register(gdb, regfile, value));
+      } else {
+        strcpy(gdb->reply, "E01");
+      }
+      break;
+    case 'P': {
+      uint32_t word;
+      value = parse_hex(&args);
+      bool written = *args++ == '=' && value < GDB_REGS && get_word(&args, &word) &&
+                     write_register(gdb, regfile, value, word);
+      strcpy(gdb->reply, written ? "OK" : "E01");
+      break;
+    }
+    case 'm':
+      read_memory(gdb, args);
+      break;
+    case 'M':
+      write_memory(gdb, args);
+      break;
+    case 'c':
+    case 's':
+      if (*args && !write_register(gdb, regfile, 32, parse_hex(&args))) {
+        strcpy(gdb->reply, "E01");
+        break;
+      }
+      gdb->stepping = packet[0] == 's';
+      gdb->running = true;
+      return;
+    case 'Z':
+    case 'z':
+      breakpoint(gdb, args, packet[0] == 'Z');
+      break;
+    case 'H':
+      strcpy(gdb->reply, "OK");
+      break;
+    case 'q':
+      if (strncmp(packet, "qRcmd,", 6) == 0) {
+        if (monitor(gdb, packet + 6)) {
+          return;
+        }
+      } else {
+        query(gdb, packet);
+      }
+      break;
+    case 'b':
+      if ((args[0] == 's' || args[0] == 'c') && timetravel.enabled) {
+        reverse(gdb, args[0] == 'c');
+      }
+      break;
+    case 'k':
+      gdb->enabled = false;
+      close(gdb->fd);
+      exit(0);
+    case 'D':
+      put_packet(gdb, "OK");
+      gdb_close(gdb, -1);
+      return;
+    default:
+      break;     // unsupported: the empty reply
+    }
+    put_packet(gdb, gdb->reply);
+  }
+  // GDB went away, run on without it
+  gdb_close(gdb, -1);
+}
+
+// Watched pages stay open while GDB looks at memory
+static void serve(gdbstub_t *gdb, regfile_t *regfile) {
+  watch_disarm(&watch);
+  serve_packets(gdb, regfile);
+  watch_arm(&watch);
+}
+
+// A Ctrl-C (0x03) GDB sent while the target runs
+static bool interrupted(gdbstub_t *gdb) {
+  if (gdb->rx_pos == gdb->rx_len) {
+    ssize_t n = recv(gdb->fd, gdb->rx, sizeof(gdb->rx), MSG_DONTWAIT);
+    if (n <= 0) {
+      return false;
+    }
+    gdb->rx_len = n;
+    gdb->rx_pos = 0;
+  }
+  while (gdb->rx_pos < gdb->rx_len) {
+    if (gdb->rx[gdb->rx_pos++] == 0x03) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Report the stop reply in gdb->reply and serve GDB until it resumes. The
+// target stands before step `at`.
+static void stop(gdbstub_t *gdb, regfile_t *regfile, uint32_t pc, int signal, uint64_t at) {
+  gdb->stepping = false;
+  gdb->pc = pc;
+  gdb->at = at;
+  gdb->signal = signal;
+  if (gdb->running) {
+    put_packet(gdb, gdb->reply);
+    gdb->running = false;
+  }
+  serve(gdb, regfile);
+}
+
+/*
+A scan reached the step it started from. Go to the last hit in the segment
+it replayed, or scan the segment before, or stop at the oldest snapshot if
+there is none. The snapshot scanned from should still be there; if the
+ring was too small for that, stop here.
+*/
+static void end_scan(gdbstub_t *gdb, regfile_t *regfile, uint32_t pc) {
+  int index = tt_find(&timetravel, gdb->base, false);
+  if (index >= 0 && timetravel.ring[index].step == gdb->base) {
+    if (gdb->event > 0) {
+      travel(gdb, index, GDB_GOTO, gdb->event, gdb->event_reply, false);
+    } else if (index > 0) {
+      travel(gdb, index - 1, GDB_SCAN, gdb->base, "", false);
+    } else {
+      travel(gdb, index, GDB_GOTO, gdb->base, "T05replaylog:begin;", false);
+    }
+  }
+  strcpy(gdb->reply, "S05");
+  stop(gdb, regfile, pc, 5, gdb->step);
+}
+
+// A replay got to its target
+static void arrive(gdbstub_t *gdb, regfile_t *regfile, uint32_t pc) {
+  int mode = gdb->mode;
+  gdb->mode = GDB_RUN;
+  schedule(gdb);
+  if (mode == GDB_SCAN) {
+    end_scan(gdb, regfile, pc);
+    return;
+  }
+  if (gdb->monitor) {
+    gdb->monitor = false;
+    console(gdb, "At cycle %lu, pc 0x%08x\n", (unsigned long)*gdb->cycles, pc);
+  } else {
+    strcpy(gdb->reply, gdb->arrival);
+  }
+  stop(gdb, regfile, pc, 5, gdb->step);
+}
+
+// gdb_check said to look at the instruction at `pc`: stop there for a step,
+// a breakpoint or a Ctrl-C and serve GDB until it resumes the target. Due
+// work comes first: a snapshot (a runner restored from it comes back here),
+// the Ctrl-C poll and the end of a replay.
+void gdb_trap(gdbstub_t *gdb, regfile_t *regfile, uint32_t pc) {
+  int signal = 0;
+  if (gdb->step == gdb->wake) {
+    if (timetravel.enabled && gdb->step == timetravel.next) {
+      if (gdb->mode == GDB_RUN) {
+        snapshot(gdb);
+      } else {
+        timetravel.next += timetravel.interval;    // a replay keeps the ring as it is
+      }
+    }
+    if (gdb->step >= gdb->poll_at) {
+      gdb->poll_at = gdb->step + GDB_POLL_INTERVAL;
+      signal = gdb->mode == GDB_RUN && interrupted(gdb) ? 2 : 0;    // SIGINT
+    }
+    schedule(gdb);
+    if (gdb->mode == GDB_GOTO_CYCLE ? *gdb->cycles >= gdb->target
+                                    : gdb->mode != GDB_RUN && gdb->step == gdb->target) {
+      arrive(gdb, regfile, pc);
+      return;
+    }
+  }
+  bool breakpoint = gdb->breakpoints > 0 && gdb_has_breakpoint(gdb, pc);
+  if (gdb->mode == GDB_SCAN && breakpoint) {
+    gdb->event = gdb->step;
+    strcpy(gdb->event_reply, "S05");
+  }
+  if (gdb->mode != GDB_RUN) {
+    return;
+  }
+  if (gdb->stepping || breakpoint) {
+    signal = 5;                           // SIGTRAP
+  }
+  if (signal == 0) {
+    return;
+  }
+  snprintf(gdb->reply, GDB_PACKET_MAX, "S%02x", signal);
+  stop(gdb, regfile, pc, signal, gdb->step);
+}
+
+// A watchpoint GDB set was hit by the instruction before `pc` (-m) or the
+// instruction at `pc` (-s)
+void gdb_watch(gdbstub_t *gdb, regfile_t *regfile, uint32_t pc, const watchpoint_t *wp) {
+  const char *reason = wp->kind == WATCH_READ ? "rwatch" : wp->kind == WATCH_ACCESS ? "awatch" : "watch";
+  if (gdb->mode == GDB_SCAN) {
+    // going back, stop before the access
+    gdb->event = gdb->step;
+    snprintf(gdb->event_reply, sizeof(gdb->event_reply), "T05%s:%x;", reason, wp->addr);
+    return;
+  }
+  if (gdb->mode != GDB_RUN) {
+    return;
+  }
+  snprintf(gdb->reply, GDB_PACKET_MAX, "T05%s:%x;", reason, wp->addr);
+  stop(gdb, regfile, pc, 5, gdb->step + 1);
+}
+
+// The pipeline (-s): look at the pair writeback retires this cycle
+void gdb_retire(gdbstub_t *gdb, regfile_t *regfile, const memwb_reg_t *memwb) {
+  if (memwb->bubble || memwb->instr.bits == 0) {
+    return;
+  }
+  if (gdb_check(gdb, memwb->instr_addr)) {
+    gdb_trap(gdb, regfile, memwb->instr_addr);
+  }
+  if (gdb->enabled && memwb->dualHazard && memwb->instrDUAL.bits != 0 &&
+      gdb->breakpoints > 0 && gdb_has_breakpoint(gdb, memwb->instr_addrDUAL)) {
+    gdb_trap(gdb, regfile, memwb->instr_addrDUAL);
+  }
+}
+
+// Tell a waiting GDB the program exited with `status` (-1: detach quietly)
+void gdb_close(gdbstub_t *gdb, int status) {
+  if (!gdb->enabled) {
+    return;
+  }
+  if (status >= 0 && gdb->running) {
+    char exited[4];
+    snprintf(exited, sizeof(exited), "W%02x", status & 0xFF);
+    put_packet(gdb, exited);
+  }
+  close(gdb->fd);
+  tt_kill_all(&timetravel);
+  timetravel.enabled = false;
+  gdb->enabled = false;
+  gdb->stepping = false;
+  gdb->breakpoints = 0;
+  for (int i = watch.count - 1; i >= 0; i--) {
+    watchpoint_t *wp = &watch.points[i];
+    if (wp->gdb) {
+      watch_remove(&watch, wp->addr, wp->len, wp->kind);
+    }
+  }
+}
@@ -0,0 +1,106 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+#include "riscv.h"
+#include "pipeline.h"
+#include "watch.h"
+#include "timetravel.h"
+
+// GDB remote stub (-G port|path). The simulator waits for GDB on a local
+// TCP port (or a Unix socket when the argument is a path) and serves the
+// remote serial protocol: registers, memory, continue, single-step,
+// breakpoints and watchpoints (target remote :port).
+// The emulator (-m) stops before the instruction at a breakpoint executes.
+// The pipeline (-s) stops at the start of the cycle that retires it: every
+// older instruction has written back, the breakpoint itself has not (a
+// store in it may already have reached memory), and a step runs to the next
+// instruction that retires.
+// Breakpoints live in a hashed set of PCs, so running to one costs a single
+// probe per instruction (none while the set is empty); GDB's Ctrl-C is only
+// looked for every GDB_POLL_INTERVAL instructions or cycles.
+// With -J the stub also runs backwards (reverse-step, reverse-continue and
+// "monitor goto <cycle>") by replaying from fork snapshots, see timetravel.h.
+// Steps count the stop points: instructions (-m) or retiring cycles (-s).
+
+#define GDB_BREAKPOINT_SLOTS 256     // hash set size, a power of two, half of it usable
+#define GDB_POLL_INTERVAL (1 << 16)
+#define GDB_PACKET_MAX 4096
+#define GDB_REGS 33                  // x0-x31 and pc
+
+typedef struct {
+    bool enabled;
+    bool pipeline;             // -s: stops at retirement, pc not writable
+    int fd;                    // the connection to GDB
+    bool stepping;
+    uint64_t step;             // stop points so far, counted by gdb_check
+    uint64_t wake;             // step gdb_trap has work at: a poll, a snapshot, a replay target
+    uint64_t poll_at;          // step of the next Ctrl-C poll
+    uint64_t at;               // step the target stopped before
+    const uint64_t *cycles;    // the cycle counter "monitor goto" goes by
+    uint32_t pc;               // where the target stopped
+    Byte *memory;
+
+    uint32_t bp_addr[GDB_BREAKPOINT_SLOTS];
+    bool bp_used[GDB_BREAKPOINT_SLOTS];  // open addressing, rebuilt on removal
+    int breakpoints;
+
+    int signal;                // why it stopped, for '?'
+    bool running;              // GDB waits for a stop reply
+    char rx[GDB_PACKET_MAX];   // bytes read from GDB, not yet parsed
+    int rx_len;
+    int rx_pos;
+    char packet[GDB_PACKET_MAX];
+    char reply[GDB_PACKET_MAX];
+
+    // a runner replaying from a snapshot, until `target`
+    int mode;
+    uint64_t target;
+    uint64_t base;             // step of the snapshot it came from
+    bool monitor;              // the arrival answers "monitor goto", not a resume
+    char arrival[64];          // stop reply at the target
+    uint64_t event;            // GDB_SCAN: step of the last hit seen, 0 if none
+    char event_reply[64];
+} gdbstub_t;
+
+enum gdb_mode_enum {
+  GDB_RUN = 0,                 // stop at steps, breakpoints and watchpoints
+  GDB_GOTO,                    // run to step `target`
+  GDB_GOTO_CYCLE,              // run to the first step at cycle `target` or later
+  GDB_SCAN                     // run to step `target`, note the hits on the way
+};
+
+extern gdbstub_t gdb;
+
+// Function declarations
+bool gdb_open(gdbstub_t *gdb, const char *spec, Byte *memory, bool pipeline, const uint64_t *cycles);
+void gdb_trap(gdbstub_t *gdb, regfile_t *regfile, uint32_t pc);
+void gdb_retire(gdbstub_t *gdb, regfile_t *regfile, const memwb_reg_t *memwb);
+void gdb_watch(gdbstub_t *gdb, regfile_t *regfile, uint32_t pc, const watchpoint_t *wp);
+void gdb_close(gdbstub_t *gdb, int status);
+
+// The slot `pc` hashes to first, probing goes on linearly from there
+static inline int gdb_hash(uint32_t pc) {
+  return ((pc >> 1) * 2654435761u) >> 24 & (GDB_BREAKPOINT_SLOTS - 1);
+}
+
+static inline bool gdb_has_breakpoint(const gdbstub_t *gdb, uint32_t pc) {
+  for (int i = gdb_hash(pc);; i = (i + 1) & (GDB_BREAKPOINT_SLOTS - 1)) {
+    if (!gdb->bp_used[i]) {
+      return false;
+    }
+    if (gdb->bp_addr[i] == pc) {
+      return true;
+    }
+  }
+}
+
+// Called before every instruction (or retirement): true when the stub has to
+// look at it, because of a step, a breakpoint or work due at this step
+static inline bool gdb_check(gdbstub_t *gdb, uint32_t pc) {
+  return ++gdb->step == gdb->wake || gdb->stepping ||
+         (gdb->breakpoints > 0 && gdb_has_breakpoint(gdb, pc));
+}
+#endif // GDBSTUB_H
@@ -0,0 +1,104 @@
+#include "hostperf.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *host_event_names[HOST_EVENTS] = {
+  "cycles", "instructions", "LLC misses", "mispredicts"
+};
+
+double host_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#ifdef __linux__
+static int open_counter(int event) {
+  static const uint64_t configs[HOST_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+  };
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = configs[event];
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+// `counters` false measures time only
+void hostperf_open(hostperf_t *hp, bool counters) {
+  memset(hp, 0, sizeof(*hp));
+  for (int e = 0; e < HOST_EVENTS; e++) {
+    hp->fds[e] = -1;
+    #ifdef __linux__
+    if (counters) {
+      hp->fds[e] = open_counter(e);
+    }
+    #endif
+    hp->valid[e] = hp->fds[e] >= 0;
+  }
+}
+
+void hostperf_start(hostperf_t *hp) {
+  #ifdef __linux__
+  for (int e = 0; e < HOST_EVENTS; e++) {
+    if (hp->valid[e]) {
+      ioctl(hp->fds[e], PERF_EVENT_IOC_RESET, 0);
+      ioctl(hp->fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  #endif
+  hp->start = host_time();
+}
+
+void hostperf_stop(hostperf_t *hp) {
+  hp->seconds = host_time() - hp->start;
+  for (int e = 0; e < HOST_EVENTS; e++) {
+    if (!hp->valid[e]) {
+      continue;
+    }
+    #ifdef __linux__
+    ioctl(hp->fds[e], PERF_EVENT_IOC_DISABLE, 0);
+    #endif
+    if (read(hp->fds[e], &hp->counts[e], sizeof(uint64_t)) != sizeof(uint64_t)) {
+      hp->valid[e] = false;
+    }
+  }
+}
+
+void hostperf_close(hostperf_t *hp) {
+  for (int e = 0; e < HOST_EVENTS; e++) {
+    if (hp->fds[e] >= 0) {
+      close(hp->fds[e]);
+    }
+    hp->fds[e] = -1;
+  }
+}
+
+// Host counters of the last start/stop interval, "n/a" when not available
+void hostperf_print(const hostperf_t *hp) {
+  for (int e = 0; e < HOST_EVENTS; e++) {
+    char name[32];
+    snprintf(name, sizeof(name), "Host %s", host_event_names[e]);
+    if (hp->valid[e]) {
+      printf("#%-18s= %5lu\n", name, (unsigned long)hp->counts[e]);
+    } else {
+      printf("#%-18s=   n/a\n", name);
+    }
+  }
+  if (hp->valid[HOST_CYCLES] && hp->valid[HOST_INSTRUCTIONS] && hp->counts[HOST_CYCLES] > 0) {
+    printf("#Host IPC          = %8.3f\n", (double)hp->counts[HOST_INSTRUCTIONS] / hp->counts[HOST_CYCLES]);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef HOSTPERF_H
+#define HOSTPERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Measures the simulator itself on the host: wall-clock time and, on Linux,
+// hardware counters read through perf_event_open. A counter the kernel
+// refuses (no permission, virtual machine, other OS) is reported as
+// unavailable and everything else still works.
+
+enum host_event_enum {
+  HOST_CYCLES = 0,
+  HOST_INSTRUCTIONS,
+  HOST_CACHE_MISSES,     // last level cache misses
+  HOST_BRANCH_MISSES,
+  HOST_EVENTS
+};
+
+typedef struct {
+    int fds[HOST_EVENTS];
+    bool valid[HOST_EVENTS];
+    uint64_t counts[HOST_EVENTS];
+    double start;
+    double seconds;
+} hostperf_t;
+
+// Function declarations
+double host_time(void);
+void hostperf_open(hostperf_t *hp, bool counters);
+void hostperf_start(hostperf_t *hp);
+void hostperf_stop(hostperf_t *hp);
+void hostperf_close(hostperf_t *hp);
+void hostperf_print(const hostperf_t *hp);
+#endif // HOSTPERF_H
@@ -0,0 +1,114 @@
+#include "issuestat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+issue_stats_t issue_stats = {0};
+
+static const char *issue_reason_names[ISSUE_REASONS] = {
+  "dual", "empty", "structural", "data", "control"
+};
+
+void issue_init(int top) {
+  memset(&issue_stats, 0, sizeof(issue_stats));
+  issue_stats.enabled = true;
+  issue_stats.top = top > 0 ? top : ISSUE_TOP_PAIRS;
+  issue_stats.pair_capacity = 256;
+  issue_stats.pairs = calloc(issue_stats.pair_capacity, sizeof(issue_pair_t));
+}
+
+void issue_free(void) {
+  free(issue_stats.pairs);
+  memset(&issue_stats, 0, sizeof(issue_stats));
+}
+
+static issue_pair_t *pair_entry(uint32_t pc, int reason) {
+  if (issue_stats.pair_used * 2 >= issue_stats.pair_capacity) {
+    issue_pair_t *old = issue_stats.pairs;
+    uint64_t old_capacity = issue_stats.pair_capacity;
+    issue_stats.pair_capacity *= 2;
+    issue_stats.pairs = calloc(issue_stats.pair_capacity, sizeof(issue_pair_t));
+    issue_stats.pair_used = 0;
+    for (uint64_t i = 0; i < old_capacity; i++) {
+      if (old[i].pc != 0) {
+        *pair_entry(old[i].pc - 1, old[i].reason) = old[i];
+      }
+    }
+    free(old);
+  }
+  uint64_t i = ((pc * 2654435761U) ^ reason) & (issue_stats.pair_capacity - 1);
+  while (issue_stats.pairs[i].pc != 0 &&
+         (issue_stats.pairs[i].pc != pc + 1 || issue_stats.pairs[i].reason != reason)) {
+    i = (i + 1) & (issue_stats.pair_capacity - 1);
+  }
+  if (issue_stats.pairs[i].pc == 0) {
+    issue_stats.pairs[i].pc = pc + 1;
+    issue_stats.pairs[i].reason = reason;
+    issue_stats.pair_used++;
+  }
+  return &issue_stats.pairs[i];
+}
+
+// Classify the pair that just executed, after squashed ones became bubbles
+void issue_record(const exmem_reg_t *exmem_reg) {
+  if (exmem_reg->bubble || exmem_reg->instr.bits == 0) {
+    issue_stats.bubbles++;
+    return;
+  }
+  int reason = exmem_reg->dual_block;
+  issue_stats.reasons[reason]++;
+  issue_stats.issued += exmem_reg->dualHazard ? 2 : 1;
+  if (reason == DUAL_ISSUED || reason == DUAL_EMPTY) {
+    return;
+  }
+  issue_pair_t *pair = pair_entry(exmem_reg->instr_addr, reason);
+  pair->pcDUAL = exmem_reg->instr_addrDUAL;
+  pair->bits = exmem_reg->instr.bits;
+  pair->bitsDUAL = exmem_reg->instrDUAL.bits;
+  pair->count++;
+}
+
+static int compare_pairs(const void *a, const void *b) {
+  uint64_t x = ((const issue_pair_t *)a)->count, y = ((const issue_pair_t *)b)->count;
+  return (x < y) - (x > y);
+}
+
+void issue_print_stats(uint64_t total_cycles) {
+  uint64_t pipeline_cycles = issue_stats.bubbles;
+  for (int r = 0; r < ISSUE_REASONS; r++) {
+    pipeline_cycles += issue_stats.reasons[r];
+  }
+  printf("#Issue dual        = %5lu\n", (unsigned long)issue_stats.reasons[DUAL_ISSUED]);
+  printf("#Issue single      = %5lu\n", (unsigned long)issue_stats.reasons[DUAL_EMPTY]);
+  printf("#Issue structural  = %5lu\n", (unsigned long)issue_stats.reasons[DUAL_STRUCTURAL]);
+  printf("#Issue data        = %5lu\n", (unsigned long)issue_stats.reasons[DUAL_DATA]);
+  printf("#Issue control     = %5lu\n", (unsigned long)issue_stats.reasons[DUAL_CONTROL]);
+  printf("#Issue bubbles     = %5lu\n", (unsigned long)issue_stats.bubbles);
+  // utilization of both slots, over pipeline cycles and over all cycles
+  // (the latter also counts the cycles stalls added to the clock)
+  printf("#Issue width used  = %8.3f (of 2 per pipeline cycle)\n",
+         pipeline_cycles ? (double)issue_stats.issued / pipeline_cycles : 0.0);
+  printf("#Issue utilization = %8.3f (of all slots over all cycles)\n",
+         total_cycles ? (double)issue_stats.issued / (2.0 * total_cycles) : 0.0);
+
+  // the most frequent blocked pairs
+  issue_pair_t *sorted = malloc(issue_stats.pair_used * sizeof(issue_pair_t));
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < issue_stats.pair_capacity; i++) {
+    if (issue_stats.pairs[i].pc != 0) {
+      sorted[n++] = issue_stats.pairs[i];
+    }
+  }
+  qsort(sorted, n, sizeof(issue_pair_t), compare_pairs);
+  if (n > 0) {
+    printf("# blocked pairs    count  reason      first / second\n");
+  }
+  for (uint64_t i = 0; i < n && i < (uint64_t)issue_stats.top; i++) {
+    char first[64], second[64];
+    disassemble(sorted[i].bits, first, sizeof(first));
+    disassemble(sorted[i].bitsDUAL, second, sizeof(second));
+    printf("# %08x %10lu  %-10s  %s / %08x %s\n", sorted[i].pc - 1, (unsigned long)sorted[i].count,
+           issue_reason_names[sorted[i].reason], first, sorted[i].pcDUAL, second);
+  }
+  free(sorted);
+}
@@ -0,0 +1,48 @@
+#ifndef ISSUESTAT_H
+#define ISSUESTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "riscv.h"
+#include "pipeline.h"
+
+// Dual-issue slot accounting (-Q[n]). Every pipeline cycle the pair that
+// reaches execute is classified as decode and execute found it: both slots
+// used, or why the second stayed empty. Blocked pairs are also counted per
+// PC and reason, and the n most frequent are printed with their
+// disassembly, to show which code patterns waste the second slot.
+
+#define ISSUE_TOP_PAIRS 10  // blocking pairs printed by default
+
+#define ISSUE_REASONS (DUAL_CONTROL + 1)
+
+typedef struct {
+    uint32_t pc;          // pc + 1 of the first instruction, 0 for a free entry
+    uint32_t pcDUAL;
+    uint32_t bits;
+    uint32_t bitsDUAL;
+    int reason;
+    uint64_t count;
+} issue_pair_t;
+
+typedef struct {
+    bool enabled;
+    int top;
+    uint64_t reasons[ISSUE_REASONS];
+    uint64_t bubbles;      // pipeline cycles with nothing to issue
+    uint64_t issued;       // instructions issued, one or two per pair
+
+    // blocked pairs (open addressing on pc and reason)
+    issue_pair_t *pairs;
+    uint64_t pair_capacity;
+    uint64_t pair_used;
+} issue_stats_t;
+
+extern issue_stats_t issue_stats;
+
+// Function declarations
+void issue_init(int top);
+void issue_record(const exmem_reg_t *exmem_reg);
+void issue_print_stats(uint64_t total_cycles);
+void issue_free(void);
+#endif // ISSUESTAT_H
@@ -0,0 +1,208 @@
+#include "missclass.h"
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *miss_class_names[MISS_CLASS_COUNT] = {"compulsory", "capacity", "conflict"};
+
+void mc_init(missclass_t *mc, int setBits, int linesPerSet, int blockBits) {
+  memset(mc, 0, sizeof(*mc));
+  mc->setBits = setBits;
+  mc->blockBits = blockBits;
+  mc->shadow_capacity = linesPerSet << setBits;
+  mc->shadow_blocks = calloc(mc->shadow_capacity, sizeof(unsigned long long));
+  mc->shadow_stamps = calloc(mc->shadow_capacity, sizeof(uint64_t));
+  mc->seen_capacity = 1024;
+  mc->seen = calloc(mc->seen_capacity, sizeof(unsigned long long));
+  mc->pc_capacity = 256;
+  mc->pc_keys = calloc(mc->pc_capacity, sizeof(uint32_t));
+  mc->pc_counts = calloc(mc->pc_capacity, sizeof(mc_counts_t));
+  mc->per_set = calloc((size_t)1 << setBits, sizeof(mc_counts_t));
+}
+
+void mc_free(missclass_t *mc) {
+  free(mc->shadow_blocks);
+  free(mc->shadow_stamps);
+  free(mc->seen);
+  free(mc->pc_keys);
+  free(mc->pc_counts);
+  free(mc->per_set);
+}
+
+// Access the shadow fully associative LRU cache, returns true on a hit
+static bool shadow_access(missclass_t *mc, unsigned long long block) {
+  mc->clock++;
+  int victim = 0;
+  for (int i = 0; i < mc->shadow_used; i++) {
+    if (mc->shadow_blocks[i] == block) {
+      mc->shadow_stamps[i] = mc->clock;
+      return true;
+    }
+    if (mc->shadow_stamps[i] < mc->shadow_stamps[victim]) {
+      victim = i;
+    }
+  }
+  if (mc->shadow_used < mc->shadow_capacity) {
+    victim = mc->shadow_used++;
+  }
+  mc->shadow_blocks[victim] = block;
+  mc->shadow_stamps[victim] = mc->clock;
+  return false;
+}
+
+// Mark `block` as seen, returns true if it was seen before
+static bool seen_insert(missclass_t *mc, unsigned long long block) {
+  if (mc->seen_used * 2 >= mc->seen_capacity) {
+    unsigned long long *old = mc->seen;
+    uint64_t old_capacity = mc->seen_capacity;
+    mc->seen_capacity *= 2;
+    mc->seen = calloc(mc->seen_capacity, sizeof(unsigned long long));
+    mc->seen_used = 0;
+    for (uint64_t i = 0; i < old_capacity; i++) {
+      if (old[i] != 0) {
+        seen_insert(mc, old[i] - 1);
+      }
+    }
+    free(old);
+  }
+  uint64_t i = (block * 0x9E3779B97F4A7C15ULL) & (mc->seen_capacity - 1);
+  while (mc->seen[i] != 0) {
+    if (mc->seen[i] == block + 1) {
+      return true;
+    }
+    i = (i + 1) & (mc->seen_capacity - 1);
+  }
+  mc->seen[i] = block + 1;
+  mc->seen_used++;
+  return false;
+}
+
+// Slot holding `pc`, or the empty slot where it would go
+static uint64_t pc_slot(const missclass_t *mc, uint32_t pc) {
+  uint64_t i = (pc * 2654435761U) & (mc->pc_capacity - 1);
+  while (mc->pc_keys[i] != 0 && mc->pc_keys[i] != pc + 1) {
+    i = (i + 1) & (mc->pc_capacity - 1);
+  }
+  return i;
+}
+
+static mc_counts_t *pc_counts(missclass_t *mc, uint32_t pc) {
+  if (mc->pc_used * 2 >= mc->pc_capacity) {
+    uint32_t *old_keys = mc->pc_keys;
+    mc_counts_t *old_counts = mc->pc_counts;
+    uint64_t old_capacity = mc->pc_capacity;
+    mc->pc_capacity *= 2;
+    mc->pc_keys = calloc(mc->pc_capacity, sizeof(uint32_t));
+    mc->pc_counts = calloc(mc->pc_capacity, sizeof(mc_counts_t));
+    mc->pc_used = 0;
+    for (uint64_t i = 0; i < old_capacity; i++) {
+      if (old_keys[i] != 0) {
+        *pc_counts(mc, old_keys[i] - 1) = old_counts[i];
+      }
+    }
+    free(old_keys);
+    free(old_counts);
+  }
+  uint64_t i = pc_slot(mc, pc);
+  if (mc->pc_keys[i] == 0) {
+    mc->pc_keys[i] = pc + 1;
+    mc->pc_used++;
+  }
+  return &mc->pc_counts[i];
+}
+
+static void count(mc_counts_t *counts, int status, int miss_class) {
+  counts->accesses++;
+  if (status != CACHE_HIT) {
+    counts->misses[miss_class]++;
+  }
+  if (status == CACHE_EVICT) {
+    counts->evictions++;
+  }
+}
+
+// Classify one access of the real cache, `status` is its operateCache result
+void mc_record(missclass_t *mc, unsigned long long address, int status, uint32_t pc) {
+  unsigned long long block = address >> mc->blockBits;
+  bool seen = seen_insert(mc, block);
+  bool shadow_hit = shadow_access(mc, block);
+
+  int miss_class = !seen ? MISS_COMPULSORY : (shadow_hit ? MISS_CONFLICT : MISS_CAPACITY);
+  count(&mc->total, status, miss_class);
+  count(&mc->per_set[block & ((1ULL << mc->setBits) - 1)], status, miss_class);
+  count(pc_counts(mc, pc), status, miss_class);
+}
+
+void mc_print_stats(const missclass_t *mc) {
+  printf("#Compulsory misses = %5lu\n", (unsigned long)mc->total.misses[MISS_COMPULSORY]);
+  printf("#Capacity misses   = %5lu\n", (unsigned long)mc->total.misses[MISS_CAPACITY]);
+  printf("#Conflict misses   = %5lu\n", (unsigned long)mc->total.misses[MISS_CONFLICT]);
+}
+
+static void write_counts(FILE *csv, const mc_counts_t *counts) {
+  uint64_t misses = 0;
+  for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+    misses += counts->misses[c];
+  }
+  fprintf(csv, "%lu,%lu,%lu", (unsigned long)counts->accesses, (unsigned long)misses,
+          (unsigned long)counts->evictions);
+  for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+    fprintf(csv, ",%lu", (unsigned long)counts->misses[c]);
+  }
+  fprintf(csv, "\n");
+}
+
+static void write_header(FILE *csv, const char *key) {
+  fprintf(csv, "%s,accesses,misses,evictions", key);
+  for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+    fprintf(csv, ",%s", miss_class_names[c]);
+  }
+  fprintf(csv, "\n");
+}
+
+static int compare_pc(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Write <prefix>_sets.csv (one row per set) and <prefix>_pcs.csv (one row
+// per load/store PC, in address order)
+int mc_write_csv(const missclass_t *mc, const char *prefix) {
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s_sets.csv", prefix);
+  FILE *csv = fopen(filename, "w");
+  if (csv == NULL) {
+    fprintf(stderr, "Cannot create %s\n", filename);
+    return -1;
+  }
+  write_header(csv, "set");
+  for (int s = 0; s < (1 << mc->setBits); s++) {
+    fprintf(csv, "%d,", s);
+    write_counts(csv, &mc->per_set[s]);
+  }
+  fclose(csv);
+
+  snprintf(filename, sizeof(filename), "%s_pcs.csv", prefix);
+  csv = fopen(filename, "w");
+  if (csv == NULL) {
+    fprintf(stderr, "Cannot create %s\n", filename);
+    return -1;
+  }
+  uint32_t *pcs = malloc((mc->pc_used + 1) * sizeof(uint32_t));
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < mc->pc_capacity; i++) {
+    if (mc->pc_keys[i] != 0) {
+      pcs[n++] = mc->pc_keys[i] - 1;
+    }
+  }
+  qsort(pcs, n, sizeof(uint32_t), compare_pc);
+  write_header(csv, "pc");
+  for (uint64_t i = 0; i < n; i++) {
+    fprintf(csv, "0x%08x,", pcs[i]);
+    write_counts(csv, &mc->pc_counts[pc_slot(mc, pcs[i])]);
+  }
+  free(pcs);
+  fclose(csv);
+  return 0;
+}
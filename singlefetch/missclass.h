@@ -0,0 +1,56 @@
+#ifndef MISSCLASS_H
+#define MISSCLASS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Three-C miss classification for a cache (-C <prefix>). Every access also
+// goes to a shadow fully associative LRU cache of the same capacity: a miss
+// to a block never seen before is compulsory, a miss the shadow cache would
+// have hit is a conflict miss, and anything else is a capacity miss.
+
+enum miss_class_enum {
+  MISS_COMPULSORY = 0,
+  MISS_CAPACITY,
+  MISS_CONFLICT,
+  MISS_CLASS_COUNT
+};
+
+typedef struct {
+    uint64_t accesses;
+    uint64_t misses[MISS_CLASS_COUNT];
+    uint64_t evictions;
+} mc_counts_t;
+
+typedef struct {
+    // shadow fully associative LRU
+    unsigned long long *shadow_blocks;
+    uint64_t *shadow_stamps;
+    int shadow_capacity;
+    int shadow_used;
+    uint64_t clock;
+
+    // blocks seen so far (open addressing, 0 marks an empty slot)
+    unsigned long long *seen;
+    uint64_t seen_capacity;
+    uint64_t seen_used;
+
+    // per-PC attribution (open addressing on pc + 1)
+    uint32_t *pc_keys;
+    mc_counts_t *pc_counts;
+    uint64_t pc_capacity;
+    uint64_t pc_used;
+
+    int setBits;
+    int blockBits;
+    mc_counts_t total;
+    mc_counts_t *per_set;
+} missclass_t;
+
+// Function declarations
+void mc_init(missclass_t *mc, int setBits, int linesPerSet, int blockBits);
+void mc_free(missclass_t *mc);
+void mc_record(missclass_t *mc, unsigned long long address, int status, uint32_t pc);
+void mc_print_stats(const missclass_t *mc);
+int mc_write_csv(const missclass_t *mc, const char *prefix);
+#endif // MISSCLASS_H
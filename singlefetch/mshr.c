@@ -0,0 +1,60 @@
+#include "mshr.h"
+#include <stdlib.h>
+
+void mshr_init(mshr_file_t *mshrs, int count) {
+  mshrs->count = count;
+  mshrs->entries = count > 0 ? calloc(count, sizeof(mshr_entry_t)) : NULL;
+  mshrs->primary_misses = 0;
+  mshrs->secondary_misses = 0;
+  mshrs->full_stalls = 0;
+  mshrs->full_stall_cycles = 0;
+}
+
+void mshr_free(mshr_file_t *mshrs) {
+  free(mshrs->entries);
+  mshrs->entries = NULL;
+  mshrs->count = 0;
+}
+
+// Release every entry whose fill has completed by `now`
+void mshr_retire(mshr_file_t *mshrs, uint64_t now) {
+  for (int i = 0; i < mshrs->count; i++) {
+    if (mshrs->entries[i].valid && mshrs->entries[i].ready_cycle <= now) {
+      mshrs->entries[i].valid = false;
+    }
+  }
+}
+
+mshr_entry_t *mshr_lookup(mshr_file_t *mshrs, unsigned long long block_addr) {
+  for (int i = 0; i < mshrs->count; i++) {
+    if (mshrs->entries[i].valid && mshrs->entries[i].block_addr == block_addr) {
+      return &mshrs->entries[i];
+    }
+  }
+  return NULL;
+}
+
+// Returns NULL when every MSHR is busy
+mshr_entry_t *mshr_allocate(mshr_file_t *mshrs, unsigned long long block_addr, uint64_t ready_cycle) {
+  for (int i = 0; i < mshrs->count; i++) {
+    mshr_entry_t *entry = &mshrs->entries[i];
+    if (!entry->valid) {
+      entry->valid = true;
+      entry->block_addr = block_addr;
+      entry->ready_cycle = ready_cycle;
+      entry->targets = 1;
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+uint64_t mshr_earliest_ready(const mshr_file_t *mshrs) {
+  uint64_t earliest = UINT64_MAX;
+  for (int i = 0; i < mshrs->count; i++) {
+    if (mshrs->entries[i].valid && mshrs->entries[i].ready_cycle < earliest) {
+      earliest = mshrs->entries[i].ready_cycle;
+    }
+  }
+  return earliest;
+}
@@ -0,0 +1,36 @@
+#ifndef MSHR_H
+#define MSHR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Miss status holding registers for the non-blocking data cache (-M <n>).
+// Each entry tracks one outstanding block fill; later misses to the same
+// block merge into it instead of going to memory again.
+
+#define MSHR_MAX 64
+
+typedef struct {
+    bool valid;
+    unsigned long long block_addr;
+    uint64_t ready_cycle;  // cycle at which the fill completes
+    int targets;           // number of requests waiting on this fill
+} mshr_entry_t;
+
+typedef struct {
+    mshr_entry_t *entries;
+    int count;             // 0 = blocking cache
+    uint64_t primary_misses;
+    uint64_t secondary_misses;
+    uint64_t full_stalls;
+    uint64_t full_stall_cycles;
+} mshr_file_t;
+
+// Function declarations
+void mshr_init(mshr_file_t *mshrs, int count);
+void mshr_free(mshr_file_t *mshrs);
+void mshr_retire(mshr_file_t *mshrs, uint64_t now);
+mshr_entry_t *mshr_lookup(mshr_file_t *mshrs, unsigned long long block_addr);
+mshr_entry_t *mshr_allocate(mshr_file_t *mshrs, unsigned long long block_addr, uint64_t ready_cycle);
+uint64_t mshr_earliest_ready(const mshr_file_t *mshrs);
+#endif // MSHR_H
@@ -4,6 +4,11 @@
 #include "types.h"
 #include "utils.h"
 #include "pipeline.h"
+#include "csr.h"
+#include "profile.h"
+#include "cpistack.h"
+#include "pipeview.h"
+#include "issuestat.h"
 #include "stage_helpers.h"
 
 uint64_t total_cycle_counter = 0;
@@ -14,6 +19,17 @@ uint64_t stall_counter = 0;
 uint64_t branch_counter = 0;
 uint64_t fwd_exex_counter = 0;
 uint64_t fwd_exmem_counter= 0;
+uint64_t pending_load_stall_counter = 0;
+uint64_t fu_stall_counter = 0;
+uint64_t mem_stall_counter = 0;
+uint64_t reg_ready_cycle[MAX_HW_THREADS][32] = {0};
+uint64_t fetch_stall_counter = 0;
+uint64_t fetch_buffer_hits = 0;
+uint64_t fetch_block_counter = 0;
+uint64_t fetch_byte_counter = 0;
+uint64_t fetch_compressed_counter = 0;
+uint64_t instret_counter = 0;
+fetch_buffer_t fetch_buffer = {0};
 simulator_config_t sim_config = {0};
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -22,6 +38,19 @@ void bootstrap(pipeline_wires_t* pwires_p, pipeline_regs_t* pregs_p, regfile_t*
 {
   // PC src must get the same value as the default PC value
   pwires_p->pc_src0 = regfile_p->PC;
+
+  // Counter CSRs read the simulator's statistics
+  csr_bind(CSR_COUNTER_CYCLE, &total_cycle_counter);
+  csr_bind(CSR_COUNTER_TIME, &total_cycle_counter);
+  csr_bind(CSR_COUNTER_INSTRET, &instret_counter);
+  csr_bind(CSR_HPM_DCACHE_HITS, &hit_count);
+  csr_bind(CSR_HPM_DCACHE_MISSES, &miss_count);
+  csr_bind(CSR_HPM_HAZARD_STALLS, &stall_counter);
+  csr_bind(CSR_HPM_MEM_STALLS, &mem_stall_counter);
+  csr_bind(CSR_HPM_BRANCHES_TAKEN, &branch_counter);
+  csr_bind(CSR_HPM_FETCH_STALLS, &fetch_stall_counter);
+  csr_bind(CSR_HPM_LOAD_WAIT_STALLS, &pending_load_stall_counter);
+  csr_bind(CSR_HPM_FU_STALLS, &fu_stall_counter);
 }
 
 ///////////////////////////
@@ -32,7 +61,7 @@ void bootstrap(pipeline_wires_t* pwires_p, pipeline_regs_t* pregs_p, regfile_t*
  * STAGE  : stage_fetch
  * output : ifid_reg_t
  **/ 
-ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* memory_p)
+ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* memory_p, Cache* icache_p)
 {
   ifid_reg_t ifid_reg = {0};
  
@@ -43,32 +72,54 @@ ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* m
       regfile_p->PC = pwires_p->pc_src0; // PC+4
   }
 
-  //Hazard check
+  //Hazard check, a taken branch squashed what was to be fetched again
   if(pwires_p->PCWriteHZD == 1)
   {
-    regfile_p->PC = regfile_p->PC - 4; // Re-fetch instruction
+    if (!pwires_p->pcsrc) {
+      regfile_p->PC = regfile_p->PC - pwires_p->fetch_size; // Re-fetch instruction
+    }
     pwires_p->pc_src0 = regfile_p->PC; 
     pwires_p->PCWriteHZD = 0;
   }
 
-  pwires_p->pc_src0 = regfile_p->PC+8; // Next set of instructions
-
-  // Get instruction from memory
-  uint32_t instruction_bits = *(uint32_t *)(memory_p + regfile_p->PC);
+  // Get instruction from memory, the second one starts where the first ends
+  uint8_t size, sizeDUAL;
+  uint32_t instruction_bits = fetch_instruction(memory_p, regfile_p->PC, &size);
+  uint32_t instruction_bitsDUAL = fetch_instruction(memory_p, regfile_p->PC + size, &sizeDUAL);
+  pwires_p->pc_src0 = regfile_p->PC + size + sizeDUAL; // Next set of instructions
+  pwires_p->fetch_size = size + sizeDUAL;
+  fetch_block_counter++;
+  fetch_byte_counter += size + sizeDUAL;
+  fetch_compressed_counter += (size == 2) + (sizeDUAL == 2);
+
+  // Instruction cache (-I): both issue slots come from the fetched line(s)
+  uint32_t last_byte = regfile_p->PC + size + sizeDUAL - 1;
+  if (fetch_queue.enabled) {
+    // decode only waits for what fetch could not do ahead of time (-B)
+    uint64_t penalty = 0;
+    if (icache_p != NULL) {
+      penalty = fetch_line(icache_p, regfile_p->PC) + fetch_line(icache_p, last_byte);
+    }
+    fetch_stall(regfile_p->PC, fq_deliver(&fetch_queue, penalty, total_cycle_counter));
+  } else if (icache_p != NULL) {
+    fetch_stall(regfile_p->PC, fetch_line(icache_p, regfile_p->PC));
+    fetch_stall(last_byte, fetch_line(icache_p, last_byte));
+  }
 
   ifid_reg.instr.bits = instruction_bits;
   ifid_reg.instr_addr = regfile_p->PC;
+  ifid_reg.instr_size = size;
   ifid_reg.rs1 = (instruction_bits >> 15) & ((1U << 5) - 1);
   ifid_reg.rs2 = (instruction_bits >> 20) & ((1U << 5)  -1);
 
   // Dual issue instruction data
-  uint32_t instruction_bitsDUAL = *(uint32_t *)(memory_p + regfile_p->PC+4);
   ifid_reg.instrDUAL.bits = instruction_bitsDUAL;
-  ifid_reg.instr_addrDUAL = regfile_p->PC+4;
+  ifid_reg.instr_addrDUAL = regfile_p->PC + size;
+  ifid_reg.instr_sizeDUAL = sizeDUAL;
   ifid_reg.rs1DUAL = (instruction_bitsDUAL >> 15) & ((1U << 5) - 1);
   ifid_reg.rs2DUAL = (instruction_bitsDUAL >> 20) & ((1U << 5)  -1);
   #ifdef DEBUG_CYCLE
-  printf("[IF ]: Instruction [%08x]@[%08x]: ", instruction_bitsDUAL, regfile_p->PC+4);
+  printf("[IF ]: Instruction [%08x]@[%08x]: ", instruction_bitsDUAL, regfile_p->PC + size);
   decode_instruction(instruction_bitsDUAL);
   #endif
 
@@ -89,6 +140,13 @@ idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile
 
   // updating idex_reg
   idex_reg = gen_control(ifid_reg.instr, ifid_reg.instrDUAL);
+  idex_reg.bubble = ifid_reg.bubble;
+  if (pwires_p->ControlMUXHZD && !ifid_reg.bubble) {
+    idex_reg.bubble = BUBBLE_STALL;
+  }
+  idex_reg.seq = ifid_reg.seq;
+  idex_reg.seqDUAL = ifid_reg.seqDUAL;
+  idex_reg.tid = ifid_reg.tid;
 
   // flush the control if hazard detected
   if(pwires_p->ControlMUXHZD == 1)
@@ -100,6 +158,11 @@ idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile
     idex_reg.Memto_Reg = 0;
     idex_reg.Mem_Write = 0;
     idex_reg.Reg_Write = 0;
+    idex_reg.BranchDUAL = 0;
+    idex_reg.Mem_ReadDUAL = 0;
+    idex_reg.Memto_RegDUAL = 0;
+    idex_reg.Mem_WriteDUAL = 0;
+    idex_reg.Reg_WriteDUAL = 0;
 
     pwires_p->ControlMUXHZD = 0;
   }
@@ -107,6 +170,7 @@ idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile
   idex_reg.instr = ifid_reg.instr;  
   idex_reg.instr.bits = ifid_reg.instr.bits;
   idex_reg.instr_addr = ifid_reg.instr_addr;
+  idex_reg.instr_size = ifid_reg.instr_size;
 
   //some may be redundant and useless code
   switch((idex_reg.instr.bits) & ((1U << 7) - 1)) {
@@ -125,6 +189,8 @@ idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile
     break;
   case 0x03:
   case 0x13:
+  case 0x67:
+  case 0x73:
     idex_reg.rs1 = (idex_reg.instr.bits >> 15) & ((1U << 5) - 1);
     idex_reg.rs1_val = regfile_p->R[idex_reg.rs1];
     break;
@@ -141,6 +207,7 @@ idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile
   idex_reg.instrDUAL = ifid_reg.instrDUAL;  
   idex_reg.instrDUAL.bits = ifid_reg.instrDUAL.bits;
   idex_reg.instr_addrDUAL = ifid_reg.instr_addrDUAL;
+  idex_reg.instr_sizeDUAL = ifid_reg.instr_sizeDUAL;
 
   switch((idex_reg.instrDUAL.bits) & ((1U << 7) - 1)) {
   case 0x33:
@@ -158,6 +225,8 @@ idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile
     break;
   case 0x03:
   case 0x13:
+  case 0x67:
+  case 0x73:
     idex_reg.rs1DUAL = (idex_reg.instrDUAL.bits >> 15) & ((1U << 5) - 1);
     idex_reg.rs1_valDUAL = regfile_p->R[idex_reg.rs1DUAL];
     break;
@@ -170,6 +239,9 @@ idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile
   idex_reg.funct7DUAL = (((idex_reg.instrDUAL.bits >> 25) & ((1U<<7)-1)));
   idex_reg.funct3DUAL = ((idex_reg.instrDUAL.bits >> 12) & ((1U << 3) - 1));
 
+  // a second instruction that cannot go with the first is held in IF/ID (hold_second_slot)
+  idex_reg.dual_block = idex_reg.bubble ? DUAL_EMPTY : dual_issue_block_reason(idex_reg);
+
   #ifdef DEBUG_CYCLE
   printf("[ID ]: Instruction [%08x]@[%08x]: ", ifid_reg.instrDUAL.bits, ifid_reg.instr_addrDUAL);
   decode_instruction(ifid_reg.instrDUAL.bits);
@@ -197,7 +269,7 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p)
     exmem_reg.Write_Address = idex_reg.rs2_val;
   }
 
-  if (pwires_p->forwardA == 0x0 && idex_reg.ALUOp == 0x5) {
+  if (pwires_p->forwardA == 0x0 && (idex_reg.ALUOp == 0x5 || idex_reg.ALUOp == 0x7)) { // jal, auipc
     idex_reg.rs1_val = idex_reg.instr_addr;
   }
   if (pwires_p->forwardA == 0x0 && idex_reg.ALUSrc == 1) {
@@ -219,21 +291,24 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p)
     fwd_exex_counter++;
   }
 
-  if(idex_reg.instr.bits == 0x63) { //gen_branch here to ensure forwarded data
-    idex_reg.Branch = gen_branch(idex_reg.rs1_val, idex_reg.rs2_val, idex_reg.funct3);
+  // jalr jumps to the forwarded rs1 plus the immediate, the ALU produces the link
+  uint32_t jalr_target = 0;
+  if (idex_reg.ALUOp == 0x6) {
+    jalr_target = (idex_reg.rs1_val + idex_reg.imm) & ~1U;
+    idex_reg.rs1_val = idex_reg.instr_addr;
   }
   
   //ALU execution
   idex_reg.alu_control = gen_alu_control(idex_reg);
   exmem_reg.Read_Address = execute_alu(idex_reg.rs1_val, idex_reg.rs2_val, idex_reg.alu_control);
-
-  if ((idex_reg.ALUOp == 0x1) && (exmem_reg.Read_Address == 0) && (idex_reg.funct3 == 0x0)) { // beq
-    exmem_reg.zero = 1;
+  if ((idex_reg.ALUOp == 0x5 || idex_reg.ALUOp == 0x6) && idex_reg.instr_size == 2) {
+    exmem_reg.Read_Address -= 2; // a compressed jal/jalr links to the next halfword
   }
-  else if ((idex_reg.ALUOp == 0x1) && (exmem_reg.Read_Address != 0) && (idex_reg.funct3 == 0x1)) { // bne
-    exmem_reg.zero = 1;
+
+  if (idex_reg.ALUOp == 0x1) { // gen_branch here to ensure forwarded data
+    exmem_reg.zero = gen_branch(idex_reg.rs1_val, idex_reg.rs2_val, idex_reg.funct3);
   }
-  else if (idex_reg.ALUOp == 0x5) { // jal
+  else if (idex_reg.ALUOp == 0x5 || idex_reg.ALUOp == 0x6) { // jal, jalr
 	  exmem_reg.zero = 1;
   }
   else {
@@ -241,7 +316,9 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p)
   }
   
 // adder
-if (idex_reg.Branch) {
+if (idex_reg.ALUOp == 0x6) {
+  exmem_reg.instr_addr_imm = jalr_target;
+} else if (idex_reg.Branch) {
   exmem_reg.instr_addr_imm = idex_reg.instr_addr + idex_reg.imm;
 } else {
   exmem_reg.instr_addr_imm = idex_reg.instr_addr;
@@ -263,12 +340,21 @@ if (idex_reg.Branch) {
   exmem_reg.Memto_Reg = idex_reg.Memto_Reg;
   exmem_reg.Reg_Write = idex_reg.Reg_Write;
   exmem_reg.Branch = idex_reg.Branch;
+  exmem_reg.bubble = idex_reg.bubble;
+  exmem_reg.seq = idex_reg.seq;
+  exmem_reg.seqDUAL = idex_reg.seqDUAL;
+  exmem_reg.tid = idex_reg.tid;
 
   // assign needed dual values to perform check before executing
   exmem_reg.instrDUAL = idex_reg.instrDUAL;
+  exmem_reg.instr_addrDUAL = idex_reg.instr_addrDUAL;
   exmem_reg.rs1DUAL = idex_reg.rs1DUAL;
   exmem_reg.rs2DUAL = idex_reg.rs2DUAL; 
-  exmem_reg.dualHazard = dualIssue_hazard_check(exmem_reg);
+  exmem_reg.dual_block = idex_reg.dual_block;
+  if (exmem_reg.dual_block == DUAL_ISSUED && exmem_reg.Branch && exmem_reg.zero) {
+    exmem_reg.dual_block = DUAL_CONTROL; // the second instruction is on the wrong path
+  }
+  exmem_reg.dualHazard = exmem_reg.dual_block == DUAL_ISSUED;
   if(exmem_reg.dualHazard){
     //execute dual
     if (pwires_p->forwardADUAL || pwires_p->forwardBDUAL) {
@@ -278,7 +364,7 @@ if (idex_reg.Branch) {
       exmem_reg.Write_AddressDUAL = idex_reg.rs2_valDUAL;
     }
 
-    if (pwires_p->forwardADUAL == 0x0 && idex_reg.ALUOpDUAL == 0x5) {
+    if (pwires_p->forwardADUAL == 0x0 && (idex_reg.ALUOpDUAL == 0x5 || idex_reg.ALUOpDUAL == 0x7)) { // jal, auipc
       idex_reg.rs1_valDUAL = idex_reg.instr_addrDUAL;
     }
     if (pwires_p->forwardADUAL == 0x0 && idex_reg.ALUSrcDUAL == 1) {
@@ -289,25 +375,34 @@ if (idex_reg.Branch) {
     if (pwires_p->forwardADUAL == 0x1) {
       fwd_exmem_counter++;
     }
+    else if (pwires_p->forwardADUAL == 0x2) {
+      fwd_exex_counter++;
+    }
+
     if (pwires_p->forwardBDUAL == 0x1) {
       fwd_exmem_counter++;
     }
+    else if (pwires_p->forwardBDUAL == 0x2) {
+      fwd_exex_counter++;
+    }
 
-    if(idex_reg.instrDUAL.bits == 0x63) { //gen_branch here to ensure forwarded data
-      idex_reg.BranchDUAL = gen_branch(idex_reg.rs1_valDUAL, idex_reg.rs2_valDUAL, idex_reg.funct3DUAL);
+    uint32_t jalr_targetDUAL = 0;
+    if (idex_reg.ALUOpDUAL == 0x6) {
+      jalr_targetDUAL = (idex_reg.rs1_valDUAL + idex_reg.immDUAL) & ~1U;
+      idex_reg.rs1_valDUAL = idex_reg.instr_addrDUAL;
     }
     
     //ALU execution
     idex_reg.alu_controlDUAL = gen_alu_controlDUAL(idex_reg);
     exmem_reg.Read_AddressDUAL = execute_alu(idex_reg.rs1_valDUAL, idex_reg.rs2_valDUAL, idex_reg.alu_controlDUAL);
-
-    if ((idex_reg.ALUOpDUAL == 0x1) && (exmem_reg.Read_AddressDUAL == 0) && (idex_reg.funct3DUAL == 0x0)) { // beq
-      exmem_reg.zeroDUAL = 1;
+    if ((idex_reg.ALUOpDUAL == 0x5 || idex_reg.ALUOpDUAL == 0x6) && idex_reg.instr_sizeDUAL == 2) {
+      exmem_reg.Read_AddressDUAL -= 2;
     }
-    else if ((idex_reg.ALUOpDUAL == 0x1) && (exmem_reg.Read_AddressDUAL != 0) && (idex_reg.funct3DUAL == 0x1)) { // bne
-      exmem_reg.zeroDUAL = 1;
+
+    if (idex_reg.ALUOpDUAL == 0x1) {
+      exmem_reg.zeroDUAL = gen_branch(idex_reg.rs1_valDUAL, idex_reg.rs2_valDUAL, idex_reg.funct3DUAL);
     }
-    else if (idex_reg.ALUOp == 0x5) { // jal
+    else if (idex_reg.ALUOpDUAL == 0x5 || idex_reg.ALUOpDUAL == 0x6) { // jal, jalr
       exmem_reg.zeroDUAL = 1;
     }
     else {
@@ -315,12 +410,13 @@ if (idex_reg.Branch) {
     }
     
     // adder
-    if (idex_reg.BranchDUAL) {
+    if (idex_reg.ALUOpDUAL == 0x6) {
+      exmem_reg.instr_addr_immDUAL = jalr_targetDUAL;
+    } else if (idex_reg.BranchDUAL) {
       exmem_reg.instr_addr_immDUAL = idex_reg.instr_addrDUAL + idex_reg.immDUAL;
     } else {
       exmem_reg.instr_addr_immDUAL = idex_reg.instr_addrDUAL;
     }
-    exmem_reg.instr_addrDUAL = idex_reg.instr_addrDUAL; 
 
     // Pass to exmem
     exmem_reg.rdDUAL = idex_reg.rdDUAL;
@@ -341,12 +437,8 @@ if (idex_reg.Branch) {
     #endif
   }
   else {
-    /*
-    perform stall by splitting in 2 packets:
-    1. update exmem_regs by assigning dual values
-    2. set dual values to 0
-    3. update pc to stall it and not fetch another instruction
-    */
+    // decode held the second instruction back (hold_second_slot), or the
+    // first is a taken branch and flush_pipeline squashes it
     exmem_reg.Mem_ReadDUAL = 0;
   }
 
@@ -370,70 +462,83 @@ memwb_reg_t type).
 memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* memory_p, Cache* cache_p)
 {
   memwb_reg_t memwb_reg = {0};
+  bool forwarded = false; // a load took its data from the store buffer
 
   if (exmem_reg.Mem_Read) {
     switch (exmem_reg.funct3) {
         case 0x0: // lb
-            exmem_reg.contents = sign_extend_number(load(memory_p, exmem_reg.Read_Address, LENGTH_BYTE), 8);
+            exmem_reg.contents = sign_extend_number(mem_load(memory_p, exmem_reg.Read_Address, LENGTH_BYTE, exmem_reg.instr_addr, &forwarded), 8);
             break;
         case 0x1: // lh
-            exmem_reg.contents = sign_extend_number(load(memory_p, exmem_reg.Read_Address, LENGTH_HALF_WORD), 16);
+            exmem_reg.contents = sign_extend_number(mem_load(memory_p, exmem_reg.Read_Address, LENGTH_HALF_WORD, exmem_reg.instr_addr, &forwarded), 16);
             break;
         case 0x2: // lw
-            exmem_reg.contents = load(memory_p, exmem_reg.Read_Address, LENGTH_WORD);
+            exmem_reg.contents = mem_load(memory_p, exmem_reg.Read_Address, LENGTH_WORD, exmem_reg.instr_addr, &forwarded);
+            break;
+        case 0x4: // lbu
+            exmem_reg.contents = mem_load(memory_p, exmem_reg.Read_Address, LENGTH_BYTE, exmem_reg.instr_addr, &forwarded);
+            break;
+        case 0x5: // lhu
+            exmem_reg.contents = mem_load(memory_p, exmem_reg.Read_Address, LENGTH_HALF_WORD, exmem_reg.instr_addr, &forwarded);
             break;
         default:
             exmem_reg.contents = 0; // invalid funct3
             break;
     }
     memwb_reg.Read_Data = exmem_reg.contents;
-    memwb_reg.Read_Address = exmem_reg.Read_AddressDUAL;
+    memwb_reg.Read_Address = exmem_reg.Read_Address;
   }
   else if(exmem_reg.Mem_ReadDUAL) {
     switch (exmem_reg.funct3DUAL) {
         case 0x0: // lb
-            exmem_reg.contents = sign_extend_number(load(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_BYTE), 8);
+            exmem_reg.contents = sign_extend_number(mem_load(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_BYTE, exmem_reg.instr_addrDUAL, &forwarded), 8);
             break;
         case 0x1: // lh
-            exmem_reg.contents = sign_extend_number(load(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_HALF_WORD), 16);
+            exmem_reg.contents = sign_extend_number(mem_load(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_HALF_WORD, exmem_reg.instr_addrDUAL, &forwarded), 16);
             break;
         case 0x2: // lw
-            exmem_reg.contents = load(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_WORD);
+            exmem_reg.contents = mem_load(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_WORD, exmem_reg.instr_addrDUAL, &forwarded);
+            break;
+        case 0x4: // lbu
+            exmem_reg.contents = mem_load(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_BYTE, exmem_reg.instr_addrDUAL, &forwarded);
+            break;
+        case 0x5: // lhu
+            exmem_reg.contents = mem_load(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_HALF_WORD, exmem_reg.instr_addrDUAL, &forwarded);
             break;
         default:
             exmem_reg.contents = 0; // invalid funct3
             break;
     }
-    memwb_reg.Read_Data = exmem_reg.contents;
+    memwb_reg.Read_DataDUAL = exmem_reg.contents;
     memwb_reg.Read_Address = exmem_reg.Read_Address;
   }
   else if (exmem_reg.Mem_Write) {
     memwb_reg.Read_Address = exmem_reg.Read_Address;
     switch (exmem_reg.funct3) {
         case 0x0: // sb
-            store(memory_p, exmem_reg.Read_Address, LENGTH_BYTE, exmem_reg.Write_Address & 0xFF);
+            mem_store(memory_p, exmem_reg.Read_Address, LENGTH_BYTE, exmem_reg.Write_Address & 0xFF, exmem_reg.instr_addr);
             break;
         case 0x1: // sh
-            store(memory_p, exmem_reg.Read_Address, LENGTH_HALF_WORD, exmem_reg.Write_Address & 0xFFFF);
+            mem_store(memory_p, exmem_reg.Read_Address, LENGTH_HALF_WORD, exmem_reg.Write_Address & 0xFFFF, exmem_reg.instr_addr);
             break;
         case 0x2: // sw
-            store(memory_p, exmem_reg.Read_Address, LENGTH_WORD, exmem_reg.Write_Address);
+            mem_store(memory_p, exmem_reg.Read_Address, LENGTH_WORD, exmem_reg.Write_Address, exmem_reg.instr_addr);
             break;
         default:
             break;
     }
   }
   else if (exmem_reg.Mem_WriteDUAL) {
-    memwb_reg.Read_Address = exmem_reg.Read_AddressDUAL;
+    memwb_reg.Read_Address = exmem_reg.Read_Address;
     switch (exmem_reg.funct3DUAL) {
         case 0x0: // sb
-            store(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_BYTE, exmem_reg.Write_AddressDUAL & 0xFF);
+            mem_store(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_BYTE, exmem_reg.Write_AddressDUAL & 0xFF, exmem_reg.instr_addrDUAL);
             break;
         case 0x1: // sh
-            store(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_HALF_WORD, exmem_reg.Write_AddressDUAL & 0xFFFF);
+            mem_store(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_HALF_WORD, exmem_reg.Write_AddressDUAL & 0xFFFF, exmem_reg.instr_addrDUAL);
             break;
         case 0x2: // sw
-            store(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_WORD, exmem_reg.Write_AddressDUAL);
+            mem_store(memory_p, exmem_reg.Read_AddressDUAL, LENGTH_WORD, exmem_reg.Write_AddressDUAL, exmem_reg.instr_addrDUAL);
             break;
         default:
             break;
@@ -452,6 +557,16 @@ memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* m
   memwb_reg.instr = exmem_reg.instr;
   memwb_reg.instr_addr = exmem_reg.instr_addr;
   memwb_reg.instr_addr_imm = exmem_reg.instr_addr_imm;
+  memwb_reg.bubble = exmem_reg.bubble;
+  memwb_reg.seq = exmem_reg.seq;
+  memwb_reg.seqDUAL = exmem_reg.seqDUAL;
+  memwb_reg.tid = exmem_reg.tid;
+
+  // Zicsr: the CSR is read and written here, once older branches have
+  // resolved, and the old value takes the ALU result's place
+  if (is_csr(exmem_reg.instr)) {
+    memwb_reg.Read_Address = access_csr(exmem_reg.instr, exmem_reg.rs1_val);
+  }
 
   // Return pc_src1 to IF MUX
   pwires_p->pc_src1 = memwb_reg.instr_addr_imm;
@@ -459,16 +574,72 @@ memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* m
   #ifdef CACHE_ENABLE
   uint32_t address;
   uint32_t latency;
-  if (exmem_reg.Mem_Write || exmem_reg.Mem_Read) {
-    address = memwb_reg.rs1_val + memwb_reg.imm;
-    if (processCacheOperation(address, cache_p) == CACHE_HIT_LATENCY) {
-      latency = CACHE_HIT_LATENCY; 
-      total_cycle_counter += (CACHE_HIT_LATENCY - 1);
-      hit_count++;
+  // loads and stores never pair, so at most one slot accesses the cache
+  bool mem_dual = exmem_reg.Mem_ReadDUAL || exmem_reg.Mem_WriteDUAL;
+  bool mem_read = exmem_reg.Mem_Read || exmem_reg.Mem_ReadDUAL;
+  bool mem_write = exmem_reg.Mem_Write || exmem_reg.Mem_WriteDUAL;
+  uint32_t mem_pc = mem_dual ? exmem_reg.instr_addrDUAL : exmem_reg.instr_addr;
+  uint8_t mem_rd = mem_dual ? exmem_reg.rdDUAL : exmem_reg.rd;
+  if ((mem_write || mem_read) && !forwarded) {
+    address = mem_dual ? exmem_reg.rs1_valDUAL + exmem_reg.immDUAL : memwb_reg.rs1_val + memwb_reg.imm;
+    cache_p->access_pc = mem_pc;
+    // a buffered store drains to the cache in the background (-O)
+    bool buffered = mem_write && store_buffer.enabled;
+    if (cache_p->mshrs.count > 0) {
+      // Non-blocking: only the tag lookup and waiting for a free MSHR stall here,
+      // a missing load instead marks its rd as pending for detect_hazard
+      uint64_t stall;
+      uint64_t start = total_cycle_counter;
+      uint64_t ready = processCacheOperationNonBlocking(address, cache_p, start, &stall);
+      uint64_t wait = stall + (CACHE_HIT_LATENCY - 1);
+      bool missed = ready > start + wait;
+      latency = ready - start + 1;
+      if (buffered) {
+        sb_schedule(&store_buffer, ready - start, true);
+        wait = 0;
+      }
+      total_cycle_counter += wait;
+      mem_stall_counter += wait;
+      cpi_charge(CPI_CACHE_MISS, wait);
+      if (profile.enabled) {
+        prof_charge(mem_pc, PROF_MEM_STALLS, wait);
+      }
+      if (missed) {
+        miss_count++;
+        if (profile.enabled) {
+          prof_charge(mem_pc, PROF_CACHE_MISSES, 1);
+        }
+        if (mem_read && mem_rd != 0) {
+          reg_ready_cycle[exmem_reg.tid][mem_rd] = ready;
+        }
+      } else {
+        hit_count++;
+      }
     } else {
-      latency = CACHE_MISS_LATENCY;
-      total_cycle_counter += (CACHE_MISS_LATENCY - 1);
-      miss_count++;
+      // miss latency is MEM_LATENCY based, or comes from the DRAM model
+      latency = processCacheOperation(address, cache_p);
+      uint64_t wait = latency - 1;
+      if (buffered) {
+        sb_schedule(&store_buffer, wait, false);
+        wait = 0;
+      }
+      total_cycle_counter += wait;
+      mem_stall_counter += wait;
+      cpi_charge(CPI_CACHE_MISS, wait);
+      if (profile.enabled) {
+        prof_charge(mem_pc, PROF_MEM_STALLS, wait);
+      }
+      if (latency == CACHE_HIT_LATENCY) {
+        hit_count++;
+      } else {
+        miss_count++;
+        if (profile.enabled) {
+          prof_charge(mem_pc, PROF_CACHE_MISSES, 1);
+        }
+      }
+    }
+    if (mem_write) {
+      dirty_cacheline(address, cache_p);
     }
     
     #ifdef PRINT_CACHE_TRACES
@@ -487,6 +658,10 @@ memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* m
     memwb_reg.instrDUAL = exmem_reg.instrDUAL;
     memwb_reg.instr_addrDUAL = exmem_reg.instr_addrDUAL;
     memwb_reg.instr_addr_immDUAL = exmem_reg.instr_addr_immDUAL;
+    memwb_reg.Read_AddressDUAL = exmem_reg.Read_AddressDUAL;
+    if (is_csr(exmem_reg.instrDUAL)) {
+      memwb_reg.Read_AddressDUAL = access_csr(exmem_reg.instrDUAL, exmem_reg.rs1_valDUAL);
+    }
 
     //Create pcsrc wire
     pwires_p->pcsrc = exmem_reg.BranchDUAL & exmem_reg.zeroDUAL;
@@ -498,35 +673,13 @@ memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* m
     printf("[MEM]: Instruction [%08x]@[%08x]: ", exmem_reg.instrDUAL.bits, exmem_reg.instr_addrDUAL);
     decode_instruction(exmem_reg.instrDUAL.bits);
     #endif
-
-    /* NEED FIXING FOR DUAL ISSUE
-    #ifdef CACHE_ENABLE
-    uint32_t address;
-    uint32_t latency;
-    if (exmem_reg.Mem_Write || exmem_reg.Mem_Read) {
-      address = memwb_reg.rs1_val + memwb_reg.imm;
-      if (processCacheOperation(address, cache_p) == CACHE_HIT_LATENCY) {
-        latency = CACHE_HIT_LATENCY; 
-        total_cycle_counter += (CACHE_HIT_LATENCY - 1);
-        hit_count++;
-      } else {
-        latency = CACHE_MISS_LATENCY;
-        total_cycle_counter += (CACHE_MISS_LATENCY - 1);
-        miss_count++;
-      }
-      
-      #ifdef PRINT_CACHE_TRACES
-      printf("[MEM]: Cache latency at addr: 0x%08x: %d cycles\n", address, latency);
-      #endif
-    }  
-    #endif 
-    */
   }
   else { //cannot have branch on 1st instruction when dual as that is control hazard between the two instructions
     pwires_p->pcsrc = exmem_reg.Branch & exmem_reg.zero;
     pwires_p->pc_src1 = memwb_reg.instr_addr_imm; 
   }
   memwb_reg.dualHazard = exmem_reg.dualHazard;
+  memwb_reg.dual_block = exmem_reg.dual_block;
 
   #ifdef DEBUG_CYCLE
   printf("[MEM]: Instruction [%08x]@[%08x]: ", exmem_reg.instr.bits, exmem_reg.instr_addr);
@@ -547,6 +700,20 @@ It is working on writing the results to the destination register (rd).
 */
 void stage_writeback(memwb_reg_t memwb_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p)
 {
+  // count retired instructions for the instret CSR
+  if (!memwb_reg.bubble && memwb_reg.instr.bits != 0) {
+    instret_counter++;
+    if (profile.enabled) {
+      prof_retire(memwb_reg.instr, memwb_reg.instr_addr);
+    }
+    if (memwb_reg.dualHazard && memwb_reg.instrDUAL.bits != 0) {
+      instret_counter++;
+      if (profile.enabled) {
+        prof_retire(memwb_reg.instrDUAL, memwb_reg.instr_addrDUAL);
+      }
+    }
+  }
+
   // Only write back if Reg_Write is true
   if (memwb_reg.Reg_Write) {
     // Determine whether to write from Read_Data or Read_Address
@@ -594,7 +761,7 @@ void stage_writeback(memwb_reg_t memwb_reg, pipeline_wires_t* pwires_p, regfile_
 /** 
  * excite the pipeline with one clock cycle
  **/
-void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit)
+void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, Cache* icache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit)
 {
   #ifdef DEBUG_CYCLE
   printf("v==============");
@@ -602,37 +769,127 @@ void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeli
   printf("==============v\n\n");
   #endif
 
+  // the oldest instruction in flight owns this cycle in the profile
+  uint32_t profile_pc = 0;
+  if (profile.enabled) {
+    prof_begin_cycle(total_cycle_counter);
+    profile_pc = oldest_in_flight(pregs_p, regfile_p);
+  }
+
+  // writeback of this cycle decides its CPI stack bucket
+  cpi_begin_cycle(total_cycle_counter);
+  int cpi_bucket = retire_bucket(pregs_p->memwb_preg.out);
+
+  // SMT (-X): the fetch policy picks the thread that fetches, every other
+  // stage works on the registers of the thread its pair belongs to
+  int fetch_tid = 0;
+  regfile_t* fetch_regfile_p = regfile_p;
+  regfile_t* decode_regfile_p = regfile_p;
+  regfile_t* wb_regfile_p = regfile_p;
+  if (smt.enabled) {
+    fetch_tid = smt_select(&smt, pregs_p, load_use_hazard(pregs_p) ? pregs_p->ifid_preg.out.tid : -1);
+    fetch_regfile_p = fetch_tid >= 0 ? &smt.thread[fetch_tid].regs : NULL;
+    decode_regfile_p = &smt.thread[pregs_p->ifid_preg.out.tid].regs;
+    wb_regfile_p = &smt.thread[pregs_p->memwb_preg.out.tid].regs;
+    if (fetch_tid >= 0) {
+      smt_begin_fetch(&smt, fetch_tid, pwires_p);
+    }
+    smt_retire(&smt, &pregs_p->memwb_preg.out);
+  }
+
   // process each stage
 
   /* Output               |    Stage      |       Inputs  */
-  pregs_p->ifid_preg.inp  = stage_fetch     (pwires_p, regfile_p, memory_p);
+  if (fetch_regfile_p != NULL) {
+    pregs_p->ifid_preg.inp  = stage_fetch     (pwires_p, fetch_regfile_p, memory_p, icache_p);
+    pregs_p->ifid_preg.inp.tid = fetch_tid;
+  } else {
+    pregs_p->ifid_preg.inp  = (ifid_reg_t){0}; // every thread has exited
+  }
+  if (pipeview.enabled) {
+    pipeview_fetch(&pregs_p->ifid_preg.inp);
+  }
 
   detect_hazard(pregs_p, pwires_p, regfile_p);
   
   #ifdef PRINT_STATS // only runs for defined configs
   if(pwires_p->IFIDWriteHZD == 1) {
     stall_counter++;
-    pregs_p->ifid_preg.inp = pregs_p->ifid_preg.out;
+    if (smt.enabled) {
+      smt.thread[pregs_p->ifid_preg.out.tid].stalls++;
+    }
+    if (profile.enabled) {
+      prof_charge(pregs_p->ifid_preg.out.instr_addr, PROF_HAZARD_STALLS, 1);
+    }
+    if (pipeview.enabled) {
+      pv_stall(pregs_p->ifid_preg.out.seq);
+      pv_stall(pregs_p->ifid_preg.out.seqDUAL);
+    }
+    if (smt.enabled && fetch_tid >= 0 && fetch_tid != pregs_p->ifid_preg.out.tid) {
+      // only the stalled thread waits, IF/ID takes what another thread fetched
+      smt_replay(&smt, pregs_p->ifid_preg.out.tid, pregs_p->ifid_preg.out.instr_addr);
+      pwires_p->PCWriteHZD = 0;
+    } else {
+      pregs_p->ifid_preg.inp = pregs_p->ifid_preg.out;
+    }
     pwires_p->IFIDWriteHZD = 0;
   }
   #endif
 
-  pregs_p->idex_preg.inp  = stage_decode    (pregs_p->ifid_preg.out, pwires_p, regfile_p);
+  pregs_p->idex_preg.inp  = stage_decode    (pregs_p->ifid_preg.out, pwires_p, decode_regfile_p);
+  if (pregs_p->idex_preg.inp.dual_block == DUAL_STRUCTURAL || pregs_p->idex_preg.inp.dual_block == DUAL_DATA) {
+    if (smt.enabled && fetch_tid >= 0 && fetch_tid != pregs_p->ifid_preg.out.tid) {
+      // the held instruction is fetched again by its thread instead
+      smt_replay(&smt, pregs_p->ifid_preg.out.tid, pregs_p->ifid_preg.out.instr_addrDUAL);
+      pregs_p->idex_preg.inp.seqDUAL = 0;
+    } else {
+      hold_second_slot(pregs_p, pwires_p);
+      if (pipeview.enabled) {
+        pv_stall(pregs_p->ifid_preg.inp.seq);
+      }
+    }
+  }
   
   #ifdef PRINT_STATS // only runs for defined configs
+  gen_regfile_bypass(pregs_p);
   gen_forward(pregs_p, pwires_p);
   gen_forwardDUAL(pregs_p, pwires_p);
   #endif
 
   pregs_p->exmem_preg.inp = stage_execute   (pregs_p->idex_preg.out, pwires_p);
 
+  if (smt.enabled) {
+    csr_file.mhartid = pregs_p->exmem_preg.out.tid;
+  }
   pregs_p->memwb_preg.inp = stage_mem       (pregs_p->exmem_preg.out, pwires_p, memory_p, cache_p);
 
-                            stage_writeback (pregs_p->memwb_preg.out, pwires_p, regfile_p);
+  // a load that just missed may already have consumers in decode or execute
+  scoreboard_stall(pregs_p->exmem_preg.inp.instr, pregs_p->exmem_preg.inp.instrDUAL, pregs_p->exmem_preg.inp.instr_addr,
+                   pregs_p->exmem_preg.inp.tid);
+  scoreboard_stall(pregs_p->idex_preg.inp.instr, pregs_p->idex_preg.inp.instrDUAL, pregs_p->idex_preg.inp.instr_addr,
+                   pregs_p->idex_preg.inp.tid);
+
+                            stage_writeback (pregs_p->memwb_preg.out, pwires_p, wb_regfile_p);
+
+  if (pipeview.enabled) {
+    pipeview_stages(pregs_p);
+  }
 
+  int branch_tid = pregs_p->exmem_preg.out.tid;
   #ifdef PRINT_STATS // only runs for defined configs
   branch_counter = flush_pipeline(pregs_p, pwires_p, branch_counter);
   #endif
+  if (smt.enabled) {
+    smt_end_cycle(&smt, fetch_tid, branch_tid, pwires_p);
+  }
+
+  // multi-cycle functional units, after the flush so squashed instructions never issue
+  if (fu_pool.enabled) {
+    fu_stall(pregs_p->exmem_preg.inp);
+  }
+  if (issue_stats.enabled) {
+    issue_record(&pregs_p->exmem_preg.inp);
+  }
 
   // update all the output registers for the next cycle from the input registers in the current cycle
   pregs_p->ifid_preg.out  = pregs_p->ifid_preg.inp;
@@ -645,6 +902,14 @@ void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeli
   // increment the cycle
   total_cycle_counter++;
 
+  cpi_end_cycle(cpi_bucket, total_cycle_counter);
+  if (pipeview.enabled) {
+    pipeview_end_cycle(pregs_p);
+  }
+  if (profile.enabled) {
+    prof_end_cycle(profile_pc, total_cycle_counter);
+  }
+
   #ifdef DEBUG_REG_TRACE
   print_register_trace(regfile_p);
   #endif
@@ -665,9 +930,22 @@ void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeli
    * 
    * If more functionality on ecall needs to be added, it can be done
    * by adding more conditions on the value of R[10]
+   *
+   * The ecall may also be the second instruction of a pair, next to a
+   * load or store.
    */
-  if( (pregs_p->memwb_preg.out.instr.bits == 0x00000073) &&
-      (regfile_p->R[10] == 10) )
+  memwb_reg_t* retired = &pregs_p->memwb_preg.out;
+  bool ecall = retired->instr.bits == 0x00000073 || (retired->dualHazard && retired->instrDUAL.bits == 0x00000073);
+  if (smt.enabled) {
+    // a thread that exits takes the pairs it fetched after the ecall along
+    smt_thread_t* thread = &smt.thread[pregs_p->memwb_preg.out.tid];
+    if (ecall && thread->regs.R[10] == 10 && !thread->halted) {
+      thread->halted = true;
+      squash_thread(pregs_p, pregs_p->memwb_preg.out.tid);
+      *(ecall_exit) = smt_all_halted(&smt);
+    }
+  }
+  else if( ecall && (regfile_p->R[10] == 10) )
   {
     *(ecall_exit) = true;
   }
@@ -10,6 +10,8 @@
 /// Functionality
 ///////////////////////////////////////////////////////////////////////////////
 
+#define MAX_HW_THREADS 4 // hardware threads sharing the pipeline (-X)
+
 extern simulator_config_t sim_config;
 extern uint64_t miss_count;
 extern uint64_t hit_count;
@@ -19,22 +21,56 @@ extern uint64_t stall_counter;
 extern uint64_t branch_counter;
 extern uint64_t fwd_exex_counter;
 extern uint64_t fwd_exmem_counter;
+extern uint64_t pending_load_stall_counter;
+extern uint64_t fu_stall_counter;
+extern uint64_t mem_stall_counter;
+extern uint64_t reg_ready_cycle[MAX_HW_THREADS][32];
+extern uint64_t fetch_stall_counter;
+extern uint64_t fetch_buffer_hits;
+extern uint64_t fetch_block_counter;
+extern uint64_t fetch_byte_counter;
+extern uint64_t fetch_compressed_counter;
+extern uint64_t instret_counter;
 
 ///////////////////////////////////////////////////////////////////////////////
 /// RISC-V Pipeline Register Types
 ///////////////////////////////////////////////////////////////////////////////
 
+// Why a latch slot holds no instruction, zero for a real instruction
+typedef enum
+{
+  BUBBLE_NONE = 0,
+  BUBBLE_STALL,   // inserted by detect_hazard
+  BUBBLE_FLUSH    // squashed by a taken branch
+}bubble_t;
+
+// Why the second instruction of a pair was not issued
+typedef enum
+{
+  DUAL_ISSUED = 0,
+  DUAL_EMPTY,      // no second instruction to issue
+  DUAL_STRUCTURAL, // both need the ALU, or both the memory port
+  DUAL_DATA,       // the second reads the first one's rd
+  DUAL_CONTROL     // the first is a taken branch
+}dual_block_t;
+
 typedef struct
 {
   Instruction instr;
   uint32_t    instr_addr;
   uint8_t rs1;
   uint8_t rs2; 
+  uint8_t instr_size; // 2 for a compressed instruction, which instr holds expanded
+  bubble_t bubble; // stall bubble or flushed slot, does not retire
+  uint64_t seq;     // pipeline trace id (-K), 0 when not traced
+  uint8_t tid;      // hardware thread (-X), 0 without SMT
 
   Instruction instrDUAL;
   uint32_t    instr_addrDUAL;
   uint8_t rs1DUAL;
   uint8_t rs2DUAL;
+  uint8_t instr_sizeDUAL;
+  uint64_t seqDUAL;
 }ifid_reg_t;
 
 typedef struct
@@ -60,9 +96,14 @@ typedef struct
   bool Mem_Write;
   bool Memto_Reg;
   bool Reg_Write;
+  uint8_t instr_size;
+  bubble_t bubble;
+  uint64_t seq;
+  uint8_t tid;
 
   Instruction instrDUAL;
   uint32_t    instr_addrDUAL;
+  uint8_t instr_sizeDUAL;
   uint8_t rs1DUAL;
   uint8_t rs2DUAL;
   uint32_t rs1_valDUAL;
@@ -82,6 +123,8 @@ typedef struct
   bool Mem_WriteDUAL;
   bool Memto_RegDUAL;
   bool Reg_WriteDUAL;
+  dual_block_t dual_block; // decode's verdict on the pair, DUAL_CONTROL is left to execute
+  uint64_t seqDUAL;
 }idex_reg_t;
 
 typedef struct
@@ -103,6 +146,9 @@ typedef struct
   bool Mem_Write;
   bool Memto_Reg;
   bool Reg_Write;
+  bubble_t bubble;
+  uint64_t seq;
+  uint8_t tid;
 
   Instruction instrDUAL;
   uint32_t    instr_addrDUAL;
@@ -124,9 +170,8 @@ typedef struct
   bool Memto_RegDUAL;
   bool Reg_WriteDUAL;
   bool dualHazard;
-
-  int ins1type;
-  int ins2type;
+  dual_block_t dual_block;
+  uint64_t seqDUAL;
 }exmem_reg_t;
 
 typedef struct
@@ -143,6 +188,9 @@ typedef struct
   bool Memto_Reg;
   bool Reg_Write;
   bool Mem_Read;
+  bubble_t bubble;
+  uint64_t seq;
+  uint8_t tid;
 
   Instruction instrDUAL;
   uint32_t    instr_addrDUAL;
@@ -158,6 +206,8 @@ typedef struct
   bool Mem_ReadDUAL;
   bool Memto_RegDUAL;
   bool dualHazard;
+  dual_block_t dual_block;
+  uint64_t seqDUAL;
 
 }memwb_reg_t;
 
@@ -189,6 +239,15 @@ typedef struct
   memwb_reg_t out;
 }memwb_reg_pair_t;
 
+// Line buffer between the instruction cache and the fetch stage
+typedef struct
+{
+  bool valid;
+  unsigned long long block_addr;
+}fetch_buffer_t;
+
+extern fetch_buffer_t fetch_buffer;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// Functional pipeline requirements
 ///////////////////////////////////////////////////////////////////////////////
@@ -214,6 +273,7 @@ typedef struct
   bool IFIDWriteHZD;
   bool ControlMUXHZD;
   bool dualIssue;
+  uint8_t fetch_size; // bytes of the last fetched pair, for the refetch
 }pipeline_wires_t;
 
 
@@ -224,7 +284,7 @@ typedef struct
 /**
  * output : ifid_reg_t
  **/ 
-ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* memory_p);
+ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* memory_p, Cache* icache_p);
 
 /**
  * output : idex_reg_t
@@ -246,7 +306,10 @@ memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* m
  **/ 
 void stage_writeback(memwb_reg_t memwb_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p);
 
-void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit);
+// see stage_helpers.h
+uint32_t execute_alu(uint32_t alu_inp1, uint32_t alu_inp2, uint32_t alu_control);
+
+void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, Cache* icache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit);
 
 void bootstrap(pipeline_wires_t* pwires_p, pipeline_regs_t* pregs_p, regfile_t* regfile_p);
 
@@ -0,0 +1,121 @@
+#include "pipeview.h"
+#include <stdio.h>
+#include <string.h>
+#include "riscv.h"
+
+pipeview_t pipeview = {0};
+
+static const char *pv_stage_names[PV_STAGE_COUNT] = {"", "F", "D", "X", "M", "W"};
+
+int pv_open(const char *filename, uint64_t now) {
+  if (!bw_open(&pipeview.out, filename)) {
+    fprintf(stderr, "Cannot create pipeline trace %s\n", filename);
+    return -1;
+  }
+  pipeview.enabled = true;
+  pipeview.next_seq = 1;
+  pipeview.retire_id = 0;
+  pipeview.cycle = now;
+  memset(pipeview.window, 0, sizeof(pipeview.window));
+  bw_printf(&pipeview.out, "Kanata\t0004\nC=\t%lu\n", (unsigned long)now);
+  return 0;
+}
+
+void pv_close(void) {
+  bw_close(&pipeview.out);
+  pipeview.enabled = false;
+}
+
+static pv_entry_t *pv_entry(uint64_t seq) {
+  pv_entry_t *entry = &pipeview.window[seq & (PV_WINDOW - 1)];
+  return seq != 0 && entry->seq == seq ? entry : NULL;
+}
+
+// Log a fetched instruction, returns its id (0 for an empty slot)
+uint64_t pv_fetch(uint32_t pc, uint32_t bits, int slot) {
+  if (bits == 0) {
+    return 0;
+  }
+  uint64_t seq = pipeview.next_seq++;
+  pv_entry_t *entry = &pipeview.window[seq & (PV_WINDOW - 1)];
+  entry->seq = seq;
+  entry->stage = PV_FETCH;
+  entry->retired = false;
+  entry->stalled = false;
+
+  char text[64];
+  disassemble(bits, text, sizeof(text));
+  for (char *c = text; *c; c++) {
+    if (*c == '\t') {
+      *c = ' '; // fields are tab separated
+    }
+  }
+  bw_printf(&pipeview.out, "I\t%lu\t%lu\t0\n", (unsigned long)(seq - 1), (unsigned long)(seq - 1));
+  bw_printf(&pipeview.out, "L\t%lu\t0\t%08x: %s\n", (unsigned long)(seq - 1), pc, text);
+  bw_printf(&pipeview.out, "L\t%lu\t1\tslot %d\n", (unsigned long)(seq - 1), slot);
+  bw_printf(&pipeview.out, "S\t%lu\t0\t%s\n", (unsigned long)(seq - 1), pv_stage_names[PV_FETCH]);
+  return seq;
+}
+
+void pv_stage(uint64_t seq, int stage) {
+  pv_entry_t *entry = pv_entry(seq);
+  if (entry == NULL || entry->stage == stage) {
+    return;
+  }
+  entry->stage = stage;
+  bw_printf(&pipeview.out, "S\t%lu\t0\t%s\n", (unsigned long)(seq - 1), pv_stage_names[stage]);
+}
+
+// Held in decode by detect_hazard for this cycle
+void pv_stall(uint64_t seq) {
+  pv_entry_t *entry = pv_entry(seq);
+  if (entry == NULL || entry->stalled) {
+    return;
+  }
+  entry->stalled = true;
+  bw_printf(&pipeview.out, "S\t%lu\t1\tstall\n", (unsigned long)(seq - 1));
+}
+
+void pv_retire(uint64_t seq) {
+  pv_entry_t *entry = pv_entry(seq);
+  if (entry != NULL) {
+    entry->retired = true;
+  }
+}
+
+/*
+Advance the log to cycle `now`. `live` holds the ids still in the pipeline;
+tracked instructions that neither retired nor appear there were squashed.
+*/
+void pv_end_cycle(const uint64_t *live, int live_count, uint64_t now) {
+  if (now > pipeview.cycle) {
+    bw_printf(&pipeview.out, "C\t%lu\n", (unsigned long)(now - pipeview.cycle));
+    pipeview.cycle = now;
+  }
+
+  for (int i = 0; i < PV_WINDOW; i++) {
+    pv_entry_t *entry = &pipeview.window[i];
+    if (entry->seq == 0) {
+      continue;
+    }
+    unsigned long id = (unsigned long)(entry->seq - 1);
+    if (entry->stalled) {
+      bw_printf(&pipeview.out, "E\t%lu\t1\tstall\n", id);
+      entry->stalled = false;
+    }
+    if (entry->retired) {
+      bw_printf(&pipeview.out, "E\t%lu\t0\t%s\n", id, pv_stage_names[entry->stage]);
+      bw_printf(&pipeview.out, "R\t%lu\t%lu\t0\n", id, (unsigned long)pipeview.retire_id++);
+      entry->seq = 0;
+      continue;
+    }
+    bool in_flight = false;
+    for (int l = 0; l < live_count && !in_flight; l++) {
+      in_flight = live[l] == entry->seq;
+    }
+    if (!in_flight) {
+      bw_printf(&pipeview.out, "R\t%lu\t0\t1\n", id);
+      entry->seq = 0;
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef PIPEVIEW_H
+#define PIPEVIEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bufwriter.h"
+
+// Pipeline trace in the Kanata log format read by the Konata viewer
+// (-K <file>). Every fetched instruction gets an id; the log records the
+// cycle it enters each stage, hazard stalls (lane 1), its issue slot, and
+// whether it retired or was squashed (flush, wrong-path second slot, refetch).
+
+#define PV_WINDOW 64  // in-flight instructions tracked, power of two
+
+enum pv_stage_enum {
+  PV_NONE = 0,
+  PV_FETCH,
+  PV_DECODE,
+  PV_EXECUTE,
+  PV_MEM,
+  PV_WRITEBACK,
+  PV_STAGE_COUNT
+};
+
+typedef struct {
+    uint64_t seq;     // 0 marks a free entry
+    int stage;
+    bool retired;
+    bool stalled;
+} pv_entry_t;
+
+typedef struct {
+    bool enabled;
+    bufwriter_t out;
+    uint64_t next_seq;
+    uint64_t retire_id;
+    uint64_t cycle;
+    pv_entry_t window[PV_WINDOW];
+} pipeview_t;
+
+extern pipeview_t pipeview;
+
+// Function declarations
+int pv_open(const char *filename, uint64_t now);
+void pv_close(void);
+uint64_t pv_fetch(uint32_t pc, uint32_t bits, int slot);
+void pv_stage(uint64_t seq, int stage);
+void pv_stall(uint64_t seq);
+void pv_retire(uint64_t seq);
+void pv_end_cycle(const uint64_t *live, int live_count, uint64_t now);
+#endif // PIPEVIEW_H
@@ -0,0 +1,289 @@
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+profile_t profile = {0};
+
+static const char *prof_event_names[PROF_EVENT_COUNT] = {
+  "base", "hazard", "mem", "fetch", "loadwait", "fu", "misses", "flushes", "retired"
+};
+
+void prof_init(uint32_t entry_pc) {
+  profile.enabled = true;
+  profile.pc_capacity = 1024;
+  profile.pc_used = 0;
+  profile.pcs = calloc(profile.pc_capacity, sizeof(prof_pc_t));
+  profile.node_capacity = 64;
+  profile.nodes = calloc(profile.node_capacity, sizeof(prof_node_t));
+  profile.nodes[0].parent = -1;
+  profile.nodes[0].first_child = -1;
+  profile.nodes[0].next_sibling = -1;
+  profile.nodes[0].func = entry_pc;
+  profile.node_count = 1;
+  profile.current = 0;
+  profile.depth = 0;
+  profile.pending_call = false;
+}
+
+void prof_free(void) {
+  free(profile.pcs);
+  free(profile.nodes);
+  for (int i = 0; i < profile.symbol_count; i++) {
+    free(profile.symbols[i].name);
+  }
+  free(profile.symbols);
+  memset(&profile, 0, sizeof(profile));
+}
+
+/// SYMBOLS ///
+
+static int compare_symbols(const void *a, const void *b) {
+  uint32_t x = ((const prof_symbol_t *)a)->addr, y = ((const prof_symbol_t *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+int prof_load_symbols(const char *filename) {
+  FILE *map = fopen(filename, "r");
+  if (map == NULL) {
+    fprintf(stderr, "Cannot open symbol map %s\n", filename);
+    return -1;
+  }
+  char line[512], field1[256], field2[256];
+  unsigned int addr;
+  int capacity = 0;
+  while (fgets(line, sizeof(line), map) != NULL) {
+    int fields = sscanf(line, "%x %255s %255s", &addr, field1, field2);
+    if (fields < 2) {
+      continue;
+    }
+    if (profile.symbol_count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      profile.symbols = realloc(profile.symbols, capacity * sizeof(prof_symbol_t));
+    }
+    profile.symbols[profile.symbol_count].addr = addr;
+    profile.symbols[profile.symbol_count].name = strdup(fields == 3 ? field2 : field1);
+    profile.symbol_count++;
+  }
+  fclose(map);
+  qsort(profile.symbols, profile.symbol_count, sizeof(prof_symbol_t), compare_symbols);
+  return 0;
+}
+
+// Closest symbol at or below `pc`, NULL if there is none
+static const prof_symbol_t *find_symbol(uint32_t pc) {
+  int lo = 0, hi = profile.symbol_count - 1;
+  const prof_symbol_t *found = NULL;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (profile.symbols[mid].addr <= pc) {
+      found = &profile.symbols[mid];
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+static void format_pc(uint32_t pc, char *buf, size_t size) {
+  const prof_symbol_t *symbol = find_symbol(pc);
+  if (symbol == NULL) {
+    snprintf(buf, size, "0x%08x", pc);
+  } else if (symbol->addr == pc) {
+    snprintf(buf, size, "%s", symbol->name);
+  } else {
+    snprintf(buf, size, "%s+0x%x", symbol->name, pc - symbol->addr);
+  }
+}
+
+/// PER-PC COUNTERS ///
+
+static prof_pc_t *pc_entry(uint32_t pc) {
+  if (profile.pc_used * 2 >= profile.pc_capacity) {
+    prof_pc_t *old = profile.pcs;
+    uint64_t old_capacity = profile.pc_capacity;
+    profile.pc_capacity *= 2;
+    profile.pcs = calloc(profile.pc_capacity, sizeof(prof_pc_t));
+    profile.pc_used = 0;
+    for (uint64_t i = 0; i < old_capacity; i++) {
+      if (old[i].pc != 0) {
+        *pc_entry(old[i].pc - 1) = old[i];
+      }
+    }
+    free(old);
+  }
+  uint64_t i = (pc * 2654435761U) & (profile.pc_capacity - 1);
+  while (profile.pcs[i].pc != 0 && profile.pcs[i].pc != pc + 1) {
+    i = (i + 1) & (profile.pc_capacity - 1);
+  }
+  if (profile.pcs[i].pc == 0) {
+    profile.pcs[i].pc = pc + 1;
+    profile.pc_used++;
+  }
+  return &profile.pcs[i];
+}
+
+/// ATTRIBUTION ///
+
+void prof_charge(uint32_t pc, int event, uint64_t amount) {
+  pc_entry(pc)->events[event] += amount;
+  if (event < PROF_CYCLE_EVENTS) {
+    profile.attributed += amount;
+    profile.nodes[profile.current].cycles += amount;
+  }
+}
+
+void prof_begin_cycle(uint64_t now) {
+  profile.cycle_start = now;
+  profile.attributed = 0;
+}
+
+// Charge whatever the stalls did not explain to `pc`
+void prof_end_cycle(uint32_t pc, uint64_t now) {
+  uint64_t elapsed = now - profile.cycle_start;
+  if (elapsed > profile.attributed) {
+    prof_charge(pc, PROF_BASE_CYCLES, elapsed - profile.attributed);
+  }
+}
+
+/// CALL STACK ///
+
+static void push_frame(uint32_t func) {
+  if (profile.depth >= PROF_MAX_DEPTH) {
+    return;
+  }
+  int child = profile.nodes[profile.current].first_child;
+  while (child >= 0 && profile.nodes[child].func != func) {
+    child = profile.nodes[child].next_sibling;
+  }
+  if (child < 0) {
+    if (profile.node_count == profile.node_capacity) {
+      profile.node_capacity *= 2;
+      profile.nodes = realloc(profile.nodes, profile.node_capacity * sizeof(prof_node_t));
+    }
+    child = profile.node_count++;
+    profile.nodes[child].parent = profile.current;
+    profile.nodes[child].first_child = -1;
+    profile.nodes[child].next_sibling = profile.nodes[profile.current].first_child;
+    profile.nodes[child].func = func;
+    profile.nodes[child].cycles = 0;
+    profile.nodes[profile.current].first_child = child;
+  }
+  profile.current = child;
+  profile.depth++;
+}
+
+static void pop_frame(void) {
+  if (profile.current != 0) {
+    profile.current = profile.nodes[profile.current].parent;
+    profile.depth--;
+  }
+}
+
+static bool is_link_register(uint32_t reg) {
+  return reg == 1 || reg == 5; // ra, t0
+}
+
+// Called for every instruction leaving writeback, in program order
+void prof_retire(Instruction instruction, uint32_t pc) {
+  pc_entry(pc)->events[PROF_RETIRED]++;
+  if (profile.pending_call) {
+    profile.pending_call = false;
+    push_frame(pc);
+  }
+  if (instruction.opcode == 0x6f && is_link_register(instruction.ujtype.rd)) {
+    profile.pending_call = true;
+  } else if (instruction.opcode == 0x67) {
+    if (is_link_register(instruction.itype.rd)) {
+      profile.pending_call = true;
+    } else if (instruction.itype.rd == 0 && is_link_register(instruction.itype.rs1)) {
+      pop_frame();
+    }
+  }
+}
+
+/// OUTPUT ///
+
+static int compare_cycles(const void *a, const void *b) {
+  const prof_pc_t *x = *(const prof_pc_t * const *)a, *y = *(const prof_pc_t * const *)b;
+  uint64_t cx = 0, cy = 0;
+  for (int e = 0; e < PROF_CYCLE_EVENTS; e++) {
+    cx += x->events[e];
+    cy += y->events[e];
+  }
+  if (cx != cy) {
+    return cx < cy ? 1 : -1;
+  }
+  return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+static void write_stack(FILE *out, int node) {
+  char name[300];
+  if (profile.nodes[node].parent >= 0) {
+    write_stack(out, profile.nodes[node].parent);
+    fputc(';', out);
+  }
+  format_pc(profile.nodes[node].func, name, sizeof(name));
+  fputs(name, out);
+}
+
+// Write <prefix>.prof (flat profile, hottest PC first) and <prefix>.folded
+// (one "frame;frame;... cycles" line per call stack)
+int prof_write(const char *prefix) {
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s.prof", prefix);
+  FILE *out = fopen(filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create %s\n", filename);
+    return -1;
+  }
+
+  prof_pc_t **sorted = malloc((profile.pc_used + 1) * sizeof(prof_pc_t *));
+  uint64_t n = 0, total = 0;
+  for (uint64_t i = 0; i < profile.pc_capacity; i++) {
+    if (profile.pcs[i].pc != 0) {
+      sorted[n++] = &profile.pcs[i];
+      for (int e = 0; e < PROF_CYCLE_EVENTS; e++) {
+        total += profile.pcs[i].events[e];
+      }
+    }
+  }
+  qsort(sorted, n, sizeof(prof_pc_t *), compare_cycles);
+
+  fprintf(out, "# %10s %7s", "cycles", "%");
+  for (int e = 0; e < PROF_EVENT_COUNT; e++) {
+    fprintf(out, " %9s", prof_event_names[e]);
+  }
+  fprintf(out, "  %-10s  %s\n", "pc", "symbol");
+  for (uint64_t i = 0; i < n; i++) {
+    uint64_t cycles = 0;
+    for (int e = 0; e < PROF_CYCLE_EVENTS; e++) {
+      cycles += sorted[i]->events[e];
+    }
+    char name[300];
+    format_pc(sorted[i]->pc - 1, name, sizeof(name));
+    fprintf(out, "  %10lu %6.2f%%", (unsigned long)cycles, total ? 100.0 * cycles / total : 0.0);
+    for (int e = 0; e < PROF_EVENT_COUNT; e++) {
+      fprintf(out, " %9lu", (unsigned long)sorted[i]->events[e]);
+    }
+    fprintf(out, "  0x%08x  %s\n", sorted[i]->pc - 1, name);
+  }
+  free(sorted);
+  fclose(out);
+
+  snprintf(filename, sizeof(filename), "%s.folded", prefix);
+  out = fopen(filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create %s\n", filename);
+    return -1;
+  }
+  for (int node = 0; node < profile.node_count; node++) {
+    if (profile.nodes[node].cycles > 0) {
+      write_stack(out, node);
+      fprintf(out, " %lu\n", (unsigned long)profile.nodes[node].cycles);
+    }
+  }
+  fclose(out);
+  return 0;
+}
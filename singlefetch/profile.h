@@ -0,0 +1,83 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+
+// Cycle profiler for the pipeline (-P <prefix>). Stall cycles are charged
+// to the instruction that caused them and every remaining cycle to the
+// oldest instruction in flight. A call stack is rebuilt from calls
+// (jal/jalr writing ra or t0) and returns (jalr x0, 0(ra/t0)), so cycles can
+// also be written as folded stacks for flamegraph.pl. Symbol names come from
+// an optional map (-S <file>, "addr name" or nm style "addr type name").
+
+enum prof_event_enum {
+  PROF_BASE_CYCLES = 0,   // cycles not explained by a stall
+  PROF_HAZARD_STALLS,
+  PROF_MEM_STALLS,
+  PROF_FETCH_STALLS,
+  PROF_LOAD_WAIT_STALLS,
+  PROF_FU_STALLS,
+  PROF_CACHE_MISSES,      // events from here on are counts, not cycles
+  PROF_FLUSHES,
+  PROF_RETIRED,
+  PROF_EVENT_COUNT
+};
+#define PROF_CYCLE_EVENTS PROF_CACHE_MISSES
+
+#define PROF_MAX_DEPTH 256  // deeper calls are folded into the deepest frame
+
+typedef struct {
+    uint32_t pc;
+    uint64_t events[PROF_EVENT_COUNT];
+} prof_pc_t;
+
+// call tree node, node 0 is the program entry
+typedef struct {
+    int parent;
+    int first_child;
+    int next_sibling;
+    uint32_t func;
+    uint64_t cycles;
+} prof_node_t;
+
+typedef struct {
+    uint32_t addr;
+    char *name;
+} prof_symbol_t;
+
+typedef struct {
+    bool enabled;
+
+    // per-PC counters (open addressing on pc + 1)
+    prof_pc_t *pcs;
+    uint64_t pc_capacity;
+    uint64_t pc_used;
+
+    prof_node_t *nodes;
+    int node_count;
+    int node_capacity;
+    int current;
+    int depth;
+    bool pending_call;   // the next retired instruction is a callee entry
+
+    prof_symbol_t *symbols;
+    int symbol_count;
+
+    uint64_t cycle_start;
+    uint64_t attributed; // stall cycles already charged in this cycle
+} profile_t;
+
+extern profile_t profile;
+
+// Function declarations
+void prof_init(uint32_t entry_pc);
+void prof_free(void);
+int prof_load_symbols(const char *filename);
+void prof_charge(uint32_t pc, int event, uint64_t amount);
+void prof_begin_cycle(uint64_t now);
+void prof_end_cycle(uint32_t pc, uint64_t now);
+void prof_retire(Instruction instruction, uint32_t pc);
+int prof_write(const char *prefix);
+#endif // PROFILE_H
@@ -0,0 +1,282 @@
+#include "replacement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Replacement policies for the cache. LRU and LFU keep using the per-line
+// lru_clock/access_counter fields; every other policy keeps its own compact
+// per-set state (tree bits, 2-bit RRPVs or a FIFO pointer).
+
+static const char *policy_names[REPL_POLICY_COUNT] = {
+  "lru", "lfu", "fifo", "random", "plru", "srrip", "brrip", "drrip"
+};
+
+repl_policy_t repl_policy_from_name(const char *name) {
+  for (int i = 0; i < REPL_POLICY_COUNT; i++) {
+    if (strcasecmp(name, policy_names[i]) == 0) {
+      return (repl_policy_t)i;
+    }
+  }
+  return REPL_POLICY_COUNT;
+}
+
+const char *repl_policy_name(repl_policy_t policy) {
+  if (policy >= REPL_POLICY_COUNT) {
+    return "unknown";
+  }
+  return policy_names[policy];
+}
+
+// Whether a "-R [level:]policy" spec applies to the cache level `name`. A
+// spec without a level applies to every level.
+bool repl_spec_names(const char *spec, const char *name) {
+  const char *colon = strchr(spec, ':');
+  if (colon == NULL) {
+    return true;
+  }
+  size_t len = colon - spec;
+  return strlen(name) == len && strncasecmp(name, spec, len) == 0;
+}
+
+// Apply a "-R [level:]policy" spec to the cache. A spec naming a different
+// level leaves the cache untouched. Returns false on an unknown policy,
+// whichever level the spec names.
+bool repl_configure(Cache *cache, const char *spec) {
+  const char *colon = strchr(spec, ':');
+  repl_policy_t policy = repl_policy_from_name(colon != NULL ? colon + 1 : spec);
+  if (policy == REPL_POLICY_COUNT) {
+    return false;
+  }
+  if (!repl_spec_names(spec, cache->name)) {
+    return true;
+  }
+  repl_free(cache);
+  cache->policy = policy;
+  repl_init(cache);
+  return true;
+}
+
+static uint32_t next_random(Cache *cache) {
+  // xorshift32
+  uint32_t x = cache->rng_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  cache->rng_state = x;
+  return x;
+}
+
+/// TREE PSEUDO-LRU ///
+
+// Nodes are stored heap-style starting at bit 1; a set bit points to the
+// right subtree as the next victim. The way index is walked from its MSB.
+static void plru_touch(Set *set, int ways, int way) {
+  int node = 1;
+  for (int span = ways >> 1; span >= 1; span >>= 1) {
+    if (way & span) {
+      set->plru_bits &= ~(1ULL << node); // point away, to the left
+      node = 2 * node + 1;
+    } else {
+      set->plru_bits |= (1ULL << node);  // point away, to the right
+      node = 2 * node;
+    }
+  }
+}
+
+static int plru_victim(const Set *set, int ways) {
+  int node = 1;
+  int way = 0;
+  for (int span = ways >> 1; span >= 1; span >>= 1) {
+    if (set->plru_bits & (1ULL << node)) {
+      way |= span;
+      node = 2 * node + 1;
+    } else {
+      node = 2 * node;
+    }
+  }
+  return way;
+}
+
+/// RRIP ///
+
+enum { DUEL_FOLLOWER = 0, DUEL_SRRIP_LEADER, DUEL_BRRIP_LEADER };
+
+static int duel_role(const Cache *cache, unsigned long long set_idx) {
+  int sets = 1 << cache->setBits;
+  if (sets < 2) {
+    return DUEL_SRRIP_LEADER;
+  }
+  int stride = sets < DRRIP_LEADER_STRIDE ? sets : DRRIP_LEADER_STRIDE;
+  if (set_idx % stride == 0) {
+    return DUEL_SRRIP_LEADER;
+  } else if (set_idx % stride == 1) {
+    return DUEL_BRRIP_LEADER;
+  }
+  return DUEL_FOLLOWER;
+}
+
+static uint8_t brrip_insert(Cache *cache) {
+  cache->fill_count++;
+  return (cache->fill_count % BRRIP_LONG_INTERVAL == 0) ? RRPV_LONG : RRPV_MAX;
+}
+
+static uint8_t rrip_insert_value(Cache *cache, unsigned long long set_idx) {
+  if (cache->policy == REPL_SRRIP) {
+    return RRPV_LONG;
+  } else if (cache->policy == REPL_BRRIP) {
+    return brrip_insert(cache);
+  }
+  // DRRIP: fills only happen on misses, so leader fills train the selector
+  int psel_max = (1 << DRRIP_PSEL_BITS) - 1;
+  switch (duel_role(cache, set_idx)) {
+    case DUEL_SRRIP_LEADER:
+      if (cache->psel < psel_max) cache->psel++;
+      return RRPV_LONG;
+    case DUEL_BRRIP_LEADER:
+      if (cache->psel > 0) cache->psel--;
+      return brrip_insert(cache);
+    default:
+      // SRRIP leaders missing more than BRRIP leaders -> follow BRRIP
+      return (cache->psel > (psel_max >> 1)) ? brrip_insert(cache) : RRPV_LONG;
+  }
+}
+
+static int rrip_victim(Set *set, int ways) {
+  while (true) {
+    for (int i = 0; i < ways; i++) {
+      if (set->rrpv[i] == RRPV_MAX) {
+        return i;
+      }
+    }
+    for (int i = 0; i < ways; i++) {
+      set->rrpv[i]++;
+    }
+  }
+}
+
+static bool is_rrip(repl_policy_t policy) {
+  return policy == REPL_SRRIP || policy == REPL_BRRIP || policy == REPL_DRRIP;
+}
+
+/// POLICY INTERFACE ///
+
+void repl_init(Cache *cache) {
+  int sets = 1 << cache->setBits;
+  if (cache->policy == REPL_PLRU) {
+    // tree bits live in one 64-bit word per set
+    if (cache->linesPerSet > 64 || (cache->linesPerSet & (cache->linesPerSet - 1)) != 0) {
+      printf("Error: plru needs a power-of-two associativity <= 64 (got %d)\n", cache->linesPerSet);
+      exit(-1);
+    }
+  }
+  cache->rng_state = CACHE_REPL_SEED;
+  cache->psel = 1 << (DRRIP_PSEL_BITS - 1);
+  cache->fill_count = 0;
+  for (int i = 0; i < sets; i++) {
+    Set *set = &cache->sets[i];
+    set->plru_bits = 0;
+    set->fifo_next = 0;
+    set->rrpv = NULL;
+    if (is_rrip(cache->policy)) {
+      set->rrpv = (uint8_t *)malloc(cache->linesPerSet * sizeof(uint8_t));
+      memset(set->rrpv, RRPV_MAX, cache->linesPerSet * sizeof(uint8_t));
+    }
+  }
+}
+
+void repl_free(Cache *cache) {
+  for (int i = 0; i < (1 << cache->setBits); i++) {
+    free(cache->sets[i].rrpv);
+    cache->sets[i].rrpv = NULL;
+  }
+}
+
+void repl_on_hit(Cache *cache, unsigned long long set_idx, int way) {
+  Set *set = &cache->sets[set_idx];
+  switch (cache->policy) {
+    case REPL_LRU:
+      set->lines[way].lru_clock = ++(set->lru_clock);
+      break;
+    case REPL_LFU:
+      set->lines[way].access_counter++;
+      break;
+    case REPL_PLRU:
+      plru_touch(set, cache->linesPerSet, way);
+      break;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+    case REPL_DRRIP:
+      set->rrpv[way] = 0; // hit priority
+      break;
+    default: // FIFO and random ignore hits
+      break;
+  }
+}
+
+void repl_on_fill(Cache *cache, unsigned long long set_idx, int way) {
+  Set *set = &cache->sets[set_idx];
+  switch (cache->policy) {
+    case REPL_LRU:
+    case REPL_LFU:
+      set->lines[way].lru_clock = set->lru_clock;
+      set->lines[way].access_counter = 1;
+      break;
+    case REPL_FIFO:
+      set->fifo_next = (way + 1) % cache->linesPerSet;
+      break;
+    case REPL_PLRU:
+      plru_touch(set, cache->linesPerSet, way);
+      break;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+    case REPL_DRRIP:
+      set->rrpv[way] = rrip_insert_value(cache, set_idx);
+      break;
+    default:
+      break;
+  }
+}
+
+int repl_victim(Cache *cache, unsigned long long set_idx) {
+  Set *set = &cache->sets[set_idx];
+  int victim = 0;
+  switch (cache->policy) {
+    case REPL_LRU:
+      // Find the cacheline that has been used the least recently
+      for (int i = 1; i < cache->linesPerSet; i++) {
+        if (set->lines[i].lru_clock < set->lines[victim].lru_clock) {
+          victim = i;
+        }
+      }
+      break;
+    case REPL_LFU:
+      // Find the cache line that has been used the least frequently, with a tie-breaker based on the least recently used
+      for (int i = 1; i < cache->linesPerSet; i++) {
+        Line *line = &set->lines[i];
+        Line *victim_line = &set->lines[victim];
+        if ((line->access_counter < victim_line->access_counter) ||
+            ((line->access_counter == victim_line->access_counter) && line->lru_clock < victim_line->lru_clock)) {
+          victim = i;
+        }
+      }
+      break;
+    case REPL_FIFO:
+      victim = set->fifo_next;
+      break;
+    case REPL_RANDOM:
+      victim = next_random(cache) % cache->linesPerSet;
+      break;
+    case REPL_PLRU:
+      victim = plru_victim(set, cache->linesPerSet);
+      break;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+    case REPL_DRRIP:
+      victim = rrip_victim(set, cache->linesPerSet);
+      break;
+    default:
+      break;
+  }
+  return victim;
+}
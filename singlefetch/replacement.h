@@ -0,0 +1,24 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <stdbool.h>
+#include "cache.h"
+
+// RRIP parameters (2-bit re-reference prediction values)
+#define RRPV_MAX 3              // distant re-reference
+#define RRPV_LONG (RRPV_MAX-1)  // SRRIP insertion value
+#define BRRIP_LONG_INTERVAL 32  // BRRIP inserts "long" once every N fills
+#define DRRIP_PSEL_BITS 10      // set-dueling selector width
+#define DRRIP_LEADER_STRIDE 32  // one leader pair per 32 sets (at least one pair)
+
+// Function declarations
+repl_policy_t repl_policy_from_name(const char *name);
+const char *repl_policy_name(repl_policy_t policy);
+bool repl_spec_names(const char *spec, const char *name);
+bool repl_configure(Cache *cache, const char *spec);
+void repl_init(Cache *cache);
+void repl_free(Cache *cache);
+void repl_on_hit(Cache *cache, unsigned long long set_idx, int way);
+void repl_on_fill(Cache *cache, unsigned long long set_idx, int way);
+int repl_victim(Cache *cache, unsigned long long set_idx);
+#endif // REPLACEMENT_H
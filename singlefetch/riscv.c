@@ -7,19 +7,59 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "cache.h"
+#include "replacement.h"
+#include "stackdist.h"
 #include "pipeline.h"
+#include "csr.h"
+#include "profile.h"
+#include "cpistack.h"
+#include "pipeview.h"
+#include "hostperf.h"
+#include "fu.h"
+#include "issuestat.h"
+#include "fetchq.h"
+#include "storebuf.h"
+#include "smp.h"
+#include "smt.h"
+#include "gdbstub.h"
+#include "timetravel.h"
+#include "watch.h"
 
 /* WARNING: DO NOT CHANGE THIS FILE.
  YOU PROBABLY DON'T EVEN NEED TO LOOK AT IT... */
 
 // Pointer to simulator memory
 Byte *memory;
+uint64_t emu_instret = 0; // instructions executed by the emulator (-m)
+hostperf_t host_perf;          // -H: the simulator's own speed on the host
 #define MAX_SIZE 50
+#define MAX_REPL_SPECS 8
+#define MAX_WATCH_SPECS 8
+
+void print_registers(regfile_t *regfile) {
+  int i, j;
+
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j < 4; j++) {
+      printf("r%2d=%08x ", i * 4 + j, regfile->R[i * 4 + j]);
+    }
+
+    puts("");
+  }
+
+  printf("\n");
+}
 
 void execute_emu(regfile_t *regfile, int prompt, int print) {
+  // -G: stop here for a breakpoint or a step
+  if (gdb.enabled && gdb_check(&gdb, regfile->PC)) {
+    gdb_trap(&gdb, regfile, regfile->PC);
+  }
+
   /* fetch an instruction */
   uint32_t instruction_bits = load(memory, regfile->PC, LENGTH_WORD);
 
@@ -35,47 +75,86 @@ void execute_emu(regfile_t *regfile, int prompt, int print) {
     decode_instruction(instruction_bits);
   }
 
+  uint32_t pc = regfile->PC;
   execute_instruction(instruction_bits, regfile, memory);
+  emu_instret++;
+
+  // -w/-G: the instruction touched a watched page
+  if (watch.faulted) {
+    watch_decode(&watch, instruction_bits);
+    int hit = watch_check(&watch, pc, emu_instret);
+    if (hit >= 0 && gdb.enabled) {
+      gdb_watch(&gdb, regfile, regfile->PC, &watch.points[hit]);
+    }
+  }
 
   // enforce $0 being hard-wired to 0
   regfile->R[0] = 0;
 
   // print trace
   if (print) {
-    int i, j;
-
-    for (i = 0; i < 8; i++) {
-      for (j = 0; j < 4; j++) {
-        printf("r%2d=%08x ", i * 4 + j, regfile->R[i * 4 + j]);
-      }
+    print_registers(regfile);
+  }
+}
 
-      puts("");
+// -w/-G: match a fault the last cycle took against the watchpoints
+void check_watch_cycle(regfile_t *regfile) {
+  if (watch.faulted) {
+    int hit = watch_check(&watch, watch.fault_pc, total_cycle_counter);
+    if (hit >= 0 && gdb.enabled) {
+      gdb_watch(&gdb, regfile, watch.fault_pc, &watch.points[hit]);
     }
+  }
+}
 
-    printf("\n");
+// -H: printed at exit, since the emulator leaves through exit() on ecall
+void print_host_stats(void) {
+  hostperf_stop(&host_perf);
+  printf("#Host seconds      = %10.6f\n", host_perf.seconds);
+  if (emu_instret > 0) {
+    printf("#Host MIPS         = %8.3f\n", emu_instret / host_perf.seconds / 1e6);
   }
+  if (total_cycle_counter > 0) {
+    printf("#Host Mcycles/s    = %8.3f\n", total_cycle_counter / host_perf.seconds / 1e6);
+    printf("#Host MIPS         = %8.3f\n", instret_counter / host_perf.seconds / 1e6);
+  }
+  hostperf_print(&host_perf);
+  hostperf_close(&host_perf);
 }
 
+// One instruction per line in hex. A line of at most four digits is a
+// 16-bit compressed instruction, anything longer a 32-bit one. `code_bytes`
+// (may be NULL) receives the size of the loaded code.
 int load_program(uint8_t *mem, size_t memsize, int startaddr,
-                 const char *filename, int disasm) {
+                 const char *filename, int disasm, uint32_t *code_bytes) {
   FILE *file = fopen(filename, "r");
   char line[MAX_SIZE];
   int instruction, offset = 0;
   int programsize = 0;
   while (fgets(line, MAX_SIZE, file) != NULL) {
+    char *digits = line;
+    if (digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+      digits += 2;
+    }
+    int size = strspn(digits, "0123456789abcdefABCDEF") <= 4 ? 2 : 4;
     instruction = (int32_t)strtol(line, NULL, 16);
     programsize++;
     mem[startaddr + offset] = instruction & 0xFF;
     mem[startaddr + offset + 1] = (instruction >> 8) & 0xFF;
-    mem[startaddr + offset + 2] = (instruction >> 16) & 0xFF;
-    mem[startaddr + offset + 3] = (instruction >> 24) & 0xFF;
+    if (size == 4) {
+      mem[startaddr + offset + 2] = (instruction >> 16) & 0xFF;
+      mem[startaddr + offset + 3] = (instruction >> 24) & 0xFF;
+    }
 
     if (disasm) {
       printf("%08x: ", startaddr + offset);
       decode_instruction((uint32_t)instruction);
     }
 
-    offset += 4;
+    offset += size;
+  }
+  if (code_bytes != NULL) {
+    *code_bytes = offset;
   }
   return programsize;
 }
@@ -95,13 +174,47 @@ int main(int argc, char **argv) {
 
   uint32_t print_mem_startaddr = 0, print_mem_stopaddr = 0;
 
+  // replacement policy specs ("-R [level:]policy"), applied once caches exist
+  char *opt_repl[MAX_REPL_SPECS];
+  int opt_repl_count = 0;
+  int opt_mshrs = 0;             // -M: non-blocking data cache with n MSHRs
+  int opt_icache = 0,            // -I[sets:ways:block]: instruction cache (log2 sets/block bytes)
+      opt_fetch_buffer = 0;      // -F: line-wide fetch buffer in front of the I-cache
+  int opt_fetch_queue = 0;       // -B[n]: decoupled front end, n pairs between fetch and decode
+  int opt_fetch_queue_depth = FETCH_QUEUE_DEPTH;
+  int opt_store_buffer = 0;      // -O[n]: n-entry store buffer with store-to-load forwarding
+  int opt_store_buffer_entries = STORE_BUFFER_ENTRIES;
+  int icache_set_bits = ICACHE_SET_BITS,
+      icache_lines_per_set = ICACHE_LINES_PER_SET,
+      icache_block_bits = ICACHE_BLOCK_BITS;
+  int opt_dram = 0;              // -D[open|closed][:channels:ranks:banks]: DRAM timing model
+  char *opt_dram_spec = NULL;
+  int opt_fu = 0;                // -U[unit=latency:interval,...]: multi-cycle functional units
+  char *opt_fu_spec = NULL;
+  char *opt_classify = NULL;     // -C: three-C miss classification, CSVs named <prefix>_*.csv
+  char *opt_profile = NULL,      // -P: cycle profile, written to <prefix>.prof and <prefix>.folded
+       *opt_symbols = NULL;      // -S: symbol map naming the profiled PCs
+  char *opt_pipeview = NULL;     // -K: pipeline trace for the Konata viewer
+  int opt_cpi_stack = 0;         // -T: print the CPI stack with the stats
+  int opt_issue = 0;             // -Q[n]: dual-issue slot stats and the n most frequent blocked pairs
+  int opt_issue_top = 0;
+  int opt_host = 0;              // -H: host time, throughput and hardware counters
+  char *opt_harts = NULL;        // -N harts[:threads[:quantum]]: multi-hart emulation
+  char *opt_smt = NULL;          // -X threads[:rr|icount]: SMT in the pipeline
+  char *opt_gdb = NULL;          // -G port|path: wait for GDB on a local socket
+  char *opt_timetravel = NULL;   // -J interval[:snapshots]: snapshots for reverse debugging
+  char *opt_watch[MAX_WATCH_SPECS];  // -w addr[:len[:w|r|a|c]]: data watchpoints
+  int opt_watch_count = 0;
+  char *opt_addr_trace = NULL,   // -W: record the data address stream
+       *opt_analyze = NULL;      // -A: stack distance analysis of a recorded stream
+
 
   /* the architectural state of the CPU */
   regfile_t regfile;
 
   /* parse the command-line args */
   int c;
-  while ((c = getopt(argc, argv, "dvritesmpcf")) != -1) {
+  while ((c = getopt(argc, argv, "dvritesmpcfTHQ::R:W:A:M:I::FB::O::D::U::C:P:S:K:N:X:G:J:w:")) != -1) {
     switch (c) {
     case 'd':
       opt_disasm = 1; break;
@@ -123,6 +236,85 @@ int main(int argc, char **argv) {
       opt_cache = 1; break;
     case 'f':
       opt_forwarding = 1; break;
+    case 'T':
+      opt_cpi_stack = 1; break;
+    case 'H':
+      opt_host = 1; break;
+    case 'Q':
+      opt_issue = 1;
+      opt_issue_top = optarg ? atoi(optarg) : 0;
+      break;
+    case 'R':
+      if (opt_repl_count < MAX_REPL_SPECS) {
+        opt_repl[opt_repl_count++] = optarg;
+      } else {
+        printf("Too many -R options, ignoring %s\n", optarg);
+      }
+      break;
+    case 'M': {
+      char *end;
+      long mshrs = strtol(optarg, &end, 10);
+      if (end == optarg || *end != '\0' || mshrs < 1 || mshrs > MSHR_MAX) {
+        fprintf(stderr, "Option -M expects a number of MSHRs from 1 to %d\n", MSHR_MAX);
+        return -1;
+      }
+      opt_mshrs = mshrs;
+      break;
+    }
+    case 'I':
+      opt_icache = 1;
+      if (optarg && sscanf(optarg, "%d:%d:%d", &icache_set_bits, &icache_lines_per_set, &icache_block_bits) != 3) {
+        fprintf(stderr, "Option -I expects <set bits>:<ways>:<block bits>\n");
+        return -1;
+      }
+      if (!cacheGeometryValid(icache_set_bits, icache_lines_per_set, icache_block_bits)) {
+        fprintf(stderr, "Option -I expects 0 to %d set bits, at least 1 way and %d to %d block bits\n",
+                CACHE_MAX_SET_BITS, CACHE_MIN_BLOCK_BITS, CACHE_MAX_BLOCK_BITS);
+        return -1;
+      }
+      break;
+    case 'F':
+      opt_fetch_buffer = 1; break;
+    case 'B':
+      opt_fetch_queue = 1;
+      opt_fetch_queue_depth = optarg ? atoi(optarg) : FETCH_QUEUE_DEPTH; break;
+    case 'O':
+      opt_store_buffer = 1;
+      opt_store_buffer_entries = optarg ? atoi(optarg) : STORE_BUFFER_ENTRIES; break;
+    case 'D':
+      opt_dram = 1;
+      opt_dram_spec = optarg;
+      break;
+    case 'U':
+      opt_fu = 1;
+      opt_fu_spec = optarg; break;
+    case 'C':
+      opt_classify = optarg; break;
+    case 'P':
+      opt_profile = optarg; break;
+    case 'S':
+      opt_symbols = optarg; break;
+    case 'K':
+      opt_pipeview = optarg; break;
+    case 'N':
+      opt_harts = optarg; break;
+    case 'X':
+      opt_smt = optarg; break;
+    case 'G':
+      opt_gdb = optarg; break;
+    case 'J':
+      opt_timetravel = optarg; break;
+    case 'w':
+      if (opt_watch_count < MAX_WATCH_SPECS) {
+        opt_watch[opt_watch_count++] = optarg;
+      } else {
+        printf("Too many -w options, ignoring %s\n", optarg);
+      }
+      break;
+    case 'W':
+      opt_addr_trace = optarg; break;
+    case 'A':
+      opt_analyze = optarg; break;
     case 'p':
       opt_printmem = 1;
       if (optind < argc - 1) { // Ensure there are two more arguments
@@ -139,6 +331,11 @@ int main(int argc, char **argv) {
     }
   }
 
+  /* trace-driven cache analysis does not run a program */
+  if (opt_analyze) {
+    return sd_analyze(opt_analyze, CACHE_BLOCK_BITS);
+  }
+
   /* make sure we got an executable filename on the command line */
   if (argc <= optind) {
     fprintf(stderr, "Give me an executable file to run!\n");
@@ -147,15 +344,123 @@ int main(int argc, char **argv) {
   
   Cache cache;
   cacheSetUp(&cache, "L1");
+  for (int r = 0; r < opt_repl_count; r++) {
+    if (!repl_configure(&cache, opt_repl[r])) {
+      fprintf(stderr, "Unknown replacement policy in -R %s\n", opt_repl[r]);
+      return -1;
+    }
+    if (!repl_spec_names(opt_repl[r], "L1") && !repl_spec_names(opt_repl[r], "L1I")) {
+      fprintf(stderr, "Unknown cache level in -R %s, expected L1 or L1I\n", opt_repl[r]);
+      return -1;
+    }
+  }
+  if (opt_mshrs > 0) {
+    mshr_init(&cache.mshrs, opt_mshrs);
+  }
+  Cache icache;
+  if (opt_icache) {
+    cacheSetUpGeometry(&icache, "L1I", icache_set_bits, icache_lines_per_set, icache_block_bits);
+    for (int r = 0; r < opt_repl_count; r++) {
+      if (!repl_configure(&icache, opt_repl[r])) {
+        fprintf(stderr, "Unknown replacement policy in -R %s\n", opt_repl[r]);
+        return -1;
+      }
+    }
+  }
+  Cache *icache_p = opt_icache ? &icache : NULL;
+  missclass_t classify;
+  if (opt_classify) {
+    mc_init(&classify, cache.setBits, cache.linesPerSet, cache.blockBits);
+    cache.classify = &classify;
+  }
+  dram_t dram;
+  if (opt_dram) {
+    if (!dram_configure(&dram, opt_dram_spec)) {
+      fprintf(stderr, "Option -D expects [open|closed][:<channels>:<ranks>:<banks>]\n");
+      return -1;
+    }
+    cache.dram = &dram;
+    cache.clock = &total_cycle_counter;
+    if (icache_p != NULL) {
+      icache.dram = &dram;
+      icache.clock = &total_cycle_counter;
+    }
+  }
+  if (opt_fu && !fu_configure(&fu_pool, opt_fu_spec)) {
+    fprintf(stderr, "Option -U expects <alu|mul|div|agu>=<latency>:<interval>[,...]\n");
+    return -1;
+  }
+  if (opt_fetch_queue && !fq_init(&fetch_queue, opt_fetch_queue_depth)) {
+    fprintf(stderr, "Option -B expects a queue depth from 1 to %d\n", FETCH_QUEUE_MAX);
+    return -1;
+  }
+  if (opt_store_buffer && !sb_init(&store_buffer, opt_store_buffer_entries)) {
+    fprintf(stderr, "Option -O expects a store buffer size from 1 to %d\n", STORE_BUFFER_MAX);
+    return -1;
+  }
+  smp_t smp;
+  if (opt_harts && !smp_configure(&smp, opt_harts)) {
+    fprintf(stderr, "Option -N expects <harts>[:<threads>[:<quantum>]] with 1 to %d harts\n", SMP_MAX_HARTS);
+    return -1;
+  }
+  if (opt_harts && !opt_mulator) {
+    fprintf(stderr, "Option -N runs the harts on the emulator, use it with -m\n");
+    return -1;
+  }
+  if (opt_smt && !smt_configure(&smt, opt_smt)) {
+    fprintf(stderr, "Option -X expects <threads>[:rr|icount] with 2 to %d threads\n", SMT_MAX_THREADS);
+    return -1;
+  }
+  if (opt_smt && (!opt_sim || opt_fetch_queue)) {
+    fprintf(stderr, "Option -X runs threads in the pipeline, use it with -s and without -B\n");
+    return -1;
+  }
+  if (opt_gdb && (opt_mulator == opt_sim || opt_harts || opt_smt)) {
+    fprintf(stderr, "Option -G debugs a single hart, use it with either -m or -s and without -N or -X\n");
+    return -1;
+  }
+  if (opt_timetravel && (!opt_gdb || opt_pipeview || opt_addr_trace)) {
+    fprintf(stderr, "Option -J travels back in a -G session, use it with -G and without -K or -W\n");
+    return -1;
+  }
+  if (opt_timetravel && !tt_configure(&timetravel, opt_timetravel)) {
+    fprintf(stderr, "Option -J expects <interval>[:<snapshots>] with 1 to %d snapshots\n", TT_MAX_SNAPSHOTS);
+    return -1;
+  }
+  if (opt_watch_count > 0 && opt_harts) {
+    fprintf(stderr, "Option -w watches a single hart, use it without -N\n");
+    return -1;
+  }
+  if (opt_addr_trace) {
+    cache.addr_trace = sd_trace_open(opt_addr_trace);
+    if (cache.addr_trace == NULL) {
+      fprintf(stderr, "Cannot create address trace %s\n", opt_addr_trace);
+      return -1;
+    }
+  }
   /* load the executable into memory */
   assert(memory == NULL);
-  memory = calloc(MEMORY_SPACE, sizeof(uint8_t)); // allocate zeroed memory
-  assert(memory != NULL);
+  // zeroed and page aligned, so watchpoints can protect the pages behind it
+  memory = mmap(NULL, MEMORY_SPACE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(memory != MAP_FAILED);
   int prog_numins = 0;
   /* set the PC to 0x1000 */
   regfile.PC = 0x1000;
+  uint32_t code_bytes = 0;
   prog_numins = load_program(memory, MEMORY_SPACE, regfile.PC, argv[optind],
-                             opt_disasm);
+                             opt_disasm, &code_bytes);
+  if (opt_profile) {
+    prof_init(regfile.PC);
+    if (opt_symbols && prof_load_symbols(opt_symbols) != 0) {
+      return -1;
+    }
+  }
+  if (opt_issue) {
+    issue_init(opt_issue_top);
+  }
+  if (opt_pipeview && pv_open(opt_pipeview, total_cycle_counter) != 0) {
+    return -1;
+  }
   /* if we're just disassembling, exit here */
   if (opt_disasm) {
     return 0;
@@ -187,10 +492,55 @@ int main(int argc, char **argv) {
   mem_access_counter = 0;
 
   bootstrap(&pipeline_wires, &pipeline_regs, &regfile);
+  if (smt.enabled) {
+    smt_boot(&smt, &regfile);
+  }
+
+  if (opt_watch_count > 0 || opt_gdb) {
+    if (!watch_init(&watch, memory)) {
+      return -1;
+    }
+    watch.regfile = opt_mulator ? &regfile : NULL;
+    for (int w = 0; w < opt_watch_count; w++) {
+      if (!watch_add(&watch, opt_watch[w])) {
+        fprintf(stderr, "Option -w expects <hex addr>[:<len>[:w|r|a|c]] inside the %d byte memory, at most %d\n",
+                MEMORY_SPACE, WATCH_MAX);
+        return -1;
+      }
+    }
+  }
+  if (opt_gdb && !gdb_open(&gdb, opt_gdb, memory, opt_sim,
+                             opt_sim ? &total_cycle_counter : &emu_instret)) {
+    return -1;
+  }
+
+  watch_arm(&watch);
+
+  if (opt_host) {
+    hostperf_open(&host_perf, true);
+    atexit(print_host_stats);
+    hostperf_start(&host_perf);
+  }
+
+  // HARTS ON THE EMULATOR
+  if (opt_harts) {
+    smp_run(&smp, &regfile, memory);
+    emu_instret = smp_instret(&smp);
+    for (int h = 0; opt_regdump && h < smp.harts; h++) {
+      printf("hart %d:\n", h);
+      print_registers(&smp.hart[h].regs);
+    }
+    smp_print_stats(&smp);
+    smp_free(&smp);
+  }
 
   // EMULATOR
-  if(opt_mulator)
+  if(opt_mulator && !opt_harts)
   {
+    // the emulator takes one cycle per instruction
+    csr_bind(CSR_COUNTER_CYCLE, &emu_instret);
+    csr_bind(CSR_COUNTER_TIME, &emu_instret);
+    csr_bind(CSR_COUNTER_INSTRET, &emu_instret);
     if (opt_exit) {
       /* simulate forever! */
       while (1) {
@@ -203,6 +553,10 @@ int main(int argc, char **argv) {
         simins++;
       }
     }
+    watch_disarm(&watch);
+    if (opt_watch_count > 0) {
+      watch_print_stats(&watch);
+    }
   }
 
   // CYCLE ACCURATE SIMULATOR
@@ -210,26 +564,37 @@ int main(int argc, char **argv) {
   {
     if(opt_cache) sim_config.cache_en = true;
     if(opt_forwarding) sim_config.fwd_en = true;
+    if(opt_fetch_buffer) sim_config.fetch_buffer = true;
     bool ecall_exit = false;
-    if (opt_exit) {
-      /* simulate forever! */
+    if (opt_exit || smt.enabled) {
+      /* simulate forever! (threads run until each one exits) */
       while (1) {
-        cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
+        if (gdb.enabled) {
+          gdb_retire(&gdb, &regfile, &pipeline_regs.memwb_preg.out);
+        }
+        cycle_pipeline(&regfile, memory, &cache, icache_p, &pipeline_regs, &pipeline_wires, &ecall_exit);
+        check_watch_cycle(&regfile);
         if(ecall_exit) break;
       }
     } else {
       /* Either simulate for program instructions */
       while (simins < prog_numins) {
-        cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
+        if (gdb.enabled) {
+          gdb_retire(&gdb, &regfile, &pipeline_regs.memwb_preg.out);
+        }
+        cycle_pipeline(&regfile, memory, &cache, icache_p, &pipeline_regs, &pipeline_wires, &ecall_exit);
+        check_watch_cycle(&regfile);
         simins++;
       }
     }
     printf("\n========\n[MAIN]: Flushing pipeline\n========\n");
     simins = 0;
-    prog_numins = load_program(memory, MEMORY_SPACE, pipeline_wires.pc_src0, "./code/input/FLUSH.input",
-                            opt_disasm);
-    while (simins < prog_numins) {
-      cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
+    // exited threads leave nothing in flight (-X)
+    int flush_numins = smt.enabled ? 0 : load_program(memory, MEMORY_SPACE, pipeline_wires.pc_src0,
+                            "./code/input/FLUSH.input", opt_disasm, NULL);
+    while (simins < flush_numins) {
+      cycle_pipeline(&regfile, memory, &cache, icache_p, &pipeline_regs, &pipeline_wires, &ecall_exit);
+      check_watch_cycle(&regfile);
       simins++;
     }
 
@@ -239,18 +604,85 @@ int main(int argc, char **argv) {
     printf("#Forwards (EX-MEM) = %5ld\n", fwd_exmem_counter);
     printf("#Branches taken    = %5ld\n", branch_counter);
     printf("#Stalls            = %5ld\n", stall_counter);
+    if (fu_pool.enabled) {
+      fu_print_stats(&fu_pool);
+    }
+    if (issue_stats.enabled) {
+      issue_print_stats(total_cycle_counter);
+    }
+    if (fetch_queue.enabled) {
+      fq_print_stats(&fetch_queue, total_cycle_counter);
+    }
+    if (store_buffer.enabled) {
+      sb_print_stats(&store_buffer);
+    }
+    if (smt.enabled) {
+      smt_print_stats(&smt, total_cycle_counter);
+    }
     #endif
+    if (opt_cpi_stack) {
+      cpi_print_stats(total_cycle_counter, instret_counter);
+    }
     #ifdef PRINT_CACHE_STATS
       #if defined(CACHE_ENABLE)
-      printf("#MEM   stalls      = %5ld\n", ((miss_count*MEM_LATENCY) + ((hit_count+miss_count) * (CACHE_HIT_LATENCY-1))));
+      printf("#MEM   stalls      = %5ld\n", mem_stall_counter + pending_load_stall_counter);
       #else
       printf("#MEM   stalls      = %5ld\n", (mem_access_counter*(MEM_LATENCY-1)));
       #endif
       printf("#Cache accesses    = %5ld\n", hit_count+miss_count);
       printf("#Cache hits        = %5ld\n", hit_count);
       printf("#Cache misses      = %5ld\n", miss_count);
+      if (icache_p != NULL) {
+        printf("#ICache accesses   = %5d\n", icache.hit_count+icache.miss_count);
+        printf("#ICache hits       = %5d\n", icache.hit_count);
+        printf("#ICache misses     = %5d\n", icache.miss_count);
+        printf("#Fetch stalls      = %5ld\n", fetch_stall_counter);
+        if (sim_config.fetch_buffer) {
+          printf("#Fetch buffer hits = %5ld\n", fetch_buffer_hits);
+        }
+        // code size and fetch bandwidth, compressed instructions take two bytes
+        printf("#Code bytes        = %5u (%d instructions, %d compressed)\n", code_bytes,
+               prog_numins, (4 * prog_numins - (int)code_bytes) / 2);
+        printf("#Fetch blocks      = %5ld\n", fetch_block_counter);
+        printf("#Fetch bytes       = %5ld (%.2f per block)\n", fetch_byte_counter,
+               fetch_block_counter ? (double)fetch_byte_counter / fetch_block_counter : 0.0);
+        printf("#Fetch compressed  = %5ld\n", fetch_compressed_counter);
+      }
+      if (cache.mshrs.count > 0) {
+        printf("#MSHR primary      = %5ld\n", cache.mshrs.primary_misses);
+        printf("#MSHR secondary    = %5ld\n", cache.mshrs.secondary_misses);
+        printf("#MSHR full stalls  = %5ld\n", cache.mshrs.full_stall_cycles);
+        printf("#Load wait stalls  = %5ld\n", pending_load_stall_counter);
+      }
+      if (opt_classify) {
+        mc_print_stats(&classify);
+      }
+      if (opt_dram) {
+        dram_print_stats(&dram);
+      }
     #endif
 
+    // stores still in the buffer reach memory before it is dumped
+    if (store_buffer.enabled) {
+      sb_drain(&store_buffer, memory);
+    }
+    if (watch.enabled) {
+      check_watch_cycle(&regfile);
+      watch_disarm(&watch);
+    }
+    if (opt_watch_count > 0) {
+      watch_print_stats(&watch);
+    }
+
+    // -r: final register state, the pipeline has no per-instruction trace
+    if (opt_regdump && smt.enabled) {
+      for (int t = 0; t < smt.threads; t++) {
+        printf("thread %d:\n", t);
+        print_registers(&smt.thread[t].regs);
+      }
+    } else if (opt_regdump) {
+      print_registers(&regfile);
+    }
   }
 
   // print mem
@@ -274,6 +706,31 @@ int main(int argc, char **argv) {
   }
 
   // Deallocate the cache after all operations
+  sd_trace_close(cache.addr_trace);
   deallocate(&cache);
+  if (icache_p != NULL) {
+    deallocate(&icache);
+  }
+  if (opt_dram) {
+    dram_free(&dram);
+  }
+  if (opt_classify) {
+    int status = mc_write_csv(&classify, opt_classify);
+    mc_free(&classify);
+    if (status != 0) {
+      return -1;
+    }
+  }
+  pv_close();
+  if (opt_profile) {
+    int status = prof_write(opt_profile);
+    prof_free();
+    if (status != 0) {
+      return -1;
+    }
+  }
+  if (opt_issue) {
+    issue_free();
+  }
   return 0;
 }
@@ -2,10 +2,12 @@
 #define MIPS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "types.h"
 
 /* see disasm.c */
 void decode_instruction(uint32_t instruction_bits);
+void disassemble(uint32_t instruction_bits, char *buf, size_t size);
 
 /* see emulator.c */
 void execute_instruction(uint32_t instruction_bits, regfile_t* regfile, Byte *memory);
@@ -17,6 +19,7 @@ typedef struct
 {
     bool cache_en;
     bool fwd_en;
+    bool fetch_buffer;  // fetch a whole I-cache line into a buffer shared by both issue slots
 }simulator_config_t;
 
 #endif
@@ -0,0 +1,225 @@
+#include "config.h"
+#include "riscv.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "hostperf.h"
+
+// Microbenchmarks of the simulator's hot paths (make simbench). Each one
+// repeats a single function over a fixed input, reports host time per call
+// and, where perf_event_open is allowed, host IPC and cache and branch
+// misses per call. Whole-program throughput (-H) is measured by
+// bench_host.py instead.
+//
+// usage: ./simbench [-n scale] [-p program] [benchmark ...]
+
+#define SIMBENCH_PROGRAM "code/bench/input/matmul_ijk_16.input"
+#define SIMBENCH_BASE_PC 0x1000
+#define SIMBENCH_MAX_WORDS 4096
+#define ECALL 0x00000073
+
+typedef struct {
+    const char *name;
+    uint64_t (*run)(uint64_t scale, uint64_t *sink);  // returns the call count
+} simbench_t;
+
+static uint32_t program[SIMBENCH_MAX_WORDS];
+static int program_words = 0;
+
+static int load_words(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot open program %s (run bench_gen.py first)\n", filename);
+    return -1;
+  }
+  char line[64];
+  while (program_words < SIMBENCH_MAX_WORDS && fgets(line, sizeof(line), file) != NULL) {
+    program[program_words++] = (uint32_t)strtoul(line, NULL, 16);
+  }
+  fclose(file);
+  return 0;
+}
+
+static Byte *fresh_memory(regfile_t *regfile) {
+  Byte *memory = calloc(MEMORY_SPACE, sizeof(Byte));
+  for (int i = 0; i < program_words; i++) {
+    store(memory, SIMBENCH_BASE_PC + 4 * i, LENGTH_WORD, program[i]);
+  }
+  memset(regfile, 0, sizeof(*regfile));
+  regfile->PC = SIMBENCH_BASE_PC;
+  regfile->R[2] = 0xEFFFF;
+  regfile->R[3] = 0x3000;
+  return memory;
+}
+
+/// BENCHMARKS ///
+
+static uint64_t bench_parse_instruction(uint64_t scale, uint64_t *sink) {
+  uint64_t calls = 0;
+  for (uint64_t r = 0; r < scale * 200000; r++) {
+    for (int i = 0; i < program_words; i++) {
+      Instruction instruction = parse_instruction(program[i]);
+      *sink += instruction.opcode + instruction.rtype.rd;
+    }
+    calls += program_words;
+  }
+  return calls;
+}
+
+static uint64_t bench_execute_alu(uint64_t scale, uint64_t *sink) {
+  uint32_t a = 0x12345678, b = 0x9abcdef;
+  uint64_t calls = scale * 20000000;
+  for (uint64_t i = 0; i < calls; i++) {
+    a = a * 1103515245 + 12345;
+    *sink += execute_alu(a, b & 31, i & 0xF);
+    b += a >> 7;
+  }
+  return calls;
+}
+
+// address stream within `span` bytes, `stride` 0 for random
+static uint64_t cache_stream(uint64_t scale, uint64_t *sink, uint32_t span, uint32_t stride) {
+  Cache cache;
+  cacheSetUp(&cache, "L1");
+  uint32_t address = 0, lcg = 1;
+  uint64_t calls = scale * 2000000;
+  for (uint64_t i = 0; i < calls; i++) {
+    if (stride) {
+      address = (address + stride) % span;
+    } else {
+      lcg = lcg * 1103515245 + 12345;
+      address = (lcg >> 4) % span & ~3U;
+    }
+    *sink += operateCache(address, &cache).status;
+  }
+  deallocate(&cache);
+  return calls;
+}
+
+static uint64_t bench_cache_sequential(uint64_t scale, uint64_t *sink) {
+  return cache_stream(scale, sink, 1 << 16, 4);
+}
+
+static uint64_t bench_cache_random(uint64_t scale, uint64_t *sink) {
+  return cache_stream(scale, sink, 1 << 20, 0);
+}
+
+// emulator up to the program's first ecall
+static uint64_t bench_execute_instruction(uint64_t scale, uint64_t *sink) {
+  uint64_t calls = 0;
+  while (calls < scale * 5000000) {
+    regfile_t regfile;
+    Byte *memory = fresh_memory(&regfile);
+    uint32_t bits;
+    while ((bits = load(memory, regfile.PC, LENGTH_WORD)) != ECALL) {
+      execute_instruction(bits, &regfile, memory);
+      regfile.R[0] = 0;
+      calls++;
+    }
+    *sink += regfile.R[11];
+    free(memory);
+  }
+  return calls;
+}
+
+// the pipeline with the D-cache, up to the exit ecall
+static uint64_t bench_cycle_pipeline(uint64_t scale, uint64_t *sink) {
+  uint64_t calls = 0;
+  sim_config.cache_en = true;
+  sim_config.fwd_en = true;
+  while (calls < scale * 1000000) {
+    regfile_t regfile;
+    Byte *memory = fresh_memory(&regfile);
+    Cache cache;
+    cacheSetUp(&cache, "L1");
+    pipeline_regs_t pregs = {0};
+    pipeline_wires_t pwires = {0};
+    bootstrap(&pwires, &pregs, &regfile);
+    bool ecall_exit = false;
+    while (!ecall_exit) {
+      cycle_pipeline(&regfile, memory, &cache, NULL, &pregs, &pwires, &ecall_exit);
+      calls++;
+    }
+    *sink += regfile.R[11];
+    deallocate(&cache);
+    free(memory);
+  }
+  return calls;
+}
+
+static const simbench_t benchmarks[] = {
+  {"parse_instruction", bench_parse_instruction},
+  {"execute_alu", bench_execute_alu},
+  {"operateCache_seq", bench_cache_sequential},
+  {"operateCache_rand", bench_cache_random},
+  {"execute_instruction", bench_execute_instruction},
+  {"cycle_pipeline", bench_cycle_pipeline},
+};
+#define SIMBENCH_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static void print_result(const char *name, uint64_t calls, const hostperf_t *hp) {
+  printf("%-20s %10lu %9.3f %9.2f %9.2f", name, (unsigned long)calls, hp->seconds,
+         hp->seconds * 1e9 / calls, calls / hp->seconds / 1e6);
+  if (hp->valid[HOST_CYCLES] && hp->valid[HOST_INSTRUCTIONS] && hp->counts[HOST_CYCLES] > 0) {
+    printf(" %7.2f", (double)hp->counts[HOST_INSTRUCTIONS] / hp->counts[HOST_CYCLES]);
+  } else {
+    printf(" %7s", "n/a");
+  }
+  for (int e = HOST_CACHE_MISSES; e <= HOST_BRANCH_MISSES; e++) {
+    if (hp->valid[e]) {
+      printf(" %9.4f", (double)hp->counts[e] / calls);
+    } else {
+      printf(" %9s", "n/a");
+    }
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  uint64_t scale = 1;
+  const char *program_file = SIMBENCH_PROGRAM;
+  int c;
+  while ((c = getopt(argc, argv, "n:p:")) != -1) {
+    switch (c) {
+    case 'n':
+      scale = strtoull(optarg, NULL, 0);
+      break;
+    case 'p':
+      program_file = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n scale] [-p program] [benchmark ...]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (scale == 0 || load_words(program_file) != 0) {
+    return -1;
+  }
+
+  printf("%-20s %10s %9s %9s %9s %7s %9s %9s\n", "# benchmark", "calls", "seconds",
+         "ns/call", "Mcalls/s", "IPC", "LLC/call", "misp/call");
+  uint64_t sink = 0;
+  hostperf_t hp;
+  hostperf_open(&hp, true);
+  for (size_t b = 0; b < SIMBENCH_COUNT; b++) {
+    bool selected = optind == argc;
+    for (int a = optind; a < argc; a++) {
+      selected |= strcmp(argv[a], benchmarks[b].name) == 0;
+    }
+    if (!selected) {
+      continue;
+    }
+    hostperf_start(&hp);
+    uint64_t calls = benchmarks[b].run(scale, &sink);
+    hostperf_stop(&hp);
+    print_result(benchmarks[b].name, calls, &hp);
+  }
+  hostperf_close(&hp);
+  // keeps the results live so the loops are not optimized away
+  fprintf(stderr, "checksum %lx\n", (unsigned long)sink);
+  return 0;
+}
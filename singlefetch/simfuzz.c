@@ -0,0 +1,1033 @@
+#include "config.h"
+#include "riscv.h"
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "utils.h"
+#include "pipeline.h"
+
+// Differential fuzzer of the pipeline against the emulator (make simfuzz).
+// Random RV32IM programs run through execute_instruction and cycle_pipeline
+// in this process, from the same state, and the final registers and data
+// must match. Memory and latches are reset in place between programs, so a
+// program costs its simulation and nothing else.
+//
+// A program is a list of ops (an ALU operation, a load, a taken branch, a
+// loop...) packed densely into issue pairs, as bench_gen.py lays out code.
+// Generation leans towards hazards: a load and its consumer in one pair,
+// chains of dependent operations, a store or an access paired with the
+// instruction that produces its data or address, and branches that are
+// taken. Every cycle of the pipeline is turned into an event (the
+// forwarding paths gen_forward and gen_forwardDUAL selected, a load-use
+// stall and whether a second slot caused or suffered it, a flush and the
+// slot it came from, the dual issue outcome and what was in execute). A
+// program whose event pairs hit a new bucket of the coverage map joins the
+// corpus, which mutation draws from.
+//
+// A divergence is reduced to the ops that still diverge and saved as a
+// program in code/fuzz/out, runnable with ./riscv -s -e and -m -e. Each
+// report carries the signature of its reduced shape: later divergences of
+// the same shape only count as duplicates, and the signatures listed in
+// the file of -x (one hex number per line, # comments) count as known bugs
+// and are not reported at all.
+//
+// usage: ./simfuzz [-n programs] [-s seed] [-l ops] [-k divergences] [-x known] [-p program]
+
+#define FUZZ_BASE_PC 0x1000
+#define FUZZ_DATA 0x10000          // data window, FUZZ_DATA_SIZE bytes
+#define FUZZ_DATA_SIZE 4096
+#define FUZZ_PROGRAMS 10000
+#define FUZZ_OPS 48                // longest generated program
+#define FUZZ_MAX_OPS 256
+#define FUZZ_MAX_INSNS (2 * FUZZ_MAX_OPS + 16)
+#define FUZZ_PAD 8                 // nops after the exit, fetched while it drains
+#define FUZZ_MAX_WORDS (2 * FUZZ_MAX_INSNS + FUZZ_PAD)
+#define FUZZ_CORPUS 1024
+#define FUZZ_MAP_SIZE (1 << 16)
+#define FUZZ_SIGNATURES 256
+#define FUZZ_KNOWN 64              // signatures -x suppresses
+#define FUZZ_MAX_INSTRET 100000    // emulator instructions before a program is dropped
+#define FUZZ_MEMORY_SIZE ((1ULL << 32) + 4096)  // a word access at the top stays inside
+#define FUZZ_OUT_DIR "code/fuzz/out"
+#define ECALL 0x00000073
+#define NOP 0x00000013
+
+// registers the ops do not choose freely
+#define REG_BASE 8                 // s0: middle of the data window
+#define REG_PTR 9                  // s1: inside the window, only written by OP_PTR
+#define REG_EXIT 10                // a0: 10 for the exit ecall
+#define REG_LOOP 27                // s11: counter of OP_LOOP and OP_END
+
+enum fuzz_kind_enum {
+  OP_ALU = 0,    // R-type, RV32IM
+  OP_ALUI,
+  OP_LUI,
+  OP_AUIPC,
+  OP_LOAD,       // off s0 or s1
+  OP_STORE,
+  OP_PTR,        // s1 = s0 + imm
+  OP_BRANCH,     // forward over imm ops
+  OP_JAL,
+  OP_LOOP,       // s11 = imm, the loop starts after it
+  OP_END,        // back to the last OP_LOOP while --s11 > 0
+  OP_KINDS
+};
+
+typedef struct {
+    uint8_t kind;
+    uint8_t funct;             // index into the kind's table
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    int32_t imm;
+    bool lead;                 // starts an issue pair, the op after it goes in the second slot
+} fuzz_op_t;
+
+typedef struct {
+    fuzz_op_t ops[FUZZ_MAX_OPS];
+    int count;
+} fuzz_prog_t;
+
+// An instruction before scheduling
+typedef struct {
+    uint32_t bits;
+    uint8_t rd;                // 0 if none
+    bool label;                // branch target or a lead op, starts a pair
+    bool alone;                // the prologue and the exit, in a pair of their own
+    int target;                // instruction a branch goes to, -1 if none
+} fuzz_insn_t;
+
+typedef struct {
+    uint32_t words[FUZZ_MAX_WORDS];
+    int count;
+} fuzz_code_t;
+
+typedef struct {
+    uint64_t programs;
+    uint64_t dropped;          // ran past FUZZ_MAX_INSTRET on the emulator
+    uint64_t divergences;
+    uint64_t duplicates;       // divergences that reduce to a reported shape
+    uint64_t known;            // divergences with a signature -x lists
+    uint64_t corpus_adds;
+    uint64_t edges;
+    uint64_t pipeline_cycles;
+    uint64_t emulator_instructions;
+    uint64_t dual[DUAL_CONTROL + 1];
+    uint64_t forwards_exex;    // the pipeline's own counters, programs as generated
+    uint64_t forwards_exmem;
+    uint64_t stalls;
+    uint64_t stalls_dual;      // load-use stalls a second slot caused or suffered
+    uint64_t flushes;
+    uint64_t flushes_dual;     // taken branches in the second slot
+} fuzz_stats_t;
+
+static const struct { uint8_t funct7, funct3; } alu_table[] = {
+  {0x00, 0x0}, {0x20, 0x0}, {0x00, 0x1}, {0x00, 0x2}, {0x00, 0x3}, {0x00, 0x4},
+  {0x00, 0x5}, {0x20, 0x5}, {0x00, 0x6}, {0x00, 0x7},
+  {0x01, 0x0}, {0x01, 0x1}, {0x01, 0x2}, {0x01, 0x3}, {0x01, 0x4}, {0x01, 0x5},
+  {0x01, 0x6}, {0x01, 0x7},
+};
+static const uint8_t alui_table[] = {0x0, 0x2, 0x3, 0x4, 0x6, 0x7, 0x1, 0x5, 0x5}; // the last srai
+static const uint8_t load_table[] = {0x0, 0x1, 0x2, 0x4, 0x5};
+static const uint8_t load_size[] = {1, 2, 4, 1, 2};
+static const uint8_t store_size[] = {1, 2, 4};
+static const uint8_t branch_table[] = {0x0, 0x1, 0x4, 0x5, 0x6, 0x7};
+#define TABLE_SIZE(t) ((int)(sizeof(t) / sizeof(t[0])))
+
+// registers the ops write, the first six most of the time
+static const uint8_t pool[] = {5, 6, 7, 11, 12, 13, 1, 2, 3, 4, 14, 15, 16, 17, 18, 19, 20, 21,
+                               22, 23, 24, 25, 26, 28, 29, 30, 31};
+#define POOL_HOT 6
+
+static uint64_t rng_state = 1;
+static Byte *emu_memory, *sim_memory;
+static uint8_t coverage[FUZZ_MAP_SIZE];   // highest bucket seen per edge
+static uint8_t trace[FUZZ_MAP_SIZE];      // hits per edge in this program
+static uint32_t touched[FUZZ_MAP_SIZE];
+static int touched_count;
+static fuzz_stats_t stats;
+static fuzz_prog_t corpus[FUZZ_CORPUS];
+static int corpus_count;
+static uint64_t signatures[FUZZ_SIGNATURES];  // divergences reported
+static int signature_count;
+static uint64_t known[FUZZ_KNOWN];            // divergences not to report (-x)
+static int known_count;
+
+static uint64_t rng(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int rnd(int n) {
+  return (int)(rng() % (uint64_t)n);
+}
+
+/// ENCODING ///
+
+static uint32_t enc_r(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+  return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t enc_i(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+  return ((uint32_t)(imm & 0xFFF) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t enc_s(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+  return ((uint32_t)(imm >> 5 & 0x7F) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+         ((uint32_t)(imm & 0x1F) << 7) | 0x23;
+}
+
+static uint32_t enc_b(int32_t offset, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+  return ((uint32_t)(offset >> 12 & 1) << 31) | ((uint32_t)(offset >> 5 & 0x3F) << 25) | (rs2 << 20) |
+         (rs1 << 15) | (funct3 << 12) | ((uint32_t)(offset >> 1 & 0xF) << 8) |
+         ((uint32_t)(offset >> 11 & 1) << 7) | 0x63;
+}
+
+static uint32_t enc_j(int32_t offset, uint32_t rd) {
+  return ((uint32_t)(offset >> 20 & 1) << 31) | ((uint32_t)(offset >> 1 & 0x3FF) << 21) |
+         ((uint32_t)(offset >> 11 & 1) << 20) | ((uint32_t)(offset >> 12 & 0xFF) << 12) | (rd << 7) | 0x6F;
+}
+
+static uint32_t enc_u(uint32_t imm20, uint32_t rd, uint32_t opcode) {
+  return (imm20 << 12) | (rd << 7) | opcode;
+}
+
+/// GENERATION ///
+
+static uint8_t random_rd(void) {
+  return rnd(4) ? pool[rnd(POOL_HOT)] : pool[rnd(TABLE_SIZE(pool))];
+}
+
+// A source register, most of the time one of the last ops wrote
+static uint8_t random_rs(const fuzz_prog_t *prog, int at) {
+  if (rnd(4) != 0) {
+    for (int back = 1 + rnd(3); at - back >= 0; back++) {
+      const fuzz_op_t *op = &prog->ops[at - back];
+      if (op->kind <= OP_LOAD && op->rd != 0) {
+        return op->rd;
+      }
+    }
+  }
+  return rnd(8) ? random_rd() : (uint8_t)rnd(32);
+}
+
+static fuzz_op_t random_op(const fuzz_prog_t *prog, int at, int kind) {
+  fuzz_op_t op = {0};
+  op.kind = kind;
+  op.rd = random_rd();
+  op.rs1 = random_rs(prog, at);
+  op.rs2 = random_rs(prog, at);
+  switch (kind) {
+    case OP_ALU:
+      op.funct = rnd(TABLE_SIZE(alu_table));
+      break;
+    case OP_ALUI:
+      op.funct = rnd(TABLE_SIZE(alui_table));
+      op.imm = op.funct >= 6 ? rnd(32) : rnd(4096) - 2048;
+      break;
+    case OP_LUI:
+    case OP_AUIPC:
+      op.imm = rnd(1 << 20);
+      break;
+    case OP_LOAD:
+      op.funct = rnd(TABLE_SIZE(load_table));
+      op.rs1 = rnd(2) ? REG_BASE : REG_PTR;
+      op.imm = (rnd(2041) - 1020) & -(int32_t)load_size[op.funct];
+      break;
+    case OP_STORE:
+      op.funct = rnd(TABLE_SIZE(store_size));
+      op.rs1 = rnd(2) ? REG_BASE : REG_PTR;
+      op.imm = (rnd(2041) - 1020) & -(int32_t)store_size[op.funct];
+      break;
+    case OP_PTR:
+      op.imm = (rnd(2049) - 1024) & ~3;
+      break;
+    case OP_BRANCH:
+      op.funct = rnd(TABLE_SIZE(branch_table));
+      if (rnd(2)) {
+        op.rs2 = op.rs1; // beq, bge, bgeu are taken, the others fall through
+      }
+      op.imm = rnd(6);
+      break;
+    case OP_JAL:
+      op.rd = rnd(2) ? 0 : random_rd();
+      op.imm = rnd(4);
+      break;
+    case OP_LOOP:
+      op.imm = 1 + rnd(6);
+      break;
+    default:
+      break;
+  }
+  return op;
+}
+
+static int random_kind(void) {
+  static const uint8_t weights[OP_KINDS] = {10, 8, 1, 1, 6, 5, 2, 4, 1, 1, 1};
+  int r = rnd(40);
+  for (int k = 0; k < OP_KINDS; k++) {
+    if (r < weights[k]) {
+      return k;
+    }
+    r -= weights[k];
+  }
+  return OP_ALU;
+}
+
+static bool insert_op(fuzz_prog_t *prog, int at, fuzz_op_t op) {
+  if (prog->count >= FUZZ_MAX_OPS) {
+    return false;
+  }
+  memmove(&prog->ops[at + 1], &prog->ops[at], (prog->count - at) * sizeof(fuzz_op_t));
+  prog->ops[at] = op;
+  prog->count++;
+  return true;
+}
+
+// A short hazard-prone sequence at `at` that starts an issue pair, so its
+// first two ops go through decode together. Returns the ops inserted.
+static int insert_template(fuzz_prog_t *prog, int at) {
+  fuzz_op_t seq[8];
+  int n = 0;
+  int kind = rnd(7);
+  fuzz_op_t first = random_op(prog, at, kind == 0 ? OP_LOAD : kind == 4 ? OP_PTR : OP_ALU);
+  seq[n++] = first;
+  uint8_t r = kind == 4 ? REG_PTR : first.rd;
+  switch (kind) {
+    case 0: // load-use
+    case 1: // back-to-back dependent operations
+      for (int i = 0; i < 1 + rnd(3); i++) {
+        fuzz_op_t use = random_op(prog, at, rnd(2) ? OP_ALU : OP_ALUI);
+        use.rs1 = r;
+        if (rnd(2)) {
+          use.rs2 = r;
+        }
+        seq[n++] = use;
+        r = use.rd;
+      }
+      break;
+    case 2: // a store that pairs with its data's producer
+      seq[n] = random_op(prog, at, OP_STORE);
+      seq[n++].rs2 = rnd(2) ? r : random_rd();
+      break;
+    case 3: // a taken branch on a fresh value
+      seq[n] = random_op(prog, at, OP_BRANCH);
+      seq[n].rs1 = r;
+      seq[n++].rs2 = rnd(2) ? r : 0;
+      break;
+    case 4: // an address computed right before its access
+      seq[n] = random_op(prog, at, rnd(2) ? OP_LOAD : OP_STORE);
+      seq[n++].rs1 = REG_PTR;
+      break;
+    case 5: // a memory access paired with a branch
+      seq[0] = random_op(prog, at, rnd(2) ? OP_LOAD : OP_STORE);
+      seq[n++] = random_op(prog, at, OP_BRANCH);
+      break;
+    default: // a loop
+      seq[0] = random_op(prog, at, OP_LOOP);
+      for (int i = 0; i < 1 + rnd(4); i++) {
+        seq[n++] = random_op(prog, at, random_kind() % OP_LOOP);
+      }
+      seq[n++] = random_op(prog, at, OP_END);
+      break;
+  }
+  seq[0].lead = true;
+  int inserted = 0;
+  for (int i = 0; i < n && insert_op(prog, at + i, seq[i]); i++) {
+    inserted++;
+  }
+  return inserted;
+}
+
+static void generate(fuzz_prog_t *prog, int max_ops) {
+  prog->count = 0;
+  // values to work with, the registers start at zero
+  for (int i = 0; i < POOL_HOT; i++) {
+    fuzz_op_t op = random_op(prog, prog->count, rnd(2) ? OP_ALUI : OP_LUI);
+    op.rd = pool[i];
+    op.funct = 0;
+    op.rs1 = 0;
+    insert_op(prog, prog->count, op);
+  }
+  int length = POOL_HOT + 1 + rnd(max_ops - POOL_HOT);
+  while (prog->count < length) {
+    if (rnd(3) == 0) {
+      insert_template(prog, prog->count);
+    } else {
+      insert_op(prog, prog->count, random_op(prog, prog->count, random_kind()));
+    }
+  }
+}
+
+static void mutate(fuzz_prog_t *prog, const fuzz_prog_t *other, int max_ops) {
+  int rounds = 1 + rnd(4);
+  for (int i = 0; i < rounds; i++) {
+    int at = rnd(prog->count + 1);
+    fuzz_op_t *op = at < prog->count ? &prog->ops[at] : NULL;
+    switch (rnd(8)) {
+      case 0:
+        insert_op(prog, at, random_op(prog, at, random_kind()));
+        break;
+      case 1:
+        insert_template(prog, at);
+        break;
+      case 2:
+        if (op != NULL) {
+          int n = 1 + rnd(3);
+          n = at + n > prog->count ? prog->count - at : n;
+          memmove(op, op + n, (prog->count - at - n) * sizeof(fuzz_op_t));
+          prog->count -= n;
+        }
+        break;
+      case 3:
+        if (op != NULL) {
+          fuzz_op_t fresh = random_op(prog, at, op->kind);
+          switch (rnd(4)) {
+            case 0: op->rd = fresh.rd; break;
+            case 1: op->rs1 = fresh.rs1; break;
+            case 2: op->rs2 = fresh.rs2; break;
+            default: op->funct = fresh.funct; op->imm = fresh.imm; break;
+          }
+        }
+        break;
+      case 4:
+        if (op != NULL && at + 1 < prog->count) {
+          fuzz_op_t swap = op[0];
+          op[0] = op[1];
+          op[1] = swap;
+        }
+        break;
+      case 5:
+        if (op != NULL) {
+          *op = random_op(prog, at, random_kind());
+        }
+        break;
+      case 6: // splice in a piece of another program
+        if (other != NULL && other->count > 0) {
+          int from = rnd(other->count);
+          int n = 1 + rnd(8);
+          for (int j = 0; j < n && from + j < other->count && insert_op(prog, at + j, other->ops[from + j]); j++)
+            ;
+        }
+        break;
+      default: // repeat a piece of this one
+        if (op != NULL) {
+          int n = 1 + rnd(6);
+          fuzz_op_t piece[6];
+          n = at + n > prog->count ? prog->count - at : n;
+          memcpy(piece, op, n * sizeof(fuzz_op_t));
+          for (int j = 0; j < n && insert_op(prog, at + n + j, piece[j]); j++)
+            ;
+        }
+        break;
+    }
+  }
+  if (prog->count > max_ops) {
+    prog->count = max_ops;
+  }
+}
+
+/// SCHEDULING ///
+
+static int add_insn(fuzz_insn_t *insns, int n, uint32_t bits, uint8_t rd) {
+  insns[n] = (fuzz_insn_t){bits, rd, false, false, -1};
+  return n + 1;
+}
+
+// Expand the ops to instructions between a prologue that points s0 and s1
+// at the data window and the exit, and resolve the branches to instructions
+static int expand(const fuzz_prog_t *prog, fuzz_insn_t *insns) {
+  int op_insn[FUZZ_MAX_OPS + 1];
+  int n = 0;
+  n = add_insn(insns, n, enc_u((FUZZ_DATA + FUZZ_DATA_SIZE) >> 12, REG_BASE, 0x37), REG_BASE);
+  n = add_insn(insns, n, enc_i(-FUZZ_DATA_SIZE / 2, REG_BASE, 0x0, REG_BASE, 0x13), REG_BASE);
+  n = add_insn(insns, n, enc_i(0, REG_BASE, 0x0, REG_PTR, 0x13), REG_PTR);
+
+  int loop = -1; // first instruction of the innermost loop
+  int loop_target[FUZZ_MAX_OPS];
+  for (int i = 0; i < prog->count; i++) {
+    const fuzz_op_t *op = &prog->ops[i];
+    op_insn[i] = n;
+    loop_target[i] = -1;
+    int first = n;
+    switch (op->kind) {
+      case OP_ALU:
+        n = add_insn(insns, n, enc_r(alu_table[op->funct].funct7, op->rs2, op->rs1, alu_table[op->funct].funct3, op->rd, 0x33), op->rd);
+        break;
+      case OP_ALUI: {
+        int32_t imm = op->funct == 8 ? 0x400 | (op->imm & 31) : op->funct >= 6 ? op->imm & 31 : op->imm;
+        n = add_insn(insns, n, enc_i(imm, op->rs1, alui_table[op->funct], op->rd, 0x13), op->rd);
+        break;
+      }
+      case OP_LUI:
+        n = add_insn(insns, n, enc_u(op->imm, op->rd, 0x37), op->rd);
+        break;
+      case OP_AUIPC:
+        n = add_insn(insns, n, enc_u(op->imm, op->rd, 0x17), op->rd);
+        break;
+      case OP_LOAD:
+        n = add_insn(insns, n, enc_i(op->imm, op->rs1, load_table[op->funct], op->rd, 0x03), op->rd);
+        break;
+      case OP_STORE:
+        n = add_insn(insns, n, enc_s(op->imm, op->rs2, op->rs1, op->funct), 0);
+        break;
+      case OP_PTR:
+        n = add_insn(insns, n, enc_i(op->imm, REG_BASE, 0x0, REG_PTR, 0x13), REG_PTR);
+        break;
+      case OP_BRANCH:
+        n = add_insn(insns, n, enc_b(0, op->rs2, op->rs1, branch_table[op->funct]), 0);
+        break;
+      case OP_JAL:
+        n = add_insn(insns, n, enc_j(0, op->rd), op->rd);
+        break;
+      case OP_LOOP:
+        n = add_insn(insns, n, enc_i(op->imm, 0, 0x0, REG_LOOP, 0x13), REG_LOOP);
+        loop = n;
+        break;
+      case OP_END:
+        if (loop < 0) {
+          break; // no loop to close
+        }
+        n = add_insn(insns, n, enc_i(-1, REG_LOOP, 0x0, REG_LOOP, 0x13), REG_LOOP);
+        n = add_insn(insns, n, enc_b(0, REG_LOOP, 0, 0x4), 0); // blt x0, s11
+        loop_target[i] = loop;
+        break;
+      default:
+        break;
+    }
+    if (op->lead && n > first) {
+      insns[first].label = true;
+    }
+  }
+  op_insn[prog->count] = n;
+  int exit = n;
+  n = add_insn(insns, n, enc_i(10, 0, 0x0, REG_EXIT, 0x13), REG_EXIT);
+  n = add_insn(insns, n, ECALL, 0);
+  for (int i = 0; i < n; i++) {
+    insns[i].alone = i < 3 || i >= exit;
+  }
+  insns[exit].label = true;
+
+  for (int i = 0; i < prog->count; i++) {
+    const fuzz_op_t *op = &prog->ops[i];
+    int from = op_insn[i + 1] - 1;
+    int target = -1;
+    if (op->kind == OP_BRANCH || op->kind == OP_JAL) {
+      int to = i + 1 + op->imm > prog->count ? prog->count : i + 1 + op->imm;
+      target = op_insn[to];
+    } else if (op->kind == OP_END && loop_target[i] >= 0) {
+      target = loop_target[i] < exit ? loop_target[i] : exit;
+    }
+    if (target >= 0) {
+      insns[from].target = target;
+      insns[target].label = true;
+    }
+  }
+  return n;
+}
+
+// Place the instructions in issue pairs, a nop filling the second slot
+// wherever the instruction that follows has to start a pair
+static void schedule(const fuzz_insn_t *insns, int count, fuzz_code_t *code) {
+  int word_of[FUZZ_MAX_INSNS + 1];
+  int n = 0;
+  int first = 0; // the instruction in the first slot of the last pair
+  for (int i = 0; i < count; i++) {
+    const fuzz_insn_t *insn = &insns[i];
+    if (n % 2 != 0 && (insn->label || insn->alone || insns[first].alone)) {
+      code->words[n++] = NOP;
+    }
+    if (n % 2 == 0) {
+      first = i;
+    }
+    word_of[i] = n;
+    code->words[n++] = insn->bits;
+  }
+  if (n % 2 != 0) {
+    code->words[n++] = NOP;
+  }
+  // nothing behind the exit reaches memory before the pipeline stops
+  for (int i = 0; i < FUZZ_PAD; i++) {
+    code->words[n++] = NOP;
+  }
+  code->count = n;
+
+  for (int i = 0; i < count; i++) {
+    if (insns[i].target < 0) {
+      continue;
+    }
+    int32_t offset = (word_of[insns[i].target] - word_of[i]) * 4;
+    uint32_t bits = insns[i].bits;
+    if ((bits & 0x7F) == 0x6F) {
+      code->words[word_of[i]] = enc_j(offset, insns[i].rd);
+    } else {
+      code->words[word_of[i]] = enc_b(offset, bits >> 20 & 0x1F, bits >> 15 & 0x1F, bits >> 12 & 0x7);
+    }
+  }
+}
+
+static void lower(const fuzz_prog_t *prog, fuzz_code_t *code) {
+  fuzz_insn_t insns[FUZZ_MAX_INSNS];
+  int count = expand(prog, insns);
+  schedule(insns, count, code);
+}
+
+/// DIFFERENTIAL RUN ///
+
+// The whole 32-bit space, so a pipeline that went wrong can compute any
+// address without faulting. Pages are only backed once touched.
+static Byte *map_memory(void) {
+  void *memory = mmap(NULL, FUZZ_MEMORY_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return memory == MAP_FAILED ? NULL : memory;
+}
+
+typedef struct {
+    regfile_t emu;
+    regfile_t sim;
+    const char *failure;       // how the pipeline went wrong, NULL if it did not
+    uint64_t cycles;
+    uint64_t instret;
+} fuzz_result_t;
+
+// The same start as ./riscv: zero registers, gp and sp set, and the program
+// at 0x1000 in zeroed memory
+static void reset(Byte *memory, regfile_t *regfile, const fuzz_code_t *code) {
+  memset(memory + FUZZ_BASE_PC, 0, FUZZ_MAX_WORDS * 4 + 64);
+  memset(memory + FUZZ_DATA, 0, FUZZ_DATA_SIZE);
+  for (int i = 0; i < code->count; i++) {
+    store(memory, FUZZ_BASE_PC + 4 * i, LENGTH_WORD, code->words[i]);
+  }
+  memset(regfile, 0, sizeof(*regfile));
+  regfile->PC = FUZZ_BASE_PC;
+  regfile->R[2] = 0xEFFFF;
+  regfile->R[3] = 0x3000;
+}
+
+static int opcode_class(Instruction instruction) {
+  switch (instruction.opcode) {
+    case 0x03: return 1;
+    case 0x23: return 2;
+    case 0x63: return 3;
+    case 0x6F: return 4;
+    case 0x33: return instruction.rtype.funct7 == 0x01 ? 5 : 6;
+    case 0x13: return instruction.bits == NOP ? 0 : 7;
+    default: return instruction.bits == 0 ? 0 : 7;
+  }
+}
+
+// True if the instruction reads register `reg`, never for x0
+static bool reads_reg(Instruction instruction, uint32_t reg) {
+  uint32_t opcode = instruction.opcode;
+  bool rs1 = instruction.bits != 0 && opcode != 0x37 && opcode != 0x17 && opcode != 0x6F;
+  bool rs2 = opcode == 0x33 || opcode == 0x23 || opcode == 0x63;
+  return reg != 0 && ((rs1 && instruction.rtype.rs1 == reg) || (rs2 && instruction.rtype.rs2 == reg));
+}
+
+// A load-use stall of the cycle that just ended that a second slot took
+// part in: the load in the second slot of the pair now in EX/MEM, or the
+// consumer in the second slot of the pair held in IF/ID
+static bool stalled_dual(const pipeline_regs_t *pregs) {
+  const exmem_reg_t *ex = &pregs->exmem_preg.out;
+  const ifid_reg_t *id = &pregs->ifid_preg.out;
+  return (ex->Mem_Read && reads_reg(id->instrDUAL, ex->rd)) ||
+         (ex->dualHazard && ex->Mem_ReadDUAL &&
+          (reads_reg(id->instr, ex->rdDUAL) || reads_reg(id->instrDUAL, ex->rdDUAL)));
+}
+
+// What the cycle that just ended did, in 21 bits
+static uint32_t cycle_event(const pipeline_regs_t *pregs, const pipeline_wires_t *pwires, bool stalled, bool flushed) {
+  const exmem_reg_t *ex = &pregs->exmem_preg.out;
+  const memwb_reg_t *mem = &pregs->memwb_preg.out;
+  bool stall_dual = stalled && stalled_dual(pregs);
+  bool flush_dual = flushed && mem->dualHazard && mem->instrDUAL.opcode == 0x63;
+  return pwires->forwardA | pwires->forwardB << 2 | pwires->forwardADUAL << 4 | pwires->forwardBDUAL << 6 |
+         stalled << 8 | stall_dual << 9 | flushed << 10 | flush_dual << 11 | ex->dual_block << 12 |
+         opcode_class(ex->instr) << 15 | opcode_class(ex->instrDUAL) << 18;
+}
+
+static void record_edge(uint32_t previous, uint32_t event) {
+  uint32_t index = (uint32_t)((((uint64_t)previous << 21 | event) * 0x9E3779B97F4A7C15ULL) >> 48);
+  if (trace[index] == 0) {
+    touched[touched_count++] = index;
+  }
+  if (trace[index] < 255) {
+    trace[index]++;
+  }
+}
+
+// AFL-style hit count buckets
+static uint8_t bucket(uint8_t hits) {
+  return hits >= 128 ? 128 : hits >= 32 ? 64 : hits >= 16 ? 32 : hits >= 8 ? 16 : hits >= 4 ? 8 : hits;
+}
+
+// Fold this program's trace into the map, true if it reached something new
+static bool merge_trace(void) {
+  bool fresh = false;
+  for (int i = 0; i < touched_count; i++) {
+    uint32_t index = touched[i];
+    uint8_t b = bucket(trace[index]);
+    if ((coverage[index] & b) == 0) {
+      stats.edges += coverage[index] == 0;
+      coverage[index] |= b;
+      fresh = true;
+    }
+    trace[index] = 0;
+  }
+  touched_count = 0;
+  return fresh;
+}
+
+// Returns false if the program did not finish on the emulator, which is
+// not the pipeline's fault (it cannot happen for generated programs)
+static bool run(const fuzz_code_t *code, fuzz_result_t *result, bool observe) {
+  result->failure = NULL;
+  result->instret = 0;
+  reset(emu_memory, &result->emu, code);
+  uint32_t bits;
+  while ((bits = load(emu_memory, result->emu.PC, LENGTH_WORD)) != ECALL) {
+    if (result->instret++ == FUZZ_MAX_INSTRET ||
+        result->emu.PC < FUZZ_BASE_PC || result->emu.PC >= FUZZ_BASE_PC + 4 * code->count) {
+      return false;
+    }
+    execute_instruction(bits, &result->emu, emu_memory);
+    result->emu.R[0] = 0;
+  }
+
+  reset(sim_memory, &result->sim, code);
+  pipeline_regs_t pregs = {0};
+  pipeline_wires_t pwires = {0};
+  bootstrap(&pwires, &pregs, &result->sim);
+  bool ecall_exit = false;
+  uint64_t counters[] = {fwd_exex_counter, fwd_exmem_counter, stall_counter, branch_counter};
+  uint64_t limit = 8 * result->instret + 64;
+  uint32_t previous = 0;
+  for (result->cycles = 0; !ecall_exit; result->cycles++) {
+    if (result->cycles == limit) {
+      result->failure = "did not reach the exit";
+      break;
+    }
+    if (result->sim.PC < FUZZ_BASE_PC || result->sim.PC >= FUZZ_BASE_PC + 4 * (code->count + FUZZ_PAD)) {
+      result->failure = "fetched outside the program";
+      break;
+    }
+    uint64_t stalls = stall_counter, flushes = branch_counter;
+    cycle_pipeline(&result->sim, sim_memory, NULL, NULL, &pregs, &pwires, &ecall_exit);
+    if (observe) {
+      uint32_t event = cycle_event(&pregs, &pwires, stall_counter != stalls, branch_counter != flushes);
+      record_edge(previous, event);
+      previous = event;
+      if (!pregs.exmem_preg.out.bubble && pregs.exmem_preg.out.instr.bits != 0) {
+        stats.dual[pregs.exmem_preg.out.dual_block]++;
+      }
+      stats.stalls_dual += event >> 9 & 1;
+      stats.flushes_dual += event >> 11 & 1;
+    }
+  }
+  if (observe) {
+    stats.pipeline_cycles += result->cycles;
+    stats.emulator_instructions += result->instret;
+    stats.forwards_exex += fwd_exex_counter - counters[0];
+    stats.forwards_exmem += fwd_exmem_counter - counters[1];
+    stats.stalls += stall_counter - counters[2];
+    stats.flushes += branch_counter - counters[3];
+  }
+
+  if (result->failure == NULL && memcmp(result->emu.R, result->sim.R, sizeof(result->emu.R)) != 0) {
+    result->failure = "registers differ";
+  }
+  if (result->failure == NULL && memcmp(emu_memory + FUZZ_DATA, sim_memory + FUZZ_DATA, FUZZ_DATA_SIZE) != 0) {
+    result->failure = "memory differs";
+  }
+  return true;
+}
+
+/// DIVERGENCES ///
+
+static bool diverges(const fuzz_prog_t *prog) {
+  static fuzz_code_t code;
+  fuzz_result_t result;
+  lower(prog, &code);
+  return run(&code, &result, false) && result.failure != NULL;
+}
+
+// Drop every op the divergence does not need
+static void reduce(fuzz_prog_t *prog) {
+  static fuzz_prog_t smaller;
+  for (bool again = true; again;) {
+    again = false;
+    for (int i = prog->count - 1; i >= 0; i--) {
+      smaller = *prog;
+      memmove(&smaller.ops[i], &smaller.ops[i + 1], (smaller.count - i - 1) * sizeof(fuzz_op_t));
+      smaller.count--;
+      if (diverges(&smaller)) {
+        *prog = smaller;
+        again = true;
+      }
+    }
+  }
+}
+
+static void print_program(const fuzz_code_t *code) {
+  char text[64];
+  for (int i = 0; i < code->count; i++) {
+    disassemble(code->words[i], text, sizeof(text));
+    printf("  %s%08x: %08x  %s\n", i % 2 ? "  " : "", FUZZ_BASE_PC + 4 * i, code->words[i], text);
+  }
+}
+
+static void report(const fuzz_code_t *code, const fuzz_result_t *result, const char *saved) {
+  printf("pipeline %s after %lu cycles (emulator: %lu instructions)\n", result->failure,
+         (unsigned long)result->cycles, (unsigned long)result->instret);
+  for (int r = 1; r < 32; r++) {
+    if (result->emu.R[r] != result->sim.R[r]) {
+      printf("  x%-2d emulator 0x%08x pipeline 0x%08x\n", r, result->emu.R[r], result->sim.R[r]);
+    }
+  }
+  int shown = 0;
+  for (Address a = FUZZ_DATA; a < FUZZ_DATA + FUZZ_DATA_SIZE && shown < 8; a += 4) {
+    Word e = load(emu_memory, a, LENGTH_WORD), s = load(sim_memory, a, LENGTH_WORD);
+    if (e != s) {
+      printf("  [0x%05x] emulator 0x%08x pipeline 0x%08x\n", a, e, s);
+      shown++;
+    }
+  }
+  printf("program (issue pairs, the second slot indented):\n");
+  print_program(code);
+  if (saved != NULL) {
+    printf("saved as %s\n", saved);
+  }
+}
+
+static int save(const fuzz_code_t *code, char *path, size_t size) {
+  if (mkdir("code/fuzz", 0755) != 0 && errno != EEXIST) {
+    return -1;
+  }
+  if (mkdir(FUZZ_OUT_DIR, 0755) != 0 && errno != EEXIST) {
+    return -1;
+  }
+  snprintf(path, size, "%s/diverge_%lu.input", FUZZ_OUT_DIR, (unsigned long)stats.divergences);
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < code->count; i++) {
+    fprintf(file, "0x%08X\n", code->words[i]);
+  }
+  fclose(file);
+  return 0;
+}
+
+static void divergence(fuzz_prog_t *prog) {
+  static fuzz_prog_t reduced;
+  reduced = *prog;
+  reduce(&reduced);
+  static fuzz_code_t code;
+  fuzz_result_t result;
+  lower(&reduced, &code);
+  run(&code, &result, false);
+
+  // one report per shape of reduced program: loads, stores, control and
+  // the other instructions, slot by slot
+  uint64_t signature = 14695981039346656037ULL;
+  for (const char *c = result.failure; *c != '\0'; c++) {
+    signature = (signature ^ (uint8_t)*c) * 1099511628211ULL;
+  }
+  for (int i = 0; i < code.count; i++) {
+    int shape = opcode_class((Instruction){.bits = code.words[i]});
+    signature = (signature ^ (shape > 5 ? 5 : shape)) * 1099511628211ULL;
+  }
+  for (int i = 0; i < known_count; i++) {
+    if (known[i] == signature) {
+      stats.known++;
+      return;
+    }
+  }
+  for (int i = 0; i < signature_count; i++) {
+    if (signatures[i] == signature) {
+      stats.duplicates++;
+      return;
+    }
+  }
+  if (signature_count < FUZZ_SIGNATURES) {
+    signatures[signature_count++] = signature;
+  }
+  stats.divergences++;
+  char path[128];
+  printf("\n#%lu: divergence in program %lu, %d ops reduced to %d, signature %016llx\n",
+         (unsigned long)stats.divergences, (unsigned long)stats.programs, prog->count, reduced.count,
+         (unsigned long long)signature);
+  report(&code, &result, save(&code, path, sizeof(path)) == 0 ? path : NULL);
+}
+
+// -x: the signatures of known divergences, one hex number per line
+static int load_known(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot open known signatures %s\n", filename);
+    return -1;
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char *end;
+    uint64_t signature = strtoull(line, &end, 16);
+    if (end == line || line[0] == '#') {
+      continue;
+    }
+    if (known_count == FUZZ_KNOWN) {
+      fprintf(stderr, "%s lists more than %d signatures\n", filename, FUZZ_KNOWN);
+      fclose(file);
+      return -1;
+    }
+    known[known_count++] = signature;
+  }
+  fclose(file);
+  return 0;
+}
+
+// -p: run a program file through both, as it is laid out
+static int replay(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot open program %s\n", filename);
+    return -1;
+  }
+  static fuzz_code_t code;
+  char line[64];
+  while (code.count < FUZZ_MAX_WORDS - FUZZ_PAD && fgets(line, sizeof(line), file) != NULL) {
+    code.words[code.count++] = (uint32_t)strtoul(line, NULL, 16);
+  }
+  fclose(file);
+  for (int i = 0; i < FUZZ_PAD; i++) {
+    code.words[code.count++] = NOP;
+  }
+  fuzz_result_t result;
+  if (!run(&code, &result, false)) {
+    fprintf(stderr, "%s does not reach an ecall on the emulator\n", filename);
+    return -1;
+  }
+  if (result.failure == NULL) {
+    printf("%s: pipeline and emulator agree (%lu cycles, %lu instructions)\n", filename,
+           (unsigned long)result.cycles, (unsigned long)result.instret);
+    return 0;
+  }
+  report(&code, &result, NULL);
+  return 1;
+}
+
+static void print_stats(double seconds) {
+  printf("#Programs          = %5lu\n", (unsigned long)stats.programs);
+  printf("#Divergences       = %5lu\n", (unsigned long)stats.divergences);
+  printf("#Duplicates        = %5lu\n", (unsigned long)stats.duplicates);
+  printf("#Known             = %5lu\n", (unsigned long)stats.known);
+  printf("#Dropped           = %5lu\n", (unsigned long)stats.dropped);
+  printf("#Corpus            = %5d\n", corpus_count);
+  printf("#Coverage edges    = %5lu\n", (unsigned long)stats.edges);
+  printf("#Instructions      = %5lu\n", (unsigned long)stats.emulator_instructions);
+  printf("#Cycles            = %5lu\n", (unsigned long)stats.pipeline_cycles);
+  printf("#Forwards (EX-EX)  = %5lu\n", (unsigned long)stats.forwards_exex);
+  printf("#Forwards (EX-MEM) = %5lu\n", (unsigned long)stats.forwards_exmem);
+  printf("#Stalls            = %5lu\n", (unsigned long)stats.stalls);
+  printf("#Stalls in slot 2  = %5lu\n", (unsigned long)stats.stalls_dual);
+  printf("#Branches taken    = %5lu\n", (unsigned long)stats.flushes);
+  printf("#Taken in slot 2   = %5lu\n", (unsigned long)stats.flushes_dual);
+  printf("#Dual issued       = %5lu\n", (unsigned long)stats.dual[DUAL_ISSUED]);
+  printf("#Dual empty        = %5lu\n", (unsigned long)stats.dual[DUAL_EMPTY]);
+  printf("#Dual structural   = %5lu\n", (unsigned long)stats.dual[DUAL_STRUCTURAL]);
+  printf("#Dual data         = %5lu\n", (unsigned long)stats.dual[DUAL_DATA]);
+  printf("#Dual control      = %5lu\n", (unsigned long)stats.dual[DUAL_CONTROL]);
+  printf("%.0f programs/s\n", stats.programs / seconds);
+}
+
+int main(int argc, char **argv) {
+  uint64_t programs = FUZZ_PROGRAMS, seed = time(NULL);
+  int max_ops = FUZZ_OPS, max_divergences = 1;
+  const char *program_file = NULL, *known_file = NULL;
+  int c;
+  while ((c = getopt(argc, argv, "n:s:l:k:x:p:")) != -1) {
+    switch (c) {
+    case 'n':
+      programs = strtoull(optarg, NULL, 0);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'l':
+      max_ops = atoi(optarg);
+      break;
+    case 'k':
+      max_divergences = atoi(optarg);
+      break;
+    case 'x':
+      known_file = optarg;
+      break;
+    case 'p':
+      program_file = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n programs] [-s seed] [-l ops] [-k divergences] [-x known] [-p program]\n",
+              argv[0]);
+      return -1;
+    }
+  }
+  if (max_ops <= POOL_HOT || max_ops > FUZZ_MAX_OPS - 16) {
+    fprintf(stderr, "Option -l expects %d to %d ops\n", POOL_HOT + 1, FUZZ_MAX_OPS - 16);
+    return -1;
+  }
+  if (known_file != NULL && load_known(known_file) != 0) {
+    return -1;
+  }
+  emu_memory = map_memory();
+  sim_memory = map_memory();
+  if (emu_memory == NULL || sim_memory == NULL) {
+    fprintf(stderr, "Cannot map %llu bytes for guest memory\n", FUZZ_MEMORY_SIZE);
+    return -1;
+  }
+  if (program_file != NULL) {
+    return replay(program_file);
+  }
+
+  rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  printf("simfuzz: seed %lu\n", (unsigned long)seed);
+  static fuzz_prog_t prog;
+  static fuzz_code_t code;
+  fuzz_result_t result;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (stats.programs < programs && stats.divergences < (uint64_t)max_divergences) {
+    // fresh programs until the corpus has some, then now and then
+    if (corpus_count < 16 || rnd(16) == 0) {
+      generate(&prog, max_ops);
+    } else {
+      prog = corpus[rnd(corpus_count)];
+      mutate(&prog, &corpus[rnd(corpus_count)], max_ops);
+    }
+    lower(&prog, &code);
+    stats.programs++;
+    if (!run(&code, &result, true)) {
+      stats.dropped++;
+      merge_trace();
+      continue;
+    }
+    bool fresh = merge_trace();
+    if (result.failure != NULL) {
+      divergence(&prog);
+    } else if (fresh) {
+      corpus[corpus_count < FUZZ_CORPUS ? corpus_count++ : rnd(FUZZ_CORPUS)] = prog;
+      stats.corpus_adds++;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  print_stats(seconds > 0 ? seconds : 1e-9);
+  munmap(emu_memory, FUZZ_MEMORY_SIZE);
+  munmap(sim_memory, FUZZ_MEMORY_SIZE);
+  return stats.divergences > 0;
+}
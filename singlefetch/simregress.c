@@ -0,0 +1,462 @@
+#define _GNU_SOURCE    // pipe2
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Regression suite (make regress). Every entry of the manifest is one
+// simulator run: a build (riscv-<config>, see config.h), its flags and a
+// program. The runs go to a pool of threads, and each thread hashes the
+// run's stdout with a rolling 64-bit FNV-1a as it streams in, so no trace
+// is written or diffed. The hash at the start of a cycle's trace ("Cycle
+// Counter =") is kept as a checkpoint for every cycle below REGRESS_DENSE
+// and for the first cycle traced in every REGRESS_CHECKPOINT cycles after
+// it (stalls can skip cycles). A run passes when its final
+// hash (output and exit status) matches the stored reference. Only the
+// failures run again, with their full trace saved to code/regress/out, and
+// the first checkpoint that differs gives the first divergent cycle.
+// With -u the references are taken from this run instead. Names on the
+// command line pick the entries whose name contains one of them.
+//
+// usage: ./simregress [-j threads] [-u] [-m manifest] [-r hashes] [name ...]
+
+#define REGRESS_MANIFEST "code/regress/manifest"
+#define REGRESS_HASHES "code/regress/hashes"
+#define REGRESS_OUT "code/regress/out"
+#define REGRESS_MAX_ENTRIES 512
+#define REGRESS_MAX_ARGS 32
+#define REGRESS_LINE 4096
+#define REGRESS_TIMEOUT 60         // seconds before a run is killed
+#define REGRESS_DENSE 64
+#define REGRESS_CHECKPOINT 1024
+#define REGRESS_MAX_CHECKPOINTS 4096
+#define CYCLE_MARKER "Cycle Counter ="
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+typedef struct {
+    uint64_t cycle;
+    uint64_t hash;             // of the output before the cycle's trace
+    uint64_t line;             // where the cycle's trace starts
+} checkpoint_t;
+
+typedef struct {
+    uint64_t hash;
+    int count;
+    checkpoint_t *points;
+} regress_hash_t;
+
+typedef struct {
+    char name[64];
+    char config[32];
+    char *argv[REGRESS_MAX_ARGS];
+    char args[REGRESS_LINE];   // the strings argv points to
+    bool selected;
+
+    bool has_ref;
+    regress_hash_t ref;
+    regress_hash_t run;
+    int status;                // as waitpid reports it, -1 if it did not start
+    double seconds;
+    bool failed;
+} regress_entry_t;
+
+static regress_entry_t entries[REGRESS_MAX_ENTRIES];
+static int entry_count = 0;
+static int next_entry = 0;
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+
+///////////////////////////////////////////////////////////////////////////////
+/// Manifest and references
+///////////////////////////////////////////////////////////////////////////////
+
+// name config program flags...  (# starts a comment)
+static int load_manifest(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot open manifest %s\n", filename);
+    return -1;
+  }
+  char line[REGRESS_LINE];
+  int number = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    number++;
+    line[strcspn(line, "#\n")] = '\0';
+    char *name = strtok(line, " \t");
+    char *config = strtok(NULL, " \t");
+    char *program = strtok(NULL, " \t");
+    if (name == NULL) {
+      continue;
+    }
+    if (program == NULL || entry_count == REGRESS_MAX_ENTRIES ||
+        strlen(name) >= sizeof(entries[0].name) || strlen(config) >= sizeof(entries[0].config)) {
+      fprintf(stderr, "%s:%d: expected <name> <config> <program> [flags]\n", filename, number);
+      fclose(file);
+      return -1;
+    }
+    regress_entry_t *entry = &entries[entry_count++];
+    strcpy(entry->name, name);
+    strcpy(entry->config, config);
+    entry->selected = true;
+
+    // argv: ./riscv-<config> flags... program
+    char *out = entry->args;
+    int argc = 0;
+    entry->argv[argc++] = out;
+    out += sprintf(out, "./riscv-%s", config) + 1;
+    char *flag;
+    while ((flag = strtok(NULL, " \t")) != NULL && argc < REGRESS_MAX_ARGS - 2) {
+      entry->argv[argc++] = strcpy(out, flag);
+      out += strlen(flag) + 1;
+    }
+    entry->argv[argc++] = strcpy(out, program);
+    entry->argv[argc] = NULL;
+  }
+  fclose(file);
+  return 0;
+}
+
+static regress_entry_t *find_entry(const char *name) {
+  for (int i = 0; i < entry_count; i++) {
+    if (strcmp(entries[i].name, name) == 0) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+// name hash cycle:hash... , one line per entry. A missing file is no error,
+// the runs just have nothing to compare with.
+static int load_hashes(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    return 0;
+  }
+  static char line[REGRESS_MAX_CHECKPOINTS * 40];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "#\n")] = '\0';
+    char *name = strtok(line, " ");
+    char *hash = strtok(NULL, " ");
+    regress_entry_t *entry = name && hash ? find_entry(name) : NULL;
+    if (entry == NULL) {
+      continue;
+    }
+    entry->has_ref = true;
+    entry->ref.hash = strtoull(hash, NULL, 16);
+    entry->ref.points = malloc(REGRESS_MAX_CHECKPOINTS * sizeof(checkpoint_t));
+    char *point;
+    while ((point = strtok(NULL, " ")) != NULL && entry->ref.count < REGRESS_MAX_CHECKPOINTS) {
+      checkpoint_t *checkpoint = &entry->ref.points[entry->ref.count++];
+      char *colon;
+      checkpoint->cycle = strtoull(point, &colon, 10);
+      checkpoint->hash = *colon == ':' ? strtoull(colon + 1, NULL, 16) : 0;
+    }
+  }
+  fclose(file);
+  return 0;
+}
+
+static void write_hash(FILE *file, const char *name, const regress_hash_t *hash) {
+  fprintf(file, "%s %016lx", name, (unsigned long)hash->hash);
+  for (int i = 0; i < hash->count; i++) {
+    fprintf(file, " %lu:%016lx", (unsigned long)hash->points[i].cycle, (unsigned long)hash->points[i].hash);
+  }
+  fprintf(file, "\n");
+}
+
+// The new references: this run's hashes for the entries it ran, the stored
+// ones for the rest
+static int update_hashes(const char *filename) {
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot write %s\n", filename);
+    return -1;
+  }
+  fprintf(file, "# simregress -u: name, hash of stdout and exit status, cycle:hash checkpoints\n");
+  for (int i = 0; i < entry_count; i++) {
+    regress_entry_t *entry = &entries[i];
+    if (entry->selected && entry->status >= 0) {
+      write_hash(file, entry->name, &entry->run);
+    } else if (entry->has_ref) {
+      write_hash(file, entry->name, &entry->ref);
+    }
+  }
+  fclose(file);
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Runs
+///////////////////////////////////////////////////////////////////////////////
+
+static uint64_t fnv1a(uint64_t hash, const char *bytes, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ (uint8_t)bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+Run one entry and hash its stdout, a copy of which goes to `save` if it is
+not NULL. The hash goes on per byte, and every line that starts a cycle's
+trace is looked at for a checkpoint first.
+*/
+static void run_entry(regress_entry_t *entry, FILE *save) {
+  regress_hash_t *run = &entry->run;
+  run->hash = FNV_OFFSET;
+  run->count = 0;
+  if (run->points == NULL) {
+    run->points = malloc(REGRESS_MAX_CHECKPOINTS * sizeof(checkpoint_t));
+  }
+  entry->status = -1;
+  double start = now();
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    return;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDERR_FILENO);
+    alarm(REGRESS_TIMEOUT);    // survives the exec and kills a run that hangs
+    execv(entry->argv[0], entry->argv);
+    _exit(127);
+  }
+  close(fds[1]);
+  if (pid < 0) {
+    close(fds[0]);
+    return;
+  }
+
+  char buffer[1 << 16];
+  char head[64];               // the start of the current line
+  int head_len = 0;
+  uint64_t line = 1;
+  uint64_t line_hash = run->hash;
+  uint64_t next_checkpoint = REGRESS_DENSE;
+  ssize_t n;
+  while ((n = read(fds[0], buffer, sizeof(buffer))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (save != NULL) {
+      fwrite(buffer, 1, n, save);
+    }
+    for (ssize_t i = 0; i < n; i++) {
+      char c = buffer[i];
+      if (c != '\n') {
+        if (head_len < (int)sizeof(head) - 1) {
+          head[head_len++] = c;
+        }
+        run->hash = (run->hash ^ (uint8_t)c) * FNV_PRIME;
+        continue;
+      }
+      head[head_len] = '\0';
+      char *marker = strstr(head, CYCLE_MARKER);
+      if (marker != NULL && run->count < REGRESS_MAX_CHECKPOINTS) {
+        uint64_t cycle = strtoull(marker + strlen(CYCLE_MARKER), NULL, 10);
+        if (cycle < REGRESS_DENSE || cycle >= next_checkpoint) {
+          run->points[run->count++] = (checkpoint_t){cycle, line_hash, line};
+          if (cycle >= next_checkpoint) {
+            next_checkpoint = (cycle / REGRESS_CHECKPOINT + 1) * REGRESS_CHECKPOINT;
+          }
+        }
+      }
+      run->hash = (run->hash ^ (uint8_t)c) * FNV_PRIME;
+      line_hash = run->hash;
+      head_len = 0;
+      line++;
+    }
+  }
+  close(fds[0]);
+  while (waitpid(pid, &entry->status, 0) < 0 && errno == EINTR) {
+  }
+  char trailer[32];
+  int length = snprintf(trailer, sizeof(trailer), "\nexit %d\n", entry->status);
+  run->hash = fnv1a(run->hash, trailer, length);
+  entry->seconds = now() - start;
+}
+
+static void *worker(void *unused) {
+  (void)unused;
+  while (1) {
+    pthread_mutex_lock(&next_lock);
+    while (next_entry < entry_count && !entries[next_entry].selected) {
+      next_entry++;
+    }
+    int i = next_entry++;
+    pthread_mutex_unlock(&next_lock);
+    if (i >= entry_count) {
+      return NULL;
+    }
+    run_entry(&entries[i], NULL);
+  }
+}
+
+static const char *describe_status(int status) {
+  static char text[64];
+  if (status < 0) {
+    return "did not start";
+  }
+  if (WIFSIGNALED(status)) {
+    snprintf(text, sizeof(text), "%s", WTERMSIG(status) == SIGALRM ? "timed out" : strsignal(WTERMSIG(status)));
+  } else {
+    snprintf(text, sizeof(text), "exit %d", WEXITSTATUS(status));
+  }
+  return text;
+}
+
+/*
+A failure runs again with its output saved. The first checkpoint that
+differs from the reference bounds the first divergent cycle. Below
+REGRESS_DENSE every traced cycle is a checkpoint, so it is the one before;
+above, it is somewhere since the checkpoint before.
+*/
+static void report_divergence(regress_entry_t *entry) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%.64s.trace", REGRESS_OUT, entry->name);
+  mkdir(REGRESS_OUT, 0755);
+  FILE *save = fopen(path, "w");
+  uint64_t first_hash = entry->run.hash;
+  run_entry(entry, save);
+  if (save != NULL) {
+    fclose(save);
+  }
+  if (entry->run.hash != first_hash) {
+    printf("  %s: the output differs from run to run\n", entry->name);
+  }
+
+  const regress_hash_t *run = &entry->run, *ref = &entry->ref;
+  int i = 0;
+  while (i < run->count && i < ref->count && run->points[i].cycle == ref->points[i].cycle &&
+         run->points[i].hash == ref->points[i].hash) {
+    i++;
+  }
+  if (i < run->count && i < ref->count) {
+    uint64_t cycle = run->points[i].cycle;
+    uint64_t last_good = i > 0 ? ref->points[i - 1].cycle : 0;
+    if (i == 0 && cycle == 0) {
+      printf("  %s: diverges before cycle 0", entry->name);
+    } else if (i > 0 && last_good < REGRESS_DENSE) {
+      printf("  %s: first divergent cycle %lu", entry->name, (unsigned long)last_good);
+    } else {
+      printf("  %s: first divergent cycle between %lu and %lu", entry->name,
+             (unsigned long)last_good, (unsigned long)cycle - 1);
+    }
+    printf(" (cycle %lu starts at line %lu of %s)\n", (unsigned long)run->points[i > 0 ? i - 1 : 0].cycle,
+           (unsigned long)run->points[i > 0 ? i - 1 : 0].line, path);
+  } else if (i < run->count || i < ref->count) {
+    printf("  %s: runs %s cycles than the reference, after cycle %lu, see %s\n", entry->name,
+           run->count > ref->count ? "more" : "fewer",
+           (unsigned long)(i > 0 ? ref->points[i - 1].cycle : 0), path);
+  } else {
+    printf("  %s: diverges after the last checkpoint (%s), in the statistics or at exit, see %s\n",
+           entry->name, describe_status(entry->status), path);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *manifest = REGRESS_MANIFEST, *hashes = REGRESS_HASHES;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  bool update = false;
+  int c;
+  while ((c = getopt(argc, argv, "j:um:r:")) != -1) {
+    switch (c) {
+    case 'j':
+      threads = strtol(optarg, NULL, 0);
+      break;
+    case 'u':
+      update = true;
+      break;
+    case 'm':
+      manifest = optarg;
+      break;
+    case 'r':
+      hashes = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-j threads] [-u] [-m manifest] [-r hashes] [name ...]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (load_manifest(manifest) != 0 || load_hashes(hashes) != 0) {
+    return -1;
+  }
+  if (optind < argc) {
+    for (int i = 0; i < entry_count; i++) {
+      entries[i].selected = false;
+      for (int a = optind; a < argc; a++) {
+        entries[i].selected |= strstr(entries[i].name, argv[a]) != NULL;
+      }
+    }
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  double start = now();
+  pthread_t pool[threads];
+  for (long t = 0; t < threads; t++) {
+    pthread_create(&pool[t], NULL, worker, NULL);
+  }
+  for (long t = 0; t < threads; t++) {
+    pthread_join(pool[t], NULL);
+  }
+  double seconds = now() - start;
+
+  int runs = 0, failures = 0, missing = 0;
+  for (int i = 0; i < entry_count; i++) {
+    regress_entry_t *entry = &entries[i];
+    if (!entry->selected) {
+      continue;
+    }
+    runs++;
+    const char *result = "ok";
+    if (entry->status < 0) {
+      result = "FAIL (did not start)";
+      entry->failed = true;
+    } else if (!entry->has_ref) {
+      result = update ? "new" : "no reference";
+      missing += !update;
+    } else if (entry->run.hash != entry->ref.hash) {
+      result = update ? "updated" : "FAIL";
+      entry->failed = !update;
+    }
+    failures += entry->failed;
+    printf("%-28s %-6s %016lx %8.3fs  %-9s %s\n", entry->name, entry->config, (unsigned long)entry->run.hash,
+           entry->seconds, describe_status(entry->status), result);
+  }
+
+  for (int i = 0; i < entry_count; i++) {
+    if (entries[i].failed && entries[i].status >= 0) {
+      report_divergence(&entries[i]);
+    }
+  }
+  if (update && update_hashes(hashes) != 0) {
+    return -1;
+  }
+  printf("%d run(s), %d failed, %d without reference in %.2fs on %ld thread(s)\n", runs, failures, missing,
+         seconds, threads);
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+#include "smp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "riscv.h"
+#include "utils.h"
+#include "csr.h"
+
+// "harts[:threads[:quantum]]"
+bool smp_configure(smp_t *smp, const char *spec) {
+  int harts = 0, threads = 1;
+  long quantum = SMP_QUANTUM;
+  memset(smp, 0, sizeof(*smp));
+  if (spec == NULL || sscanf(spec, "%d:%d:%ld", &harts, &threads, &quantum) < 1) {
+    return false;
+  }
+  if (harts < 1 || harts > SMP_MAX_HARTS || threads < 1 || quantum < 1) {
+    return false;
+  }
+  smp->harts = harts;
+  smp->threads = threads < harts ? threads : harts;
+  smp->quantum = quantum;
+  return true;
+}
+
+// Address a load, store or AMO touches, whether it writes
+static Address mem_address(const hart_t *hart, Instruction instruction, bool *write) {
+  Register base = hart->regs.R[instruction.itype.rs1];
+  switch (instruction.opcode) {
+    case 0x03:
+      *write = false;
+      return base + sign_extend_number(instruction.itype.imm, 12);
+    case 0x23:
+      *write = true;
+      return base + sign_extend_number(get_store_offset(instruction), 12);
+    default: // 0x2F, lr.w only reads
+      *write = (instruction.rtype.funct7 >> 2) != 0x02;
+      return base;
+  }
+}
+
+// Run one instruction of `hart`
+static void step(smp_t *smp, hart_t *hart) {
+  uint32_t bits = load(smp->memory, hart->regs.PC, LENGTH_WORD);
+  uint32_t expanded = instruction_size(bits) == 2 ? expand_compressed(bits & 0xFFFF) : bits;
+  Instruction instruction = parse_instruction(expanded);
+  uint64_t stall = 0;
+
+  switch (instruction.opcode) {
+    case 0x73:
+      if (instruction.itype.funct3 == 0x0 && hart->regs.R[10] == 10) {
+        hart->halted = true;
+        break;
+      }
+      pthread_mutex_lock(&smp->bus);
+      csr_file.mhartid = hart->id;
+      csr_bind(CSR_COUNTER_CYCLE, &hart->cycle);
+      csr_bind(CSR_COUNTER_TIME, &hart->cycle);
+      csr_bind(CSR_COUNTER_INSTRET, &hart->instret);
+      execute_instruction(bits, &hart->regs, smp->memory);
+      fflush(stdout);
+      pthread_mutex_unlock(&smp->bus);
+      break;
+    case 0x03:
+    case 0x23:
+    case 0x2F: {
+      bool write;
+      Address addr = mem_address(hart, instruction, &write);
+      pthread_mutex_lock(&smp->bus);
+      if (write) {
+        // a write to the block breaks every other hart's reservation on it
+        for (int h = 0; h < smp->harts; h++) {
+          hart_t *other = &smp->hart[h];
+          if (other != hart && other->regs.reserved &&
+              mesi_block(&smp->mesi, other->regs.reservation) == mesi_block(&smp->mesi, addr)) {
+            other->regs.reserved = false;
+          }
+        }
+      }
+      stall = mesi_access(&smp->mesi, hart->id, addr, write);
+      execute_instruction(bits, &hart->regs, smp->memory);
+      pthread_mutex_unlock(&smp->bus);
+      break;
+    }
+    default:
+      execute_instruction(bits, &hart->regs, smp->memory);
+      break;
+  }
+  hart->regs.R[0] = 0;
+  hart->instret++;
+  hart->cycle += 1 + stall;
+}
+
+static void *worker(void *arg) {
+  smp_t *smp = ((void **)arg)[0];
+  int index = (int)(intptr_t)((void **)arg)[1];
+  for (;;) {
+    for (int h = index; h < smp->harts; h += smp->threads) {
+      hart_t *hart = &smp->hart[h];
+      while (!hart->halted && hart->cycle < smp->quantum_end) {
+        step(smp, hart);
+      }
+    }
+    // one thread moves the quantum on while the others wait
+    if (pthread_barrier_wait(&smp->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+      smp->running = 0;
+      for (int h = 0; h < smp->harts; h++) {
+        smp->running += !smp->hart[h].halted;
+      }
+      smp->quantum_end += smp->quantum;
+      smp->quanta++;
+    }
+    pthread_barrier_wait(&smp->barrier);
+    if (smp->running == 0) {
+      return NULL;
+    }
+  }
+}
+
+void smp_run(smp_t *smp, const regfile_t *boot, Byte *memory) {
+  pthread_t threads[SMP_MAX_HARTS];
+  void *args[SMP_MAX_HARTS][2];
+
+  smp->memory = memory;
+  smp->quantum_end = smp->quantum;
+  mesi_init(&smp->mesi, smp->harts);
+  for (int h = 0; h < smp->harts; h++) {
+    hart_t *hart = &smp->hart[h];
+    hart->id = h;
+    hart->regs = *boot;
+    hart->regs.R[2] = boot->R[2] - h * SMP_STACK_BYTES;
+    hart->regs.R[10] = h;
+  }
+  pthread_mutex_init(&smp->bus, NULL);
+  pthread_barrier_init(&smp->barrier, NULL, smp->threads);
+  for (int t = 1; t < smp->threads; t++) {
+    args[t][0] = smp;
+    args[t][1] = (void *)(intptr_t)t;
+    pthread_create(&threads[t], NULL, worker, args[t]);
+  }
+  args[0][0] = smp;
+  args[0][1] = (void *)(intptr_t)0;
+  worker(args[0]);
+  for (int t = 1; t < smp->threads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  pthread_barrier_destroy(&smp->barrier);
+  pthread_mutex_destroy(&smp->bus);
+  // the counters point at the harts, which are about to go
+  csr_bind(CSR_COUNTER_CYCLE, NULL);
+  csr_bind(CSR_COUNTER_TIME, NULL);
+  csr_bind(CSR_COUNTER_INSTRET, NULL);
+}
+
+uint64_t smp_instret(const smp_t *smp) {
+  uint64_t instret = 0;
+  for (int h = 0; h < smp->harts; h++) {
+    instret += smp->hart[h].instret;
+  }
+  return instret;
+}
+
+void smp_print_stats(smp_t *smp) {
+  uint64_t cycles = 0;
+  for (int h = 0; h < smp->harts; h++) {
+    cycles = smp->hart[h].cycle > cycles ? smp->hart[h].cycle : cycles;
+  }
+  printf("#Harts             = %5d (%d threads, quantum %lu)\n", smp->harts, smp->threads,
+         (unsigned long)smp->quantum);
+  printf("#Cycles            = %5lu (slowest hart)\n", (unsigned long)cycles);
+  printf("#Instructions      = %5lu\n", (unsigned long)smp_instret(smp));
+  printf("#Quanta            = %5lu\n", (unsigned long)smp->quanta);
+  for (int h = 0; h < smp->harts; h++) {
+    hart_t *hart = &smp->hart[h];
+    printf("#Hart %-2d instret %lu, cycles %lu, CPI %.3f\n", h, (unsigned long)hart->instret,
+           (unsigned long)hart->cycle, hart->instret ? (double)hart->cycle / hart->instret : 0.0);
+  }
+  mesi_print_stats(&smp->mesi);
+}
+
+void smp_free(smp_t *smp) {
+  mesi_free(&smp->mesi);
+}
@@ -0,0 +1,55 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+#include "coherence.h"
+
+// Multi-hart emulation (-N harts[:threads[:quantum]]). Every hart runs the
+// same program from 0x1000 on the functional emulator with its own
+// registers and stack, finds its id in mhartid (and a0 at boot), and stops
+// at its exit ecall. The harts share memory through private L1 data caches
+// kept coherent with MESI (coherence.h), and charge each instruction one
+// cycle plus its coherence stalls.
+// The harts are spread over host threads that run in quanta: a thread
+// steps each of its harts until the hart's clock passes the end of the
+// quantum, then waits for the others, so no two harts drift more than a
+// quantum apart. Memory accesses, ecalls and CSR accesses go through one
+// lock, which also orders the harts' accesses for the coherence model. One
+// thread is deterministic; with more, the interleaving depends on the host.
+
+#define SMP_MAX_HARTS MESI_MAX_HARTS
+#define SMP_QUANTUM 1000         // cycles a hart runs before the harts resync
+#define SMP_STACK_BYTES 0x4000   // stack of each hart below the previous one
+
+typedef struct {
+    int id;
+    regfile_t regs;
+    uint64_t cycle;
+    uint64_t instret;
+    bool halted;
+} hart_t;
+
+typedef struct {
+    int harts;
+    int threads;
+    uint64_t quantum;
+    hart_t hart[SMP_MAX_HARTS];
+    mesi_t mesi;
+    Byte *memory;
+    pthread_mutex_t bus;         // memory, ecalls and CSRs
+    pthread_barrier_t barrier;   // end of a quantum
+    uint64_t quantum_end;
+    int running;                 // harts not halted at the last quantum boundary
+    uint64_t quanta;
+} smp_t;
+
+// Function declarations
+bool smp_configure(smp_t *smp, const char *spec);
+void smp_run(smp_t *smp, const regfile_t *boot, Byte *memory);
+uint64_t smp_instret(const smp_t *smp);
+void smp_print_stats(smp_t *smp);
+void smp_free(smp_t *smp);
+#endif // SMP_H
@@ -0,0 +1,160 @@
+#include "smt.h"
+#include <stdio.h>
+#include <string.h>
+
+smt_t smt = {0};
+
+// "threads[:rr|icount]"
+bool smt_configure(smt_t *smt, const char *spec) {
+  char policy[16] = "rr";
+  int threads = 0;
+  memset(smt, 0, sizeof(*smt));
+  if (spec == NULL || sscanf(spec, "%d:%15s", &threads, policy) < 1) {
+    return false;
+  }
+  if (threads < 2 || threads > SMT_MAX_THREADS) {
+    return false;
+  }
+  if (strcmp(policy, "rr") == 0) {
+    smt->policy = SMT_ROUND_ROBIN;
+  } else if (strcmp(policy, "icount") == 0) {
+    smt->policy = SMT_ICOUNT;
+  } else {
+    return false;
+  }
+  smt->enabled = true;
+  smt->threads = threads;
+  smt->last = threads - 1;
+  return true;
+}
+
+void smt_boot(smt_t *smt, const regfile_t *boot) {
+  for (int t = 0; t < smt->threads; t++) {
+    smt_thread_t *thread = &smt->thread[t];
+    thread->regs = *boot;
+    thread->regs.R[2] = boot->R[2] - t * SMT_STACK_BYTES;
+    thread->regs.R[10] = t;
+    thread->pc_src0 = boot->PC;
+  }
+}
+
+// Instructions of thread `tid` in a latch
+static int in_latch(bool real, uint8_t latch_tid, uint32_t second, int tid) {
+  return real && latch_tid == tid ? 1 + (second != 0) : 0;
+}
+
+// ICOUNT: instructions in flight, plus the loads still outstanding that
+// its next instructions may have to wait for
+static int in_flight(const pipeline_regs_t *pregs_p, int tid) {
+  const ifid_reg_t *ifid = &pregs_p->ifid_preg.out;
+  const idex_reg_t *idex = &pregs_p->idex_preg.out;
+  const exmem_reg_t *exmem = &pregs_p->exmem_preg.out;
+  int pending = 0;
+  for (int r = 1; r < 32; r++) {
+    pending += reg_ready_cycle[tid][r] > total_cycle_counter;
+  }
+  return pending + in_latch(!ifid->bubble && ifid->instr.bits != 0, ifid->tid, ifid->instrDUAL.bits, tid) +
+         in_latch(!idex->bubble && idex->instr.bits != 0, idex->tid, idex->instrDUAL.bits, tid) +
+         in_latch(!exmem->bubble && exmem->instr.bits != 0, exmem->tid, exmem->instrDUAL.bits, tid);
+}
+
+// The thread that fetches this cycle, -1 when all have exited. Ties (and
+// round-robin) go to the first thread after the one that fetched last. The
+// thread whose pair stalls in decode this cycle (`stalled`, -1 for none)
+// only fetches when every other thread has exited.
+int smt_select(smt_t *smt, const pipeline_regs_t *pregs_p, int stalled) {
+  int best = -1, best_count = 0;
+  for (int i = 1; i <= smt->threads; i++) {
+    int tid = (smt->last + i) % smt->threads;
+    if (smt->thread[tid].halted || tid == stalled) {
+      continue;
+    }
+    if (smt->policy == SMT_ROUND_ROBIN) {
+      best = tid;
+      break;
+    }
+    int count = in_flight(pregs_p, tid);
+    if (best < 0 || count < best_count) {
+      best = tid;
+      best_count = count;
+    }
+  }
+  if (best < 0 && stalled >= 0 && !smt->thread[stalled].halted) {
+    best = stalled;
+  }
+  if (best < 0) {
+    smt->idle++;
+    return -1;
+  }
+  smt->last = best;
+  smt->thread[best].fetches++;
+  return best;
+}
+
+// Put the thread's front end on the wires for stage_fetch
+void smt_begin_fetch(smt_t *smt, int tid, pipeline_wires_t *pwires_p) {
+  smt_thread_t *thread = &smt->thread[tid];
+  pwires_p->pc_src0 = thread->pc_src0;
+  pwires_p->fetch_size = thread->fetch_size;
+  pwires_p->PCWriteHZD = thread->refetch;
+  pwires_p->pcsrc = thread->redirect;
+  pwires_p->pc_src1 = thread->redirect_pc;
+  thread->refetch = false;
+  thread->redirect = false;
+}
+
+// Send a pair that left IF/ID without going through decode back to fetch
+void smt_replay(smt_t *smt, int tid, uint32_t pc) {
+  smt->thread[tid].redirect = true;
+  smt->thread[tid].redirect_pc = pc;
+}
+
+// Take the front end of the thread that fetched (`tid`, -1 for none) back
+// off the wires, and give a branch resolved this cycle to its thread
+void smt_end_cycle(smt_t *smt, int tid, int branch_tid, pipeline_wires_t *pwires_p) {
+  if (tid >= 0) {
+    smt_thread_t *thread = &smt->thread[tid];
+    thread->pc_src0 = pwires_p->pc_src0;
+    thread->fetch_size = pwires_p->fetch_size;
+    thread->refetch = pwires_p->PCWriteHZD;
+  }
+  if (pwires_p->pcsrc) {
+    smt->thread[branch_tid].redirect = true;
+    smt->thread[branch_tid].redirect_pc = pwires_p->pc_src1;
+    smt->thread[branch_tid].flushes++;
+  }
+  pwires_p->PCWriteHZD = 0;
+  pwires_p->pcsrc = 0;
+}
+
+void smt_retire(smt_t *smt, const memwb_reg_t *memwb_reg) {
+  if (!memwb_reg->bubble && memwb_reg->instr.bits != 0) {
+    smt->thread[memwb_reg->tid].retired += 1 + (memwb_reg->dualHazard && memwb_reg->instrDUAL.bits != 0);
+  }
+}
+
+bool smt_all_halted(const smt_t *smt) {
+  for (int t = 0; t < smt->threads; t++) {
+    if (!smt->thread[t].halted) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void smt_print_stats(smt_t *smt, uint64_t total_cycles) {
+  uint64_t retired = 0;
+  for (int t = 0; t < smt->threads; t++) {
+    retired += smt->thread[t].retired;
+  }
+  printf("#SMT threads       = %5d (%s)\n", smt->threads, smt->policy == SMT_ICOUNT ? "icount" : "rr");
+  printf("#SMT IPC           = %8.3f\n", total_cycles ? (double)retired / total_cycles : 0.0);
+  printf("#SMT idle fetches  = %5lu\n", (unsigned long)smt->idle);
+  for (int t = 0; t < smt->threads; t++) {
+    smt_thread_t *thread = &smt->thread[t];
+    printf("#Thread %d fetches %lu, retired %lu, IPC %.3f, stalls %lu, flushes %lu, squashed %lu\n", t,
+           (unsigned long)thread->fetches, (unsigned long)thread->retired,
+           total_cycles ? (double)thread->retired / total_cycles : 0.0, (unsigned long)thread->stalls,
+           (unsigned long)thread->flushes, (unsigned long)thread->squashed);
+  }
+}
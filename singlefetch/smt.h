@@ -0,0 +1,71 @@
+#ifndef SMT_H
+#define SMT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+#include "riscv.h"
+#include "pipeline.h"
+
+// Simultaneous multithreading in the pipeline (-X threads[:rr|icount]).
+// Two to four hardware threads run the program, each with its own
+// registers, PC and stack, and its id in mhartid and a0 at boot. They share
+// the pipeline and caches: every cycle the fetch policy picks the thread
+// that fetches the next pair, round-robin or the thread with the fewest
+// instructions in decode, execute and memory (ICOUNT), where a register
+// still waiting for a load miss (-M) counts as one more. Every latch carries
+// the thread of its pair, so hazards, forwarding and branch flushes only
+// act within a thread, and a flush of one thread leaves the other threads'
+// pairs in flight. A pair that has to wait in decode for a load-use stall,
+// or a second instruction held back from its pair, goes back to be fetched
+// again by its own thread while IF/ID takes the pair another thread fetched,
+// and a stalled thread only fetches when no other thread can. A thread
+// stops at its exit ecall.
+
+#define SMT_MAX_THREADS MAX_HW_THREADS
+#define SMT_STACK_BYTES 0x4000   // stack of each thread below the previous one, as for -N
+
+enum smt_policy_enum {
+  SMT_ROUND_ROBIN = 0,
+  SMT_ICOUNT
+};
+
+typedef struct {
+    regfile_t regs;
+    // front end state the pipeline wires hold while this thread fetches
+    uint32_t pc_src0;
+    uint8_t fetch_size;
+    bool refetch;              // a stall or a held second slot threw its last fetch away
+    bool redirect;             // a taken branch or a replay, fetch from redirect_pc next
+    uint32_t redirect_pc;
+    bool halted;
+
+    uint64_t fetches;          // pairs fetched
+    uint64_t retired;
+    uint64_t stalls;           // load-use stalls of its pairs in decode
+    uint64_t flushes;          // taken branches
+    uint64_t squashed;         // pairs lost to its flushes
+} smt_thread_t;
+
+typedef struct {
+    bool enabled;
+    int threads;
+    int policy;
+    int last;                  // thread that fetched last
+    smt_thread_t thread[SMT_MAX_THREADS];
+    uint64_t idle;             // cycles no thread could fetch
+} smt_t;
+
+extern smt_t smt;
+
+// Function declarations
+bool smt_configure(smt_t *smt, const char *spec);
+void smt_boot(smt_t *smt, const regfile_t *boot);
+int smt_select(smt_t *smt, const pipeline_regs_t *pregs_p, int stalled);
+void smt_begin_fetch(smt_t *smt, int tid, pipeline_wires_t *pwires_p);
+void smt_replay(smt_t *smt, int tid, uint32_t pc);
+void smt_end_cycle(smt_t *smt, int tid, int branch_tid, pipeline_wires_t *pwires_p);
+void smt_retire(smt_t *smt, const memwb_reg_t *memwb_reg);
+bool smt_all_halted(const smt_t *smt);
+void smt_print_stats(smt_t *smt, uint64_t total_cycles);
+#endif // SMT_H
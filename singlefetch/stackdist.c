@@ -0,0 +1,230 @@
+#include "stackdist.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// ADDRESS TRACE RECORDING ///
+
+FILE *sd_trace_open(const char *filename) {
+  FILE *trace = fopen(filename, "wb");
+  if (trace == NULL) {
+    return NULL;
+  }
+  uint32_t magic = SD_TRACE_MAGIC;
+  fwrite(&magic, sizeof(magic), 1, trace);
+  return trace;
+}
+
+void sd_trace_record(FILE *trace, uint32_t address) {
+  fwrite(&address, sizeof(address), 1, trace);
+}
+
+void sd_trace_close(FILE *trace) {
+  if (trace != NULL) {
+    fclose(trace);
+  }
+}
+
+/// BLOCK -> LAST ACCESS TIME MAP (open addressing) ///
+
+typedef struct {
+  uint32_t *blocks;
+  uint64_t *last;   // last access position + 1, 0 means empty slot
+  uint64_t capacity;
+  uint64_t used;
+} last_access_map_t;
+
+static void map_init(last_access_map_t *map, uint64_t capacity) {
+  map->capacity = capacity;
+  map->used = 0;
+  map->blocks = calloc(capacity, sizeof(uint32_t));
+  map->last = calloc(capacity, sizeof(uint64_t));
+}
+
+static uint64_t *map_slot(last_access_map_t *map, uint32_t block) {
+  uint64_t i = (block * 2654435761U) & (map->capacity - 1);
+  while (map->last[i] != 0 && map->blocks[i] != block) {
+    i = (i + 1) & (map->capacity - 1);
+  }
+  map->blocks[i] = block;
+  return &map->last[i];
+}
+
+static void map_grow(last_access_map_t *map) {
+  last_access_map_t bigger;
+  map_init(&bigger, map->capacity * 2);
+  for (uint64_t i = 0; i < map->capacity; i++) {
+    if (map->last[i] != 0) {
+      *map_slot(&bigger, map->blocks[i]) = map->last[i];
+      bigger.used++;
+    }
+  }
+  free(map->blocks);
+  free(map->last);
+  *map = bigger;
+}
+
+/// FENWICK TREE OVER TRACE POSITIONS ///
+
+// A position holds 1 while it is the most recent access to its block, so the
+// number of distinct blocks touched between two accesses is a range sum.
+
+static void fenwick_add(int64_t *tree, uint64_t n, uint64_t pos, int64_t delta) {
+  for (uint64_t i = pos + 1; i <= n; i += i & (-i)) {
+    tree[i] += delta;
+  }
+}
+
+static int64_t fenwick_sum(const int64_t *tree, uint64_t pos) {
+  int64_t sum = 0;
+  for (uint64_t i = pos + 1; i > 0; i -= i & (-i)) {
+    sum += tree[i];
+  }
+  return sum;
+}
+
+static int log2_bucket(uint64_t distance) {
+  int bucket = 0;
+  while (distance > 0 && bucket < SD_REUSE_BUCKETS - 1) {
+    distance >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+/// ANALYSIS ///
+
+int sd_analyze(const char *filename, int blockBits) {
+  FILE *trace = fopen(filename, "rb");
+  if (trace == NULL) {
+    fprintf(stderr, "Cannot open address trace %s\n", filename);
+    return -1;
+  }
+  uint32_t magic = 0;
+  if (fread(&magic, sizeof(magic), 1, trace) != 1 || magic != SD_TRACE_MAGIC) {
+    fprintf(stderr, "%s is not an address trace (record one with -W)\n", filename);
+    fclose(trace);
+    return -1;
+  }
+  fseek(trace, 0, SEEK_END);
+  uint64_t n = (ftell(trace) - sizeof(magic)) / sizeof(uint32_t);
+  fseek(trace, sizeof(magic), SEEK_SET);
+  uint32_t *addresses = malloc((n ? n : 1) * sizeof(uint32_t));
+  n = fread(addresses, sizeof(uint32_t), n, trace);
+  fclose(trace);
+
+  // per set-count LRU stacks, truncated at SD_MAX_WAYS entries
+  uint32_t *stacks[SD_MAX_SET_BITS + 1];
+  uint8_t *depths[SD_MAX_SET_BITS + 1];
+  uint64_t hits_at[SD_MAX_SET_BITS + 1][SD_MAX_WAYS];
+  memset(hits_at, 0, sizeof(hits_at));
+  for (int s = 0; s <= SD_MAX_SET_BITS; s++) {
+    stacks[s] = calloc((size_t)SD_MAX_WAYS << s, sizeof(uint32_t));
+    depths[s] = calloc((size_t)1 << s, sizeof(uint8_t));
+  }
+
+  // fully associative reuse distances
+  uint64_t reuse_hist[SD_REUSE_BUCKETS];
+  memset(reuse_hist, 0, sizeof(reuse_hist));
+  uint64_t cold = 0;
+  int64_t *fenwick = calloc(n + 1, sizeof(int64_t));
+  last_access_map_t last_access;
+  map_init(&last_access, 1024);
+
+  for (uint64_t t = 0; t < n; t++) {
+    uint32_t block = addresses[t] >> blockBits;
+
+    for (int s = 0; s <= SD_MAX_SET_BITS; s++) {
+      uint32_t set = block & ((1U << s) - 1);
+      uint32_t *stack = &stacks[s][(size_t)set * SD_MAX_WAYS];
+      int depth = depths[s][set];
+      int pos = 0;
+      while (pos < depth && stack[pos] != block) {
+        pos++;
+      }
+      if (pos < depth) {
+        hits_at[s][pos]++;
+      } else if (depth < SD_MAX_WAYS) {
+        depths[s][set]++;
+      } else {
+        pos = SD_MAX_WAYS - 1; // falls off the bottom of the tracked stack
+      }
+      memmove(&stack[1], &stack[0], pos * sizeof(uint32_t));
+      stack[0] = block;
+    }
+
+    if (last_access.used * 2 >= last_access.capacity) {
+      map_grow(&last_access);
+    }
+    uint64_t *last = map_slot(&last_access, block);
+    if (*last == 0) {
+      cold++;
+      last_access.used++;
+    } else {
+      uint64_t prev = *last - 1;
+      uint64_t distance = fenwick_sum(fenwick, t) - fenwick_sum(fenwick, prev);
+      reuse_hist[log2_bucket(distance)]++;
+      fenwick_add(fenwick, n, prev, -1);
+    }
+    fenwick_add(fenwick, n, t, 1);
+    *last = t + 1;
+  }
+
+  printf("Stack distance analysis of %s\n", filename);
+  printf("#Accesses          = %5lu\n", (unsigned long)n);
+  printf("#Unique blocks     = %5lu\n", (unsigned long)cold);
+  printf("Block size         = %5d bytes\n\n", 1 << blockBits);
+
+  printf("LRU miss ratios\n");
+  printf("%6s %5s %10s %10s %10s\n", "sets", "ways", "bytes", "misses", "ratio");
+  for (int s = 0; s <= SD_MAX_SET_BITS; s++) {
+    uint64_t hits = 0;
+    for (int w = 1; w <= SD_MAX_WAYS; w++) {
+      hits += hits_at[s][w - 1];
+      uint64_t misses = n - hits;
+      printf("%6d %5d %10lu %10lu %10.4f\n", 1 << s, w,
+             ((unsigned long)w << s) << blockBits, (unsigned long)misses,
+             n ? (double)misses / n : 0.0);
+    }
+  }
+
+  printf("\nReuse distance histogram (distinct blocks between reuses)\n");
+  printf("%12s %10s\n", "distance", "count");
+  printf("%12s %10lu\n", "cold", (unsigned long)cold);
+  for (int b = 0; b < SD_REUSE_BUCKETS; b++) {
+    if (reuse_hist[b] == 0) {
+      continue;
+    }
+    uint64_t lo = b == 0 ? 0 : 1ULL << (b - 1);
+    uint64_t hi = b == 0 ? 0 : (1ULL << b) - 1;
+    char range[32];
+    snprintf(range, sizeof(range), "%lu-%lu", (unsigned long)lo, (unsigned long)hi);
+    printf("%12s %10lu\n", range, (unsigned long)reuse_hist[b]);
+  }
+
+  // a block hits in a fully associative LRU cache of C blocks iff its reuse
+  // distance is below C; power-of-two capacities line up with the buckets
+  printf("\nFully associative LRU miss ratios\n");
+  printf("%10s %10s %10s\n", "bytes", "misses", "ratio");
+  uint64_t hits = 0;
+  for (int b = 0; b < SD_REUSE_BUCKETS; b++) {
+    hits += reuse_hist[b];
+    uint64_t blocks = 1ULL << b;
+    uint64_t misses = n - hits;
+    printf("%10lu %10lu %10.4f\n", (unsigned long)(blocks << blockBits),
+           (unsigned long)misses, n ? (double)misses / n : 0.0);
+    if (blocks >= cold) {
+      break;
+    }
+  }
+
+  for (int s = 0; s <= SD_MAX_SET_BITS; s++) {
+    free(stacks[s]);
+    free(depths[s]);
+  }
+  free(fenwick);
+  free(last_access.blocks);
+  free(last_access.last);
+  free(addresses);
+  return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Single-pass cache sizing: the data address stream is recorded once during a
+// "-s -c" run (-W <file>) and later replayed by "-A <file>", which uses
+// Mattson stack distances to report LRU miss ratios for every set count and
+// associativity at once, plus a reuse-distance histogram.
+
+#define SD_TRACE_MAGIC 0x54415652 // "RVAT", little endian
+#define SD_MAX_SET_BITS 10        // set counts 1 .. 2^SD_MAX_SET_BITS
+#define SD_MAX_WAYS 16            // associativities 1 .. SD_MAX_WAYS
+#define SD_REUSE_BUCKETS 24       // log2 buckets of the reuse histogram
+
+FILE *sd_trace_open(const char *filename);
+void sd_trace_record(FILE *trace, uint32_t address);
+void sd_trace_close(FILE *trace);
+int sd_analyze(const char *filename, int blockBits);
+
+#endif // STACKDIST_H
@@ -4,6 +4,73 @@
 #include <stdio.h>
 #include "utils.h"
 #include "pipeline.h"
+#include "csr.h"
+#include "profile.h"
+#include "cpistack.h"
+#include "pipeview.h"
+#include "fu.h"
+#include "fetchq.h"
+#include "storebuf.h"
+#include "smt.h"
+#include "watch.h"
+
+/// FETCH STAGE HELPERS ///
+
+// Read the instruction at `addr` and its size. A compressed instruction is
+// expanded to its 32-bit form, so decode never sees the 16-bit encodings.
+// Anything that does not expand (such as the zeros past the program) is
+// passed on as a 32-bit word, as before the C extension.
+uint32_t fetch_instruction(Byte* memory_p, uint32_t addr, uint8_t* size)
+{
+  uint32_t bits = *(uint32_t *)(memory_p + addr);
+  if (instruction_size(bits) == 2) {
+    uint32_t expanded = expand_compressed(bits & 0xFFFF);
+    if (expanded != 0) {
+      *size = 2;
+      return expanded;
+    }
+  }
+  *size = 4;
+  return bits;
+}
+
+// Fetch the line holding `addr` through the instruction cache, returns the
+// cycles the fill takes beyond a hit. With the fetch buffer enabled a line
+// that is already buffered is served without another cache access.
+uint64_t fetch_line(Cache* icache_p, uint32_t addr)
+{
+  unsigned long long block_addr = address_to_block(addr, icache_p);
+  if (sim_config.fetch_buffer && fetch_buffer.valid && fetch_buffer.block_addr == block_addr) {
+    fetch_buffer_hits++;
+    return 0;
+  }
+
+  int latency = processCacheOperation(addr, icache_p);
+  fetch_buffer.valid = true;
+  fetch_buffer.block_addr = block_addr;
+  if (latency <= CACHE_HIT_LATENCY) {
+    return 0;
+  }
+
+  #ifdef DEBUG_CYCLE
+  printf("[IF ]: I-cache miss at addr: 0x%08x: %d cycles\n", addr, latency - CACHE_HIT_LATENCY);
+  #endif
+  return latency - CACHE_HIT_LATENCY;
+}
+
+// Stall fetch for `cycles` on behalf of the instruction at `addr`
+void fetch_stall(uint32_t addr, uint64_t cycles)
+{
+  if (cycles == 0) {
+    return;
+  }
+  total_cycle_counter += cycles;
+  fetch_stall_counter += cycles;
+  cpi_charge(CPI_FRONTEND, cycles);
+  if (profile.enabled) {
+    prof_charge(addr, PROF_FETCH_STALLS, cycles);
+  }
+}
 
 /// EXECUTE STAGE HELPERS ///
 
@@ -14,7 +81,7 @@ uint32_t gen_alu_control(idex_reg_t idex_reg)
     case 0x0: // lw or sw
       alu_control = 0x2; // add
       break;
-    case 0x1: // beq or bne
+    case 0x1: // branches (the outcome comes from gen_branch)
       alu_control = 0x6; // subtract
       break;
     case 0x2: // R-type
@@ -36,23 +103,48 @@ uint32_t gen_alu_control(idex_reg_t idex_reg)
           }
           break;
         case 0x2: 
-          alu_control = 0x8; // slt
+          if (idex_reg.funct7 == 0x01) {
+            alu_control = 0x4; // mulhsu
+          } else {
+            alu_control = 0x8; // slt
+          }
+          break;
+        case 0x3: 
+          if (idex_reg.funct7 == 0x01) {
+            alu_control = 0x5; // mulhu
+          } else {
+            alu_control = 0x3; // sltu
+          }
           break;
         case 0x4: 
-          alu_control = 0x9; // xor
+          if (idex_reg.funct7 == 0x01) {
+            alu_control = 0x10; // div
+          } else {
+            alu_control = 0x9; // xor
+          }
           break;
         case 0x5:
           if (idex_reg.funct7 == 0x0) {
             alu_control = 0xA; // srl
           } else if (idex_reg.funct7 == 0x20) {
             alu_control = 0xB; // sra
+          } else if (idex_reg.funct7 == 0x01) {
+            alu_control = 0x11; // divu
           }
           break;
         case 0x6: 
-          alu_control = 0x1; // or
+          if (idex_reg.funct7 == 0x01) {
+            alu_control = 0x12; // rem
+          } else {
+            alu_control = 0x1; // or
+          }
           break;
         case 0x7: 
-          alu_control = 0x0; // and
+          if (idex_reg.funct7 == 0x01) {
+            alu_control = 0x13; // remu
+          } else {
+            alu_control = 0x0; // and
+          }
           break;
         default:
           break;
@@ -69,6 +161,9 @@ uint32_t gen_alu_control(idex_reg_t idex_reg)
         case 0x2: 
           alu_control = 0x8; // slti
           break;
+        case 0x3: 
+          alu_control = 0x3; // sltiu
+          break;
         case 0x4: 
           alu_control = 0x9; // xori
           break;
@@ -93,8 +188,12 @@ uint32_t gen_alu_control(idex_reg_t idex_reg)
       alu_control = 0xE;
       break;
     case 0x5: // jal
+    case 0x6: // jalr, the link address (the target is added in execute)
       alu_control = 0xF;
       break;
+    case 0x7: // auipc
+      alu_control = 0x14;
+      break;
     default:
         break;
   }
@@ -117,8 +216,17 @@ uint32_t execute_alu(uint32_t alu_inp1, uint32_t alu_inp2, uint32_t alu_control)
     case 0x6: // sub
       result = alu_inp1 - alu_inp2;
       break;
+    case 0x3: // sltu
+      result = alu_inp1 < alu_inp2 ? 1 : 0;
+      break;
+    case 0x4: // mulhsu
+      result = ((int64_t)(int32_t)alu_inp1 * (int64_t)alu_inp2) >> 32;
+      break;
+    case 0x5: // mulhu
+      result = ((uint64_t)alu_inp1 * (uint64_t)alu_inp2) >> 32;
+      break;
     case 0x7: // sll
-      result = alu_inp1 << alu_inp2;
+      result = alu_inp1 << (alu_inp2 & 0x1F);
       break;
     case 0x8: // slt
       result = (int32_t)alu_inp1 < (int32_t)alu_inp2 ? 1 : 0;
@@ -127,16 +235,16 @@ uint32_t execute_alu(uint32_t alu_inp1, uint32_t alu_inp2, uint32_t alu_control)
       result = alu_inp1 ^ alu_inp2;
       break;
     case 0xA: // srl
-      result = alu_inp1 >> alu_inp2;
+      result = alu_inp1 >> (alu_inp2 & 0x1F);
       break;
     case 0xB: // sra
-      result = (int32_t)alu_inp1 >> alu_inp2;
+      result = (int32_t)alu_inp1 >> (alu_inp2 & 0x1F);
       break;
     case 0xC: // mul
       result = alu_inp1 * alu_inp2;
       break;
     case 0xD: // mulh
-      result = ((uint64_t)alu_inp1 * (uint64_t)alu_inp2) >> 32;
+      result = ((int64_t)(int32_t)alu_inp1 * (int64_t)(int32_t)alu_inp2) >> 32;
       break;
     case 0xE: // lui
       result = alu_inp2 << 12;
@@ -144,6 +252,21 @@ uint32_t execute_alu(uint32_t alu_inp1, uint32_t alu_inp2, uint32_t alu_control)
     case 0xF: // jal
       result = alu_inp1 + 4;
       break;
+    case 0x10: // div
+      result = divide(alu_inp1, alu_inp2, 1, 0);
+      break;
+    case 0x11: // divu
+      result = divide(alu_inp1, alu_inp2, 0, 0);
+      break;
+    case 0x12: // rem
+      result = divide(alu_inp1, alu_inp2, 1, 1);
+      break;
+    case 0x13: // remu
+      result = divide(alu_inp1, alu_inp2, 0, 1);
+      break;
+    case 0x14: // auipc
+      result = alu_inp1 + (alu_inp2 << 12);
+      break;
     default:
       result = 0xBADCAFFE;
       break;
@@ -151,6 +274,25 @@ uint32_t execute_alu(uint32_t alu_inp1, uint32_t alu_inp2, uint32_t alu_control)
   return result;
 }
 
+/// MEMORY STAGE HELPERS ///
+
+// csrrw/csrrs/csrrc and the immediate forms (ecall shares the opcode)
+bool is_csr(Instruction instruction)
+{
+  return instruction.opcode == 0x73 && instruction.itype.funct3 != 0;
+}
+
+// Performs the CSR access and returns the old value for rd
+uint32_t access_csr(Instruction instruction, uint32_t rs1_val)
+{
+  uint32_t old_value;
+  if (!csr_execute(instruction, rs1_val, &old_value)) {
+    handle_invalid_instruction(instruction);
+    exit(-1);
+  }
+  return old_value;
+}
+
 /// DECODE STAGE HELPERS ///
 
 uint32_t gen_imm(Instruction instruction)
@@ -159,12 +301,14 @@ uint32_t gen_imm(Instruction instruction)
   switch(instruction.opcode) {
     case 0x03: // L-type
     case 0x13: // I-type
+    case 0x67: // jalr
         imm_val = sign_extend_number(instruction.itype.imm,12); 
         break;
     case 0x23: // S-type
-        imm_val = get_store_offset(instruction);
+        imm_val = sign_extend_number(get_store_offset(instruction), 12);
         break;
     case 0x37: // U-type
+    case 0x17: // auipc
         imm_val = instruction.utype.imm;
         break;
     case 0x6f: // UJ-type
@@ -238,6 +382,24 @@ idex_reg_t gen_control(Instruction instruction1, Instruction instruction2)
       idex_reg.Mem_Write = 0;
       idex_reg.Reg_Write = 1;
       break;
+    case 0x67: // jalr
+      idex_reg.ALUOp = 0x6;
+      idex_reg.ALUSrc = 1;
+      idex_reg.Branch = 1;
+      idex_reg.Mem_Read = 0;
+      idex_reg.Memto_Reg = 0;
+      idex_reg.Mem_Write = 0;
+      idex_reg.Reg_Write = 1;
+      break;
+    case 0x17: // auipc
+      idex_reg.ALUOp = 0x7;
+      idex_reg.ALUSrc = 1;
+      idex_reg.Branch = 0;
+      idex_reg.Mem_Read = 0;
+      idex_reg.Memto_Reg = 0;
+      idex_reg.Mem_Write = 0;
+      idex_reg.Reg_Write = 1;
+      break;
     case 0x63: // SB-type
       idex_reg.ALUOp = 0x1;
       idex_reg.ALUSrc = 0;
@@ -245,6 +407,10 @@ idex_reg_t gen_control(Instruction instruction1, Instruction instruction2)
       idex_reg.Mem_Read = 0;
       idex_reg.Mem_Write = 0;
       idex_reg.Reg_Write = 0;
+      break;
+    case 0x73: // Zicsr (ecall writes no register)
+      idex_reg.Reg_Write = is_csr(instruction1);
+      break;
     default:  // Remaining opcodes
       break;
   }
@@ -303,6 +469,24 @@ idex_reg_t gen_control(Instruction instruction1, Instruction instruction2)
       idex_reg.Mem_WriteDUAL = 0;
       idex_reg.Reg_WriteDUAL = 1;
       break;
+    case 0x67: // jalr
+      idex_reg.ALUOpDUAL = 0x6;
+      idex_reg.ALUSrcDUAL = 1;
+      idex_reg.BranchDUAL = 1;
+      idex_reg.Mem_ReadDUAL = 0;
+      idex_reg.Memto_RegDUAL = 0;
+      idex_reg.Mem_WriteDUAL = 0;
+      idex_reg.Reg_WriteDUAL = 1;
+      break;
+    case 0x17: // auipc
+      idex_reg.ALUOpDUAL = 0x7;
+      idex_reg.ALUSrcDUAL = 1;
+      idex_reg.BranchDUAL = 0;
+      idex_reg.Mem_ReadDUAL = 0;
+      idex_reg.Memto_RegDUAL = 0;
+      idex_reg.Mem_WriteDUAL = 0;
+      idex_reg.Reg_WriteDUAL = 1;
+      break;
     case 0x63: // SB-type
       idex_reg.ALUOpDUAL = 0x1;
       idex_reg.ALUSrcDUAL = 0;
@@ -310,6 +494,10 @@ idex_reg_t gen_control(Instruction instruction1, Instruction instruction2)
       idex_reg.Mem_ReadDUAL = 0;
       idex_reg.Mem_WriteDUAL = 0;
       idex_reg.Reg_WriteDUAL = 0;
+      break;
+    case 0x73: // Zicsr (ecall writes no register)
+      idex_reg.Reg_WriteDUAL = is_csr(instruction2);
+      break;
     default:  // Remaining opcodes
       break;
   }
@@ -321,115 +509,309 @@ idex_reg_t gen_control(Instruction instruction1, Instruction instruction2)
 // Evaluates whether a branch must be taken
 bool gen_branch(uint32_t alu1, uint32_t alu2, uint32_t funct3)
 {
-  // Return true if bne or beq outcome is true and false otherwise
-  if(alu1 == alu2 && (funct3 == 0x0))
-  {
-    return true;
+  switch (funct3) {
+    case 0x0: // beq
+      return alu1 == alu2;
+    case 0x1: // bne
+      return alu1 != alu2;
+    case 0x4: // blt
+      return (int32_t)alu1 < (int32_t)alu2;
+    case 0x5: // bge
+      return (int32_t)alu1 >= (int32_t)alu2;
+    case 0x6: // bltu
+      return alu1 < alu2;
+    case 0x7: // bgeu
+      return alu1 >= alu2;
+    default:
+      return false;
   }
-  else if(alu1 != alu2 && (funct3 == 0x1))
-  {
-    return true;
+}
+
+/// PIPELINE FEATURES ///
+
+// Register and value a writeback slot writes, false if it writes nothing
+bool wb_result(memwb_reg_t* memwb, bool dual, uint8_t* rd, uint32_t* value)
+{
+  bool reg_write = dual ? (memwb->dualHazard && memwb->Reg_WriteDUAL) : memwb->Reg_Write;
+  *rd = dual ? memwb->rdDUAL : memwb->rd;
+  if (dual) {
+    *value = memwb->Memto_RegDUAL ? memwb->Read_DataDUAL : memwb->Read_AddressDUAL;
+  } else {
+    *value = memwb->Memto_Reg ? memwb->Read_Data : memwb->Read_Address;
+  }
+  return reg_write && *rd != 0;
+}
+
+// Where an operand of the pair in execute comes from: 0x2 for a result in
+// EX/MEM, 0x1 for one in MEM/WB, 0x0 for the register file. Either slot of
+// an older pair can produce it, the younger result wins, and results only go
+// to instructions of the same hardware thread (-X).
+uint32_t forward_source(pipeline_regs_t* pregs_p, uint8_t rs, uint32_t* value)
+{
+  if (rs == 0) {
+    return 0x0;
+  }
+  exmem_reg_t* exmem = &pregs_p->exmem_preg.out;
+  if (exmem->tid == pregs_p->idex_preg.out.tid) {
+    if (exmem->dualHazard && exmem->Reg_WriteDUAL && exmem->rdDUAL == rs) {
+      *value = exmem->Read_AddressDUAL;
+      return 0x2;
+    }
+    if (exmem->Reg_Write && exmem->rd == rs) {
+      *value = exmem->Read_Address;
+      return 0x2;
+    }
   }
-  else{
-    return false;
+  if (pregs_p->memwb_preg.out.tid == pregs_p->idex_preg.out.tid) {
+    for (int slot = 1; slot >= 0; slot--) {
+      uint8_t rd;
+      if (wb_result(&pregs_p->memwb_preg.out, slot, &rd, value) && rd == rs) {
+        return 0x1;
+      }
+    }
   }
+  return 0x0;
 }
 
-/// PIPELINE FEATURES ///
+// Operand MUXes of one slot in execute, a store keeps its data in
+// Write_Address once its address operands are forwarded
+void forward_operands(uint32_t forwardA, uint32_t forwardB, uint32_t valueA, uint32_t valueB, bool ALUSrc,
+                      uint32_t imm, uint32_t* rs1_val, uint32_t* rs2_val, uint32_t* Write_Address)
+{
+  //MUX for first ALU operand
+  if (forwardA) {
+    *rs1_val = valueA;
+    if (ALUSrc) { // store instruction
+      *Write_Address = *rs2_val;
+      *rs2_val = imm;
+    }
+  }
+
+  //MUX for second ALU operand
+  if (forwardB) {
+    *rs2_val = valueB;
+    if (ALUSrc) { // store instruction
+      *Write_Address = *rs2_val;
+      *rs2_val = imm;
+    }
+  }
+}
 
 void gen_forward(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p)
 {
+  idex_reg_t* idex = &pregs_p->idex_preg.out;
+  uint32_t valueA = 0, valueB = 0;
+
   //By defualt, set both to 0. If there is no need for forwarding, A and B will exit function with value of 0
-  pwires_p->forwardA = 0x0;
-  pwires_p->forwardB = 0x0;
+  pwires_p->forwardA = forward_source(pregs_p, idex->rs1, &valueA);
+  pwires_p->forwardB = forward_source(pregs_p, idex->rs2, &valueB);
 
-  if(pregs_p->exmem_preg.out.Reg_Write && (pregs_p->exmem_preg.out.rd != 0)){
-    if(pregs_p->exmem_preg.out.rd == pregs_p->idex_preg.out.rs1){
+  #ifdef DEBUG_CYCLE
+  if (pwires_p->forwardA) {
+    printf("[FWD]: Resolving %s hazard on rs1: x%d\n", pwires_p->forwardA == 0x2 ? "EX" : "MEM", idex->rs1);
+  }
+  if (pwires_p->forwardB) {
+    printf("[FWD]: Resolving %s hazard on rs2: x%d\n", pwires_p->forwardB == 0x2 ? "EX" : "MEM", idex->rs2);
+  }
+  #endif
 
-      #ifdef DEBUG_CYCLE
-      printf("[FWD]: Resolving EX hazard on rs1: x%d\n", pregs_p->idex_preg.out.rs1);
-      #endif
+  forward_operands(pwires_p->forwardA, pwires_p->forwardB, valueA, valueB, idex->ALUSrc, idex->imm,
+                   &idex->rs1_val, &idex->rs2_val, &idex->Write_Address);
+}
 
-      pwires_p->forwardA = 0x2;
-    }
-    if(pregs_p->exmem_preg.out.rd == pregs_p->idex_preg.out.rs2){
+// Register usage by opcode, used by the scoreboard
+bool reads_rs1(Instruction instruction)
+{
+  switch(instruction.opcode) {
+    case 0x33: case 0x13: case 0x03: case 0x23: case 0x63: case 0x67: case 0x73:
+      return true;
+    default:
+      return false;
+  }
+}
 
-      #ifdef DEBUG_CYCLE
-      printf("[FWD]: Resolving EX hazard on rs2: x%d\n", pregs_p->idex_preg.out.rs2);
-      #endif
+bool reads_rs2(Instruction instruction)
+{
+  switch(instruction.opcode) {
+    case 0x33: case 0x23: case 0x63:
+      return true;
+    default:
+      return false;
+  }
+}
 
-      pwires_p->forwardB = 0x2;
-    }
+// True if the instruction reads register `reg`, never for x0
+bool reads_reg(Instruction instruction, uint32_t reg)
+{
+  return reg != 0 && ((reads_rs1(instruction) && instruction.rtype.rs1 == reg) ||
+                      (reads_rs2(instruction) && instruction.rtype.rs2 == reg));
+}
+
+bool writes_rd(Instruction instruction)
+{
+  switch(instruction.opcode) {
+    case 0x33: case 0x13: case 0x03: case 0x37: case 0x17: case 0x6f: case 0x67: case 0x73:
+      return true;
+    default:
+      return false;
   }
-  if(pregs_p->memwb_preg.out.Reg_Write && (pregs_p->memwb_preg.out.rd != 0)){
-    if ((pregs_p->memwb_preg.out.rd == pregs_p->idex_preg.out.rs1) &&
-     !(pregs_p->exmem_preg.out.Reg_Write && (pregs_p->exmem_preg.out.rd != 0) && (pregs_p->exmem_preg.out.rd == pregs_p->idex_preg.out.rs1))){
-      
-      #ifdef DEBUG_CYCLE
-      printf("[FWD]: Resolving MEM hazard on rs1: x%d\n", pregs_p->idex_preg.out.rs1);
-      #endif
+}
 
-      pwires_p->forwardA = 0x1;
-    }
-    if ((pregs_p->memwb_preg.out.rd == pregs_p->idex_preg.out.rs2) &&
-     !(pregs_p->exmem_preg.out.Reg_Write && (pregs_p->exmem_preg.out.rd != 0) && (pregs_p->exmem_preg.out.rd == pregs_p->idex_preg.out.rs2))){
-      
-      #ifdef DEBUG_CYCLE
-      printf("[FWD]: Resolving MEM hazard on rs2: x%d\n", pregs_p->idex_preg.out.rs2);
-      #endif
-
-      pwires_p->forwardB = 0x1;
-    }
+// Cycles until every register the instruction reads or writes is no longer
+// waiting on an outstanding load (non-blocking cache only). Each hardware
+// thread (-X) has its own registers to wait on.
+uint64_t scoreboard_wait(Instruction instruction, uint8_t tid)
+{
+  uint64_t* reg_ready = reg_ready_cycle[tid];
+  uint64_t ready = 0;
+  if (reads_rs1(instruction) && instruction.rtype.rs1 != 0 && reg_ready[instruction.rtype.rs1] > ready) {
+    ready = reg_ready[instruction.rtype.rs1];
+  }
+  if (reads_rs2(instruction) && instruction.rtype.rs2 != 0 && reg_ready[instruction.rtype.rs2] > ready) {
+    ready = reg_ready[instruction.rtype.rs2];
+  }
+  if (writes_rd(instruction) && instruction.rtype.rd != 0 && reg_ready[instruction.rtype.rd] > ready) {
+    ready = reg_ready[instruction.rtype.rd];
   }
+  return ready > total_cycle_counter ? ready - total_cycle_counter : 0;
+}
 
-  //MUX for first ALU operand
-  if (pwires_p->forwardA == 0x2) {
-    pregs_p->idex_preg.out.rs1_val = pregs_p->exmem_preg.out.Read_Address;
-    if (pregs_p->idex_preg.out.ALUSrc) { // store instruction
-      pregs_p->idex_preg.out.Write_Address = pregs_p->idex_preg.out.rs2_val;
-      pregs_p->idex_preg.out.rs2_val = pregs_p->idex_preg.out.imm;
-    }
-  } 
-  else if (pwires_p->forwardA == 0x1) {
-    if (pregs_p->memwb_preg.out.Memto_Reg) { // load instruction
-      pregs_p->idex_preg.out.rs1_val = pregs_p->memwb_preg.out.Read_Data;
-    } 
-    else {
-      pregs_p->idex_preg.out.rs1_val = pregs_p->memwb_preg.out.Read_Address;
-    }
-    if (pregs_p->idex_preg.out.ALUSrc) { // store instruction
-      pregs_p->idex_preg.out.Write_Address = pregs_p->idex_preg.out.rs2_val;
-      pregs_p->idex_preg.out.rs2_val = pregs_p->idex_preg.out.imm;
+// Charge the wait for a pair of instructions that use a pending load result
+void scoreboard_stall(Instruction instruction1, Instruction instruction2, uint32_t pc, uint8_t tid)
+{
+  uint64_t wait = scoreboard_wait(instruction1, tid);
+  uint64_t waitDUAL = scoreboard_wait(instruction2, tid);
+  if (waitDUAL > wait) {
+    wait = waitDUAL;
+  }
+  if (wait > 0) {
+    total_cycle_counter += wait;
+    pending_load_stall_counter += wait;
+    cpi_charge(CPI_CACHE_MISS, wait);
+    if (profile.enabled) {
+      prof_charge(pc, PROF_LOAD_WAIT_STALLS, wait);
     }
+
+    #ifdef DEBUG_CYCLE
+    printf("[HZD]: Waiting %lu cycles for outstanding load\n", wait);
+    #endif
   }
+}
 
-  //MUX for second ALU operand
-  if (pwires_p->forwardB == 0x2) {
-    pregs_p->idex_preg.out.rs2_val = pregs_p->exmem_preg.out.Read_Address;
-    if (pregs_p->idex_preg.out.ALUSrc) { // store instruction
-      pregs_p->idex_preg.out.Write_Address = pregs_p->idex_preg.out.rs2_val;
-      pregs_p->idex_preg.out.rs2_val = pregs_p->idex_preg.out.imm;
-    }
-  } 
-  else if (pwires_p->forwardB == 0x1) {
-    if (pregs_p->memwb_preg.out.Memto_Reg) { // load instruction
-      pregs_p->idex_preg.out.rs2_val = pregs_p->memwb_preg.out.Read_Data;
-    } 
-    else {
-      pregs_p->idex_preg.out.rs2_val = pregs_p->memwb_preg.out.Read_Address;
-    }
-    if (pregs_p->idex_preg.out.ALUSrc) { // store instruction
-      pregs_p->idex_preg.out.Write_Address = pregs_p->idex_preg.out.rs2_val;
-      pregs_p->idex_preg.out.rs2_val = pregs_p->idex_preg.out.imm;
+// Issue one instruction to its functional unit, returns the cycles it waited
+uint64_t fu_issue_instruction(Instruction instruction, int tid, uint64_t now)
+{
+  if (instruction.bits == 0) {
+    return 0;
+  }
+  uint32_t uses = 0;
+  if (reads_rs1(instruction)) {
+    uses |= 1u << instruction.rtype.rs1;
+  }
+  if (reads_rs2(instruction)) {
+    uses |= 1u << instruction.rtype.rs2;
+  }
+  int rd = writes_rd(instruction) ? instruction.rtype.rd : 0;
+  uses |= 1u << rd;
+  return fu_issue(&fu_pool, fu_kind(instruction), tid, uses, rd, now);
+}
+
+// The pair that just executed waits for its operands and units (-U). The
+// whole pipeline stands still meanwhile, which is the same as holding the
+// pair in decode until the scoreboard lets it go.
+void fu_stall(exmem_reg_t exmem_reg)
+{
+  if (exmem_reg.bubble) {
+    return;
+  }
+  uint64_t wait = fu_issue_instruction(exmem_reg.instr, exmem_reg.tid, total_cycle_counter);
+  if (exmem_reg.dualHazard) {
+    wait += fu_issue_instruction(exmem_reg.instrDUAL, exmem_reg.tid, total_cycle_counter + wait);
+  }
+  if (wait > 0) {
+    total_cycle_counter += wait;
+    fu_stall_counter += wait;
+    cpi_charge(CPI_FUNCTIONAL_UNIT, wait);
+    if (profile.enabled) {
+      prof_charge(exmem_reg.instr_addr, PROF_FU_STALLS, wait);
     }
+
+    #ifdef DEBUG_CYCLE
+    printf("[FU]: Waiting %lu cycles for operands or a functional unit\n", wait);
+    #endif
+  }
+}
+
+/// MEMORY STAGE HELPERS ///
+
+// The MEM stage waits `cycles` for the store buffer on behalf of `pc`
+void store_buffer_stall(uint32_t pc, uint64_t cycles)
+{
+  if (cycles == 0) {
+    return;
+  }
+  total_cycle_counter += cycles;
+  mem_stall_counter += cycles;
+  cpi_charge(CPI_CACHE_MISS, cycles);
+  if (profile.enabled) {
+    prof_charge(pc, PROF_MEM_STALLS, cycles);
+  }
+
+  #ifdef DEBUG_CYCLE
+  printf("[MEM]: Waiting %lu cycles for the store buffer\n", cycles);
+  #endif
+}
+
+// Data loads and stores, through the store buffer when there is one (-O).
+// `forwarded` tells the caller a buffered store supplied the data, and a
+// watchpoint hit (-w) names `pc`.
+Word mem_load(Byte* memory_p, Address addr, Alignment size, uint32_t pc, bool* forwarded)
+{
+  watch.pc = pc;
+  watch.addr = addr;
+  watch.size = size;
+  if (!store_buffer.enabled) {
+    return load(memory_p, addr, size);
   }
+  Word value;
+  store_buffer_stall(pc, sb_load(&store_buffer, memory_p, addr, size, total_cycle_counter, &value, forwarded));
+  return value;
+}
+
+void mem_store(Byte* memory_p, Address addr, Alignment size, Word value, uint32_t pc)
+{
+  watch.pc = pc;
+  watch.addr = addr;
+  watch.size = size;
+  if (!store_buffer.enabled) {
+    store(memory_p, addr, size, value);
+    return;
+  }
+  store_buffer_stall(pc, sb_store(&store_buffer, memory_p, addr, size, value, pc, total_cycle_counter));
+}
+
+// True if the pair in IF/ID reads what a load in ID/EX has yet to load.
+// CSR results, like loads, only exist after the MEM stage. Only an
+// instruction of the same hardware thread can depend on them (-X).
+bool load_use_hazard(const pipeline_regs_t* pregs_p)
+{
+  const idex_reg_t* idex = &pregs_p->idex_preg.out;
+  const ifid_reg_t* ifid = &pregs_p->ifid_preg.out;
+  bool late = idex->Mem_Read || (idex->Reg_Write && is_csr(idex->instr));
+  bool lateDUAL = idex->dual_block == DUAL_ISSUED &&
+                  (idex->Mem_ReadDUAL || (idex->Reg_WriteDUAL && is_csr(idex->instrDUAL)));
+  return idex->tid == ifid->tid &&
+         ((late && (reads_reg(ifid->instr, idex->rd) || reads_reg(ifid->instrDUAL, idex->rd))) ||
+          (lateDUAL && (reads_reg(ifid->instr, idex->rdDUAL) || reads_reg(ifid->instrDUAL, idex->rdDUAL))));
 }
 
 void detect_hazard(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, regfile_t* regfile_p)
 {
-  if (pregs_p->idex_preg.out.Mem_Read &&
-    ((pregs_p->idex_preg.out.rd == pregs_p->ifid_preg.out.rs1) || 
-    (pregs_p->idex_preg.out.rd == pregs_p->ifid_preg.out.rs2))) {
+  // Hold decode until pending loads that either instruction depends on return
+  scoreboard_stall(pregs_p->ifid_preg.out.instr, pregs_p->ifid_preg.out.instrDUAL, pregs_p->ifid_preg.out.instr_addr,
+                   pregs_p->ifid_preg.out.tid);
+
+  if (load_use_hazard(pregs_p)) {
 
     // Stop PC and IF/ID register update
     pwires_p->PCWriteHZD = 1;
@@ -448,6 +830,96 @@ void detect_hazard(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, regfile
   }
 }
 
+// Turn a latch into a flush bubble
+void squash_ifid(ifid_reg_t* ifid_reg)
+{
+  ifid_reg->instr.ujtype.opcode = 0x13;
+  ifid_reg->instr.ujtype.rd = 0;
+  ifid_reg->instr.ujtype.imm = 0;
+  ifid_reg->instrDUAL.bits = 0;
+  ifid_reg->rs1DUAL = 0;
+  ifid_reg->rs2DUAL = 0;
+  ifid_reg->bubble = BUBBLE_FLUSH;
+}
+
+void squash_idex(idex_reg_t* idex_reg)
+{
+  idex_reg->instr.rtype.opcode = 0x13;
+  idex_reg->instr.rtype.rd = 0;
+  idex_reg->instr.rtype.funct3 = 0;
+  idex_reg->instr.rtype.rs1 = 0;
+  idex_reg->instr.rtype.rs2 = 0;
+  idex_reg->instr.rtype.funct7 = 0;
+
+  // Clear control signals for the flushed stage
+  idex_reg->ALUOp = 0;
+  idex_reg->ALUSrc = 0;
+  idex_reg->Branch = 0;
+  idex_reg->Mem_Read = 0;
+  idex_reg->Mem_Write = 0;
+  idex_reg->Memto_Reg = 0;
+  idex_reg->Reg_Write = 0;
+  idex_reg->BranchDUAL = 0;
+  idex_reg->Mem_ReadDUAL = 0;
+  idex_reg->Mem_WriteDUAL = 0;
+  idex_reg->Memto_RegDUAL = 0;
+  idex_reg->Reg_WriteDUAL = 0;
+  idex_reg->dual_block = DUAL_EMPTY;
+  idex_reg->bubble = BUBBLE_FLUSH;
+}
+
+void squash_exmem(exmem_reg_t* exmem_reg)
+{
+  exmem_reg->instr.rtype.opcode = 0x13;
+  exmem_reg->instr.rtype.rd = 0;
+  exmem_reg->instr.rtype.funct3 = 0;
+  exmem_reg->instr.rtype.rs1 = 0;
+  exmem_reg->instr.rtype.rs2 = 0;
+  exmem_reg->instr.rtype.funct7 = 0;
+
+  exmem_reg->Branch = 0;
+  exmem_reg->Mem_Read = 0;
+  exmem_reg->Mem_Write = 0;
+  exmem_reg->Memto_Reg = 0;
+  exmem_reg->Reg_Write = 0;
+  exmem_reg->BranchDUAL = 0;
+  exmem_reg->Mem_ReadDUAL = 0;
+  exmem_reg->Mem_WriteDUAL = 0;
+  exmem_reg->Memto_RegDUAL = 0;
+  exmem_reg->Reg_WriteDUAL = 0;
+  exmem_reg->dualHazard = false;
+  exmem_reg->bubble = BUBBLE_FLUSH;
+}
+
+// Squash everything of hardware thread `tid` in the stages before MEM (all of
+// it without SMT), returns the pairs of real instructions lost
+int squash_thread(pipeline_regs_t* pregs_p, uint8_t tid)
+{
+  int squashed = 0;
+  if (pregs_p->ifid_preg.inp.tid == tid) {
+    squashed += !pregs_p->ifid_preg.inp.bubble && pregs_p->ifid_preg.inp.instr.bits != 0;
+    squash_ifid(&pregs_p->ifid_preg.inp);
+  }
+  if (pregs_p->ifid_preg.out.tid == tid) {
+    squash_ifid(&pregs_p->ifid_preg.out);
+  }
+  if (pregs_p->idex_preg.inp.tid == tid) {
+    squashed += !pregs_p->idex_preg.inp.bubble && pregs_p->idex_preg.inp.instr.bits != 0;
+    squash_idex(&pregs_p->idex_preg.inp);
+  }
+  if (pregs_p->idex_preg.out.tid == tid) {
+    squash_idex(&pregs_p->idex_preg.out);
+  }
+  if (pregs_p->exmem_preg.inp.tid == tid) {
+    squashed += !pregs_p->exmem_preg.inp.bubble && pregs_p->exmem_preg.inp.instr.bits != 0;
+    squash_exmem(&pregs_p->exmem_preg.inp);
+  }
+  if (pregs_p->exmem_preg.out.tid == tid) {
+    squash_exmem(&pregs_p->exmem_preg.out);
+  }
+  return squashed;
+}
+
 uint64_t flush_pipeline(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, uint64_t branch_counter)
 {
   // Flush Pipeline if Branch is taken
@@ -457,65 +929,20 @@ uint64_t flush_pipeline(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, ui
     printf("[CPL]: Pipeline Flushed\n");
     #endif
 
-    pregs_p->ifid_preg.inp.instr.ujtype.opcode = 0x13;
-    pregs_p->ifid_preg.inp.instr.ujtype.rd = 0;
-    pregs_p->ifid_preg.inp.instr.ujtype.imm = 0;
-    pregs_p->ifid_preg.out.instr.ujtype.opcode = 0x13;
-    pregs_p->ifid_preg.out.instr.ujtype.rd = 0;
-    pregs_p->ifid_preg.out.instr.ujtype.imm = 0;
-
-    pregs_p->idex_preg.inp.instr.rtype.opcode = 0x13;
-    pregs_p->idex_preg.inp.instr.rtype.rd = 0;
-    pregs_p->idex_preg.inp.instr.rtype.funct3 = 0;
-    pregs_p->idex_preg.inp.instr.rtype.rs1 = 0;
-    pregs_p->idex_preg.inp.instr.rtype.rs2 = 0;
-    pregs_p->idex_preg.inp.instr.rtype.funct7 = 0;
-    pregs_p->idex_preg.out.instr.rtype.opcode = 0x13;
-    pregs_p->idex_preg.out.instr.rtype.rd = 0;
-    pregs_p->idex_preg.out.instr.rtype.funct3 = 0;
-    pregs_p->idex_preg.out.instr.rtype.rs1 = 0;
-    pregs_p->idex_preg.out.instr.rtype.rs2 = 0;
-    pregs_p->idex_preg.out.instr.rtype.funct7 = 0;
-
-    pregs_p->exmem_preg.inp.instr.rtype.opcode = 0x13;
-    pregs_p->exmem_preg.inp.instr.rtype.rd = 0;
-    pregs_p->exmem_preg.inp.instr.rtype.funct3 = 0;
-    pregs_p->exmem_preg.inp.instr.rtype.rs1 = 0;
-    pregs_p->exmem_preg.inp.instr.rtype.rs2 = 0;
-    pregs_p->exmem_preg.inp.instr.rtype.funct7 = 0;
-    pregs_p->exmem_preg.out.instr.rtype.opcode = 0x13;
-    pregs_p->exmem_preg.out.instr.rtype.rd = 0;
-    pregs_p->exmem_preg.out.instr.rtype.funct3 = 0;
-    pregs_p->exmem_preg.out.instr.rtype.rs1 = 0;
-    pregs_p->exmem_preg.out.instr.rtype.rs2 = 0;
-    pregs_p->exmem_preg.out.instr.rtype.funct7 = 0;
-
-    // Clear control signals for the flushed stages
-    pregs_p->idex_preg.inp.ALUOp = 0;
-    pregs_p->idex_preg.inp.ALUSrc = 0;
-    pregs_p->idex_preg.inp.Branch = 0;
-    pregs_p->idex_preg.inp.Mem_Read = 0;
-    pregs_p->idex_preg.inp.Mem_Write = 0;
-    pregs_p->idex_preg.inp.Memto_Reg = 0;
-    pregs_p->idex_preg.inp.Reg_Write = 0;
-    pregs_p->idex_preg.out.ALUOp = 0;
-    pregs_p->idex_preg.out.ALUSrc = 0;
-    pregs_p->idex_preg.out.Branch = 0;
-    pregs_p->idex_preg.out.Mem_Read = 0;
-    pregs_p->idex_preg.out.Mem_Write = 0;
-    pregs_p->idex_preg.out.Memto_Reg = 0;
-    pregs_p->idex_preg.out.Reg_Write = 0;
-
-    pregs_p->exmem_preg.inp.Branch = 0;
-    pregs_p->exmem_preg.inp.Mem_Read = 0;
-    pregs_p->exmem_preg.inp.Mem_Write = 0;
-    pregs_p->exmem_preg.inp.Memto_Reg = 0;
-    pregs_p->exmem_preg.inp.Reg_Write = 0;
-    pregs_p->exmem_preg.out.Branch = 0;
-    pregs_p->exmem_preg.out.Mem_Read = 0;
-    pregs_p->exmem_preg.out.Mem_Write = 0;
-    pregs_p->exmem_preg.out.Memto_Reg = 0;
-    pregs_p->exmem_preg.out.Reg_Write = 0;
+    if (fetch_queue.enabled) {
+      fq_redirect(&fetch_queue);
+    }
+    if (profile.enabled) {
+      exmem_reg_t *branch = &pregs_p->exmem_preg.out;
+      prof_charge(branch->BranchDUAL && branch->zeroDUAL ? branch->instr_addrDUAL : branch->instr_addr, PROF_FLUSHES, 1);
+    }
+
+    // only the branch's own thread fetched down the wrong path (-X)
+    uint8_t tid = pregs_p->exmem_preg.out.tid;
+    int squashed = squash_thread(pregs_p, tid);
+    if (smt.enabled) {
+      smt.thread[tid].squashed += squashed;
+    }
 
     //need to add for DUAL 
     return branch_counter + 1;
@@ -532,7 +959,7 @@ uint32_t gen_alu_controlDUAL(idex_reg_t idex_reg)
     case 0x0: // lw or sw
       alu_control = 0x2; // add
       break;
-    case 0x1: // beq or bne
+    case 0x1: // branches (the outcome comes from gen_branch)
       alu_control = 0x6; // subtract
       break;
     case 0x2: // R-type
@@ -554,23 +981,48 @@ uint32_t gen_alu_controlDUAL(idex_reg_t idex_reg)
           }
           break;
         case 0x2: 
-          alu_control = 0x8; // slt
+          if (idex_reg.funct7DUAL == 0x01) {
+            alu_control = 0x4; // mulhsu
+          } else {
+            alu_control = 0x8; // slt
+          }
+          break;
+        case 0x3: 
+          if (idex_reg.funct7DUAL == 0x01) {
+            alu_control = 0x5; // mulhu
+          } else {
+            alu_control = 0x3; // sltu
+          }
           break;
         case 0x4: 
-          alu_control = 0x9; // xor
+          if (idex_reg.funct7DUAL == 0x01) {
+            alu_control = 0x10; // div
+          } else {
+            alu_control = 0x9; // xor
+          }
           break;
         case 0x5:
           if (idex_reg.funct7DUAL == 0x0) {
             alu_control = 0xA; // srl
           } else if (idex_reg.funct7DUAL == 0x20) {
             alu_control = 0xB; // sra
+          } else if (idex_reg.funct7DUAL == 0x01) {
+            alu_control = 0x11; // divu
           }
           break;
         case 0x6: 
-          alu_control = 0x1; // or
+          if (idex_reg.funct7DUAL == 0x01) {
+            alu_control = 0x12; // rem
+          } else {
+            alu_control = 0x1; // or
+          }
           break;
         case 0x7: 
-          alu_control = 0x0; // and
+          if (idex_reg.funct7DUAL == 0x01) {
+            alu_control = 0x13; // remu
+          } else {
+            alu_control = 0x0; // and
+          }
           break;
         default:
           break;
@@ -587,6 +1039,9 @@ uint32_t gen_alu_controlDUAL(idex_reg_t idex_reg)
         case 0x2: 
           alu_control = 0x8; // slti
           break;
+        case 0x3: 
+          alu_control = 0x3; // sltiu
+          break;
         case 0x4: 
           alu_control = 0x9; // xori
           break;
@@ -611,118 +1066,229 @@ uint32_t gen_alu_controlDUAL(idex_reg_t idex_reg)
       alu_control = 0xE;
       break;
     case 0x5: // jal
+    case 0x6: // jalr, the link address (the target is added in execute)
       alu_control = 0xF;
       break;
+    case 0x7: // auipc
+      alu_control = 0x14;
+      break;
     default:
         break;
   }
   return alu_control;
 }
 
-// Check if the two instructions are able to be executed together
-// Cannot be done if there are hazards as explained
-bool dualIssue_hazard_check(exmem_reg_t instruction)
+// Check if the two instructions decode holds are able to be executed together.
+// A taken branch in the first slot (DUAL_CONTROL) is only known in execute.
+dual_block_t dual_issue_block_reason(idex_reg_t pair)
 {
-  if(instruction.instr.opcode != 0x03 && instruction.instr.opcode != 0x23) {
-    instruction.ins1type = 1; //1 represents ALU/Branch type
-  }
-  else if(instruction.instr.opcode == 0x03 || instruction.instr.opcode == 0x23) {
-    instruction.ins1type = 2; //2 represents Load/Store type
+  if(pair.instrDUAL.bits == 0) {
+    return DUAL_EMPTY;
   }
 
-  if(instruction.instrDUAL.opcode != 0x03 && instruction.instrDUAL.opcode != 0x23) {
-    instruction.ins2type = 1; //1 represents ALU/Branch type
+  int ins1type = 1; //1 represents ALU/Branch type
+  if(pair.instr.opcode == 0x03 || pair.instr.opcode == 0x23) {
+    ins1type = 2; //2 represents Load/Store type
   }
-  else if(instruction.instrDUAL.opcode == 0x03 || instruction.instrDUAL.opcode == 0x23) {
-    instruction.ins2type = 2; //2 represents Load/Store type
+  int ins2type = 1;
+  if(pair.instrDUAL.opcode == 0x03 || pair.instrDUAL.opcode == 0x23) {
+    ins2type = 2;
   }
 
-  if(instruction.ins2type == instruction.ins1type) { // check for structural hazard
-    return false;
+  if(ins2type == ins1type) { // check for structural hazard
+    return DUAL_STRUCTURAL;
   }
-  else { //check for data hazard
-    if(instruction.Reg_Write && (instruction.rd != 0)){
-      if(instruction.rd == instruction.rs1DUAL || instruction.rd == instruction.rs2DUAL){
-        return false;
-      }
-      else { //check for control hazard
-        if((instruction.Branch & instruction.zero) == true) {
-          return false;
-        }
-        else {
-          return true;
-        }
-      }
-    }
-    else { //check for control hazard
-      if((instruction.Branch & instruction.zero) == true) {
-        return false;
-      }
-      else {
-        return true;
-      }
-    }
+  if(pair.Reg_Write && (pair.rd != 0) && (pair.rd == pair.rs1DUAL || pair.rd == pair.rs2DUAL)) { // check for data hazard
+    return DUAL_DATA;
   }
+  return DUAL_ISSUED;
+}
+
+// A second instruction that could not issue with the first stays in IF/ID
+// and goes through decode again next cycle, in the first slot of a pair of
+// its own. The pair fetched this cycle is thrown away and fetched again.
+void hold_second_slot(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p)
+{
+  ifid_reg_t* held = &pregs_p->ifid_preg.inp;
+  *held = pregs_p->ifid_preg.out;
+  held->instr = held->instrDUAL;
+  held->instr_addr = held->instr_addrDUAL;
+  held->instr_size = held->instr_sizeDUAL;
+  held->rs1 = held->rs1DUAL;
+  held->rs2 = held->rs2DUAL;
+  held->seq = held->seqDUAL;
+  held->instrDUAL.bits = 0;
+  held->instr_addrDUAL = 0;
+  held->instr_sizeDUAL = 0;
+  held->rs1DUAL = 0;
+  held->rs2DUAL = 0;
+  held->seqDUAL = 0;
+  pregs_p->idex_preg.inp.seqDUAL = 0;
+  pwires_p->PCWriteHZD = 1;
+
+  #ifdef DEBUG_CYCLE
+  printf("[HZD]: Holding second instruction: 0x%08x\n", held->instr_addr);
+  #endif
 }
 
-// Resolves hazard between the second instruction of one cycle and the second of the next
-// As dictated from the above function, we will not consider hazards between two instructions in the same cycle
+// Same for the second slot. Its producer in the same pair never reaches
+// here, dual_issue_block_reason holds a dependent second instruction back.
 void gen_forwardDUAL(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p)
 {
-  //By defualt, set both to 0. If there is no need for forwarding, A and B will exit function with value of 0
-  pwires_p->forwardADUAL = 0x0;
-  pwires_p->forwardBDUAL = 0x0;
-
-  if(pregs_p->memwb_preg.out.Reg_WriteDUAL && (pregs_p->memwb_preg.out.rdDUAL != 0)){
-    if((pregs_p->memwb_preg.out.rdDUAL == pregs_p->idex_preg.out.rs1DUAL) &&
-     !(pregs_p->exmem_preg.out.Reg_WriteDUAL && (pregs_p->exmem_preg.out.rdDUAL != 0) &&
-      (pregs_p->exmem_preg.out.rdDUAL == pregs_p->idex_preg.out.rs1DUAL))){
-      
-      #ifdef DEBUG_CYCLE
-      printf("[FWD]: Resolving MEM hazard on rs1: x%d\n", pregs_p->idex_preg.out.rs1DUAL);
-      #endif
-
-      pwires_p->forwardADUAL = 0x1;
-    }
-    if((pregs_p->memwb_preg.out.rdDUAL == pregs_p->idex_preg.out.rs2DUAL) &&
-     !(pregs_p->exmem_preg.out.Reg_WriteDUAL && (pregs_p->exmem_preg.out.rdDUAL != 0) &&
-      (pregs_p->exmem_preg.out.rdDUAL == pregs_p->idex_preg.out.rs2DUAL))){
-      
-      #ifdef DEBUG_CYCLE
-      printf("[FWD]: Resolving MEM hazard on rs2: x%d\n", pregs_p->idex_preg.out.rs2DUAL);
-      #endif
-
-      pwires_p->forwardBDUAL = 0x1;
+  idex_reg_t* idex = &pregs_p->idex_preg.out;
+  uint32_t valueA = 0, valueB = 0;
+
+  pwires_p->forwardADUAL = forward_source(pregs_p, idex->rs1DUAL, &valueA);
+  pwires_p->forwardBDUAL = forward_source(pregs_p, idex->rs2DUAL, &valueB);
+
+  #ifdef DEBUG_CYCLE
+  if (pwires_p->forwardADUAL) {
+    printf("[FWD]: Resolving %s hazard on rs1: x%d\n", pwires_p->forwardADUAL == 0x2 ? "EX" : "MEM", idex->rs1DUAL);
+  }
+  if (pwires_p->forwardBDUAL) {
+    printf("[FWD]: Resolving %s hazard on rs2: x%d\n", pwires_p->forwardBDUAL == 0x2 ? "EX" : "MEM", idex->rs2DUAL);
+  }
+  #endif
+
+  forward_operands(pwires_p->forwardADUAL, pwires_p->forwardBDUAL, valueA, valueB, idex->ALUSrcDUAL, idex->immDUAL,
+                   &idex->rs1_valDUAL, &idex->rs2_valDUAL, &idex->Write_AddressDUAL);
+}
+
+// Decode reads the register file before writeback of the same cycle updates
+// it, so pass the writeback results straight to the operands just read
+// (write-before-read register file). Without it a consumer three issue
+// groups behind its producer sees the stale value.
+void gen_regfile_bypass(pipeline_regs_t* pregs_p)
+{
+  idex_reg_t* idex = &pregs_p->idex_preg.inp;
+  if (pregs_p->memwb_preg.out.tid != idex->tid) {
+    return; // another hardware thread's registers (-X)
+  }
+  for (int slot = 0; slot < 2; slot++) {
+    uint8_t rd;
+    uint32_t value;
+    if (!wb_result(&pregs_p->memwb_preg.out, slot, &rd, &value)) {
+      continue;
     }
+    if (idex->rs1 == rd) idex->rs1_val = value;
+    if (idex->rs2 == rd) idex->rs2_val = value;
+    if (idex->rs1DUAL == rd) idex->rs1_valDUAL = value;
+    if (idex->rs2DUAL == rd) idex->rs2_valDUAL = value;
   }
+}
 
-  //MUX for first ALU operand
-  if (pwires_p->forwardADUAL == 0x1) {
-    if (pregs_p->memwb_preg.out.Memto_RegDUAL) { // load instruction
-      pregs_p->idex_preg.out.rs1_valDUAL = pregs_p->memwb_preg.out.Read_DataDUAL;
-    } 
-    else {
-      pregs_p->idex_preg.out.rs1_valDUAL = pregs_p->memwb_preg.out.Read_AddressDUAL;
+/// PROFILER HELPERS ///
+
+// PC of the oldest real instruction in the pipeline, or the fetch PC when
+// only bubbles are in flight
+uint32_t oldest_in_flight(pipeline_regs_t* pregs_p, regfile_t* regfile_p)
+{
+  if (!pregs_p->memwb_preg.out.bubble && pregs_p->memwb_preg.out.instr.bits != 0) {
+    return pregs_p->memwb_preg.out.instr_addr;
+  }
+  if (!pregs_p->exmem_preg.out.bubble && pregs_p->exmem_preg.out.instr.bits != 0) {
+    return pregs_p->exmem_preg.out.instr_addr;
+  }
+  if (!pregs_p->idex_preg.out.bubble && pregs_p->idex_preg.out.instr.bits != 0) {
+    return pregs_p->idex_preg.out.instr_addr;
+  }
+  if (!pregs_p->ifid_preg.out.bubble && pregs_p->ifid_preg.out.instr.bits != 0) {
+    return pregs_p->ifid_preg.out.instr_addr;
+  }
+  return regfile_p->PC;
+}
+
+/// CPI STACK HELPERS ///
+
+// CPI stack bucket for a cycle in which writeback sees `memwb_reg`
+int retire_bucket(memwb_reg_t memwb_reg)
+{
+  if (memwb_reg.bubble == BUBBLE_STALL) {
+    return CPI_LOAD_USE;
+  }
+  if (memwb_reg.bubble == BUBBLE_FLUSH) {
+    return CPI_BRANCH_FLUSH;
+  }
+  if (memwb_reg.instr.bits == 0) {
+    return CPI_FRONTEND;
+  }
+  switch (memwb_reg.dual_block) {
+    case DUAL_ISSUED:
+      return memwb_reg.instrDUAL.bits != 0 ? CPI_RETIRE_DUAL : CPI_RETIRE_SINGLE;
+    case DUAL_EMPTY:
+      return CPI_RETIRE_SINGLE;
+    case DUAL_STRUCTURAL:
+      return CPI_DUAL_STRUCTURAL;
+    case DUAL_DATA:
+      return CPI_DUAL_DATA;
+    default: // the second slot was on the wrong path
+      return CPI_BRANCH_FLUSH;
+  }
+}
+
+/// PIPELINE TRACE HELPERS ///
+
+void pipeview_fetch(ifid_reg_t* ifid_reg)
+{
+  ifid_reg->seq = pv_fetch(ifid_reg->instr_addr, ifid_reg->instr.bits, 0);
+  ifid_reg->seqDUAL = pv_fetch(ifid_reg->instr_addrDUAL, ifid_reg->instrDUAL.bits, 1);
+}
+
+// Log the stage each instruction occupied this cycle, called before
+// flush_pipeline turns the younger ones into bubbles
+void pipeview_stages(pipeline_regs_t* pregs_p)
+{
+  if (!pregs_p->ifid_preg.out.bubble) {
+    pv_stage(pregs_p->ifid_preg.out.seq, PV_DECODE);
+    pv_stage(pregs_p->ifid_preg.out.seqDUAL, PV_DECODE);
+  }
+  if (!pregs_p->idex_preg.out.bubble) {
+    pv_stage(pregs_p->idex_preg.out.seq, PV_EXECUTE);
+    pv_stage(pregs_p->idex_preg.out.seqDUAL, PV_EXECUTE);
+  }
+  if (!pregs_p->exmem_preg.out.bubble) {
+    pv_stage(pregs_p->exmem_preg.out.seq, PV_MEM);
+    if (pregs_p->exmem_preg.out.dualHazard) {
+      pv_stage(pregs_p->exmem_preg.out.seqDUAL, PV_MEM);
     }
-    if (pregs_p->idex_preg.out.ALUSrcDUAL) { // store instruction
-      pregs_p->idex_preg.out.Write_AddressDUAL = pregs_p->idex_preg.out.rs2_valDUAL;
-      pregs_p->idex_preg.out.rs2_valDUAL = pregs_p->idex_preg.out.immDUAL;
+  }
+  if (!pregs_p->memwb_preg.out.bubble) {
+    pv_stage(pregs_p->memwb_preg.out.seq, PV_WRITEBACK);
+    pv_retire(pregs_p->memwb_preg.out.seq);
+    if (pregs_p->memwb_preg.out.dualHazard) {
+      pv_stage(pregs_p->memwb_preg.out.seqDUAL, PV_WRITEBACK);
+      pv_retire(pregs_p->memwb_preg.out.seqDUAL);
     }
   }
+}
 
-  //MUX for second ALU operand
-  if (pwires_p->forwardBDUAL== 0x1) {
-    if (pregs_p->memwb_preg.out.Memto_RegDUAL) { // load instruction
-      pregs_p->idex_preg.out.rs2_valDUAL = pregs_p->memwb_preg.out.Read_DataDUAL;
-    } 
-    else {
-      pregs_p->idex_preg.out.rs2_valDUAL = pregs_p->memwb_preg.out.Read_AddressDUAL;
+// Close the cycle once the latches hold the next cycle's instructions;
+// anything traced that is no longer among them was squashed
+void pipeview_end_cycle(pipeline_regs_t* pregs_p)
+{
+  uint64_t live[8];
+  int count = 0;
+  if (!pregs_p->ifid_preg.out.bubble) {
+    live[count++] = pregs_p->ifid_preg.out.seq;
+    live[count++] = pregs_p->ifid_preg.out.seqDUAL;
+  }
+  if (!pregs_p->idex_preg.out.bubble) {
+    live[count++] = pregs_p->idex_preg.out.seq;
+    live[count++] = pregs_p->idex_preg.out.seqDUAL;
+  }
+  if (!pregs_p->exmem_preg.out.bubble) {
+    live[count++] = pregs_p->exmem_preg.out.seq;
+    if (pregs_p->exmem_preg.out.dualHazard) {
+      live[count++] = pregs_p->exmem_preg.out.seqDUAL;
     }
-    if (pregs_p->idex_preg.out.ALUSrcDUAL) { // store instruction
-      pregs_p->idex_preg.out.Write_AddressDUAL = pregs_p->idex_preg.out.rs2_valDUAL;
-      pregs_p->idex_preg.out.rs2_valDUAL = pregs_p->idex_preg.out.immDUAL;
+  }
+  if (!pregs_p->memwb_preg.out.bubble) {
+    live[count++] = pregs_p->memwb_preg.out.seq;
+    if (pregs_p->memwb_preg.out.dualHazard) {
+      live[count++] = pregs_p->memwb_preg.out.seqDUAL;
     }
   }
+  pv_end_cycle(live, count, total_cycle_counter);
 }
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -0,0 +1,147 @@
+#include "storebuf.h"
+#include <stdio.h>
+#include <string.h>
+#include "riscv.h"
+#include "watch.h"
+
+store_buffer_t store_buffer = {0};
+
+bool sb_init(store_buffer_t *sb, int entries) {
+  if (entries < 1 || entries > STORE_BUFFER_MAX) {
+    return false;
+  }
+  memset(sb, 0, sizeof(*sb));
+  sb->enabled = true;
+  sb->size = entries;
+  return true;
+}
+
+// Write the oldest store to memory
+static void retire_oldest(store_buffer_t *sb, Byte *memory) {
+  sb_entry_t *entry = &sb->entries[sb->head];
+  // a watchpoint hit (-w) names the store, not the access draining it
+  uint32_t pc = watch.pc, size = watch.size;
+  Address addr = watch.addr;
+  watch.pc = entry->pc;
+  watch.addr = entry->addr;
+  watch.size = entry->size;
+  store(memory, entry->addr, entry->size, entry->value);
+  watch.pc = pc;
+  watch.addr = addr;
+  watch.size = size;
+  sb->head = (sb->head + 1) % sb->size;
+  sb->count--;
+  sb->drained++;
+}
+
+// Write every store that has drained by cycle `now`
+static void retire(store_buffer_t *sb, Byte *memory, uint64_t now) {
+  while (sb->count > 0 && sb->entries[sb->head].done <= now) {
+    retire_oldest(sb, memory);
+  }
+}
+
+/*
+Put a store in the buffer at cycle `now`, returns the cycles the MEM stage
+waits for an entry. Until sb_schedule says otherwise the store drains in
+one cycle.
+*/
+uint64_t sb_store(store_buffer_t *sb, Byte *memory, Address addr, Alignment size, Word value, uint32_t pc,
+                  uint64_t now) {
+  retire(sb, memory, now);
+  uint64_t wait = 0;
+  if (sb->count == sb->size) {
+    uint64_t done = sb->entries[sb->head].done;
+    wait = done > now ? done - now : 0;
+    sb->full_stalls += wait;
+    retire(sb, memory, now + wait);
+  }
+
+  sb_entry_t *entry = &sb->entries[(sb->head + sb->count) % sb->size];
+  entry->addr = addr;
+  entry->size = size;
+  entry->value = value;
+  entry->pc = pc;
+  entry->issued = now + wait;
+  entry->start = sb->drain_clock > now + wait ? sb->drain_clock : now + wait;
+  entry->done = entry->start + 1;
+  sb->drain_clock = entry->done;
+  sb->count++;
+
+  sb->stores++;
+  sb->occupancy += sb->count;
+  if (sb->count > sb->max_occupancy) {
+    sb->max_occupancy = sb->count;
+  }
+  return wait;
+}
+
+// The youngest store's cache access takes `cycles`. A blocking cache
+// drains one store at a time; with MSHRs (`overlapped`) the fills of
+// successive stores overlap and the stores only leave in order.
+void sb_schedule(store_buffer_t *sb, uint64_t cycles, bool overlapped) {
+  if (sb->count == 0) {
+    return;
+  }
+  sb_entry_t *entry = &sb->entries[(sb->head + sb->count - 1) % sb->size];
+  if (overlapped) {
+    entry->done = entry->issued + cycles > entry->start + 1 ? entry->issued + cycles : entry->start + 1;
+  } else {
+    entry->done = entry->start + (cycles > 0 ? cycles : 1);
+  }
+  sb->drain_clock = entry->done;
+}
+
+/*
+Load `size` bytes at `addr` at cycle `now`. Sets *forwarded when a buffered
+store supplied the data, returns the cycles the load waits for a partly
+overlapping store to drain.
+*/
+uint64_t sb_load(store_buffer_t *sb, Byte *memory, Address addr, Alignment size, uint64_t now,
+                 Word *value, bool *forwarded) {
+  retire(sb, memory, now);
+  *forwarded = false;
+  for (int i = sb->count - 1; i >= 0; i--) {
+    sb_entry_t *entry = &sb->entries[(sb->head + i) % sb->size];
+    if (entry->addr >= addr + size || addr >= entry->addr + entry->size) {
+      continue;
+    }
+    if (entry->addr <= addr && addr + size <= entry->addr + entry->size) {
+      Word bytes = entry->value >> (8 * (addr - entry->addr));
+      *value = size == LENGTH_WORD ? bytes : bytes & ((1u << (8 * size)) - 1);
+      *forwarded = true;
+      sb->forwards++;
+      return 0;
+    }
+    // some bytes are only in memory: wait until this store and all older ones drained
+    uint64_t wait = entry->done > now ? entry->done - now : 0;
+    sb->partial++;
+    sb->partial_stalls += wait;
+    for (int older = 0; older <= i; older++) {
+      retire_oldest(sb, memory);
+    }
+    *value = load(memory, addr, size);
+    return wait;
+  }
+  *value = load(memory, addr, size);
+  return 0;
+}
+
+// Write everything still buffered, at the end of the simulation
+void sb_drain(store_buffer_t *sb, Byte *memory) {
+  while (sb->count > 0) {
+    retire_oldest(sb, memory);
+  }
+}
+
+void sb_print_stats(store_buffer_t *sb) {
+  printf("#SB entries        = %5d\n", sb->size);
+  printf("#SB stores         = %5lu\n", (unsigned long)sb->stores);
+  printf("#SB drained        = %5lu\n", (unsigned long)sb->drained);
+  printf("#SB forwards       = %5lu\n", (unsigned long)sb->forwards);
+  printf("#SB partial        = %5lu (%lu stall cycles)\n", (unsigned long)sb->partial,
+         (unsigned long)sb->partial_stalls);
+  printf("#SB full stalls    = %5lu\n", (unsigned long)sb->full_stalls);
+  printf("#SB occupancy      = %8.3f (mean entries at a store, max %d)\n",
+         sb->stores ? (double)sb->occupancy / sb->stores : 0.0, sb->max_occupancy);
+}
@@ -0,0 +1,60 @@
+#ifndef STOREBUF_H
+#define STOREBUF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+
+// Store buffer (-O[n]). A store leaves the MEM stage as soon as it has an
+// entry, and the buffer writes the stores to memory in order, one at a time,
+// each taking the cycles its cache access would have stalled the pipeline
+// (with MSHRs the fills overlap and only the order is kept).
+// A load looks at the buffer first: the youngest store to overlap it
+// forwards its data when it holds every byte the load reads; when it holds
+// only some of them (an sb under an lw, an sh across a word) the load waits
+// until that store has drained and then reads memory. The pipeline only
+// stalls for a full buffer or a partial overlap.
+
+#define STORE_BUFFER_ENTRIES 8  // entries by default
+#define STORE_BUFFER_MAX 64
+
+typedef struct {
+    Address addr;
+    Alignment size;
+    Word value;
+    uint32_t pc;         // the store, for a watchpoint it hits when it drains
+    uint64_t issued;     // cycle the store entered the buffer
+    uint64_t start;      // cycle the store starts draining
+    uint64_t done;       // cycle it is in memory
+} sb_entry_t;
+
+typedef struct {
+    bool enabled;
+    int size;
+    sb_entry_t entries[STORE_BUFFER_MAX];  // ring, oldest at head
+    int head;
+    int count;
+    uint64_t drain_clock;      // cycle the youngest store is in memory
+
+    uint64_t stores;
+    uint64_t drained;
+    uint64_t forwards;         // loads served by a store in the buffer
+    uint64_t partial;          // loads that overlapped a store only partly
+    uint64_t partial_stalls;
+    uint64_t full_stalls;
+    uint64_t occupancy;        // entries in use summed over stores, for the mean
+    int max_occupancy;
+} store_buffer_t;
+
+extern store_buffer_t store_buffer;
+
+// Function declarations
+bool sb_init(store_buffer_t *sb, int entries);
+uint64_t sb_store(store_buffer_t *sb, Byte *memory, Address addr, Alignment size, Word value, uint32_t pc,
+                  uint64_t now);
+void sb_schedule(store_buffer_t *sb, uint64_t cycles, bool overlapped);
+uint64_t sb_load(store_buffer_t *sb, Byte *memory, Address addr, Alignment size, uint64_t now,
+                 Word *value, bool *forwarded);
+void sb_drain(store_buffer_t *sb, Byte *memory);
+void sb_print_stats(store_buffer_t *sb);
+#endif // STOREBUF_H
@@ -0,0 +1,177 @@
+#include "timetravel.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+timetravel_t timetravel = {0};
+
+#define TT_MAX_WAKERS 256      // pipes a snapshot listens on, one per trip to it
+
+static void tt_exit(void) {
+  tt_kill_all(&timetravel);
+}
+
+// interval[:snapshots]
+bool tt_configure(timetravel_t *tt, const char *spec) {
+  memset(tt, 0, sizeof(*tt));
+  long interval = TT_INTERVAL, size = TT_SNAPSHOTS;
+  char *end = (char *)spec;
+  if (spec != NULL && *spec) {
+    interval = strtol(spec, &end, 0);
+    if (*end == ':') {
+      size = strtol(end + 1, &end, 0);
+    }
+  }
+  if (*end != '\0' || interval < 1 || size < 1 || size > TT_MAX_SNAPSHOTS) {
+    return false;
+  }
+  tt->enabled = true;
+  tt->interval = interval;
+  tt->size = size;
+  tt->next = 1;
+  signal(SIGCHLD, SIG_IGN);    // nobody waits for snapshots
+  signal(SIGPIPE, SIG_IGN);    // a snapshot that went away fails the write instead
+  atexit(tt_exit);
+  return true;
+}
+
+static void forget(timetravel_t *tt, int index) {
+  close(tt->ring[index].fd);
+  memmove(&tt->ring[index], &tt->ring[index + 1], (tt->count - index - 1) * sizeof(tt_snapshot_t));
+  tt->count--;
+}
+
+static void add(timetravel_t *tt, pid_t pid, int fd, uint64_t step, uint64_t cycle) {
+  if (tt->count == tt->size) {
+    kill(tt->ring[0].pid, SIGKILL);
+    forget(tt, 0);
+  }
+  tt->ring[tt->count++] = (tt_snapshot_t){pid, fd, step, cycle};
+}
+
+/*
+Wait as a snapshot. Every request forks a runner that returns with it, the
+snapshot goes back to waiting. When no process is left that holds a pipe to
+it (all of them exited) the snapshot exits.
+*/
+static void wait_as_snapshot(timetravel_t *tt, int fd, uint64_t step, uint64_t cycle,
+                             void *request, size_t size) {
+  struct pollfd wakers[TT_MAX_WAKERS];
+  int count = 1;
+  wakers[0] = (struct pollfd){fd, POLLIN, 0};
+  pid_t self = getpid();
+
+  while (count > 0) {
+    if (poll(wakers, count, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      _exit(1);
+    }
+    for (int w = 0; w < count; w++) {
+      if (wakers[w].revents == 0) {
+        continue;
+      }
+      ssize_t n = read(wakers[w].fd, request, size);
+      if (n <= 0) {
+        close(wakers[w].fd);
+        wakers[w--] = wakers[--count];
+        continue;
+      }
+      int trip[2];
+      if (count == TT_MAX_WAKERS || pipe(trip) != 0) {
+        continue;
+      }
+      pid_t runner = fork();
+      if (runner == 0) {
+        for (int r = 0; r < count; r++) {
+          close(wakers[r].fd);
+        }
+        close(trip[0]);
+        add(tt, self, trip[1], step, cycle);
+        tt->next = step + tt->interval;
+        return;
+      }
+      close(trip[1]);
+      if (runner > 0) {
+        wakers[count++] = (struct pollfd){trip[0], POLLIN, 0};
+      } else {
+        close(trip[0]);
+      }
+    }
+  }
+  _exit(0);
+}
+
+/*
+Take a snapshot at stop point `step`. Returns false in the simulation, which
+goes on, and true in a runner restored from this snapshot later, with the
+request it was woken with in `request`.
+*/
+bool tt_snapshot(timetravel_t *tt, uint64_t step, uint64_t cycle, void *request, size_t size) {
+  tt->next = step + tt->interval;
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid > 0) {
+    close(fds[0]);
+    add(tt, pid, fds[1], step, cycle);
+    return false;
+  }
+  close(fds[1]);
+  wait_as_snapshot(tt, fds[0], step, cycle, request, size);
+  return true;
+}
+
+// The newest snapshot at or before `step` (a cycle when `by_cycle`), -1 if none
+int tt_find(const timetravel_t *tt, uint64_t step, bool by_cycle) {
+  for (int i = tt->count - 1; i >= 0; i--) {
+    if ((by_cycle ? tt->ring[i].cycle : tt->ring[i].step) <= step) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Drop every snapshot after `index`, wake it with `request` and leave the
+// rest to the runner. Returns only if the snapshot is gone.
+void tt_travel(timetravel_t *tt, int index, const void *request, size_t size) {
+  while (tt->count > index + 1) {
+    kill(tt->ring[tt->count - 1].pid, SIGKILL);
+    forget(tt, tt->count - 1);
+  }
+  fflush(stdout);
+  fflush(stderr);
+  if (write(tt->ring[index].fd, request, size) == (ssize_t)size) {
+    _exit(0);
+  }
+  forget(tt, index);
+}
+
+// A runner inherits the ring of its snapshot's time: forget the snapshots
+// before `oldest`, the process that travelled has seen them go
+void tt_trim(timetravel_t *tt, uint64_t oldest) {
+  while (tt->count > 0 && tt->ring[0].step < oldest) {
+    forget(tt, 0);
+  }
+}
+
+void tt_kill_all(timetravel_t *tt) {
+  while (tt->count > 0) {
+    kill(tt->ring[tt->count - 1].pid, SIGKILL);
+    forget(tt, tt->count - 1);
+  }
+}
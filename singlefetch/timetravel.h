@@ -0,0 +1,49 @@
+#ifndef TIMETRAVEL_H
+#define TIMETRAVEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Snapshots for time travel in the GDB stub (-J interval[:snapshots]).
+// A snapshot is a fork of the simulator, taken every `interval` stop points
+// (instructions under -m, retiring cycles under -s): the kernel shares the
+// pages and copies only those written since, so guest memory, registers,
+// latches, caches and every counter come back without save/restore code in
+// each module. The snapshot waits on a pipe; waking it forks a runner from
+// it that replays forward deterministically, while the snapshot stays for
+// the next trip. The newest `snapshots` are kept, older ones are killed.
+// A snapshot exits by itself once nothing that could wake it is left.
+
+#define TT_INTERVAL 100000
+#define TT_SNAPSHOTS 8
+#define TT_MAX_SNAPSHOTS 64
+#define TT_REQUEST_MAX 4096     // a request goes through the pipe in one write
+
+typedef struct {
+    pid_t pid;
+    int fd;                    // write end of its pipe
+    uint64_t step;             // stop points before it
+    uint64_t cycle;
+} tt_snapshot_t;
+
+typedef struct {
+    bool enabled;
+    uint64_t interval;
+    int size;
+    tt_snapshot_t ring[TT_MAX_SNAPSHOTS];  // oldest first
+    int count;
+    uint64_t next;             // step of the next snapshot
+} timetravel_t;
+
+extern timetravel_t timetravel;
+
+// Function declarations
+bool tt_configure(timetravel_t *tt, const char *spec);
+bool tt_snapshot(timetravel_t *tt, uint64_t step, uint64_t cycle, void *request, size_t size);
+int tt_find(const timetravel_t *tt, uint64_t step, bool by_cycle);
+void tt_travel(timetravel_t *tt, int index, const void *request, size_t size);
+void tt_trim(timetravel_t *tt, uint64_t oldest);
+void tt_kill_all(timetravel_t *tt);
+#endif // TIMETRAVEL_H
@@ -1,6 +1,7 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /* WARNING: DO NOT CHANGE THIS FILE. 
@@ -30,6 +31,8 @@ typedef Word Register; /* unsigned 32-bit*/
 typedef struct {
     Register R[32];
     Register PC;
+    Register reservation; // address reserved by lr.w
+    bool reserved;        // cleared by sc.w, or by another hart's write (-N)
 } regfile_t;
 
 typedef regfile_t Processor;
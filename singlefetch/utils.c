@@ -16,6 +16,7 @@ Instruction parse_instruction(uint32_t instruction_bits) {
   switch (instruction.opcode) {
   // R-Type
   case 0x33:
+  case 0x2F: // A extension, funct7 holds funct5/aq/rl
     // instruction: 0000 0001 0101 1010 0000 0100 1, destination : 01001
     instruction.rtype.rd = instruction_bits & ((1U << 5) - 1);
     instruction_bits >>= 5;
@@ -50,6 +51,7 @@ Instruction parse_instruction(uint32_t instruction_bits) {
     break;
     // I-Type
     case 0x13: 
+    case 0x67: // jalr
     instruction.itype.rd = instruction_bits & ((1U << 5) - 1);
     instruction_bits >>= 5;
 
@@ -108,6 +110,7 @@ Instruction parse_instruction(uint32_t instruction_bits) {
     break;
     // U-Type
   case 0x37:
+  case 0x17: // auipc
     instruction.utype.rd = instruction_bits & ((1U << 5) - 1);
     instruction_bits >>= 5;
 
@@ -128,6 +131,141 @@ Instruction parse_instruction(uint32_t instruction_bits) {
   return instruction;
 }
 
+/* Size in bytes of the instruction whose low half is `instruction_bits`: the
+ * C extension uses the 16-bit encodings, any whose low two bits are not 11 */
+int instruction_size(uint32_t instruction_bits) {
+  return (instruction_bits & 0x3) == 0x3 ? 4 : 2;
+}
+
+static uint32_t c_bits(uint32_t parcel, int hi, int lo) {
+  return (parcel >> lo) & ((1U << (hi - lo + 1)) - 1);
+}
+
+static uint32_t encode_i(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+  return ((uint32_t)imm & 0xFFF) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static uint32_t encode_r(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd) {
+  return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | 0x33;
+}
+
+static uint32_t encode_s(uint32_t imm, uint32_t rs2, uint32_t rs1) {
+  return (imm >> 5) << 25 | rs2 << 20 | rs1 << 15 | 0x2 << 12 | (imm & 0x1F) << 7 | 0x23;
+}
+
+static uint32_t encode_b(int32_t offset, uint32_t rs1, uint32_t funct3) {
+  uint32_t imm = (uint32_t)offset;
+  return (imm >> 12 & 1) << 31 | (imm >> 5 & 0x3F) << 25 | rs1 << 15 | funct3 << 12 |
+         (imm >> 1 & 0xF) << 8 | (imm >> 11 & 1) << 7 | 0x63;
+}
+
+static uint32_t encode_j(int32_t offset, uint32_t rd) {
+  uint32_t imm = (uint32_t)offset;
+  return (imm >> 20 & 1) << 31 | (imm >> 1 & 0x3FF) << 21 | (imm >> 11 & 1) << 20 |
+         (imm >> 12 & 0xFF) << 12 | rd << 7 | 0x6F;
+}
+
+/* Expands a 16-bit RV32C instruction into the 32-bit instruction it stands
+ * for, so the rest of the simulator only decodes base encodings. Returns 0
+ * for reserved encodings and for the floating-point loads and stores. */
+uint32_t expand_compressed(uint16_t parcel) {
+  uint32_t rd = c_bits(parcel, 11, 7);             // also rs1 of the full-register forms
+  uint32_t rs2 = c_bits(parcel, 6, 2);
+  uint32_t rd_c = c_bits(parcel, 4, 2) + 8;        // x8-x15 of the 3-bit register fields
+  uint32_t rs1_c = c_bits(parcel, 9, 7) + 8;
+  int32_t imm6 = sign_extend_number(c_bits(parcel, 12, 12) << 5 | c_bits(parcel, 6, 2), 6);
+  uint32_t funct3 = c_bits(parcel, 15, 13);
+  uint32_t imm;
+
+  switch (parcel & 0x3) {
+  case 0x0:
+    switch (funct3) {
+    case 0x0: // c.addi4spn
+      imm = c_bits(parcel, 12, 11) << 4 | c_bits(parcel, 10, 7) << 6 |
+            c_bits(parcel, 6, 6) << 2 | c_bits(parcel, 5, 5) << 3;
+      return imm == 0 ? 0 : encode_i(imm, 2, 0x0, rd_c, 0x13);
+    case 0x2: // c.lw
+      imm = c_bits(parcel, 12, 10) << 3 | c_bits(parcel, 6, 6) << 2 | c_bits(parcel, 5, 5) << 6;
+      return encode_i(imm, rs1_c, 0x2, rd_c, 0x03);
+    case 0x6: // c.sw
+      imm = c_bits(parcel, 12, 10) << 3 | c_bits(parcel, 6, 6) << 2 | c_bits(parcel, 5, 5) << 6;
+      return encode_s(imm, rd_c, rs1_c);
+    }
+    return 0;
+  case 0x1:
+    switch (funct3) {
+    case 0x0: // c.addi, c.nop
+      return encode_i(imm6, rd, 0x0, rd, 0x13);
+    case 0x1: // c.jal
+    case 0x5: // c.j
+      imm = c_bits(parcel, 12, 12) << 11 | c_bits(parcel, 11, 11) << 4 |
+            c_bits(parcel, 10, 9) << 8 | c_bits(parcel, 8, 8) << 10 |
+            c_bits(parcel, 7, 7) << 6 | c_bits(parcel, 6, 6) << 7 |
+            c_bits(parcel, 5, 3) << 1 | c_bits(parcel, 2, 2) << 5;
+      return encode_j(sign_extend_number(imm, 12), funct3 == 0x1 ? 1 : 0);
+    case 0x2: // c.li
+      return encode_i(imm6, 0, 0x0, rd, 0x13);
+    case 0x3:
+      if (rd == 2) { // c.addi16sp
+        imm = c_bits(parcel, 12, 12) << 9 | c_bits(parcel, 6, 6) << 4 | c_bits(parcel, 5, 5) << 6 |
+              c_bits(parcel, 4, 3) << 7 | c_bits(parcel, 2, 2) << 5;
+        return imm == 0 ? 0 : encode_i(sign_extend_number(imm, 10), 2, 0x0, 2, 0x13);
+      }
+      // c.lui
+      return imm6 == 0 ? 0 : ((uint32_t)imm6 & 0xFFFFF) << 12 | rd << 7 | 0x37;
+    case 0x4:
+      switch (c_bits(parcel, 11, 10)) {
+      case 0x0: // c.srli
+        return c_bits(parcel, 12, 12) ? 0 : encode_i(c_bits(parcel, 6, 2), rs1_c, 0x5, rs1_c, 0x13);
+      case 0x1: // c.srai
+        return c_bits(parcel, 12, 12) ? 0 : encode_i(0x400 | c_bits(parcel, 6, 2), rs1_c, 0x5, rs1_c, 0x13);
+      case 0x2: // c.andi
+        return encode_i(imm6, rs1_c, 0x7, rs1_c, 0x13);
+      default:
+        if (c_bits(parcel, 12, 12)) {
+          return 0;
+        }
+        switch (c_bits(parcel, 6, 5)) {
+        case 0x0: return encode_r(0x20, rd_c, rs1_c, 0x0, rs1_c); // c.sub
+        case 0x1: return encode_r(0x00, rd_c, rs1_c, 0x4, rs1_c); // c.xor
+        case 0x2: return encode_r(0x00, rd_c, rs1_c, 0x6, rs1_c); // c.or
+        default:  return encode_r(0x00, rd_c, rs1_c, 0x7, rs1_c); // c.and
+        }
+      }
+    case 0x6: // c.beqz
+    case 0x7: // c.bnez
+      imm = c_bits(parcel, 12, 12) << 8 | c_bits(parcel, 11, 10) << 3 | c_bits(parcel, 6, 5) << 6 |
+            c_bits(parcel, 4, 3) << 1 | c_bits(parcel, 2, 2) << 5;
+      return encode_b(sign_extend_number(imm, 9), rs1_c, funct3 == 0x6 ? 0x0 : 0x1);
+    }
+    return 0;
+  case 0x2:
+    switch (funct3) {
+    case 0x0: // c.slli
+      return c_bits(parcel, 12, 12) ? 0 : encode_i(c_bits(parcel, 6, 2), rd, 0x1, rd, 0x13);
+    case 0x2: // c.lwsp
+      imm = c_bits(parcel, 12, 12) << 5 | c_bits(parcel, 6, 4) << 2 | c_bits(parcel, 3, 2) << 6;
+      return rd == 0 ? 0 : encode_i(imm, 2, 0x2, rd, 0x03);
+    case 0x4:
+      if (c_bits(parcel, 12, 12) == 0) {
+        if (rs2 == 0) { // c.jr
+          return rd == 0 ? 0 : encode_i(0, rd, 0x0, 0, 0x67);
+        }
+        return encode_r(0x00, rs2, 0, 0x0, rd); // c.mv
+      }
+      if (rs2 == 0) {
+        // c.ebreak has nothing to trap to here
+        return rd == 0 ? 0 : encode_i(0, rd, 0x0, 1, 0x67); // c.jalr
+      }
+      return encode_r(0x00, rs2, rd, 0x0, rd); // c.add
+    case 0x6: // c.swsp
+      imm = c_bits(parcel, 12, 9) << 2 | c_bits(parcel, 8, 7) << 6;
+      return encode_s(imm, rs2, 2);
+    }
+    return 0;
+  }
+  return 0; // low bits 11: not a compressed instruction
+}
 /************************Helper functions************************/
 /* Sign extends the given field to a 32-bit integer where field is
  * interpreted an n-bit integer. */
@@ -181,6 +319,23 @@ int get_store_offset(Instruction instruction) {
   int offset = (instruction.stype.imm7 << 5) | (instruction.stype.imm5);
   return offset;
 }
+
+/* RV32M division and remainder. Division by zero gives all ones (the
+ * remainder: the dividend) and the signed overflow -2^31 / -1 gives -2^31
+ * (the remainder: 0), as the ISA specifies, instead of trapping. */
+uint32_t divide(uint32_t dividend, uint32_t divisor, int is_signed, int remainder) {
+  if (divisor == 0) {
+    return remainder ? dividend : 0xFFFFFFFF;
+  }
+  if (is_signed) {
+    if (dividend == 0x80000000 && divisor == 0xFFFFFFFF) {
+      return remainder ? 0 : dividend;
+    }
+    return remainder ? (uint32_t)((int32_t)dividend % (int32_t)divisor)
+                     : (uint32_t)((int32_t)dividend / (int32_t)divisor);
+  }
+  return remainder ? dividend % divisor : dividend / divisor;
+}
 /************************Helper functions************************/
 
 void handle_invalid_instruction(Instruction instruction) {
@@ -7,9 +7,14 @@
 #define ITYPE_FORMAT "%s\tx%d, x%d, %d\n"
 #define MEM_FORMAT "%s\tx%d, %d(x%d)\n"
 #define LUI_FORMAT "lui\tx%d, %d\n"
+#define AUIPC_FORMAT "auipc\tx%d, %d\n"
 #define JAL_FORMAT "jal\tx%d, %d\n"
 #define BRANCH_FORMAT "%s\tx%d, x%d, %d\n"
 #define ECALL_FORMAT "ecall\n"
+#define CSR_FORMAT "%s\tx%d, 0x%03x, x%d\n"
+#define CSRI_FORMAT "%s\tx%d, 0x%03x, %d\n"
+#define AMO_FORMAT "%s\tx%d, x%d, (x%d)\n"
+#define LR_FORMAT "%s\tx%d, (x%d)\n"
 #define CACHE_EVICTION_FORMAT "[MEM]: Cache eviction for address: 0x%.8llx\n"
 #define CACHE_HIT_FORMAT "[MEM]: Cache hit for address: 0x%.8llx\n"
 #define CACHE_MISS_FORMAT "[MEM]: Cache miss for address: 0x%.8llx\n"
@@ -19,6 +24,9 @@ int sign_extend_number(unsigned, unsigned);
 int get_branch_offset(Instruction);
 int get_jump_offset(Instruction);
 int get_store_offset(Instruction);
+uint32_t divide(uint32_t, uint32_t, int, int);
+int instruction_size(uint32_t);
+uint32_t expand_compressed(uint16_t);
 void handle_invalid_instruction(Instruction);
 void handle_invalid_read(Address);
 void handle_invalid_write(Address);
@@ -0,0 +1,321 @@
+#define _GNU_SOURCE    // REG_ERR
+#include "watch.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+watch_t watch = {0};
+
+static struct sigaction previous_segv, previous_bus;
+static const char *kind_names[] = {"write", "read", "access", "change"};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Page protection
+///////////////////////////////////////////////////////////////////////////////
+
+static uint32_t first_page(const watch_t *watch, const watchpoint_t *wp) {
+  return wp->addr & ~(watch->page_size - 1);
+}
+
+static uint32_t last_page(const watch_t *watch, const watchpoint_t *wp) {
+  return (wp->addr + wp->len - 1) & ~(watch->page_size - 1);
+}
+
+// No access if a read or access watch needs the page, else read only
+static int page_protection(const watch_t *watch, uint32_t page) {
+  for (int i = 0; i < watch->count; i++) {
+    const watchpoint_t *wp = &watch->points[i];
+    if ((wp->kind == WATCH_READ || wp->kind == WATCH_ACCESS) &&
+        first_page(watch, wp) <= page && page <= last_page(watch, wp)) {
+      return PROT_NONE;
+    }
+  }
+  return PROT_READ;
+}
+
+static void protect_pages(watch_t *watch, bool open) {
+  for (int i = 0; i < watch->count; i++) {
+    watchpoint_t *wp = &watch->points[i];
+    for (uint32_t page = first_page(watch, wp); page <= last_page(watch, wp); page += watch->page_size) {
+      mprotect(watch->memory + page, watch->page_size,
+               open ? PROT_READ | PROT_WRITE : page_protection(watch, page));
+    }
+  }
+}
+
+// The page fault error code says whether the access was a write
+static bool fault_is_write(void *context) {
+#if defined(__linux__) && defined(__x86_64__)
+  return ((ucontext_t *)context)->uc_mcontext.gregs[REG_ERR] & 2;
+#else
+  (void)context;
+  return false;
+#endif
+}
+
+/*
+A guest access touched a protected page: open the pages, note where and
+let the access run again. Every other fault goes to the handler that was
+installed before (dogfault), or gets the default action.
+*/
+static void watch_fault(int sig, siginfo_t *si, void *context) {
+  Byte *addr = si->si_addr;
+  if (watch.armed && addr >= watch.memory && addr < watch.memory + MEMORY_SPACE) {
+    watch.fault_addr = addr - watch.memory;
+    watch.fault_write = page_protection(&watch, watch.fault_addr & ~(watch.page_size - 1)) == PROT_READ ||
+                        fault_is_write(context);
+    watch.fault_pc = watch.pc;
+    watch.access_addr = watch.addr;
+    watch.access_size = watch.size;
+    if (watch.regfile != NULL) {
+      watch.fault_regs = *watch.regfile;    // before the load writes rd
+    }
+    watch.faults++;
+    protect_pages(&watch, true);
+    watch.armed = false;
+    watch.faulted = 1;
+    return;
+  }
+  struct sigaction *previous = sig == SIGBUS ? &previous_bus : &previous_segv;
+  if (previous->sa_flags & SA_SIGINFO) {
+    previous->sa_sigaction(sig, si, context);
+  } else if (previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN) {
+    previous->sa_handler(sig);
+  } else {
+    sigaction(sig, previous, NULL);    // the access faults again and gets the default
+  }
+}
+
+bool watch_init(watch_t *watch, Byte *memory) {
+  memset(watch, 0, sizeof(*watch));
+  watch->page_size = sysconf(_SC_PAGESIZE);
+  if (((uintptr_t)memory & (watch->page_size - 1)) != 0) {
+    fprintf(stderr, "Watchpoints need page aligned guest memory\n");
+    return false;
+  }
+  watch->enabled = true;
+  watch->memory = memory;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_sigaction = watch_fault;
+  sa.sa_flags = SA_SIGINFO;
+  sigaction(SIGSEGV, &sa, &previous_segv);
+  sigaction(SIGBUS, &sa, &previous_bus);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Watchpoints
+///////////////////////////////////////////////////////////////////////////////
+
+bool watch_insert(watch_t *watch, Address addr, uint32_t len, int kind, bool gdb) {
+  if (watch->count == WATCH_MAX || len == 0 || (uint64_t)addr + len > MEMORY_SPACE) {
+    return false;
+  }
+  bool armed = watch->armed;
+  watch_disarm(watch);
+  watchpoint_t *wp = &watch->points[watch->count++];
+  memset(wp, 0, sizeof(*wp));
+  wp->addr = addr;
+  wp->len = len;
+  wp->kind = kind;
+  wp->gdb = gdb;
+  wp->snapshot = malloc(len);
+  if (armed) {
+    watch_arm(watch);
+  }
+  return true;
+}
+
+void watch_remove(watch_t *watch, Address addr, uint32_t len, int kind) {
+  bool armed = watch->armed;
+  watch_disarm(watch);
+  for (int i = 0; i < watch->count; i++) {
+    watchpoint_t *wp = &watch->points[i];
+    if (wp->addr == addr && wp->len == len && wp->kind == kind) {
+      free(wp->snapshot);
+      memmove(wp, wp + 1, (watch->count - i - 1) * sizeof(*wp));
+      watch->count--;
+      break;
+    }
+  }
+  if (armed) {
+    watch_arm(watch);
+  }
+}
+
+// -w addr[:len[:w|r|a|c]], addr in hex, len 4 and a write watch by default
+bool watch_add(watch_t *watch, const char *spec) {
+  char *end;
+  Address addr = strtoul(spec, &end, 16);
+  uint32_t len = 4;
+  int kind = WATCH_WRITE;
+  if (end == spec) {
+    return false;
+  }
+  if (*end == ':') {
+    const char *field = end + 1;
+    len = strtoul(field, &end, 0);
+    if (end == field) {
+      return false;
+    }
+  }
+  if (*end == ':') {
+    const char *kinds = "wrac";
+    const char *letter = end[1] ? strchr(kinds, end[1]) : NULL;
+    if (letter == NULL || end[2] != '\0') {
+      return false;
+    }
+    kind = letter - kinds;
+    end += 2;
+  }
+  return *end == '\0' && watch_insert(watch, addr, len, kind, false);
+}
+
+// Take a snapshot of every range and protect the pages
+void watch_arm(watch_t *watch) {
+  if (!watch->enabled || watch->armed || watch->count == 0) {
+    return;
+  }
+  for (int i = 0; i < watch->count; i++) {
+    watchpoint_t *wp = &watch->points[i];
+    memcpy(wp->snapshot, watch->memory + wp->addr, wp->len);
+  }
+  watch->faulted = 0;
+  protect_pages(watch, false);
+  watch->armed = true;
+}
+
+// Open the pages again, for the stub, the memory dump and the end of the run
+void watch_disarm(watch_t *watch) {
+  if (watch->armed) {
+    protect_pages(watch, true);
+    watch->armed = false;
+  }
+}
+
+// Little endian value of up to four bytes of `bytes`, range offset `offset`
+static Word range_word(const watchpoint_t *wp, const Byte *bytes, uint32_t offset) {
+  Word value = 0;
+  for (uint32_t b = 0; b < 4 && offset + b < wp->len; b++) {
+    value |= (Word)bytes[offset + b] << (8 * b);
+  }
+  return value;
+}
+
+static void report(watch_t *watch, watchpoint_t *wp, uint32_t pc, uint64_t cycle, bool changed) {
+  printf("[WATCH]: %s 0x%08x:%u hit by 0x%08x at cycle %lu", kind_names[wp->kind], wp->addr, wp->len,
+         pc, (unsigned long)cycle);
+  if (changed) {
+    uint32_t offset = 0;
+    const Byte *now = watch->memory + wp->addr;
+    while (wp->snapshot[offset] == now[offset]) {
+      offset++;
+    }
+    offset &= ~3u;
+    printf(", 0x%08x: %08x -> %08x", wp->addr + offset, range_word(wp, wp->snapshot, offset),
+           range_word(wp, now, offset));
+  }
+  printf("\n");
+}
+
+/*
+-m: the access the faulting instruction made, from its registers as they
+were at the fault. An instruction fetch or an ecall leaves it unknown.
+*/
+void watch_decode(watch_t *watch, uint32_t instruction_bits) {
+  if (instruction_size(instruction_bits) == 2) {
+    instruction_bits = expand_compressed(instruction_bits & 0xFFFF);
+  }
+  Instruction instruction = parse_instruction(instruction_bits);
+  const regfile_t *regs = &watch->fault_regs;
+  watch->access_size = 0;
+  switch (instruction.opcode) {
+  case 0x03:
+    watch->access_addr = regs->R[instruction.itype.rs1] + sign_extend_number(instruction.itype.imm, 12);
+    watch->access_size = 1 << (instruction.itype.funct3 & 3);
+    break;
+  case 0x23:
+    watch->access_addr = regs->R[instruction.stype.rs1] + sign_extend_number(get_store_offset(instruction), 12);
+    watch->access_size = 1 << (instruction.stype.funct3 & 3);
+    break;
+  case 0x2F:
+    watch->access_addr = regs->R[instruction.rtype.rs1];
+    watch->access_size = 4;
+    break;
+  }
+}
+
+// Whether the faulting access overlaps `wp`. If the access is not known
+// (or it is not the one that faulted) the fault could be any byte of a word.
+static bool near(const watch_t *watch, const watchpoint_t *wp) {
+  Address addr = watch->access_addr;
+  uint32_t size = watch->access_size;
+  if (size == 0 || watch->fault_addr < addr || watch->fault_addr >= addr + size) {
+    addr = watch->fault_addr >= 3 ? watch->fault_addr - 3 : 0;
+    size = 7;
+  }
+  return addr < wp->addr + wp->len && wp->addr < addr + size;
+}
+
+/*
+Called once the instruction at `pc` (the cycle, for -s) is done after a
+fault. Matches the access against every range, prints the hits of -w
+watches and protects the pages again. Returns the first hit GDB asked
+for, -1 if there is none.
+*/
+int watch_check(watch_t *watch, uint32_t pc, uint64_t cycle) {
+  int first = -1;
+  for (int i = 0; i < watch->count; i++) {
+    watchpoint_t *wp = &watch->points[i];
+    bool touched = near(watch, wp);
+    bool changed = memcmp(wp->snapshot, watch->memory + wp->addr, wp->len) != 0;
+    bool hit = false;
+    switch (wp->kind) {
+    case WATCH_WRITE:
+      hit = changed || (touched && watch->fault_write);
+      break;
+    case WATCH_READ:
+      hit = touched && !changed && !watch->fault_write;
+      break;
+    case WATCH_ACCESS:
+      hit = touched || changed;
+      break;
+    case WATCH_CHANGE:
+      hit = changed;
+      break;
+    }
+    if (!hit) {
+      continue;
+    }
+    wp->hits++;
+    watch->hits++;
+    if (!wp->gdb) {
+      report(watch, wp, pc, cycle, changed);
+    } else if (first < 0) {
+      first = i;
+    }
+  }
+  watch->faulted = 0;
+  watch_arm(watch);
+  return first;
+}
+
+void watch_print_stats(watch_t *watch) {
+  printf("#Watch faults      = %5lu (accesses to watched pages)\n", (unsigned long)watch->faults);
+  printf("#Watch hits        = %5lu\n", (unsigned long)watch->hits);
+}
+
+void watch_free(watch_t *watch) {
+  watch_disarm(watch);
+  for (int i = 0; i < watch->count; i++) {
+    free(watch->points[i].snapshot);
+  }
+  watch->count = 0;
+}
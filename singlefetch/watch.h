@@ -0,0 +1,80 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+
+// Data watchpoints (-w addr[:len[:w|r|a|c]], or GDB's watch/rwatch/awatch).
+// The host pages behind a watched range are protected with mprotect: read
+// only for write and value-change watches, no access for read and access
+// watches. Loads and stores elsewhere run at full speed; one that touches a
+// protected page faults into a SIGSEGV/SIGBUS handler that opens the pages
+// and lets it finish, and after the instruction (-m) or the cycle (-s) the
+// access is matched against the ranges and the pages are protected again.
+// Faults outside guest memory still go to the dogfault handler.
+// A write of an unchanged value is only seen where the fault says it is a
+// write (read-only pages, x86-64 Linux); a value-change watch ignores it.
+// Other accesses to a watched page cost a fault each, but are not reported.
+
+#define WATCH_MAX 16
+
+enum watch_kind_enum {
+  WATCH_WRITE = 0,
+  WATCH_READ,
+  WATCH_ACCESS,
+  WATCH_CHANGE
+};
+
+typedef struct {
+    Address addr;
+    uint32_t len;
+    int kind;
+    bool gdb;                  // set by GDB, which is told instead of printing
+    Byte *snapshot;            // the range as of the last check
+    uint64_t hits;
+} watchpoint_t;
+
+typedef struct {
+    bool enabled;
+    bool armed;                // the pages are protected
+    Byte *memory;
+    long page_size;
+    watchpoint_t points[WATCH_MAX];
+    int count;
+
+    volatile sig_atomic_t faulted;  // a protected page was touched, the pages are open
+    Address fault_addr;        // guest address of the first fault
+    bool fault_write;          // known to be a write
+    uint32_t fault_pc;
+    Address access_addr;       // the access that faulted
+    uint32_t access_size;      // 0 if not known, then it is near fault_addr
+
+    // -s: the pipeline's current data access, set by the MEM stage and the
+    // store buffer (plain stores, no checks)
+    uint32_t pc;
+    Address addr;
+    uint32_t size;
+    // -m: the registers, copied at a fault to decode the access afterwards
+    regfile_t *regfile;
+    regfile_t fault_regs;
+
+    uint64_t faults;
+    uint64_t hits;
+} watch_t;
+
+extern watch_t watch;
+
+// Function declarations
+bool watch_init(watch_t *watch, Byte *memory);
+bool watch_add(watch_t *watch, const char *spec);
+bool watch_insert(watch_t *watch, Address addr, uint32_t len, int kind, bool gdb);
+void watch_remove(watch_t *watch, Address addr, uint32_t len, int kind);
+void watch_arm(watch_t *watch);
+void watch_disarm(watch_t *watch);
+void watch_decode(watch_t *watch, uint32_t instruction_bits);
+int watch_check(watch_t *watch, uint32_t pc, uint64_t cycle);
+void watch_print_stats(watch_t *watch);
+void watch_free(watch_t *watch);
+#endif // WATCH_H